@@ -0,0 +1,122 @@
+/***************************************************************************
+ *   Copyright (C) 2011, 2012 by Leandro Graciá Gil                        *
+ *   leandro.gracia.gil@gmail.com                                          *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/**
+ * \file bound_checks.h
+ * \brief Runtime cadence and instrumentation of the boundary checks in bounded distance calculations.
+ * \author Leandro Graciá Gil
+ */
+
+#ifndef _KCHE_TREE_BOUND_CHECKS_H_
+#define _KCHE_TREE_BOUND_CHECKS_H_
+
+// Include fixed size integer types.
+#include <stdint.h>
+
+// Include STL vectors.
+#include <vector>
+
+// Include the map-reduce metaprograming templates.
+#include "map_reduce.h"
+
+namespace kche_tree {
+
+/**
+ * \brief Cadence of the boundary checks used by bounded distance calculations, along with optional statistics about their early-outs.
+ *
+ * By default the metrics accumulate a fixed fraction of the dimensions and then check the upper bound at a fixed
+ * compile-time frequency. When a profile is attached to a metric (see for example
+ * \link kche_tree::EuclideanMetric::set_bound_check_profile EuclideanMetric::set_bound_check_profile\endlink)
+ * its bounded distances use the runtime cadence of the profile instead: \a prefix dimensions are accumulated
+ * without any check, and the bound is then checked after every \a interval dimensions.
+ *
+ * The cadence can be set manually or selected from the statistics collected while instrumented, usually by
+ * \link kche_tree::KDTree::calibrate_bound_checks KDTree::calibrate_bound_checks\endlink.
+ * The distance kernels split the vectors in up to \link max_check_points max_check_points\endlink unrolled chunks of whole elements
+ * (for example 4 floats with SSE) and can only check the bound at the end of a chunk, so each check is delayed to the end of the chunk where it falls.
+ * The chunks followed by a check are precalculated when the cadence is set, so bounded distances only read the cadence.
+ *
+ * \note Recording statistics is not thread-safe. Profiles should only be instrumented in sequential searches.
+ */
+class BoundCheckProfile {
+public:
+  /// Maximum number of points where the distance kernels can check the bound.
+  static const unsigned int max_check_points = 64;
+
+  /// Maximum number of dimensions per chunk with precalculated check masks. Larger chunks calculate their masks on every call.
+  static const unsigned int max_chunk_dimensions = 64;
+
+  // Constructor.
+  explicit BoundCheckProfile(unsigned int prefix = 0, unsigned int interval = 1);
+
+  // Check cadence.
+  void set_cadence(unsigned int prefix, unsigned int interval);
+  unsigned int prefix() const { return prefix_; } ///< Number of dimensions accumulated before the first boundary check.
+  unsigned int interval() const { return interval_; } ///< Number of dimensions accumulated between consecutive boundary checks.
+  uint64_t check_mask(unsigned int chunk_dimensions) const;
+
+  // Instrumentation.
+  void set_instrumented(bool instrumented) { instrumented_ = instrumented; } ///< Enable or disable recording the statistics of the bounded distances.
+  bool is_instrumented() const { return instrumented_; } ///< Check if the statistics of the bounded distances are being recorded.
+  void record(unsigned int position, unsigned int granularity, unsigned int element_dimensions, bool early_out);
+  void reset_statistics();
+
+  // Recorded statistics.
+  uint64_t num_calls() const { return num_calls_; } ///< Number of bounded distances recorded.
+  uint64_t num_early_outs() const { return num_early_outs_; } ///< Number of bounded distances that left before processing all the dimensions.
+  unsigned int granularity() const { return granularity_; } ///< Number of dimensions between the points where the recorded distance kernels can check the bound.
+  unsigned int element_dimensions() const { return element_dimensions_; } ///< Number of dimensions held by each element processed by the recorded distance kernels.
+  const std::vector<uint64_t> &early_outs() const { return early_outs_; } ///< Number of early-outs after accumulating each number of dimensions.
+  double average_dimensions() const;
+
+  // Cadence selection. Costs are relative to accumulating one element of the distance kernel.
+  double estimated_cost(unsigned int dimensions, unsigned int prefix, unsigned int interval,
+                        unsigned int check_cost = Settings::bound_check_cost, unsigned int misprediction_cost = Settings::branch_misprediction_cost) const;
+  bool select_cadence(unsigned int dimensions, unsigned int check_cost = Settings::bound_check_cost, unsigned int misprediction_cost = Settings::branch_misprediction_cost);
+
+private:
+  unsigned int prefix_; ///< Number of dimensions accumulated before the first boundary check.
+  unsigned int interval_; ///< Number of dimensions accumulated between consecutive boundary checks.
+
+  uint64_t check_masks_[max_chunk_dimensions]; ///< Precalculated masks of the chunks followed by a boundary check, indexed by the number of dimensions per chunk minus one.
+
+  // Calculation of the check masks.
+  uint64_t calculate_check_mask(unsigned int chunk_dimensions) const;
+
+  bool instrumented_; ///< Flag indicating if statistics are being recorded.
+  uint64_t num_calls_; ///< Number of bounded distances recorded.
+  uint64_t num_early_outs_; ///< Number of recorded bounded distances leaving early.
+  uint64_t num_dimensions_; ///< Total number of dimensions processed by the recorded bounded distances.
+  unsigned int granularity_; ///< Number of dimensions between the points where the recorded distance kernels can check the bound.
+  unsigned int element_dimensions_; ///< Number of dimensions held by each element processed by the recorded distance kernels.
+  std::vector<uint64_t> early_outs_; ///< Histogram of the early-outs by number of dimensions accumulated.
+};
+
+// Bounded map-reduce operation following the cadence of a profile.
+template <unsigned int D, unsigned int N, unsigned int Granularity, unsigned int BlockSize, typename T, typename MapReduceFunctor, typename Accumulator, typename BoundaryCheckFunctor, typename Boundary>
+inline void profiled_bounded_map_reduce(BoundCheckProfile &profile, const MapReduceFunctor &map_reduce, Accumulator &accumulator,
+                                        const BoundaryCheckFunctor &check, const Boundary &boundary, const T *a, const T *b = NULL, const void *extra = NULL);
+
+} // namespace kche_tree
+
+// Template implementation.
+#include "bound_checks.tpp"
+
+#endif
@@ -0,0 +1,242 @@
+/***************************************************************************
+ *   Copyright (C) 2011, 2012 by Leandro Graciá Gil                        *
+ *   leandro.gracia.gil@gmail.com                                          *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/**
+ * \file bound_checks.tpp
+ * \brief Template implementation of the runtime cadence and instrumentation of the boundary checks in bounded distance calculations.
+ * \author Leandro Graciá Gil
+ */
+
+// Include STL algorithms.
+#include <algorithm>
+
+namespace kche_tree {
+
+/**
+ * \brief Create a profile with the provided cadence and no statistics recorded.
+ *
+ * The default cadence checks the bound after every dimension, as used to calibrate the profiles.
+ *
+ * \param prefix Number of dimensions accumulated before the first boundary check.
+ * \param interval Number of dimensions accumulated between consecutive boundary checks. Values of \c 0 are treated as \c 1.
+ */
+inline BoundCheckProfile::BoundCheckProfile(unsigned int prefix, unsigned int interval)
+    : instrumented_(false) {
+  set_cadence(prefix, interval);
+  reset_statistics();
+}
+
+/**
+ * \brief Set the cadence of the boundary checks, precalculating the chunks of the distance kernels followed by a check.
+ *
+ * Not thread-safe: the cadence should not change while bounded distances are being calculated.
+ *
+ * \param prefix Number of dimensions accumulated before the first boundary check.
+ * \param interval Number of dimensions accumulated between consecutive boundary checks. Values of \c 0 are treated as \c 1.
+ */
+inline void BoundCheckProfile::set_cadence(unsigned int prefix, unsigned int interval) {
+  prefix_ = prefix;
+  interval_ = std::max(interval, 1u);
+  for (unsigned int i=0; i<max_chunk_dimensions; ++i)
+    check_masks_[i] = calculate_check_mask(i + 1);
+}
+
+/**
+ * \brief Get the chunks of a distance kernel after which the bound should be checked according to the cadence.
+ *
+ * Each check is delayed to the end of the chunk where it falls. The mask does not depend on the number of dimensions,
+ * so distance kernels must clear the bits of their last chunk and beyond, since there is nothing left to save there.
+ * Read-only, so it can be used concurrently by bounded distances.
+ *
+ * \param chunk_dimensions Number of dimensions processed by each chunk of the distance kernel.
+ * \return Mask with a bit set for each chunk followed by a boundary check, starting from the least significant bit.
+ */
+inline uint64_t BoundCheckProfile::check_mask(unsigned int chunk_dimensions) const {
+  if (chunk_dimensions && chunk_dimensions <= max_chunk_dimensions)
+    return check_masks_[chunk_dimensions - 1];
+  return calculate_check_mask(chunk_dimensions);
+}
+
+/**
+ * \brief Calculate the chunks of a distance kernel after which the bound should be checked according to the cadence.
+ *
+ * \param chunk_dimensions Number of dimensions processed by each chunk of the distance kernel.
+ * \return Mask with a bit set for each of the first \link max_check_points max_check_points\endlink chunks containing a check.
+ */
+inline uint64_t BoundCheckProfile::calculate_check_mask(unsigned int chunk_dimensions) const {
+
+  // Find the first check after the beginning of each chunk, and mark the chunk if the check falls inside it.
+  const uint64_t first_check = static_cast<uint64_t>(prefix_) + interval_;
+  uint64_t mask = 0;
+  for (unsigned int chunk=0; chunk<max_check_points; ++chunk) {
+    const uint64_t begin = static_cast<uint64_t>(chunk) * chunk_dimensions;
+    const uint64_t check = begin < first_check ? first_check : first_check + ((begin - first_check) / interval_ + 1) * interval_;
+    if (check <= begin + chunk_dimensions)
+      mask |= static_cast<uint64_t>(1) << chunk;
+  }
+  return mask;
+}
+
+/**
+ * \brief Record the result of a bounded distance calculation. Called by the distance kernels when instrumented.
+ *
+ * \param position Number of dimensions accumulated when the calculation finished.
+ * \param granularity Number of dimensions between the points where the distance kernel can check the bound.
+ * \param element_dimensions Number of dimensions held by each element processed by the distance kernel.
+ * \param early_out \c true if the calculation left early because the bound was exceeded.
+ */
+inline void BoundCheckProfile::record(unsigned int position, unsigned int granularity, unsigned int element_dimensions, bool early_out) {
+  ++num_calls_;
+  num_dimensions_ += position;
+  granularity_ = std::max(granularity_, granularity);
+  element_dimensions_ = std::max(element_dimensions_, element_dimensions);
+
+  if (early_out) {
+    ++num_early_outs_;
+    if (early_outs_.size() <= position)
+      early_outs_.resize(position + 1, 0);
+    ++early_outs_[position];
+  }
+}
+
+/// Discard all the recorded statistics.
+inline void BoundCheckProfile::reset_statistics() {
+  num_calls_ = 0;
+  num_early_outs_ = 0;
+  num_dimensions_ = 0;
+  granularity_ = 1;
+  element_dimensions_ = 1;
+  early_outs_.clear();
+}
+
+/// Average number of dimensions accumulated by the recorded bounded distances.
+inline double BoundCheckProfile::average_dimensions() const {
+  return num_calls_ ? static_cast<double>(num_dimensions_) / num_calls_ : 0.0;
+}
+
+/**
+ * \brief Estimate the average cost of the recorded bounded distances if they had used a different cadence.
+ *
+ * Assumes the statistics were recorded checking the bound after every \link granularity granularity\endlink
+ * dimensions from the beginning, so that each early-out position is the point where the partial sum first exceeded its bound.
+ * Every accumulated dimension costs 1 and every boundary check costs \a check_cost times the dimensions of an element.
+ * Branch mispredictions are estimated as the least frequent outcome of each check, costing \a misprediction_cost times the dimensions of an element.
+ * This favours checks where most of the distances reaching them take the same decision, and makes checks not worth it
+ * when the early-outs are spread out or would only save a few elements.
+ *
+ * \param dimensions Number of dimensions of the feature vectors.
+ * \param prefix Number of dimensions accumulated before the first boundary check.
+ * \param interval Number of dimensions accumulated between consecutive boundary checks.
+ * \param check_cost Cost of a boundary check relative to accumulating one element of the distance kernel, i.e. \link element_dimensions element_dimensions\endlink dimensions.
+ * \param misprediction_cost Cost of a mispredicted boundary check relative to accumulating one element of the distance kernel.
+ * \return Estimated average cost per bounded distance.
+ */
+inline double BoundCheckProfile::estimated_cost(unsigned int dimensions, unsigned int prefix, unsigned int interval, unsigned int check_cost, unsigned int misprediction_cost) const {
+
+  if (!num_calls_)
+    return dimensions;
+  interval = std::max(interval, 1u);
+
+  const double cost_per_check = static_cast<double>(check_cost) * element_dimensions_;
+  const double cost_per_misprediction = static_cast<double>(misprediction_cost) * element_dimensions_;
+
+  // Follow the distances still running at each check. Those whose bound was crossed since the previous check leave at it.
+  double total_cost = 0.0;
+  uint64_t num_running = num_calls_;
+  unsigned int position = 0;
+  for (unsigned int check = prefix + interval; prefix < dimensions && check < dimensions; check += interval) {
+    uint64_t num_leaving = 0;
+    for (; position <= check && position < early_outs_.size(); ++position)
+      num_leaving += early_outs_[position];
+
+    total_cost += num_running * cost_per_check + std::min(num_leaving, num_running - num_leaving) * cost_per_misprediction + num_leaving * static_cast<double>(check);
+    num_running -= num_leaving;
+  }
+
+  // The remaining distances process all the dimensions.
+  return (total_cost + num_running * static_cast<double>(dimensions)) / num_calls_;
+}
+
+/**
+ * \brief Select the cadence minimizing the estimated cost of the recorded bounded distances.
+ *
+ * Prefixes and intervals are evaluated in multiples of the \link granularity granularity\endlink of the recorded distance kernels.
+ * A prefix covering all the dimensions disables the checks completely.
+ *
+ * \param dimensions Number of dimensions of the feature vectors.
+ * \param check_cost Cost of a boundary check relative to accumulating one element of the distance kernel, i.e. \link element_dimensions element_dimensions\endlink dimensions.
+ * \param misprediction_cost Cost of a mispredicted boundary check relative to accumulating one element of the distance kernel.
+ * \return \c true if a cadence was selected, \c false if no statistics have been recorded.
+ */
+inline bool BoundCheckProfile::select_cadence(unsigned int dimensions, unsigned int check_cost, unsigned int misprediction_cost) {
+
+  if (!num_calls_ || !dimensions)
+    return false;
+
+  const unsigned int granularity = granularity_;
+  unsigned int best_prefix = dimensions, best_interval = granularity;
+  double best_cost = estimated_cost(dimensions, best_prefix, best_interval, check_cost, misprediction_cost);
+
+  for (unsigned int prefix = 0; prefix < dimensions; prefix += granularity) {
+    for (unsigned int interval = granularity; interval < dimensions - prefix; interval += granularity) {
+      double cost = estimated_cost(dimensions, prefix, interval, check_cost, misprediction_cost);
+      if (cost < best_cost) {
+        best_cost = cost;
+        best_prefix = prefix;
+        best_interval = interval;
+      }
+    }
+  }
+
+  set_cadence(best_prefix, best_interval);
+  return true;
+}
+
+/**
+ * \brief Run a bounded map-reduce operation over a pair of arrays following the cadence of a profile, recording the result if instrumented.
+ *
+ * \tparam D Number of dimensions of the feature vectors.
+ * \tparam N Number of elements in the input arrays.
+ * \tparam Granularity Number of dimensions held by each element of the input arrays.
+ * \tparam BlockSize Number of consecutive elements processed by each call to the functor when possible.
+ * \tparam T Type of the elements in the input arrays.
+ * \param profile Profile defining the cadence of the boundary checks.
+ * \param map_reduce Functor used to map the input and reduce the corresponding elements in the input arrays to a single value.
+ * \param accumulator Reference to initial accumulation value and holder of the result when finished.
+ * \param check Functor used for checking the boundaries. Should return \c true when the boundary is crossed.
+ * \param boundary Boundary value used to avoid unnecessary calculations.
+ * \param a First input array.
+ * \param b Second input array. Optional, defaults to \c NULL.
+ * \param extra Extra arguments provided to the map-reduce function. Optional, defaults to \c NULL.
+ */
+template <unsigned int D, unsigned int N, unsigned int Granularity, unsigned int BlockSize, typename T, typename MapReduceFunctor, typename Accumulator, typename BoundaryCheckFunctor, typename Boundary>
+inline void profiled_bounded_map_reduce(BoundCheckProfile &profile, const MapReduceFunctor &map_reduce, Accumulator &accumulator,
+                                        const BoundaryCheckFunctor &check, const Boundary &boundary, const T *a, const T *b, const void *extra) {
+  // Split the arrays in the largest number of chunks that can be checked. No check is placed after the last chunk.
+  static const unsigned int ChunkSize = (N + BoundCheckProfile::max_check_points - 1) / BoundCheckProfile::max_check_points;
+  static const unsigned int NumChunks = (N + ChunkSize - 1) / ChunkSize;
+  const uint64_t check_mask = profile.check_mask(ChunkSize * Granularity) & ((static_cast<uint64_t>(1) << (NumChunks - 1)) - 1);
+
+  unsigned int end = MaskedBoundedMapReduce<T, N, ChunkSize, BlockSize>::run(map_reduce, accumulator, check, boundary, check_mask, a, b, extra);
+  if (profile.is_instrumented())
+    profile.record(std::min(end * Granularity, D), ChunkSize * Granularity, Granularity, end < N);
+}
+
+} // namespace kche_tree
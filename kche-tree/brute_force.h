@@ -0,0 +1,179 @@
+/***************************************************************************
+ *   Copyright (C) 2011, 2012 by Leandro Graciá Gil                        *
+ *   leandro.gracia.gil@gmail.com                                          *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/**
+ * \file brute_force.h
+ * \brief Template for the blocked brute-force search of batches of queries.
+ * \author Leandro Graciá Gil
+ */
+
+#ifndef _KCHE_TREE_BRUTE_FORCE_H_
+#define _KCHE_TREE_BRUTE_FORCE_H_
+
+// Include STL vectors for the batch output.
+#include <vector>
+
+#include "cpp1x.h"
+#include "dataset.h"
+#include "dot_products.h"
+#include "neighbor.h"
+#include "prepared_query.h"
+#include "scoped_ptr.h"
+#include "traits.h"
+#include "utils.h"
+
+namespace kche_tree {
+
+/**
+ * \brief Calculate the distances between a tile of queries and a block of points using the metric through prepared queries.
+ *
+ * Distances are exact, but may use the upper bound provided for each query.
+ */
+template <typename T, unsigned int D, typename Metric, bool use_dot_products = UseDotProducts<T, D, Metric>::value>
+struct BruteForceKernel {
+  /// Distance type associated with the elements.
+  typedef typename Traits<T>::Distance Distance;
+
+  /// Alias of compatible non-labeled data sets.
+  typedef typename kche_tree::DataSet<T, D> DataSet;
+
+  /// Indicates if the distances provided by the kernel are exact or just lower bounds.
+  static const bool exact = true;
+
+  /// Prepare the kernel for the first points of a data set.
+  BruteForceKernel(const DataSet &data, unsigned int num_points, const Distance *squared_norms) : data_(data) {}
+
+  // Calculate the distances between a tile of queries and a block of points.
+  void distances(const Metric &metric, const DataSet &queries, unsigned int first_query, unsigned int num_queries,
+      unsigned int first_point, unsigned int num_points, const Distance *bounds, const bool *bounded, Distance *output) const;
+
+private:
+  const DataSet &data_; ///< Data set where neighbours are searched.
+};
+
+/**
+ * \brief Calculate lower bounds of the Euclidean distances between a tile of queries and a block of points using dot products.
+ *
+ * Computes ||a||² + ||b||² - 2 a·b with the norms of the points precalculated, in the same way as a matrix product.
+ * The squared norms stored by the kd-tree are reused if available.
+ * The result is lowered by the maximum rounding error of the expansion, so candidates can be safely discarded
+ * before calculating their exact distance.
+ */
+template <typename T, unsigned int D, typename Metric>
+struct BruteForceKernel<T, D, Metric, true> {
+  /// Distance type associated with the elements.
+  typedef typename Traits<T>::Distance Distance;
+
+  /// Alias of compatible non-labeled data sets.
+  typedef typename kche_tree::DataSet<T, D> DataSet;
+
+  /// Indicates if the distances provided by the kernel are exact or just lower bounds.
+  static const bool exact = false;
+
+  // Prepare the kernel for the first points of a data set.
+  BruteForceKernel(const DataSet &data, unsigned int num_points, const Distance *squared_norms);
+
+  // Calculate lower bounds of the distances between a tile of queries and a block of points.
+  void distances(const Metric &metric, const DataSet &queries, unsigned int first_query, unsigned int num_queries,
+      unsigned int first_point, unsigned int num_points, const Distance *bounds, const bool *bounded, Distance *output) const;
+
+private:
+  const DataSet &data_; ///< Data set where neighbours are searched.
+  std::vector<Distance> local_norms_; ///< Squared norms of the points calculated by the kernel if not provided.
+  const Distance *norms_; ///< Squared norms of the points.
+};
+
+/**
+ * \brief Exhaustive search of the K nearest neighbours of a batch of queries.
+ *
+ * Queries are processed in tiles against blocks of points small enough to stay in cache, in the same way
+ * as a blocked matrix product. For the Euclidean metric with floating point types distances are expanded
+ * in norms and dot products, and only the candidates that may improve the current results have their
+ * exact distance calculated.
+ *
+ * \tparam ElementType Type of the elements in the data set.
+ * \tparam NumDimensions Number of dimensions of the feature vectors.
+ * \tparam MetricType Metric functor used to calculate distances between points.
+ * \tparam ContainerType Container used to keep the K nearest neighbour candidates of each query.
+ */
+template <typename ElementType, unsigned int NumDimensions, typename MetricType, typename ContainerType>
+class BruteForceSearch : NonCopyable {
+public:
+  /// Type of the elements in the data set.
+  typedef ElementType Element;
+
+  /// Number of dimensions of the feature vectors.
+  static const unsigned int Dimensions = NumDimensions;
+
+  /// Type of the metric used in the search.
+  typedef MetricType Metric;
+
+  /// Type of the containers holding the neighbour candidates.
+  typedef ContainerType Container;
+
+  /// Distance type associated with the elements.
+  typedef typename Traits<Element>::Distance Distance;
+
+  /// Alias of compatible non-labeled data sets.
+  typedef typename kche_tree::DataSet<Element, Dimensions> DataSet;
+
+  /// Type of the neighbour results.
+  typedef kche_tree::Neighbor<Distance> Neighbor;
+
+  /// Type of the k-neighbour results.
+  typedef std::vector<Neighbor> KNeighbors;
+
+  static const unsigned int tile_size = 8; ///< Number of queries processed together.
+  static const unsigned int block_size = 256; ///< Number of points processed at a time by each tile.
+
+  // Constructor.
+  BruteForceSearch(const DataSet &data, const Metric &metric, unsigned int K, bool ignore_null_distances, unsigned int num_points,
+      const Distance *squared_norms = NULL);
+
+  // Search the K nearest neighbours of a range of queries in the batch.
+  void run(const DataSet &queries, std::vector<KNeighbors> &output, unsigned int first_query, unsigned int last_query);
+
+private:
+  /// Type of the kernel used to calculate the distances.
+  typedef BruteForceKernel<Element, Dimensions, Metric> Kernel;
+
+  // Search the K nearest neighbours of a tile of queries.
+  void search_tile(const DataSet &queries, unsigned int first_query, unsigned int num_queries, std::vector<KNeighbors> &output);
+
+  const DataSet &data_; ///< Permuted training set stored by the tree.
+  const Metric &metric_; ///< Metric functor used to calculate distances between points.
+  unsigned int K_; ///< Number of neighbours to retrieve.
+  bool ignore_null_distances_; ///< Exclude points with null distance to the queries.
+  unsigned int num_points_; ///< Number of points of the data set being searched.
+  Kernel kernel_; ///< Kernel calculating the distances.
+
+  ScopedPtr<Container> candidates_[tile_size]; ///< Current neighbour candidates of each query in the tile.
+  ScopedPtr<PreparedQuery<Metric> > queries_[tile_size]; ///< Queries of the tile prepared for the exact distances of the candidates. Unused if the kernel is exact.
+  Distance farthest_[tile_size]; ///< Distance of the farthest candidate of each query in the tile.
+  bool full_[tile_size]; ///< Indicates if the candidates of each query in the tile are already full.
+  std::vector<Distance> distances_; ///< Distances between the queries in the tile and the current block of points.
+};
+
+} // namespace kche_tree
+
+// Template implementation.
+#include "brute_force.tpp"
+
+#endif
@@ -0,0 +1,238 @@
+/***************************************************************************
+ *   Copyright (C) 2011, 2012 by Leandro Graciá Gil                        *
+ *   leandro.gracia.gil@gmail.com                                          *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/**
+ * \file brute_force.tpp
+ * \brief Template implementation for the blocked brute-force search of batches of queries.
+ * \author Leandro Graciá Gil
+ */
+
+// Include STL min.
+#include <algorithm>
+
+namespace kche_tree {
+
+// Static data.
+template <typename T, unsigned int D, typename M, bool U>
+const bool BruteForceKernel<T, D, M, U>::exact;
+
+template <typename T, unsigned int D, typename M>
+const bool BruteForceKernel<T, D, M, true>::exact;
+
+template <typename T, unsigned int D, typename M, typename C>
+const unsigned int BruteForceSearch<T, D, M, C>::tile_size;
+
+template <typename T, unsigned int D, typename M, typename C>
+const unsigned int BruteForceSearch<T, D, M, C>::block_size;
+
+/**
+ * \brief Calculate the distances between a tile of queries and a block of points.
+ *
+ * \param metric Metric functor used to calculate distances between points.
+ * \param queries Batch of queries.
+ * \param first_query Index of the first query of the tile.
+ * \param num_queries Number of queries in the tile.
+ * \param first_point Index of the first point of the block.
+ * \param num_points Number of points in the block.
+ * \param bounds Upper bound of the distances of each query. Only used if the corresponding \a bounded flag is set.
+ * \param bounded Indicates if the distances of each query can be upper bounded.
+ * \param output Array of \a num_queries rows of \a num_points distances where the results are written.
+ */
+template <typename T, unsigned int D, typename M, bool U>
+void BruteForceKernel<T, D, M, U>::distances(const M &metric, const DataSet &queries, unsigned int first_query, unsigned int num_queries,
+    unsigned int first_point, unsigned int num_points, const Distance *bounds, const bool *bounded, Distance *output) const {
+
+  for (unsigned int q=0; q<num_queries; ++q) {
+    const PreparedQuery<M> query(queries[first_query + q], metric);
+    Distance *row = output + q * num_points;
+    if (bounded[q]) {
+      for (unsigned int i=0; i<num_points; ++i)
+        row[i] = query.distance(data_.get_permuted(first_point + i), bounds[q]);
+    } else {
+      for (unsigned int i=0; i<num_points; ++i)
+        row[i] = query.distance(data_.get_permuted(first_point + i));
+    }
+  }
+}
+
+/**
+ * \brief Prepare the kernel precalculating the squared norms of the first points of a data set if not provided.
+ *
+ * \param data Data set where neighbours are searched.
+ * \param num_points Number of points of the data set being searched.
+ * \param squared_norms Squared norms of the points of the data set in permuted order, or \c NULL if not available.
+ */
+template <typename T, unsigned int D, typename M>
+BruteForceKernel<T, D, M, true>::BruteForceKernel(const DataSet &data, unsigned int num_points, const Distance *squared_norms)
+  : data_(data),
+    norms_(squared_norms) {
+
+  if (norms_)
+    return;
+
+  local_norms_.resize(num_points);
+  for (unsigned int i=0; i<num_points; ++i)
+    local_norms_[i] = DotProductDistance<T, D, M>::squared_norm(data.get_permuted(i));
+  norms_ = num_points ? &local_norms_[0] : NULL;
+}
+
+/**
+ * \brief Calculate lower bounds of the distances between a tile of queries and a block of points.
+ *
+ * \param metric Metric functor. Not used, since the Euclidean distances are expanded in terms of dot products.
+ * \param queries Batch of queries.
+ * \param first_query Index of the first query of the tile.
+ * \param num_queries Number of queries in the tile.
+ * \param first_point Index of the first point of the block.
+ * \param num_points Number of points in the block.
+ * \param bounds Upper bound of the distances of each query. Not used.
+ * \param bounded Indicates if the distances of each query can be upper bounded. Not used.
+ * \param output Array of \a num_queries rows of \a num_points distances where the results are written.
+ */
+template <typename T, unsigned int D, typename M>
+void BruteForceKernel<T, D, M, true>::distances(const M &metric, const DataSet &queries, unsigned int first_query, unsigned int num_queries,
+    unsigned int first_point, unsigned int num_points, const Distance *bounds, const bool *bounded, Distance *output) const {
+
+  // Bound of the relative rounding error of the expansion with respect to the distance calculated by the metric.
+  const Distance relative_error = DotProductDistance<T, D, M>::relative_error();
+
+  for (unsigned int q=0; q<num_queries; ++q) {
+    const T *p = queries[first_query + q].data();
+    Distance query_norm = DotProductDistance<T, D, M>::squared_norm(queries[first_query + q]);
+
+    Distance *row = output + q * num_points;
+    for (unsigned int i=0; i<num_points; ++i) {
+      const T *x = data_.get_permuted(first_point + i).data();
+      Distance dot = Traits<Distance>::zero();
+      for (unsigned int d=0; d<D; ++d)
+        dot += p[d] * x[d];
+
+      Distance norms = query_norm + norms_[first_point + i];
+      row[i] = norms - 2 * dot - relative_error * norms;
+    }
+  }
+}
+
+/**
+ * \brief Prepare a brute-force search.
+ *
+ * \param data Permuted training set stored by the kd-tree.
+ * \param metric Metric functor used to calculate distances between points.
+ * \param K Number of neighbours to retrieve for each query.
+ * \param ignore_null_distances Ignore points at null distance from the queries.
+ * \param num_points Number of points of the data set to search, starting from the first one.
+ * \param squared_norms Squared norms of the points precalculated by the kd-tree, if available. Only used by the Euclidean metric with floating point types.
+ */
+template <typename T, unsigned int D, typename M, typename C>
+BruteForceSearch<T, D, M, C>::BruteForceSearch(const DataSet &data, const Metric &metric, unsigned int K, bool ignore_null_distances, unsigned int num_points,
+    const Distance *squared_norms)
+  : data_(data),
+    metric_(metric),
+    K_(K),
+    ignore_null_distances_(ignore_null_distances),
+    num_points_(num_points),
+    kernel_(data, num_points, squared_norms),
+    distances_(tile_size * block_size) {
+
+  KCHE_TREE_DCHECK(num_points <= data.size());
+  for (unsigned int q=0; q<tile_size; ++q)
+    candidates_[q].reset(new Container(K_));
+}
+
+/**
+ * \brief Search the K nearest neighbours of a range of queries in the batch.
+ *
+ * \param queries Points whose neighbours should be retrieved.
+ * \param output Vector resized to the number of queries. The nearest neighbours of each query in the range are appended to its entry sorted by increasing distance.
+ * \param first_query Index of the first query to search.
+ * \param last_query Index after the last query to search.
+ */
+template <typename T, unsigned int D, typename M, typename C>
+void BruteForceSearch<T, D, M, C>::run(const DataSet &queries, std::vector<KNeighbors> &output, unsigned int first_query, unsigned int last_query) {
+
+  output.resize(queries.size());
+  for (unsigned int first = first_query; first < last_query; first += tile_size)
+    search_tile(queries, first, std::min(tile_size, last_query - first), output);
+}
+
+/**
+ * \brief Search the K nearest neighbours of a tile of queries.
+ *
+ * Each block of points is compared with all the queries of the tile, so that it is reused from cache.
+ *
+ * \param queries Batch of queries.
+ * \param first_query Index of the first query of the tile.
+ * \param num_queries Number of queries in the tile.
+ * \param output Output vector of the batch.
+ */
+template <typename T, unsigned int D, typename M, typename C>
+void BruteForceSearch<T, D, M, C>::search_tile(const DataSet &queries, unsigned int first_query, unsigned int num_queries, std::vector<KNeighbors> &output) {
+
+  for (unsigned int q=0; q<num_queries; ++q) {
+    farthest_[q] = Traits<Distance>::zero();
+    full_[q] = false;
+    if (!Kernel::exact)
+      queries_[q].reset(new PreparedQuery<Metric>(queries[first_query + q], metric_));
+  }
+
+  for (unsigned int block = 0; block < num_points_; block += block_size) {
+    const unsigned int num_points = std::min(block_size, num_points_ - block);
+    kernel_.distances(metric_, queries, first_query, num_queries, block, num_points, farthest_, full_, &distances_[0]);
+
+    for (unsigned int q=0; q<num_queries; ++q) {
+      const Distance *row = &distances_[q * num_points];
+      Container &candidates = *candidates_[q];
+
+      for (unsigned int i=0; i<num_points; ++i) {
+
+        // Discard the candidates that cannot improve the current ones before calculating their exact distance.
+        Distance distance = row[i];
+        if (full_[q] && distance > farthest_[q])
+          continue;
+        if (!Kernel::exact)
+          distance = queries_[q]->distance(data_.get_permuted(block + i));
+
+        if (ignore_null_distances_ && distance == Traits<Distance>::zero())
+          continue;
+
+        // Accept the candidate as the leaf nodes of the kd-tree do.
+        if (!full_[q] || !(distance > farthest_[q])) {
+          candidates.push_back(Neighbor(block + i, distance));
+          full_[q] = candidates.size() >= K_;
+          if (full_[q])
+            farthest_[q] = candidates.front().squared_distance();
+        }
+      }
+    }
+  }
+
+  // Append the nearest neighbours in increasing distance correcting index permutations.
+  for (unsigned int q=0; q<num_queries; ++q) {
+    Container &candidates = *candidates_[q];
+    KNeighbors &neighbors = output[first_query + q];
+    while (!candidates.empty()) {
+      const Neighbor &neighbor = candidates.back();
+      neighbors.push_back(Neighbor(data_.get_original_index(neighbor.index()), neighbor.squared_distance()));
+      candidates.pop_back();
+    }
+  }
+}
+
+} // namespace kche_tree
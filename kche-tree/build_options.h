@@ -0,0 +1,95 @@
+/***************************************************************************
+ *   Copyright (C) 2011, 2012 by Leandro Graciá Gil                        *
+ *   leandro.gracia.gil@gmail.com                                          *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/**
+ * \file build_options.h
+ * \brief Structure holding the options used to build a kd-tree.
+ * \author Leandro Graciá Gil
+ */
+
+#ifndef _KCHE_TREE_BUILD_OPTIONS_H_
+#define _KCHE_TREE_BUILD_OPTIONS_H_
+
+namespace kche_tree {
+
+/**
+ * \brief Options controlling how a kd-tree is built.
+ *
+ * Used by \link kche_tree::KDTree::build KDTree::build\endlink. Default values build the same tree as
+ * providing only a bucket size.
+ */
+struct BuildOptions {
+  /// Default size for kd-tree leaf node buckets.
+  static const unsigned int default_bucket_size = 32;
+
+  unsigned int bucket_size; ///< Number of elements that should be grouped in leaf nodes.
+
+  /**
+   * Precalculate the squared norms of the training points, so that Euclidean distances are calculated as
+   * ||p||² + ||x||² - 2 p·x with dot products. Only used by the Euclidean metric with floating point types.
+   * Distances are then accurate up to the rounding error of the expansion instead of being exactly the ones
+   * provided by the metric. The norms are recalculated when the kd-tree is deserialized.
+   */
+  bool squared_norms;
+
+  /**
+   * Store the dimensions of the vectors sorted by decreasing variance in the train set, reordering each query
+   * in the same way on entry. Bounded distances then exceed their bounds sooner when the variance spectrum is skewed.
+   * Requires metrics invariant to permutations of the dimensions (see IsPermutationInvariant) and arithmetic element types.
+   * \warning The data returned by \link kche_tree::KDTree::data KDTree::data\endlink keeps the reordered dimensions.
+   */
+  bool reorder_dimensions;
+
+  /**
+   * Store identical vectors of the train set only once, keeping the original indices of each group of them.
+   * Searches then process every distinct point once and expand the indices of its group in their results,
+   * and \link kche_tree::KDTree::count_in_range KDTree::count_in_range\endlink uses the size of the groups.
+   * Results are the same as without collapsing, except for the order of neighbours at the same distance.
+   * \warning The data returned by \link kche_tree::KDTree::data KDTree::data\endlink only contains the distinct vectors,
+   * indexed as in \link kche_tree::KDTree::duplicates KDTree::duplicates\endlink. Labels are taken from the first vector of each group.
+   */
+  bool collapse_duplicates;
+
+  /**
+   * Precalculate summaries of the labels of the train vectors for every branch of the kd-tree, so that the aggregate queries
+   * \link kche_tree::KDTree::summarize_box KDTree::summarize_box\endlink and \link kche_tree::KDTree::summarize_in_range KDTree::summarize_in_range\endlink
+   * add the summary of each branch covered by their region in constant time instead of visiting its points. Summaries include the
+   * number of vectors, the sum of their labels if arithmetic and, if \a label_classes is not zero, the histogram of their integral labels.
+   * Identical vectors collapsed in the kd-tree are summarized with their own labels, which are kept by the summaries and serialized
+   * with the kd-tree since the stored data only has the label of the first vector of each group.
+   */
+  bool label_summaries;
+
+  /// Number of classes counted in the label histograms. Integral labels must be in the range [0, label_classes). Zero to skip the histograms.
+  unsigned int label_classes;
+
+  /// Create a set of options with the provided bucket size.
+  explicit BuildOptions(unsigned int bucket_size = default_bucket_size)
+      : bucket_size(bucket_size),
+        squared_norms(false),
+        reorder_dimensions(false),
+        collapse_duplicates(false),
+        label_summaries(false),
+        label_classes(0) {}
+};
+
+} // namespace kche_tree
+
+#endif
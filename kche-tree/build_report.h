@@ -0,0 +1,78 @@
+/***************************************************************************
+ *   Copyright (C) 2011, 2012 by Leandro Graciá Gil                        *
+ *   leandro.gracia.gil@gmail.com                                          *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/**
+ * \file build_report.h
+ * \brief Structure reporting the time spent in each of the kd-tree build phases.
+ * \author Leandro Graciá Gil
+ */
+
+#ifndef _KCHE_TREE_BUILD_REPORT_H_
+#define _KCHE_TREE_BUILD_REPORT_H_
+
+// Include C time functions for clock().
+#include <ctime>
+
+namespace kche_tree {
+
+/**
+ * \brief Per-phase breakdown of the time spent building a kd-tree.
+ *
+ * Filled by \link kche_tree::KDTree::build KDTree::build\endlink when a report object is provided.
+ * No timing overhead is added to the build if no report is requested.
+ * All times are measured in seconds of processor time using \c clock().
+ *
+ * \note Labels of labeled data sets are shared between the train set and the permuted copy
+ * instead of being copied, so their cost is included in \a data_copy_time.
+ */
+struct BuildReport {
+  double permutation_time; ///< Time spent initializing the permutation array to the identity.
+  double dimension_order_time; ///< Time spent sorting and reordering the dimensions of the train set, if requested by the build options.
+  double duplicates_time; ///< Time spent grouping identical vectors and copying the distinct ones, if requested by the build options.
+  double recursion_time; ///< Time spent in the whole recursive construction of the tree, including splitting and node allocation.
+  double split_time; ///< Time spent sorting indices and selecting pivots while splitting the data. Each split is timed on its own, so it includes the overhead of two \c clock() calls per branch node, which is comparable to the cost of the smallest splits.
+  double allocation_time; ///< Time spent allocating branch and leaf nodes, measured in batches of nodes preallocated during the recursion.
+  double data_copy_time; ///< Time spent creating the internal permuted copy of the train set.
+  double squared_norms_time; ///< Time spent precalculating the squared norms of the points, if requested by the build options.
+  double summaries_time; ///< Time spent summarizing the labels of the points in each branch, if requested by the build options.
+  double total_time; ///< Total time spent in the build.
+
+  unsigned int num_branches; ///< Number of branch nodes created.
+  unsigned int num_leaves; ///< Number of leaf nodes created.
+
+  /// Create an empty report.
+  BuildReport() { reset(); }
+
+  /// Reset all times and counters to zero.
+  void reset() {
+    permutation_time = dimension_order_time = duplicates_time = recursion_time = split_time = allocation_time = data_copy_time = squared_norms_time = summaries_time = total_time = 0.0;
+    num_branches = num_leaves = 0;
+  }
+
+  /// Time spent in the recursive construction not accounted by splitting or allocating nodes.
+  double other_recursion_time() const { return recursion_time - split_time - allocation_time; }
+
+  /// Seconds of processor time elapsed since the provided clock value.
+  static double elapsed(clock_t start) { return (clock() - start) / static_cast<double>(CLOCKS_PER_SEC); }
+};
+
+} // namespace kche_tree
+
+#endif
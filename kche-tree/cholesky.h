@@ -0,0 +1,82 @@
+/***************************************************************************
+ *   Copyright (C) 2011, 2012 by Leandro Graciá Gil                        *
+ *   leandro.gracia.gil@gmail.com                                          *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/**
+ * \file cholesky.h
+ * \brief Cholesky decomposition of symmetric positive-definite matrices.
+ * \author Leandro Graciá Gil
+ */
+
+#ifndef _KCHE_TREE_CHOLESKY_H_
+#define _KCHE_TREE_CHOLESKY_H_
+
+// Include STL vectors.
+#include <vector>
+
+#include "sse.h"
+#include "symmetric_matrix.h"
+#include "utils.h"
+
+namespace kche_tree {
+
+/**
+ * \brief Cholesky decomposition A = LL' of a symmetric positive-definite matrix.
+ *
+ * The lower triangular factor L is stored by rows, so that the decomposition and the inversion only operate on
+ * contiguous rows with dot products and scaled additions. Dot products are processed for 4 rows at a time and use
+ * SSE registers if enabled. When A is a covariance matrix, L can also be reused to whiten feature vectors.
+ *
+ * \note Only available for floating point types, as square roots are required.
+ * \tparam U Data type of the elements in the matrix.
+ */
+template <typename U>
+class CholeskyDecomposition {
+public:
+  /// Type of the elements in the matrix.
+  typedef U Element;
+
+  // Constructor.
+  CholeskyDecomposition();
+
+  // Decomposition.
+  bool decompose(const SymmetricMatrix<U> &matrix);
+  void clear();
+
+  // Access to the lower triangular factor.
+  unsigned int size() const { return size_; } ///< Size of the decomposed matrix, or 0 if no matrix is decomposed.
+  const U *row(unsigned int row) const { return &factor_[row * (row + 1) / 2]; } ///< Elements of a row of L up to and including the diagonal.
+  U operator () (unsigned int row, unsigned int column) const;
+
+  // Operations using the decomposition.
+  void invert(SymmetricMatrix<U> &inverse) const;
+  void whiten(const U *input, U *output) const;
+
+private:
+  unsigned int size_; ///< Size of the decomposed matrix.
+  std::vector<U> factor_; ///< Rows of the lower triangular factor L up to and including the diagonal.
+  std::vector<U> inverse_diagonal_; ///< Multiplicative inverses of the diagonal elements of L.
+};
+
+} // namespace kche_tree
+
+// Template implementation.
+#include "cholesky.tpp"
+
+#endif
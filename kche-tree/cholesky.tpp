@@ -0,0 +1,422 @@
+/***************************************************************************
+ *   Copyright (C) 2011, 2012 by Leandro Graciá Gil                        *
+ *   leandro.gracia.gil@gmail.com                                          *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/**
+ * \file cholesky.tpp
+ * \brief Template implementation of the Cholesky decomposition of symmetric positive-definite matrices.
+ * \author Leandro Graciá Gil
+ */
+
+// Include STL algorithms and C math functions.
+#include <algorithm>
+#include <cmath>
+
+// Include traits.
+#include "traits.h"
+
+namespace kche_tree {
+
+/**
+ * \brief Square roots required by the Cholesky decomposition.
+ *
+ * Generic version for types without square roots. The decomposition is not available for them.
+ */
+template <typename U, bool is_floating_point = IsArithmetic<U>::value && !IsIntegral<U>::value>
+struct CholeskySquareRoot {
+  /// Indicates if square roots are available.
+  static const bool available = false;
+
+  /// Square roots are not available, so the value is never considered positive.
+  static bool positive_root(const U &value, U &root) { return false; }
+};
+
+/// Square roots required by the Cholesky decomposition. Version for floating point types.
+template <typename U>
+struct CholeskySquareRoot<U, true> {
+  /// Indicates if square roots are available.
+  static const bool available = true;
+
+  /**
+   * \brief Calculate the square root of a value if positive.
+   *
+   * \param value Value whose square root is calculated.
+   * \param root Square root of the value. Not modified if the value is not positive.
+   * \return \c true if the value is positive, \c false otherwise (including NaNs).
+   */
+  static bool positive_root(U value, U &root) {
+    if (!(value > U()))
+      return false;
+    root = std::sqrt(value);
+    return true;
+  }
+};
+
+/**
+ * \brief Add an array scaled by a value to another one.
+ *
+ * Simple loop over contiguous elements, vectorized by compilers for fundamental types.
+ *
+ * \param alpha Value scaling the first array.
+ * \param x Array to scale.
+ * \param y Array where the scaled values are added.
+ * \param size Number of elements of the arrays.
+ */
+template <typename U>
+inline void scaled_add(typename RParam<U>::Type alpha, const U *x, U *y, unsigned int size) {
+  for (unsigned int i=0; i<size; ++i) {
+    U value = x[i];
+    value *= alpha;
+    y[i] += value;
+  }
+}
+
+/**
+ * \brief Dot products used by the Cholesky decomposition.
+ *
+ * Generic version using independent partial sums, so that consecutive multiply-adds do not depend on each other.
+ */
+#if KCHE_TREE_ENABLE_SSE
+template <typename U, bool use_sse = (SSETraits<U>::NumElements > 0)>
+#else
+template <typename U, bool use_sse = false>
+#endif
+struct CholeskyKernels {
+  /**
+   * \brief Dot product of two arrays.
+   *
+   * \param a First array.
+   * \param b Second array.
+   * \param size Number of elements of the arrays.
+   * \return Dot product of the arrays.
+   */
+  static U dot(const U *a, const U *b, unsigned int size) {
+    U acc0 = Traits<U>::zero(), acc1 = acc0, acc2 = acc0, acc3 = acc0;
+    unsigned int i = 0;
+    for (; i + 4 <= size; i += 4) {
+      U product0 = a[i], product1 = a[i + 1], product2 = a[i + 2], product3 = a[i + 3];
+      product0 *= b[i];
+      product1 *= b[i + 1];
+      product2 *= b[i + 2];
+      product3 *= b[i + 3];
+      acc0 += product0;
+      acc1 += product1;
+      acc2 += product2;
+      acc3 += product3;
+    }
+
+    for (; i < size; ++i) {
+      U product = a[i];
+      product *= b[i];
+      acc0 += product;
+    }
+
+    acc0 += acc1;
+    acc2 += acc3;
+    acc0 += acc2;
+    return acc0;
+  }
+
+  /**
+   * \brief Dot products of 4 arrays with a common one, loading the common elements only once.
+   *
+   * \param a0 First array.
+   * \param a1 Second array.
+   * \param a2 Third array.
+   * \param a3 Fourth array.
+   * \param b Array multiplied by the other four.
+   * \param size Number of elements of the arrays.
+   * \param result Array where the 4 dot products are returned.
+   */
+  static void dot4(const U *a0, const U *a1, const U *a2, const U *a3, const U *b, unsigned int size, U *result) {
+    U acc0 = Traits<U>::zero(), acc1 = acc0, acc2 = acc0, acc3 = acc0;
+    for (unsigned int i=0; i<size; ++i) {
+      U product0 = a0[i], product1 = a1[i], product2 = a2[i], product3 = a3[i];
+      product0 *= b[i];
+      product1 *= b[i];
+      product2 *= b[i];
+      product3 *= b[i];
+      acc0 += product0;
+      acc1 += product1;
+      acc2 += product2;
+      acc3 += product3;
+    }
+
+    result[0] = acc0;
+    result[1] = acc1;
+    result[2] = acc2;
+    result[3] = acc3;
+  }
+};
+
+#if KCHE_TREE_ENABLE_SSE
+/// Dot products used by the Cholesky decomposition. SSE version for the types supporting it.
+template <typename U>
+struct CholeskyKernels<U, true> {
+  /// Type of the SSE registers.
+  typedef typename SSETraits<U>::Register Register;
+
+  /// Number of elements in each SSE register.
+  static const unsigned int NumElements = SSETraits<U>::NumElements;
+
+  /// Dot product of two arrays. Rows are not aligned, so unaligned loads are used.
+  static U dot(const U *a, const U *b, unsigned int size) {
+    typedef SSETraits<U> SSE;
+    Register acc0 = SSE::zero(), acc1 = SSE::zero();
+    unsigned int i = 0;
+    for (; i + 2 * NumElements <= size; i += 2 * NumElements) {
+      acc0 = SSE::add(acc0, SSE::mult(SSE::load_unaligned(a + i), SSE::load_unaligned(b + i)));
+      acc1 = SSE::add(acc1, SSE::mult(SSE::load_unaligned(a + i + NumElements), SSE::load_unaligned(b + i + NumElements)));
+    }
+
+    SSERegister<U> sum;
+    sum.reg = SSE::add(acc0, acc1);
+    U result = sum.sum();
+    for (; i < size; ++i)
+      result += a[i] * b[i];
+    return result;
+  }
+
+  /// Dot products of 4 arrays with a common one, loading the common elements only once.
+  static void dot4(const U *a0, const U *a1, const U *a2, const U *a3, const U *b, unsigned int size, U *result) {
+    typedef SSETraits<U> SSE;
+    Register acc0 = SSE::zero(), acc1 = SSE::zero(), acc2 = SSE::zero(), acc3 = SSE::zero();
+    unsigned int i = 0;
+    for (; i + NumElements <= size; i += NumElements) {
+      Register b_i = SSE::load_unaligned(b + i);
+      acc0 = SSE::add(acc0, SSE::mult(SSE::load_unaligned(a0 + i), b_i));
+      acc1 = SSE::add(acc1, SSE::mult(SSE::load_unaligned(a1 + i), b_i));
+      acc2 = SSE::add(acc2, SSE::mult(SSE::load_unaligned(a2 + i), b_i));
+      acc3 = SSE::add(acc3, SSE::mult(SSE::load_unaligned(a3 + i), b_i));
+    }
+
+    SSERegister<U> sum;
+    sum.reg = acc0;
+    result[0] = sum.sum();
+    sum.reg = acc1;
+    result[1] = sum.sum();
+    sum.reg = acc2;
+    result[2] = sum.sum();
+    sum.reg = acc3;
+    result[3] = sum.sum();
+
+    for (; i < size; ++i) {
+      result[0] += a0[i] * b[i];
+      result[1] += a1[i] * b[i];
+      result[2] += a2[i] * b[i];
+      result[3] += a3[i] * b[i];
+    }
+  }
+};
+#endif
+
+/// Create an empty decomposition.
+template <typename U>
+CholeskyDecomposition<U>::CholeskyDecomposition()
+    : size_(0) {}
+
+/// Discard the current decomposition.
+template <typename U>
+void CholeskyDecomposition<U>::clear() {
+  size_ = 0;
+  factor_.clear();
+  inverse_diagonal_.clear();
+}
+
+/**
+ * \brief Decompose a symmetric positive-definite matrix.
+ *
+ * Rows of L are calculated in groups of 4, so that each previous row is loaded once per group.
+ * \note The current decomposition won't be updated if the matrix is not positive-definite.
+ *
+ * \param matrix Matrix to decompose.
+ * \return \c true if successful, \c false if the matrix is not positive-definite or the element type has no square roots.
+ */
+template <typename U>
+bool CholeskyDecomposition<U>::decompose(const SymmetricMatrix<U> &matrix) {
+
+  typedef CholeskyKernels<U> Kernels;
+  if (!CholeskySquareRoot<U>::available)
+    return false;
+
+  const unsigned int n = matrix.size();
+  std::vector<U> factor(n * (n + 1) / 2);
+  std::vector<U> inverse_diagonal(n);
+
+  for (unsigned int j0 = 0; j0 < n; j0 += 4) {
+    const unsigned int num_rows = std::min(4u, n - j0);
+
+    // Copy the rows of the group from the lower triangle of the matrix.
+    U *rows[4] = { NULL, NULL, NULL, NULL };
+    for (unsigned int r=0; r<num_rows; ++r) {
+      const unsigned int j = j0 + r;
+      rows[r] = &factor[j * (j + 1) / 2];
+      std::copy(matrix.column(j), matrix.column(j) + j, rows[r]);
+      rows[r][j] = matrix.diagonal()[j];
+    }
+
+    // Calculate the elements at the left of the group.
+    for (unsigned int i=0; i<j0; ++i) {
+      const U *row_i = &factor[i * (i + 1) / 2];
+      U dots[4];
+      if (num_rows == 4)
+        Kernels::dot4(rows[0], rows[1], rows[2], rows[3], row_i, i, dots);
+      else {
+        for (unsigned int r=0; r<num_rows; ++r)
+          dots[r] = Kernels::dot(rows[r], row_i, i);
+      }
+
+      for (unsigned int r=0; r<num_rows; ++r) {
+        rows[r][i] -= dots[r];
+        rows[r][i] *= inverse_diagonal[i];
+      }
+    }
+
+    // Calculate the elements inside the group, including the diagonal.
+    for (unsigned int r=0; r<num_rows; ++r) {
+      const unsigned int j = j0 + r;
+      for (unsigned int i=j0; i<j; ++i) {
+        rows[r][i] -= Kernels::dot(rows[r], &factor[i * (i + 1) / 2], i);
+        rows[r][i] *= inverse_diagonal[i];
+      }
+
+      U diagonal = rows[r][j];
+      diagonal -= Kernels::dot(rows[r], rows[r], j);
+      if (!CholeskySquareRoot<U>::positive_root(diagonal, rows[r][j]))
+        return false;
+
+      inverse_diagonal[j] = rows[r][j];
+      Traits<U>::invert(inverse_diagonal[j]);
+    }
+  }
+
+  size_ = n;
+  factor_.swap(factor);
+  inverse_diagonal_.swap(inverse_diagonal);
+  return true;
+}
+
+/**
+ * \brief Get an element of the lower triangular factor L.
+ *
+ * \param row Row of the element. Behaviour is undefined if greater or equal than \link size size()\endlink.
+ * \param column Column of the element. Behaviour is undefined if greater or equal than \link size size()\endlink.
+ * \return Value of the element, zero if above the diagonal.
+ */
+template <typename U>
+U CholeskyDecomposition<U>::operator () (unsigned int row, unsigned int column) const {
+  return column > row ? Traits<U>::zero() : factor_[row * (row + 1) / 2 + column];
+}
+
+/**
+ * \brief Calculate the inverse of the decomposed matrix as inv(L)' * inv(L).
+ *
+ * inv(L) is calculated by rows from the previous ones, and its product is accumulated as rank-one updates
+ * with 4 rows at a time. Both steps only add scaled contiguous rows.
+ *
+ * \param inverse Matrix where the inverse is returned. Resized if required. Can be the decomposed matrix.
+ */
+template <typename U>
+void CholeskyDecomposition<U>::invert(SymmetricMatrix<U> &inverse) const {
+
+  const unsigned int n = size_;
+
+  // Calculate the rows of inv(L) as (e_j - sum L(j, k) * inv(L)_k) / L(j, j), for k < j.
+  std::vector<U> inverse_factor(factor_.size(), Traits<U>::zero());
+  for (unsigned int j=0; j<n; ++j) {
+    U *inverse_row = &inverse_factor[j * (j + 1) / 2];
+    const U *factor_row = row(j);
+    for (unsigned int k=0; k<j; ++k) {
+      U coefficient = factor_row[k];
+      Traits<U>::negate(coefficient);
+      scaled_add<U>(coefficient, &inverse_factor[k * (k + 1) / 2], inverse_row, k + 1);
+    }
+
+    for (unsigned int i=0; i<j; ++i)
+      inverse_row[i] *= inverse_diagonal_[j];
+    inverse_row[j] = inverse_diagonal_[j];
+  }
+
+  // Accumulate inv(L)' * inv(L) as the sum of the outer products of the rows of inv(L).
+  std::vector<U> product(factor_.size(), Traits<U>::zero());
+  unsigned int k = 0;
+  for (; k + 4 <= n; k += 4) {
+    const U *rows[4];
+    for (unsigned int r=0; r<4; ++r)
+      rows[r] = &inverse_factor[(k + r) * (k + r + 1) / 2];
+
+    // Columns covered by the 4 rows.
+    for (unsigned int j=0; j<=k; ++j) {
+      U *product_row = &product[j * (j + 1) / 2];
+      const U x0j = rows[0][j], x1j = rows[1][j], x2j = rows[2][j], x3j = rows[3][j];
+      for (unsigned int i=0; i<=j; ++i) {
+        U value0 = rows[0][i], value1 = rows[1][i], value2 = rows[2][i], value3 = rows[3][i];
+        value0 *= x0j;
+        value1 *= x1j;
+        value2 *= x2j;
+        value3 *= x3j;
+        value0 += value1;
+        value2 += value3;
+        value0 += value2;
+        product_row[i] += value0;
+      }
+    }
+
+    // Columns only covered by some of the rows.
+    for (unsigned int j=k+1; j<k+4; ++j) {
+      for (unsigned int r=j-k; r<4; ++r)
+        scaled_add<U>(rows[r][j], rows[r], &product[j * (j + 1) / 2], j + 1);
+    }
+  }
+
+  for (; k < n; ++k) {
+    const U *inverse_row = &inverse_factor[k * (k + 1) / 2];
+    for (unsigned int j=0; j<=k; ++j)
+      scaled_add<U>(inverse_row[j], inverse_row, &product[j * (j + 1) / 2], j + 1);
+  }
+
+  // Copy the result to the symmetric matrix.
+  inverse.reset_to_size(n, false);
+  for (unsigned int j=0; j<n; ++j) {
+    const U *product_row = &product[j * (j + 1) / 2];
+    for (unsigned int i=0; i<=j; ++i)
+      inverse(j, i) = product_row[i];
+  }
+}
+
+/**
+ * \brief Whiten a vector by solving Ly = x with forward substitution.
+ *
+ * If the decomposed matrix is a covariance matrix, the Mahalanobis distance between two vectors equals the
+ * Euclidean distance between their whitened versions, and whitened data has the identity as covariance.
+ *
+ * \param input Vector x to whiten, with \link size size()\endlink elements.
+ * \param output Array where the whitened vector y is returned. Can be the same as \a input.
+ */
+template <typename U>
+void CholeskyDecomposition<U>::whiten(const U *input, U *output) const {
+  for (unsigned int j=0; j<size_; ++j) {
+    U value = input[j];
+    value -= CholeskyKernels<U>::dot(row(j), output, j);
+    value *= inverse_diagonal_[j];
+    output[j] = value;
+  }
+}
+
+} // namespace kche_tree
@@ -0,0 +1,109 @@
+/***************************************************************************
+ *   Copyright (C) 2011, 2012 by Leandro Graciá Gil                        *
+ *   leandro.gracia.gil@gmail.com                                          *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/**
+ * \file covariance.h
+ * \brief Streaming estimation of the covariance matrix of feature vectors.
+ * \author Leandro Graciá Gil
+ */
+
+#ifndef _KCHE_TREE_COVARIANCE_H_
+#define _KCHE_TREE_COVARIANCE_H_
+
+// Include fixed size integer types.
+#include <stdint.h>
+
+// Include STL vectors.
+#include <vector>
+
+#include "dataset.h"
+#include "symmetric_matrix.h"
+#include "traits.h"
+#include "vector.h"
+
+namespace kche_tree {
+
+/**
+ * \brief Covariance estimator that can be updated with new feature vectors at any time.
+ *
+ * Keeps the number of vectors, their mean and the sum of the products of their deviations from the mean (co-moment).
+ * Single vectors are added with Welford's update, and data sets are processed in blocks whose statistics are merged
+ * with Chan's pairwise update. Blocks are split between threads if OpenMP is enabled.
+ * Estimators fitted independently, for example with different chunks of data, can also be merged.
+ * Vectors previously added can be removed by reverting Welford's update.
+ *
+ * Statistics are kept relative to the first vector added, so that they can be expressed as distances between elements
+ * and are less affected by cancellation when the data is far from the origin.
+ *
+ * \tparam ElementType Type of the elements in the feature vectors. Requires the +=, -= and *= (float) operators in its distance type.
+ * \tparam NumDimensions Number of dimensions of the feature vectors.
+ */
+template <typename ElementType, unsigned int NumDimensions>
+class CovarianceEstimator {
+public:
+  /// Type of the elements in the feature vectors.
+  typedef ElementType Element;
+
+  /// Number of dimensions of the feature vectors.
+  static const unsigned int Dimensions = NumDimensions;
+
+  /// Type of the distances between elements, used for all the statistics.
+  typedef typename Traits<Element>::Distance Distance;
+
+  /// Type of the feature vectors.
+  typedef kche_tree::Vector<Element, Dimensions> Vector;
+
+  /// Type of the data sets.
+  typedef kche_tree::DataSet<Element, Dimensions> DataSet;
+
+  /// Number of vectors whose statistics are calculated together before being merged.
+  static const unsigned int block_size = 256;
+
+  // Constructor.
+  CovarianceEstimator();
+
+  // Update of the statistics.
+  void reset();
+  void add(const Vector &vector);
+  void add(const DataSet &data_set);
+  bool remove(const Vector &vector);
+  void merge(const CovarianceEstimator &estimator);
+
+  // Results.
+  uint64_t size() const { return count_; } ///< Number of feature vectors added to the estimator.
+  bool covariance(SymmetricMatrix<Distance> &covariance) const;
+  void deviation(const Vector &vector, Distance *deviation) const;
+
+private:
+  void add_blocks(const DataSet &data_set, unsigned int first, unsigned int last);
+  void merge_moments(uint64_t count, const Distance *mean_delta, const Distance *comoment);
+
+  Vector reference_; ///< First vector added. Statistics are kept relative to it.
+  uint64_t count_; ///< Number of vectors added.
+  Distance mean_[Dimensions]; ///< Mean of the vectors relative to the reference.
+  std::vector<Distance> comoment_; ///< Lower triangle of the co-moment matrix stored by rows.
+};
+
+} // namespace kche_tree
+
+// Template implementation.
+#include "covariance.tpp"
+
+#endif
@@ -0,0 +1,367 @@
+/***************************************************************************
+ *   Copyright (C) 2011, 2012 by Leandro Graciá Gil                        *
+ *   leandro.gracia.gil@gmail.com                                          *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/**
+ * \file covariance.tpp
+ * \brief Template implementation of the streaming estimation of the covariance matrix of feature vectors.
+ * \author Leandro Graciá Gil
+ */
+
+// Include STL algorithms.
+#include <algorithm>
+
+// Include OpenMP functions if enabled.
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace kche_tree {
+
+// Static data.
+template <typename T, unsigned int D>
+const unsigned int CovarianceEstimator<T, D>::block_size;
+
+/// Create an estimator with no vectors added.
+template <typename T, unsigned int D>
+CovarianceEstimator<T, D>::CovarianceEstimator()
+    : comoment_(D * (D + 1) / 2) {
+  reset();
+}
+
+/// Discard all the vectors added to the estimator.
+template <typename T, unsigned int D>
+void CovarianceEstimator<T, D>::reset() {
+  count_ = 0;
+  std::fill(mean_, mean_ + D, Traits<Distance>::zero());
+  std::fill(comoment_.begin(), comoment_.end(), Traits<Distance>::zero());
+}
+
+/**
+ * \brief Add a single feature vector to the estimator.
+ *
+ * \param vector Feature vector to add.
+ */
+template <typename T, unsigned int D>
+void CovarianceEstimator<T, D>::add(const Vector &vector) {
+
+  if (!count_)
+    reference_ = vector;
+
+  Distance mean_delta[D];
+  for (unsigned int d=0; d<D; ++d) {
+    mean_delta[d] = Traits<T>::distance(vector[d], reference_[d]);
+    mean_delta[d] -= mean_[d];
+  }
+
+  merge_moments(1, mean_delta, NULL);
+}
+
+/**
+ * \brief Remove a feature vector previously added to the estimator.
+ *
+ * \note The result is undefined if the vector was not added before.
+ *
+ * \param vector Feature vector to remove.
+ * \return \c true if successful, \c false if the estimator has no vectors.
+ */
+template <typename T, unsigned int D>
+bool CovarianceEstimator<T, D>::remove(const Vector &vector) {
+
+  if (!count_)
+    return false;
+
+  if (count_ == 1) {
+    reset();
+    return true;
+  }
+
+  // Revert the update of the mean and the co-moment made when the vector was added.
+  const uint64_t total = count_ - 1;
+  const float mean_weight = static_cast<float>(1.0 / total);
+  const float comoment_weight = static_cast<float>(static_cast<double>(count_) / total);
+
+  Distance mean_delta[D];
+  deviation(vector, mean_delta);
+
+  Distance *row = &comoment_[0];
+  for (unsigned int j=0; j<D; ++j) {
+    Distance weighted_delta = mean_delta[j];
+    weighted_delta *= comoment_weight;
+    for (unsigned int i=0; i<=j; ++i) {
+      Distance product = mean_delta[i];
+      product *= weighted_delta;
+      row[i] -= product;
+    }
+    row += j + 1;
+  }
+
+  for (unsigned int d=0; d<D; ++d) {
+    Distance delta = mean_delta[d];
+    delta *= mean_weight;
+    mean_[d] -= delta;
+  }
+
+  count_ = total;
+  return true;
+}
+
+/**
+ * \brief Add all the feature vectors of a data set to the estimator.
+ *
+ * Vectors are processed in blocks of \link block_size block_size\endlink. If OpenMP is enabled, large data sets
+ * are split in a contiguous range per thread whose partial estimations are merged in order at the end.
+ *
+ * \param data_set Data set whose vectors are added.
+ */
+template <typename T, unsigned int D>
+void CovarianceEstimator<T, D>::add(const DataSet &data_set) {
+
+  const unsigned int num_vectors = data_set.size();
+  if (!num_vectors)
+    return;
+
+  #ifdef _OPENMP
+  const int num_ranges = std::min(omp_get_max_threads(), static_cast<int>(num_vectors / (4 * block_size)));
+  if (num_ranges > 1) {
+    std::vector<CovarianceEstimator> partial(num_ranges);
+
+    #pragma omp parallel for schedule(static)
+    for (int range = 0; range < num_ranges; ++range) {
+      unsigned int first = static_cast<unsigned int>(static_cast<uint64_t>(num_vectors) * range / num_ranges);
+      unsigned int last = static_cast<unsigned int>(static_cast<uint64_t>(num_vectors) * (range + 1) / num_ranges);
+      partial[range].add_blocks(data_set, first, last);
+    }
+
+    for (int range = 0; range < num_ranges; ++range)
+      merge(partial[range]);
+    return;
+  }
+  #endif
+
+  add_blocks(data_set, 0, num_vectors);
+}
+
+/**
+ * \brief Merge the statistics of another estimator, as if all its vectors were added to this one.
+ *
+ * \param estimator Estimator whose statistics are merged.
+ */
+template <typename T, unsigned int D>
+void CovarianceEstimator<T, D>::merge(const CovarianceEstimator &estimator) {
+
+  if (!estimator.count_)
+    return;
+
+  if (!count_) {
+    *this = estimator;
+    return;
+  }
+
+  // Express the mean of the other estimator relative to this reference.
+  Distance mean_delta[D];
+  for (unsigned int d=0; d<D; ++d) {
+    mean_delta[d] = Traits<T>::distance(estimator.reference_[d], reference_[d]);
+    mean_delta[d] += estimator.mean_[d];
+    mean_delta[d] -= mean_[d];
+  }
+
+  merge_moments(estimator.count_, mean_delta, &estimator.comoment_[0]);
+}
+
+/**
+ * \brief Calculate the unbiased estimation of the covariance matrix of the vectors added.
+ *
+ * \param covariance Symmetric matrix where the covariance is returned. Resized if required.
+ * \return \c true if successful, \c false if less than 2 vectors have been added.
+ */
+template <typename T, unsigned int D>
+bool CovarianceEstimator<T, D>::covariance(SymmetricMatrix<Distance> &covariance) const {
+
+  if (count_ <= 1)
+    return false;
+
+  covariance.reset_to_size(D, false);
+  const float inv_N1 = static_cast<float>(1.0 / (count_ - 1));
+  const Distance *row = &comoment_[0];
+  for (unsigned int j=0; j<D; ++j) {
+    for (unsigned int i=0; i<=j; ++i) {
+      Distance value = row[i];
+      value *= inv_N1;
+      covariance(j, i) = value;
+    }
+    row += j + 1;
+  }
+
+  return true;
+}
+
+/**
+ * \brief Calculate the difference between a feature vector and the current mean.
+ *
+ * \warning At least one vector should have been added to the estimator.
+ *
+ * \param vector Feature vector to compare with the mean.
+ * \param deviation Array of \a D values where the difference is returned.
+ */
+template <typename T, unsigned int D>
+void CovarianceEstimator<T, D>::deviation(const Vector &vector, Distance *deviation) const {
+  KCHE_TREE_DCHECK(count_ > 0);
+  for (unsigned int d=0; d<D; ++d) {
+    deviation[d] = Traits<T>::distance(vector[d], reference_[d]);
+    deviation[d] -= mean_[d];
+  }
+}
+
+/**
+ * \brief Add a range of vectors from a data set in blocks of \link block_size block_size\endlink.
+ *
+ * The mean and co-moment of each block are calculated in two passes over the block, which stays in cache,
+ * and then merged with the statistics of the estimator.
+ *
+ * \param data_set Data set whose vectors are added.
+ * \param first Index of the first vector to add.
+ * \param last Index of the last (non-inclusive) vector to add.
+ */
+template <typename T, unsigned int D>
+void CovarianceEstimator<T, D>::add_blocks(const DataSet &data_set, unsigned int first, unsigned int last) {
+
+  if (first >= last)
+    return;
+
+  if (!count_)
+    reference_ = data_set[first];
+
+  std::vector<Distance> deviations(block_size * D);
+  std::vector<Distance> block_comoment(comoment_.size());
+  Distance block_mean[D];
+
+  for (unsigned int block = first; block < last; block += block_size) {
+    const unsigned int num_vectors = std::min(block_size, last - block);
+
+    // Calculate the mean of the block relative to the reference.
+    std::fill(block_mean, block_mean + D, Traits<Distance>::zero());
+    for (unsigned int k=0; k<num_vectors; ++k) {
+      const Vector &vector = data_set[block + k];
+      Distance *deviation = &deviations[k * D];
+      for (unsigned int d=0; d<D; ++d) {
+        deviation[d] = Traits<T>::distance(vector[d], reference_[d]);
+        block_mean[d] += deviation[d];
+      }
+    }
+
+    const float inv_num_vectors = 1.0f / num_vectors;
+    for (unsigned int d=0; d<D; ++d)
+      block_mean[d] *= inv_num_vectors;
+
+    // Center the block on its own mean.
+    for (unsigned int k=0; k<num_vectors; ++k) {
+      Distance *deviation = &deviations[k * D];
+      for (unsigned int d=0; d<D; ++d)
+        deviation[d] -= block_mean[d];
+    }
+
+    // Accumulate the co-moment of the block. Vectors are processed 4 at a time to reduce the passes over the matrix.
+    std::fill(block_comoment.begin(), block_comoment.end(), Traits<Distance>::zero());
+    unsigned int k = 0;
+    for (; k + 4 <= num_vectors; k += 4) {
+      const Distance *x0 = &deviations[k * D], *x1 = x0 + D, *x2 = x1 + D, *x3 = x2 + D;
+      Distance *row = &block_comoment[0];
+      for (unsigned int j=0; j<D; ++j) {
+        const Distance x0j = x0[j], x1j = x1[j], x2j = x2[j], x3j = x3[j];
+        for (unsigned int i=0; i<=j; ++i) {
+          Distance product0 = x0[i], product1 = x1[i], product2 = x2[i], product3 = x3[i];
+          product0 *= x0j;
+          product1 *= x1j;
+          product2 *= x2j;
+          product3 *= x3j;
+          product0 += product1;
+          product2 += product3;
+          product0 += product2;
+          row[i] += product0;
+        }
+        row += j + 1;
+      }
+    }
+
+    for (; k < num_vectors; ++k) {
+      const Distance *x = &deviations[k * D];
+      Distance *row = &block_comoment[0];
+      for (unsigned int j=0; j<D; ++j) {
+        const Distance xj = x[j];
+        for (unsigned int i=0; i<=j; ++i) {
+          Distance product = x[i];
+          product *= xj;
+          row[i] += product;
+        }
+        row += j + 1;
+      }
+    }
+
+    // Merge the block with the current statistics.
+    for (unsigned int d=0; d<D; ++d)
+      block_mean[d] -= mean_[d];
+    merge_moments(num_vectors, block_mean, &block_comoment[0]);
+  }
+}
+
+/**
+ * \brief Merge the statistics of a group of vectors with the current ones using Chan's pairwise update.
+ *
+ * \param count Number of vectors in the group.
+ * \param mean_delta Difference between the mean of the group and the current one, both relative to the reference.
+ * \param comoment Lower triangle of the co-moment matrix of the group stored by rows, or \c NULL if zero.
+ */
+template <typename T, unsigned int D>
+void CovarianceEstimator<T, D>::merge_moments(uint64_t count, const Distance *mean_delta, const Distance *comoment) {
+
+  const uint64_t total = count_ + count;
+  const float mean_weight = static_cast<float>(static_cast<double>(count) / total);
+  const float comoment_weight = static_cast<float>(static_cast<double>(count_) * count / total);
+
+  // Update the co-moment with the product of the mean differences.
+  Distance *row = &comoment_[0];
+  for (unsigned int j=0; j<D; ++j) {
+    Distance weighted_delta = mean_delta[j];
+    weighted_delta *= comoment_weight;
+    for (unsigned int i=0; i<=j; ++i) {
+      Distance product = mean_delta[i];
+      product *= weighted_delta;
+      row[i] += product;
+    }
+
+    if (comoment) {
+      for (unsigned int i=0; i<=j; ++i)
+        row[i] += comoment[i];
+      comoment += j + 1;
+    }
+    row += j + 1;
+  }
+
+  // Update the mean.
+  for (unsigned int d=0; d<D; ++d) {
+    Distance delta = mean_delta[d];
+    delta *= mean_weight;
+    mean_[d] += delta;
+  }
+
+  count_ = total;
+}
+
+} // namespace kche_tree
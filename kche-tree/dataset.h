@@ -69,6 +69,7 @@ public:
   DataSet(const Vector *vectors, unsigned int size);
   DataSet(SharedArray<Vector> vectors, unsigned int size);
   DataSet(const DataSet &dataset, unsigned int *permutation);
+  DataSet(const DataSet &dataset, const unsigned int *indices, unsigned int size);
   virtual ~DataSet();
 
   // Initialization methods.
@@ -109,6 +109,21 @@ DataSet<T, D>::DataSet(const DataSet &dataset, unsigned int *permutation)
   }
 }
 
+/**
+ * \brief Create a copy of a subset of the vectors of another data set.
+ *
+ * \param dataset Data set to be copied.
+ * \param indices Array of the indices of the vectors to copy, in the order they are stored in the new set.
+ * \param size Number of vectors to copy.
+ */
+template <typename T, unsigned int D>
+DataSet<T, D>::DataSet(const DataSet &dataset, const unsigned int *indices, unsigned int size)
+    : vectors_(size ? new Vector[size] : NULL),
+      size_(size) {
+  for (unsigned int i=0; i<size_; ++i)
+    vectors_[i] = dataset[indices[i]];
+}
+
 /**
  * \brief Default virtual destructor.
  */
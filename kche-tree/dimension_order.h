@@ -0,0 +1,88 @@
+/***************************************************************************
+ *   Copyright (C) 2011, 2012 by Leandro Graciá Gil                        *
+ *   leandro.gracia.gil@gmail.com                                          *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/**
+ * \file dimension_order.h
+ * \brief Reordering of the dimensions of feature vectors by decreasing variance.
+ * \author Leandro Graciá Gil
+ */
+
+#ifndef _KCHE_TREE_DIMENSION_ORDER_H_
+#define _KCHE_TREE_DIMENSION_ORDER_H_
+
+// Include fixed size integer types.
+#include <stdint.h>
+
+#include "traits.h"
+#include "utils.h"
+#include "vector.h"
+
+namespace kche_tree {
+
+/**
+ * \brief Permutation of the dimensions of the feature vectors stored in a kd-tree.
+ *
+ * Placing the dimensions with the largest variance first makes the partial sums of bounded distance
+ * calculations exceed their upper bounds sooner, and makes the first levels of the tree split along them.
+ * Only valid for metrics invariant to permutations of the dimensions, such as the Euclidean one.
+ *
+ * \tparam ElementType Type of the elements in the feature vectors.
+ * \tparam NumDimensions Number of dimensions of the feature vectors.
+ */
+template <typename ElementType, unsigned int NumDimensions>
+class DimensionOrder {
+public:
+  /// Type of the elements in the feature vectors.
+  typedef ElementType Element;
+
+  /// Number of dimensions of the feature vectors.
+  static const unsigned int Dimensions = NumDimensions;
+
+  /// Type of the feature vectors.
+  typedef kche_tree::Vector<Element, Dimensions> Vector;
+
+  // Constructor.
+  DimensionOrder();
+
+  // Order calculation.
+  template <typename DataSet>
+  void sort_by_variance(const DataSet &data);
+  bool set_order(const uint32_t *order);
+
+  // Order properties.
+  bool is_identity() const;
+  unsigned int operator [] (unsigned int position) const { return order_[position]; } ///< Original dimension stored at a position.
+
+  // Application of the order to vectors and data sets.
+  void reorder(const Vector &original, Vector &reordered) const;
+  void restore(const Vector &reordered, Vector &original) const;
+  template <typename DataSet>
+  void reorder(DataSet &data) const;
+
+private:
+  uint32_t order_[Dimensions]; ///< Original dimension stored at each position.
+};
+
+} // namespace kche_tree
+
+// Template implementation.
+#include "dimension_order.tpp"
+
+#endif
@@ -0,0 +1,184 @@
+/***************************************************************************
+ *   Copyright (C) 2011, 2012 by Leandro Graciá Gil                        *
+ *   leandro.gracia.gil@gmail.com                                          *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/**
+ * \file dimension_order.tpp
+ * \brief Template implementation of the reordering of the dimensions of feature vectors by decreasing variance.
+ * \author Leandro Graciá Gil
+ */
+
+// Include STL sorting and pairs.
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+namespace kche_tree {
+
+/**
+ * \brief Calculate the variance of each dimension of a data set.
+ *
+ * Generic version for types that cannot be converted to floating point values. No variances are calculated.
+ */
+template <typename T, unsigned int D, bool is_arithmetic = IsArithmetic<T>::value>
+struct DimensionVariances {
+  /// Calculate the variances of the dimensions of a data set.
+  template <typename DataSet>
+  static bool calculate(const DataSet &data, double *variances) { return false; }
+};
+
+/// Calculate the variance of each dimension of a data set. Version for arithmetic types.
+template <typename T, unsigned int D>
+struct DimensionVariances<T, D, true> {
+  /**
+   * \brief Calculate the variances of the dimensions of a data set.
+   *
+   * \param data Data set whose variances are calculated.
+   * \param variances Array of \a D values where the variances are returned.
+   * \return \c true if successful, \c false if the variances could not be calculated.
+   */
+  template <typename DataSet>
+  static bool calculate(const DataSet &data, double *variances) {
+    if (data.size() < 2)
+      return false;
+
+    // Two passes over the data to avoid the cancellation of the sum of squares.
+    std::vector<double> mean(D, 0.0);
+    for (unsigned int i=0; i<data.size(); ++i)
+      for (unsigned int d=0; d<D; ++d)
+        mean[d] += static_cast<double>(data[i][d]);
+    for (unsigned int d=0; d<D; ++d)
+      mean[d] /= data.size();
+
+    std::fill(variances, variances + D, 0.0);
+    for (unsigned int i=0; i<data.size(); ++i) {
+      for (unsigned int d=0; d<D; ++d) {
+        double difference = static_cast<double>(data[i][d]) - mean[d];
+        variances[d] += difference * difference;
+      }
+    }
+    return true;
+  }
+};
+
+/// Create an identity order.
+template <typename T, unsigned int D>
+DimensionOrder<T, D>::DimensionOrder() {
+  for (unsigned int d=0; d<D; ++d)
+    order_[d] = d;
+}
+
+/**
+ * \brief Sort the dimensions by decreasing variance in a data set.
+ *
+ * Dimensions with the same variance keep their original relative order. The order is left unchanged
+ * if the variances cannot be calculated for the element type.
+ *
+ * \param data Data set whose variances are used.
+ */
+template <typename T, unsigned int D> template <typename DataSet>
+void DimensionOrder<T, D>::sort_by_variance(const DataSet &data) {
+
+  double variances[D];
+  if (!DimensionVariances<T, D>::calculate(data, variances))
+    return;
+
+  // Sort by decreasing variance, breaking ties by increasing original dimension.
+  std::vector<std::pair<double, int> > keys(D);
+  for (unsigned int d=0; d<D; ++d)
+    keys[d] = std::make_pair(-variances[d], static_cast<int>(d));
+  std::sort(keys.begin(), keys.end());
+
+  for (unsigned int d=0; d<D; ++d)
+    order_[d] = keys[d].second;
+}
+
+/**
+ * \brief Set the order explicitly.
+ *
+ * \param order Array with the original dimension stored at each position.
+ * \return \c true if successful, \c false if \a order is not a valid permutation. The order is not modified in that case.
+ */
+template <typename T, unsigned int D>
+bool DimensionOrder<T, D>::set_order(const uint32_t *order) {
+
+  bool used[D];
+  std::fill(used, used + D, false);
+  for (unsigned int d=0; d<D; ++d) {
+    if (order[d] >= D || used[order[d]])
+      return false;
+    used[order[d]] = true;
+  }
+
+  std::copy(order, order + D, order_);
+  return true;
+}
+
+/**
+ * \brief Check if the order leaves all the dimensions in place.
+ */
+template <typename T, unsigned int D>
+bool DimensionOrder<T, D>::is_identity() const {
+  for (unsigned int d=0; d<D; ++d)
+    if (order_[d] != d)
+      return false;
+  return true;
+}
+
+/**
+ * \brief Reorder the dimensions of a feature vector.
+ *
+ * \param original Feature vector in the original order.
+ * \param reordered Feature vector where the reordered dimensions are written. Must be different from \a original.
+ */
+template <typename T, unsigned int D>
+void DimensionOrder<T, D>::reorder(const Vector &original, Vector &reordered) const {
+  KCHE_TREE_DCHECK(&original != &reordered);
+  for (unsigned int d=0; d<D; ++d)
+    reordered[d] = original[order_[d]];
+}
+
+/**
+ * \brief Restore the original order of the dimensions of a feature vector.
+ *
+ * \param reordered Feature vector with reordered dimensions.
+ * \param original Feature vector where the dimensions in their original order are written. Must be different from \a reordered.
+ */
+template <typename T, unsigned int D>
+void DimensionOrder<T, D>::restore(const Vector &reordered, Vector &original) const {
+  KCHE_TREE_DCHECK(&original != &reordered);
+  for (unsigned int d=0; d<D; ++d)
+    original[order_[d]] = reordered[d];
+}
+
+/**
+ * \brief Reorder the dimensions of all the feature vectors in a data set in place.
+ *
+ * \param data Data set to reorder.
+ */
+template <typename T, unsigned int D> template <typename DataSet>
+void DimensionOrder<T, D>::reorder(DataSet &data) const {
+  Vector original;
+  for (unsigned int i=0; i<data.size(); ++i) {
+    original = data[i];
+    reorder(original, data[i]);
+  }
+}
+
+} // namespace kche_tree
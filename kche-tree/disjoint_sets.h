@@ -0,0 +1,64 @@
+/***************************************************************************
+ *   Copyright (C) 2011, 2012 by Leandro Graciá Gil                        *
+ *   leandro.gracia.gil@gmail.com                                          *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/**
+ * \file disjoint_sets.h
+ * \brief Union-find structure for disjoint sets of indices.
+ * \author Leandro Graciá Gil
+ */
+
+#ifndef _KCHE_TREE_DISJOINT_SETS_H_
+#define _KCHE_TREE_DISJOINT_SETS_H_
+
+// Include fixed size integer types and STL vectors.
+#include <stdint.h>
+#include <vector>
+
+namespace kche_tree {
+
+/**
+ * \brief Disjoint sets of consecutive indices that can be merged, also known as a union-find structure.
+ *
+ * The representative of each set is always its lowest index. Merging sets whose indices lie in a range
+ * therefore only modifies the entries of that range, so disjoint ranges can be merged by different threads
+ * as long as each thread only merges and finds indices of its own range.
+ */
+class DisjointSets {
+public:
+  // Initialization.
+  void reset(unsigned int size);
+
+  // Set operations.
+  uint32_t find(uint32_t index);
+  bool merge(uint32_t index1, uint32_t index2);
+
+  /// Number of indices in all the sets.
+  unsigned int size() const { return static_cast<unsigned int>(parents_.size()); }
+
+private:
+  std::vector<uint32_t> parents_; ///< Parent of each index in the tree of its set. Representatives are their own parents.
+};
+
+} // namespace kche_tree
+
+// Template implementation.
+#include "disjoint_sets.tpp"
+
+#endif
@@ -0,0 +1,73 @@
+/***************************************************************************
+ *   Copyright (C) 2011, 2012 by Leandro Graciá Gil                        *
+ *   leandro.gracia.gil@gmail.com                                          *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/**
+ * \file disjoint_sets.tpp
+ * \brief Implementation of a union-find structure for disjoint sets of indices.
+ * \author Leandro Graciá Gil
+ */
+
+namespace kche_tree {
+
+/**
+ * \brief Reset the structure to a set for each index.
+ *
+ * \param size Number of indices.
+ */
+inline void DisjointSets::reset(unsigned int size) {
+  parents_.resize(size);
+  for (unsigned int i=0; i<size; ++i)
+    parents_[i] = i;
+}
+
+/**
+ * \brief Find the representative of the set containing an index, halving the path to it.
+ *
+ * \param index Index whose set is requested.
+ * \return Lowest index of the set.
+ */
+inline uint32_t DisjointSets::find(uint32_t index) {
+  while (parents_[index] != index) {
+    parents_[index] = parents_[parents_[index]];
+    index = parents_[index];
+  }
+  return index;
+}
+
+/**
+ * \brief Merge the sets containing two indices.
+ *
+ * \param index1 Index in the first set.
+ * \param index2 Index in the second set.
+ * \return \c true if the sets were merged, \c false if both indices were already in the same set.
+ */
+inline bool DisjointSets::merge(uint32_t index1, uint32_t index2) {
+  uint32_t root1 = find(index1), root2 = find(index2);
+  if (root1 == root2)
+    return false;
+
+  if (root1 < root2)
+    parents_[root2] = root1;
+  else
+    parents_[root1] = root2;
+  return true;
+}
+
+} // namespace kche_tree
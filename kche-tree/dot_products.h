@@ -0,0 +1,127 @@
+/***************************************************************************
+ *   Copyright (C) 2011, 2012 by Leandro Graciá Gil                        *
+ *   leandro.gracia.gil@gmail.com                                          *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/**
+ * \file dot_products.h
+ * \brief Calculation of Euclidean distances expanded in terms of squared norms and dot products.
+ * \author Leandro Graciá Gil
+ */
+
+#ifndef _KCHE_TREE_DOT_PRODUCTS_H_
+#define _KCHE_TREE_DOT_PRODUCTS_H_
+
+// Include STL vectors for the squared norms.
+#include <vector>
+
+#include "traits.h"
+#include "utils.h"
+#include "vector.h"
+
+namespace kche_tree {
+
+// Forward declarations.
+template <typename T, unsigned int D> class EuclideanMetric;
+
+/**
+ * \brief Check if the distances of a metric can be expanded in terms of norms and dot products.
+ *
+ * Only holds for the Euclidean metric with floating point types, where ||a - b||² = ||a||² + ||b||² - 2 a·b.
+ */
+template <typename T, unsigned int D, typename Metric>
+struct UseDotProducts {
+  enum { value = IsSame<Metric, EuclideanMetric<T, D> >::value && IsArithmetic<T>::value && !IsIntegral<T>::value };
+};
+
+/**
+ * \brief Distances calculated directly by the metric. Used when the metric cannot be expanded in dot products.
+ *
+ * Provides the same interface as the dot product version so that callers do not need to know which one is used.
+ */
+template <typename T, unsigned int D, typename Metric, bool use_dot_products = UseDotProducts<T, D, Metric>::value>
+struct DotProductDistance {
+  /// Distance type associated with the elements.
+  typedef typename Traits<T>::Distance Distance;
+
+  /// Use optimized const reference type for distance.
+  typedef typename RParam<Distance>::Type ConstRef_Distance;
+
+  /// Alias for the compatible feature vectors.
+  typedef typename kche_tree::Vector<T, D> Vector;
+
+  /// Indicates if squared norms are used by the distance calculations.
+  static const bool enabled = false;
+
+  /// Squared norm of a vector. Not used.
+  static Distance squared_norm(const Vector &v) { return Traits<Distance>::zero(); }
+
+  /// Squared norms of the first vectors of a data set. Not used, so no norms are calculated.
+  template <typename DataSet>
+  static void squared_norms(const DataSet &data, std::vector<Distance> &norms) { norms.clear(); }
+
+  /// Bound of the relative rounding error of the expansion. Zero, since distances are not expanded.
+  static Distance relative_error() { return Traits<Distance>::zero(); }
+
+  /// Distance between two vectors calculated by the metric.
+  static Distance distance(const Metric &metric, const Vector &v1, ConstRef_Distance v1_norm, const Vector &v2, ConstRef_Distance v2_norm) {
+    return metric(v1, v2);
+  }
+};
+
+/**
+ * \brief Euclidean distances calculated as ||a||² + ||b||² - 2 a·b using precalculated squared norms.
+ *
+ * The dot product is a single multiply-add chain, which compilers contract into FMA instructions when available
+ * and vectorize as well as the plain difference. Distances are only accurate up to the rounding error of the
+ * expansion, so any distance small enough to be affected by cancellation is recalculated with the metric.
+ * In particular, null distances are always exact.
+ */
+template <typename T, unsigned int D, typename Metric>
+struct DotProductDistance<T, D, Metric, true> {
+  /// Distance type associated with the elements.
+  typedef typename Traits<T>::Distance Distance;
+
+  /// Use optimized const reference type for distance.
+  typedef typename RParam<Distance>::Type ConstRef_Distance;
+
+  /// Alias for the compatible feature vectors.
+  typedef typename kche_tree::Vector<T, D> Vector;
+
+  /// Indicates if squared norms are used by the distance calculations.
+  static const bool enabled = true;
+
+  // Squared norms.
+  static inline Distance squared_norm(const Vector &v);
+
+  template <typename DataSet>
+  static void squared_norms(const DataSet &data, std::vector<Distance> &norms);
+
+  // Bound of the relative rounding error of the expansion.
+  static inline Distance relative_error();
+
+  // Distance between two vectors.
+  static inline Distance distance(const Metric &metric, const Vector &v1, ConstRef_Distance v1_norm, const Vector &v2, ConstRef_Distance v2_norm);
+};
+
+} // namespace kche_tree
+
+// Template implementation.
+#include "dot_products.tpp"
+
+#endif
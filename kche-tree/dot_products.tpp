@@ -0,0 +1,106 @@
+/***************************************************************************
+ *   Copyright (C) 2011, 2012 by Leandro Graciá Gil                        *
+ *   leandro.gracia.gil@gmail.com                                          *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/**
+ * \file dot_products.tpp
+ * \brief Template implementation of the Euclidean distances expanded in terms of squared norms and dot products.
+ * \author Leandro Graciá Gil
+ */
+
+// Include STL numeric limits.
+#include <limits>
+
+namespace kche_tree {
+
+// Static data.
+template <typename T, unsigned int D, typename M, bool U>
+const bool DotProductDistance<T, D, M, U>::enabled;
+
+template <typename T, unsigned int D, typename M>
+const bool DotProductDistance<T, D, M, true>::enabled;
+
+/**
+ * \brief Calculate the squared norm of a vector.
+ *
+ * \param v Feature vector.
+ * \return Squared norm of \a v.
+ */
+template <typename T, unsigned int D, typename M>
+typename DotProductDistance<T, D, M, true>::Distance DotProductDistance<T, D, M, true>::squared_norm(const Vector &v) {
+  const T *x = v.data();
+  Distance norm = Traits<Distance>::zero();
+  for (unsigned int d=0; d<D; ++d)
+    norm += x[d] * x[d];
+  return norm;
+}
+
+/**
+ * \brief Calculate the squared norms of all the vectors in a data set.
+ *
+ * \param data Data set. Vectors are accessed in their permuted order.
+ * \param norms Vector where the squared norms are returned.
+ */
+template <typename T, unsigned int D, typename M> template <typename DataSet>
+void DotProductDistance<T, D, M, true>::squared_norms(const DataSet &data, std::vector<Distance> &norms) {
+  norms.resize(data.size());
+  for (unsigned int i=0; i<data.size(); ++i)
+    norms[i] = squared_norm(data.get_permuted(i));
+}
+
+/**
+ * \brief Bound of the relative rounding error of the expansion with respect to the sum of the squared norms.
+ *
+ * Includes the accumulation errors of the norms, the dot product and the metric itself.
+ */
+template <typename T, unsigned int D, typename M>
+typename DotProductDistance<T, D, M, true>::Distance DotProductDistance<T, D, M, true>::relative_error() {
+  return (4 * D + 4) * std::numeric_limits<Distance>::epsilon();
+}
+
+/**
+ * \brief Calculate the squared Euclidean distance between two vectors using their squared norms.
+ *
+ * \param metric Metric functor. Only used to recalculate distances affected by cancellation.
+ * \param v1 First feature vector.
+ * \param v1_norm Squared norm of \a v1.
+ * \param v2 Second feature vector.
+ * \param v2_norm Squared norm of \a v2.
+ * \return Squared Euclidean distance between the two vectors.
+ */
+template <typename T, unsigned int D, typename M>
+typename DotProductDistance<T, D, M, true>::Distance DotProductDistance<T, D, M, true>::distance(const M &metric,
+    const Vector &v1, ConstRef_Distance v1_norm, const Vector &v2, ConstRef_Distance v2_norm) {
+
+  const T *a = v1.data();
+  const T *b = v2.data();
+  Distance dot = Traits<Distance>::zero();
+  for (unsigned int d=0; d<D; ++d)
+    dot += a[d] * b[d];
+
+  // Recalculate the distance if it is not clearly above the rounding error of the expansion.
+  Distance norms = v1_norm + v2_norm;
+  Distance distance = norms - 2 * dot;
+  if (!(distance > relative_error() * norms))
+    return metric(v1, v2);
+
+  return distance;
+}
+
+} // namespace kche_tree
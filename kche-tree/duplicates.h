@@ -0,0 +1,71 @@
+/***************************************************************************
+ *   Copyright (C) 2011, 2012 by Leandro Graciá Gil                        *
+ *   leandro.gracia.gil@gmail.com                                          *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/**
+ * \file duplicates.h
+ * \brief Groups of identical vectors collapsed into a single point of a kd-tree.
+ * \author Leandro Graciá Gil
+ */
+
+#ifndef _KCHE_TREE_DUPLICATES_H_
+#define _KCHE_TREE_DUPLICATES_H_
+
+// Include fixed size integer types and STL vectors.
+#include <stdint.h>
+#include <vector>
+
+#include "endianness.h"
+
+namespace kche_tree {
+
+/**
+ * \brief Original indices of the groups of identical vectors stored only once in a kd-tree.
+ *
+ * Each group corresponds to one of the distinct vectors of a set, numbered in the order of their first occurrence.
+ * The indices of each group are sorted, so its first one is always the first occurrence of the vector.
+ */
+class Duplicates {
+public:
+  // Grouping.
+  template <typename DataSet>
+  bool group(const DataSet &data, std::vector<unsigned int> &representatives);
+  void clear();
+
+  // Access to the groups.
+  unsigned int num_groups() const { return offsets_.empty() ? 0 : static_cast<unsigned int>(offsets_.size() - 1); } ///< Number of distinct vectors.
+  unsigned int num_indices() const { return static_cast<unsigned int>(indices_.size()); } ///< Number of vectors in all the groups.
+  unsigned int count(unsigned int group) const { return offsets_[group + 1] - offsets_[group]; } ///< Number of identical vectors in a group.
+  const uint32_t *indices(unsigned int group) const { return &indices_[offsets_[group]]; } ///< Sorted original indices of the vectors in a group.
+
+  // Serialization.
+  void serialize(std::ostream &out) const;
+  void deserialize(std::istream &in, Endianness::Type endianness);
+
+private:
+  std::vector<uint32_t> offsets_; ///< Position of the first index of each group, followed by the total number of indices.
+  std::vector<uint32_t> indices_; ///< Original indices of the vectors in each group, stored contiguously.
+};
+
+} // namespace kche_tree
+
+// Template implementation.
+#include "duplicates.tpp"
+
+#endif
@@ -0,0 +1,183 @@
+/***************************************************************************
+ *   Copyright (C) 2011, 2012 by Leandro Graciá Gil                        *
+ *   leandro.gracia.gil@gmail.com                                          *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/**
+ * \file duplicates.tpp
+ * \brief Template implementation of the groups of identical vectors collapsed into a single point of a kd-tree.
+ * \author Leandro Graciá Gil
+ */
+
+// Include STL algorithms and exceptions.
+#include <algorithm>
+#include <stdexcept>
+
+#include "traits.h"
+
+namespace kche_tree {
+
+/// Lexicographical comparison of the vectors of a data set by their indices. Ties are broken by index.
+template <typename DataSet>
+struct LexicographicalIndexComparer {
+  const DataSet &data; ///< Data set containing the vectors.
+
+  /// Check if the vector with index \a i1 goes before the one with index \a i2.
+  bool operator () (unsigned int i1, unsigned int i2) const {
+    const typename DataSet::Vector &v1 = data[i1], &v2 = data[i2];
+    for (unsigned int d=0; d<DataSet::Dimensions; ++d) {
+      if (v1[d] < v2[d])
+        return true;
+      if (v2[d] < v1[d])
+        return false;
+    }
+    return i1 < i2;
+  }
+
+  /// Check if the vectors with indices \a i1 and \a i2 are identical, that is, if no element of one is less than the corresponding one of the other.
+  bool identical(unsigned int i1, unsigned int i2) const {
+    const typename DataSet::Vector &v1 = data[i1], &v2 = data[i2];
+    for (unsigned int d=0; d<DataSet::Dimensions; ++d) {
+      if (v1[d] < v2[d] || v2[d] < v1[d])
+        return false;
+    }
+    return true;
+  }
+};
+
+/**
+ * \brief Group the identical vectors of a data set.
+ *
+ * Vectors are sorted lexicographically, which costs O(n log n) vector comparisons and only requires the < operator of the elements.
+ * The existing groups are only replaced if any identical vectors are found.
+ *
+ * \param data Data set whose vectors are grouped.
+ * \param representatives Vector where the index of the first occurrence of each distinct vector is returned, in increasing order.
+ * \return \c true if there are any identical vectors, \c false otherwise.
+ */
+template <typename DataSet>
+bool Duplicates::group(const DataSet &data, std::vector<unsigned int> &representatives) {
+
+  // Sort the indices so that identical vectors are contiguous and sorted by index.
+  const unsigned int size = data.size();
+  std::vector<unsigned int> order(size);
+  for (unsigned int i=0; i<size; ++i)
+    order[i] = i;
+  LexicographicalIndexComparer<DataSet> comparer = { data };
+  std::sort(order.begin(), order.end(), comparer);
+
+  // Find the runs of identical vectors, marking the first occurrence of each one with the position where its run starts.
+  const unsigned int not_first = static_cast<unsigned int>(-1);
+  std::vector<unsigned int> run_start(size, not_first);
+  unsigned int num_groups = 0;
+  for (unsigned int i=0; i<size; ++i) {
+    if (i > 0 && comparer.identical(order[i - 1], order[i]))
+      continue;
+    run_start[order[i]] = i;
+    ++num_groups;
+  }
+
+  if (num_groups == size)
+    return false;
+
+  // Number the groups by their first occurrence and store their indices contiguously.
+  representatives.clear();
+  representatives.reserve(num_groups);
+  offsets_.resize(num_groups + 1);
+  indices_.resize(size);
+  unsigned int num_indices = 0;
+  for (unsigned int i=0; i<size; ++i) {
+    if (run_start[i] == not_first)
+      continue;
+
+    offsets_[representatives.size()] = num_indices;
+    representatives.push_back(i);
+    unsigned int position = run_start[i];
+    do {
+      indices_[num_indices++] = order[position++];
+    } while (position < size && comparer.identical(i, order[position]));
+  }
+  offsets_[num_groups] = num_indices;
+  KCHE_TREE_DCHECK(num_indices == size);
+
+  return true;
+}
+
+/**
+ * \brief Remove all the groups.
+ */
+inline void Duplicates::clear() {
+  offsets_.clear();
+  indices_.clear();
+}
+
+/**
+ * \brief Serialize the groups into an output stream.
+ *
+ * \param out Output stream.
+ * \exception std::runtime_error Thrown in case of error.
+ */
+inline void Duplicates::serialize(std::ostream &out) const {
+  kche_tree::serialize(static_cast<uint32_t>(num_groups()), out);
+  kche_tree::serialize(static_cast<uint32_t>(num_indices()), out);
+  for (unsigned int i=0; i<offsets_.size(); ++i)
+    kche_tree::serialize(offsets_[i], out);
+  for (unsigned int i=0; i<indices_.size(); ++i)
+    kche_tree::serialize(indices_[i], out);
+
+  if (!out.good())
+    throw std::runtime_error("error writing the groups of identical vectors");
+}
+
+/**
+ * \brief Read the groups from an input stream, checking their consistency.
+ *
+ * \param in Input stream.
+ * \param endianness Endianness of the serialized data.
+ * \exception std::runtime_error Thrown in case of error or if the groups are not consistent.
+ */
+inline void Duplicates::deserialize(std::istream &in, Endianness::Type endianness) {
+  uint32_t num_groups = 0, num_indices = 0;
+  kche_tree::deserialize(num_groups, in, endianness);
+  kche_tree::deserialize(num_indices, in, endianness);
+  if (!in.good() || num_groups == 0 || num_groups > num_indices)
+    throw std::runtime_error("error reading the groups of identical vectors");
+
+  offsets_.resize(num_groups + 1);
+  indices_.resize(num_indices);
+  for (unsigned int i=0; i<offsets_.size(); ++i)
+    kche_tree::deserialize(offsets_[i], in, endianness);
+  for (unsigned int i=0; i<indices_.size(); ++i)
+    kche_tree::deserialize(indices_[i], in, endianness);
+  if (!in.good())
+    throw std::runtime_error("error reading the groups of identical vectors");
+
+  // Each group must have at least one index, and all the indices must be used.
+  for (unsigned int g=0; g<num_groups; ++g) {
+    if (!(offsets_[g] < offsets_[g + 1]))
+      throw std::runtime_error("invalid groups of identical vectors");
+  }
+  if (offsets_[0] != 0 || offsets_[num_groups] != num_indices)
+    throw std::runtime_error("invalid groups of identical vectors");
+  for (unsigned int i=0; i<num_indices; ++i) {
+    if (indices_[i] >= num_indices)
+      throw std::runtime_error("invalid groups of identical vectors");
+  }
+}
+
+} // namespace kche_tree
@@ -0,0 +1,76 @@
+/***************************************************************************
+ *   Copyright (C) 2011, 2012 by Leandro Graciá Gil                        *
+ *   leandro.gracia.gil@gmail.com                                          *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/**
+ * \file eigen_decomposition.h
+ * \brief Eigendecomposition of symmetric matrices.
+ * \author Leandro Graciá Gil
+ */
+
+#ifndef _KCHE_TREE_EIGEN_DECOMPOSITION_H_
+#define _KCHE_TREE_EIGEN_DECOMPOSITION_H_
+
+// Include STL vectors.
+#include <vector>
+
+#include "symmetric_matrix.h"
+
+namespace kche_tree {
+
+/**
+ * \brief Eigendecomposition A = V diag(λ) V' of a symmetric matrix.
+ *
+ * The matrix is reduced to tridiagonal form with Householder reflections and then diagonalized with the implicit QL method.
+ * Calculations are performed in double precision and the eigenvectors are stored by rows, so that the rotations
+ * of the QL iterations operate on contiguous data. Eigenvalues are sorted in decreasing order.
+ *
+ * \note Only available for floating point types, as square roots are required.
+ * \tparam U Data type of the elements in the matrix.
+ */
+template <typename U>
+class EigenDecomposition {
+public:
+  /// Type of the elements in the matrix.
+  typedef U Element;
+
+  // Constructor.
+  EigenDecomposition();
+
+  // Decomposition.
+  bool decompose(const SymmetricMatrix<U> &matrix);
+  void clear();
+
+  // Access to the results.
+  unsigned int size() const { return size_; } ///< Size of the decomposed matrix, or 0 if no matrix is decomposed.
+  const U &eigenvalue(unsigned int index) const { return eigenvalues_[index]; } ///< Eigenvalue of the given index, in decreasing order.
+  const U *eigenvector(unsigned int index) const { return &eigenvectors_[index * size_]; } ///< Unit eigenvector associated to the eigenvalue of the same index.
+
+private:
+  unsigned int size_; ///< Size of the decomposed matrix.
+  std::vector<U> eigenvalues_; ///< Eigenvalues in decreasing order.
+  std::vector<U> eigenvectors_; ///< Unit eigenvectors stored by rows in the order of their eigenvalues.
+};
+
+} // namespace kche_tree
+
+// Template implementation.
+#include "eigen_decomposition.tpp"
+
+#endif
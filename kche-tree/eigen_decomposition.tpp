@@ -0,0 +1,345 @@
+/***************************************************************************
+ *   Copyright (C) 2011, 2012 by Leandro Graciá Gil                        *
+ *   leandro.gracia.gil@gmail.com                                          *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/**
+ * \file eigen_decomposition.tpp
+ * \brief Template implementations for the eigendecomposition of symmetric matrices.
+ * \author Leandro Graciá Gil
+ */
+
+// Include STL algorithms and C math functions.
+#include <algorithm>
+#include <cmath>
+
+// Include traits.
+#include "traits.h"
+
+namespace kche_tree {
+
+/**
+ * \brief Solver of the eigendecomposition of symmetric matrices.
+ *
+ * Generic version for types without square roots. The decomposition is not available for them.
+ */
+template <typename U, bool is_floating_point = IsArithmetic<U>::value && !IsIntegral<U>::value>
+struct SymmetricEigenSolver {
+  /// The decomposition is not available for this type.
+  static bool solve(const SymmetricMatrix<U> &matrix, std::vector<U> &eigenvalues, std::vector<U> &eigenvectors) { return false; }
+};
+
+/**
+ * \brief Solver of the eigendecomposition of symmetric matrices. Version for floating point types.
+ *
+ * Based on the tred2 and tql2 routines of EISPACK, as adapted by the public domain JAMA library.
+ */
+template <typename U>
+struct SymmetricEigenSolver<U, true> {
+
+  /// Calculate sqrt(a² + b²) avoiding overflows and underflows.
+  static double hypot(double a, double b) {
+    a = std::fabs(a);
+    b = std::fabs(b);
+    if (a < b)
+      std::swap(a, b);
+    if (a == 0.0)
+      return 0.0;
+    double ratio = b / a;
+    return a * std::sqrt(1.0 + ratio * ratio);
+  }
+
+  /**
+   * \brief Reduce a symmetric matrix to tridiagonal form with Householder reflections.
+   *
+   * \param n Size of the matrix.
+   * \param v Matrix to reduce stored by rows. Replaced by the accumulated orthogonal transformation.
+   * \param d Array of \a n values where the diagonal of the tridiagonal matrix is returned.
+   * \param e Array of \a n values where the subdiagonal of the tridiagonal matrix is returned, starting at index 1.
+   */
+  static void tridiagonalize(unsigned int n, double *v, double *d, double *e) {
+
+    for (unsigned int j=0; j<n; ++j)
+      d[j] = v[(n - 1) * n + j];
+
+    for (unsigned int i=n-1; i>0; --i) {
+
+      // Scale to avoid under/overflow.
+      double scale = 0.0, h = 0.0;
+      for (unsigned int k=0; k<i; ++k)
+        scale += std::fabs(d[k]);
+
+      if (scale == 0.0) {
+        e[i] = d[i - 1];
+        for (unsigned int j=0; j<i; ++j) {
+          d[j] = v[(i - 1) * n + j];
+          v[i * n + j] = 0.0;
+          v[j * n + i] = 0.0;
+        }
+      } else {
+
+        // Generate the Householder vector.
+        for (unsigned int k=0; k<i; ++k) {
+          d[k] /= scale;
+          h += d[k] * d[k];
+        }
+
+        double f = d[i - 1];
+        double g = std::sqrt(h);
+        if (f > 0.0)
+          g = -g;
+        e[i] = scale * g;
+        h -= f * g;
+        d[i - 1] = f - g;
+        for (unsigned int j=0; j<i; ++j)
+          e[j] = 0.0;
+
+        // Apply the similarity transformation to the remaining columns.
+        for (unsigned int j=0; j<i; ++j) {
+          f = d[j];
+          v[j * n + i] = f;
+          g = e[j] + v[j * n + j] * f;
+          for (unsigned int k=j+1; k<i; ++k) {
+            g += v[k * n + j] * d[k];
+            e[k] += v[k * n + j] * f;
+          }
+          e[j] = g;
+        }
+
+        f = 0.0;
+        for (unsigned int j=0; j<i; ++j) {
+          e[j] /= h;
+          f += e[j] * d[j];
+        }
+
+        double hh = f / (h + h);
+        for (unsigned int j=0; j<i; ++j)
+          e[j] -= hh * d[j];
+
+        for (unsigned int j=0; j<i; ++j) {
+          f = d[j];
+          g = e[j];
+          for (unsigned int k=j; k<i; ++k)
+            v[k * n + j] -= f * e[k] + g * d[k];
+          d[j] = v[(i - 1) * n + j];
+          v[i * n + j] = 0.0;
+        }
+      }
+      d[i] = h;
+    }
+
+    // Accumulate the transformations.
+    for (unsigned int i=0; i+1<n; ++i) {
+      v[(n - 1) * n + i] = v[i * n + i];
+      v[i * n + i] = 1.0;
+      double h = d[i + 1];
+      if (h != 0.0) {
+        for (unsigned int k=0; k<=i; ++k)
+          d[k] = v[k * n + i + 1] / h;
+        for (unsigned int j=0; j<=i; ++j) {
+          double g = 0.0;
+          for (unsigned int k=0; k<=i; ++k)
+            g += v[k * n + i + 1] * v[k * n + j];
+          for (unsigned int k=0; k<=i; ++k)
+            v[k * n + j] -= g * d[k];
+        }
+      }
+      for (unsigned int k=0; k<=i; ++k)
+        v[k * n + i + 1] = 0.0;
+    }
+
+    for (unsigned int j=0; j<n; ++j) {
+      d[j] = v[(n - 1) * n + j];
+      v[(n - 1) * n + j] = 0.0;
+    }
+    v[(n - 1) * n + n - 1] = 1.0;
+    e[0] = 0.0;
+  }
+
+  /**
+   * \brief Diagonalize a symmetric tridiagonal matrix with the implicit QL method.
+   *
+   * \param n Size of the matrix.
+   * \param w Orthogonal transformation of the tridiagonalization stored by columns. Replaced by the eigenvectors stored by rows.
+   * \param d Diagonal of the tridiagonal matrix. Replaced by the eigenvalues.
+   * \param e Subdiagonal of the tridiagonal matrix, starting at index 1. Destroyed.
+   * \return \c true if successful, \c false if the method did not converge.
+   */
+  static bool diagonalize(unsigned int n, double *w, double *d, double *e) {
+
+    for (unsigned int i=1; i<n; ++i)
+      e[i - 1] = e[i];
+    e[n - 1] = 0.0;
+
+    const unsigned int max_iterations = 64;
+    const double epsilon = std::pow(2.0, -52.0);
+    double f = 0.0, tst1 = 0.0;
+    for (unsigned int l=0; l<n; ++l) {
+
+      // Find a small subdiagonal element.
+      tst1 = std::max(tst1, std::fabs(d[l]) + std::fabs(e[l]));
+      unsigned int m = l;
+      while (m < n - 1 && std::fabs(e[m]) > epsilon * tst1)
+        ++m;
+
+      // If m == l, d[l] is already an eigenvalue. Otherwise, iterate.
+      unsigned int iteration = 0;
+      while (m > l) {
+        if (++iteration > max_iterations)
+          return false;
+
+        // Compute the implicit shift.
+        double g = d[l];
+        double p = (d[l + 1] - g) / (2.0 * e[l]);
+        double r = hypot(p, 1.0);
+        if (p < 0.0)
+          r = -r;
+        d[l] = e[l] / (p + r);
+        d[l + 1] = e[l] * (p + r);
+        double dl1 = d[l + 1];
+        double h = g - d[l];
+        for (unsigned int i=l+2; i<n; ++i)
+          d[i] -= h;
+        f += h;
+
+        // Implicit QL transformation.
+        p = d[m];
+        double c = 1.0, c2 = c, c3 = c;
+        double el1 = e[l + 1];
+        double s = 0.0, s2 = 0.0;
+        for (unsigned int i=m; i-->l; ) {
+          c3 = c2;
+          c2 = c;
+          s2 = s;
+          g = c * e[i];
+          h = c * p;
+          r = hypot(p, e[i]);
+          e[i + 1] = s * r;
+          s = e[i] / r;
+          c = p / r;
+          p = c * d[i] - s * g;
+          d[i + 1] = h + s * (c * g + s * d[i]);
+
+          // Accumulate the rotation in the eigenvectors.
+          double *w_i = w + i * n, *w_i1 = w_i + n;
+          for (unsigned int k=0; k<n; ++k) {
+            h = w_i1[k];
+            w_i1[k] = s * w_i[k] + c * h;
+            w_i[k] = c * w_i[k] - s * h;
+          }
+        }
+        p = -s * s2 * c3 * el1 * e[l] / dl1;
+        e[l] = s * p;
+        d[l] = c * p;
+
+        // Check for convergence.
+        if (!(std::fabs(e[l]) > epsilon * tst1))
+          break;
+      }
+      d[l] += f;
+      e[l] = 0.0;
+    }
+
+    return true;
+  }
+
+  /**
+   * \brief Calculate the eigenvalues and unit eigenvectors of a symmetric matrix.
+   *
+   * \param matrix Matrix to decompose.
+   * \param eigenvalues Eigenvalues of the matrix in decreasing order.
+   * \param eigenvectors Unit eigenvectors of the matrix stored by rows.
+   * \return \c true if successful, \c false if the method did not converge.
+   */
+  static bool solve(const SymmetricMatrix<U> &matrix, std::vector<U> &eigenvalues, std::vector<U> &eigenvectors) {
+
+    const unsigned int n = matrix.size();
+    std::vector<double> v(n * n), w(n * n), d(n), e(n);
+    for (unsigned int j=0; j<n; ++j)
+      for (unsigned int i=0; i<n; ++i)
+        v[j * n + i] = matrix(j, i);
+
+    tridiagonalize(n, &v[0], &d[0], &e[0]);
+
+    // Transpose the transformation so that each eigenvector is rotated as a contiguous row.
+    for (unsigned int j=0; j<n; ++j)
+      for (unsigned int i=0; i<n; ++i)
+        w[i * n + j] = v[j * n + i];
+
+    if (!diagonalize(n, &w[0], &d[0], &e[0]))
+      return false;
+
+    // Sort the eigenvalues in decreasing order.
+    std::vector<unsigned int> order(n);
+    for (unsigned int i=0; i<n; ++i)
+      order[i] = i;
+    for (unsigned int i=0; i<n; ++i) {
+      unsigned int largest = i;
+      for (unsigned int j=i+1; j<n; ++j)
+        if (d[order[j]] > d[order[largest]])
+          largest = j;
+      std::swap(order[i], order[largest]);
+    }
+
+    eigenvalues.resize(n);
+    eigenvectors.resize(n * n);
+    for (unsigned int i=0; i<n; ++i) {
+      eigenvalues[i] = static_cast<U>(d[order[i]]);
+      const double *row = &w[order[i] * n];
+      for (unsigned int k=0; k<n; ++k)
+        eigenvectors[i * n + k] = static_cast<U>(row[k]);
+    }
+
+    return true;
+  }
+};
+
+/// Create an empty decomposition.
+template <typename U>
+EigenDecomposition<U>::EigenDecomposition() : size_(0) {}
+
+/**
+ * \brief Calculate the eigendecomposition of a symmetric matrix.
+ *
+ * \note Existing results are cleared if the decomposition fails.
+ *
+ * \param matrix Matrix to decompose.
+ * \return \c true if successful, \c false if the decomposition is not available for the element type or did not converge.
+ */
+template <typename U>
+bool EigenDecomposition<U>::decompose(const SymmetricMatrix<U> &matrix) {
+
+  clear();
+  if (matrix.size() == 0 || !SymmetricEigenSolver<U>::solve(matrix, eigenvalues_, eigenvectors_)) {
+    clear();
+    return false;
+  }
+
+  size_ = matrix.size();
+  return true;
+}
+
+/// Discard any decomposition results.
+template <typename U>
+void EigenDecomposition<U>::clear() {
+  size_ = 0;
+  eigenvalues_.clear();
+  eigenvectors_.clear();
+}
+
+} // namespace kche_tree
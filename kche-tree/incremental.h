@@ -38,6 +38,7 @@ namespace kche_tree {
 template <typename T, unsigned int D, typename M> class KDSearch;
 template <typename T, unsigned int D> class EuclideanMetric;
 template <typename T, unsigned int D> class MahalanobisMetric;
+template <typename T, unsigned int D> class PeriodicEuclideanMetric;
 
 /**
  * \brief Provide the basic operations for an axis-based incremental hyperrectangle distance calculation.
@@ -129,7 +130,8 @@ public:
 
 /**
  * \brief Perform an incremental hyperrectangle distance update based on the Mahalanobis metric.
- * The cost of the update will be considerably reduced if the inverse covariance matrix associated with the metric object used is diagonal.
+ * The cost of the update will be considerably reduced if the inverse covariance matrix associated with the metric object used is diagonal,
+ * or approximated as a diagonal plus a low-rank matrix.
  *
  * \tparam T Type of the elements used. The operators +=, -= and *= are required for this type in addition to the ones required by IncrementalBase.
  * \tparam D Number of dimensions in the vectors.
@@ -140,10 +142,86 @@ public:
   /// Metric associated with this incremental calculation.
   typedef MahalanobisMetric<T, D> Metric;
 
+  /// Base incremental calculation type.
+  typedef IncrementalBase<T, D, Metric> Base;
+
+  /// Alias for the associated distance type.
+  typedef typename Traits<T>::Distance Distance;
+
+  /// Extra data required in the KDSearch struct by the Mahalanobis incremental calculations.
+  struct SearchData : Base::SearchData {
+    /// Projections of the difference between the reference point and the nearest point in the hyperrectangle on each low-rank factor of the metric.
+    /// Only used if the metric has a low-rank covariance.
+    Distance projections[D];
+
+    /// Fill per-axis data contents and reset the projections.
+    SearchData(const typename Base::Vector &p, const typename Base::DataSet &data);
+  };
+
+  /// Type of the data extension applied to the KDSearch object for incremental calculations.
+  typedef SearchData SearchExtras;
+
   MahalanobisIncrementalUpdater(const KDNode<T, D> *node, const KDNode<T, D> *parent, KDSearch<T, D, Metric> &search_data);
   ~MahalanobisIncrementalUpdater();
 };
 
+/**
+ * \brief Perform an incremental hyperrectangle distance update based on the periodic Euclidean metric.
+ *
+ * Unlike the other updaters, both bounds of the hyperrectangle are kept for each axis, since the nearest point of a region
+ * in a periodic box can be at either side of it depending on the wrap-around. Axes with a single bound set are never
+ * farther than zero, as their regions cover all the periodic images of the axis.
+ *
+ * \tparam T Type of the elements used. The operators +=, -=, *=, < and > are required for this type.
+ * \tparam D Number of dimensions in the vectors.
+ */
+template <typename T, const unsigned int D>
+class PeriodicEuclideanIncrementalUpdater {
+public:
+  /// Metric associated with this incremental calculation.
+  typedef PeriodicEuclideanMetric<T, D> Metric;
+
+  /// Alias for the associated distance type.
+  typedef typename Traits<T>::Distance Distance;
+
+  /// Alias for compatible non-labeled data sets.
+  typedef typename kche_tree::DataSet<T, D> DataSet;
+
+  /// Alias for the compatible feature vectors.
+  typedef typename kche_tree::Vector<T, D> Vector;
+
+  /// Extra data required in the KDSearch struct by the periodic incremental calculations.
+  struct SearchData {
+
+    /// Per-axis reference point and hyperrectangle bounds.
+    struct AxisData {
+      T p; ///< Per-axis reference input point.
+      T lower; ///< Lower bound of the current hyperrectangle, if set.
+      T upper; ///< Upper bound of the current hyperrectangle, if set.
+      bool has_lower; ///< Flag indicating if the lower bound is set.
+      bool has_upper; ///< Flag indicating if the upper bound is set.
+      Distance distance; ///< Squared distance along the axis from the reference point to the nearest periodic image of the hyperrectangle.
+    } axis[D]; ///< Per-axis data defined this way to reduce cache misses.
+
+    /// Fill per-axis data contents with an unbounded hyperrectangle.
+    SearchData(const Vector &p, const DataSet &data);
+  };
+
+  /// Type of the data extension applied to the KDSearch object for incremental calculations.
+  typedef SearchData SearchExtras;
+
+  PeriodicEuclideanIncrementalUpdater(const KDNode<T, D> *node, const KDNode<T, D> *parent, KDSearch<T, D, Metric> &search_data);
+  ~PeriodicEuclideanIncrementalUpdater();
+
+private:
+  static Distance axis_distance(const typename SearchData::AxisData &axis_data, const Distance &box_length);
+
+  KDSearch<T, D, Metric> &search_data_; ///< Reference to the search data being used.
+  unsigned int parent_axis_; ///< Axis that defines the hyperspace splitting.
+  bool modified_; ///< Flag indicating if the values were modified as part of the incremental update.
+  typename SearchData::AxisData previous_axis_; ///< Previous data of the local axis.
+  Distance previous_hyperrect_distance_; ///< Previous value of the distance to the nearest point in the hyperrectangle.
+};
 
 } // namespace kche_tree
 
@@ -151,5 +229,6 @@ public:
 #include "incremental.tpp"
 #include "incremental_euclidean.tpp"
 #include "incremental_mahalanobis.tpp"
+#include "incremental_periodic.tpp"
 
 #endif
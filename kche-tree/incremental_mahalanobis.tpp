@@ -46,7 +46,7 @@ struct MahalanobisIncrementalFunctor {
   /// Use optimized const reference types.
   typedef typename RParam<T>::Type ConstRef_T;
 
-  inline Distance& operator () (Distance &current_distance, unsigned int axis, ConstRef_T split_value, const KDSearch<T, D, Metric> &search_data) const;
+  inline Distance& operator () (Distance &current_distance, unsigned int axis, ConstRef_T split_value, KDSearch<T, D, Metric> &search_data) const;
 };
 
 /**
@@ -67,7 +67,7 @@ struct MahalanobisIncrementalFunctor {
  * \return The reference to the current distance to the hyperrectangle. Should have been updated.
  */
 template <typename T, const unsigned int D>
-typename MahalanobisIncrementalFunctor<T, D>::Distance& MahalanobisIncrementalFunctor<T, D>::operator () (Distance &current_distance, unsigned int axis, ConstRef_T split_value, const KDSearch<T, D, Metric> &search_data) const {
+typename MahalanobisIncrementalFunctor<T, D>::Distance& MahalanobisIncrementalFunctor<T, D>::operator () (Distance &current_distance, unsigned int axis, ConstRef_T split_value, KDSearch<T, D, Metric> &search_data) const {
 
   // Equivalent to:
   //  Distance inc_axis = search_data.axis[axis].nearest - split_value;
@@ -76,6 +76,40 @@ typename MahalanobisIncrementalFunctor<T, D>::Distance& MahalanobisIncrementalFu
   Distance inc_axis = Traits<T>::distance(search_data.axis[axis].nearest, split_value);
   Distance cur_axis = Traits<T>::distance(search_data.axis[axis].p, search_data.axis[axis].nearest);
 
+  // With a low-rank covariance the distance is the diagonal part plus or minus the squared projections on the low-rank factors.
+  // The projections change along with the axis, each by the increment times the element of its factor for the axis.
+  if (search_data.metric.has_low_rank_covariance()) {
+
+    // Equivalent to: Distance acc = diagonal[axis] * (inc_axis + cur_axis * 2.0) * inc_axis;
+    Distance acc = cur_axis;
+    acc += cur_axis;
+    acc += inc_axis;
+    acc *= search_data.metric.low_rank_diagonal()[axis];
+    acc *= inc_axis;
+
+    const unsigned int rank = search_data.metric.low_rank();
+    const unsigned int num_positive = search_data.metric.num_positive_low_rank_factors();
+    const Distance *factors = search_data.metric.low_rank_axis_factors(axis);
+    for (unsigned int k=0; k<rank; ++k) {
+      // Equivalent to:
+      //  Distance delta = factors[k] * inc_axis;
+      //  acc ±= (projections[k] + delta)² - projections[k]² = delta * (projections[k] * 2.0 + delta);
+      Distance delta = factors[k];
+      delta *= inc_axis;
+      Distance temp = search_data.projections[k];
+      temp += search_data.projections[k];
+      temp += delta;
+      temp *= delta;
+      if (k < num_positive)
+        acc += temp;
+      else
+        acc -= temp;
+      search_data.projections[k] += delta;
+    }
+
+    return current_distance += acc;
+  }
+
   // Equivalent to: Distance acc = S(axis, axis) * (inc_axis + cur_axis * 2.0);
   Distance acc = cur_axis;
   acc += cur_axis;
@@ -107,6 +141,19 @@ typename MahalanobisIncrementalFunctor<T, D>::Distance& MahalanobisIncrementalFu
   return current_distance += acc;
 }
 
+/**
+ * Initialize the axis-specific data to the reference point and reset the low-rank projections.
+ *
+ * \param p Reference point.
+ * \param data Input data. Unused in this case.
+ */
+template <typename T, const unsigned int D>
+MahalanobisIncrementalUpdater<T, D>::SearchData::SearchData(const typename Base::Vector &p, const typename Base::DataSet &data)
+    : Base::SearchData(p, data) {
+  for (unsigned int k=0; k<D; ++k)
+    projections[k] = Traits<Distance>::zero();
+}
+
 /// Update the current incremental distance using the Mahalanobis metric.
 template <typename T, const unsigned int D>
 MahalanobisIncrementalUpdater<T, D>::MahalanobisIncrementalUpdater(const KDNode<T, D> *node, const KDNode<T, D> *parent, KDSearch<T, D, Metric> &search_data)
@@ -117,6 +164,19 @@ MahalanobisIncrementalUpdater<T, D>::MahalanobisIncrementalUpdater(const KDNode<
 /// Undo any incremental updates performed to the hyperrectangle distance.
 template <typename T, const unsigned int D>
 MahalanobisIncrementalUpdater<T, D>::~MahalanobisIncrementalUpdater() {
+
+  // Undo the update of the low-rank projections. The increment is the same used when updating, so it's calculated before restoring the axis.
+  if (this->modified_ && this->search_data_.metric.has_low_rank_covariance()) {
+    Distance inc_axis = Traits<T>::distance(this->previous_axis_nearest_, this->search_data_.axis[this->parent_axis_].nearest);
+    const unsigned int rank = this->search_data_.metric.low_rank();
+    const Distance *factors = this->search_data_.metric.low_rank_axis_factors(this->parent_axis_);
+    for (unsigned int k=0; k<rank; ++k) {
+      Distance delta = factors[k];
+      delta *= inc_axis;
+      this->search_data_.projections[k] -= delta;
+    }
+  }
+
   IncrementalBase<T, D, Metric>::restore();
 }
 
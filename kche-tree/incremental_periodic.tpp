@@ -0,0 +1,150 @@
+/***************************************************************************
+ *   Copyright (C) 2011, 2012 by Leandro Graciá Gil                        *
+ *   leandro.gracia.gil@gmail.com                                          *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/**
+ * \file incremental_periodic.tpp
+ * \brief Template implementations for incremental hyperrectangle intersection using the periodic Euclidean metric.
+ * \author Leandro Graciá Gil
+ */
+
+namespace kche_tree {
+
+/**
+ * Initialize the axis-specific data to the reference point and an unbounded hyperrectangle.
+ *
+ * \param p Reference point.
+ * \param data Input data. Unused in this case.
+ */
+template <typename T, const unsigned int D>
+PeriodicEuclideanIncrementalUpdater<T, D>::SearchData::SearchData(const Vector &p, const DataSet &data) {
+  for (unsigned int d=0; d<D; ++d) {
+    axis[d].p = p[d];
+    axis[d].lower = p[d];
+    axis[d].upper = p[d];
+    axis[d].has_lower = false;
+    axis[d].has_upper = false;
+    axis[d].distance = Traits<Distance>::zero();
+  }
+}
+
+/**
+ * \brief Calculate the squared distance along an axis from the reference point to the nearest periodic image of the hyperrectangle.
+ *
+ * Let \a p be the reference point and [\a lower, \a upper] the hyperrectangle along the axis, all within a window of length \a L.
+ * If \a p is below the hyperrectangle, its nearest image is either \a lower at \a lower - \a p or \a upper wrapped around at \a p + \a L - \a upper.
+ * Symmetrically, if \a p is above it the candidates are \a p - \a upper and \a lower + \a L - \a p.
+ * If one of the bounds is not set the periodic images of the hyperrectangle cover the whole axis.
+ *
+ * \param axis_data Reference point and hyperrectangle bounds along the axis.
+ * \param box_length Box length of the axis, or zero if not periodic.
+ * \return Squared distance along the axis.
+ */
+template <typename T, const unsigned int D>
+typename PeriodicEuclideanIncrementalUpdater<T, D>::Distance PeriodicEuclideanIncrementalUpdater<T, D>::axis_distance(const typename SearchData::AxisData &axis_data, const Distance &box_length) {
+
+  const bool periodic = box_length > Traits<Distance>::zero();
+  Distance gap = Traits<Distance>::zero();
+  if (axis_data.has_lower && axis_data.p < axis_data.lower) {
+    if (periodic && !axis_data.has_upper)
+      return Traits<Distance>::zero();
+    gap = Traits<T>::distance(axis_data.lower, axis_data.p);
+    if (periodic) {
+      Distance wrapped = Traits<T>::distance(axis_data.p, axis_data.upper);
+      wrapped += box_length;
+      if (wrapped < gap)
+        gap = wrapped;
+    }
+  } else if (axis_data.has_upper && axis_data.p > axis_data.upper) {
+    if (periodic && !axis_data.has_lower)
+      return Traits<Distance>::zero();
+    gap = Traits<T>::distance(axis_data.p, axis_data.upper);
+    if (periodic) {
+      Distance wrapped = Traits<T>::distance(axis_data.lower, axis_data.p);
+      wrapped += box_length;
+      if (wrapped < gap)
+        gap = wrapped;
+    }
+  }
+
+  gap *= gap;
+  return gap;
+}
+
+/**
+ * Update the current incremental distance using the periodic Euclidean metric.
+ * The hyperrectangle is bounded by the split value of the parent along its axis, and the distance along the axis is replaced.
+ *
+ * \param node Current node in the sub-hyperrectangular region.
+ * \param parent Parent node that halves the hyperspace in two.
+ * \param search_data Auxiliar data structure used for tree traversal and incremental calculations.
+ */
+template <typename T, const unsigned int D>
+PeriodicEuclideanIncrementalUpdater<T, D>::PeriodicEuclideanIncrementalUpdater(const KDNode<T, D> *node, const KDNode<T, D> *parent, KDSearch<T, D, Metric> &search_data)
+    : search_data_(search_data),
+      parent_axis_(0),
+      modified_(false),
+      previous_hyperrect_distance_(Traits<Distance>::zero()) {
+
+  // Check parent.
+  if (parent == NULL)
+    return;
+
+  // Get splitting axis data.
+  parent_axis_ = parent->axis & KDNode<T, D>::axis_mask;
+  typename SearchData::AxisData &axis_data = search_data.axis[parent_axis_];
+
+  // Check if current branch reduces the bounding hyperrectangle.
+  const bool is_left = parent->left_branch == node;
+  if (( is_left && axis_data.has_upper && !(parent->split_element < axis_data.upper)) ||
+      (!is_left && axis_data.has_lower && !(parent->split_element > axis_data.lower)))
+    return;
+
+  // Store current values before any update.
+  modified_ = true;
+  previous_axis_ = axis_data;
+  previous_hyperrect_distance_ = search_data.hyperrect_distance;
+
+  // Define the new boundaries of the hyperrectangle.
+  if (is_left) {
+    axis_data.upper = parent->split_element;
+    axis_data.has_upper = true;
+  } else {
+    axis_data.lower = parent->split_element;
+    axis_data.has_lower = true;
+  }
+
+  // Replace the distance along the axis.
+  axis_data.distance = axis_distance(axis_data, search_data.metric.box_lengths()[parent_axis_]);
+  search_data.hyperrect_distance -= previous_axis_.distance;
+  search_data.hyperrect_distance += axis_data.distance;
+}
+
+/// Undo any incremental updates performed to the hyperrectangle distance.
+template <typename T, const unsigned int D>
+PeriodicEuclideanIncrementalUpdater<T, D>::~PeriodicEuclideanIncrementalUpdater() {
+
+  // Restore previous values if modified.
+  if (modified_) {
+    search_data_.axis[parent_axis_] = previous_axis_;
+    search_data_.hyperrect_distance = previous_hyperrect_distance_;
+  }
+}
+
+} // namespace kche_tree
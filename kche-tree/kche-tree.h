@@ -79,6 +79,15 @@
  *   Defaults to 1024.
  * - \c KCHE_TREE_VERIFY_KDTREE_AFTER_DESERIALIZING: if enabled, the structural properties of the kd-tree are verified after loading it from a file.
  *   This can be disabled for performance reasons if set to \c false. Defaults to \c true.
+ * - \c KCHE_TREE_INTERLEAVED_SEARCH_WIDTH: number of queries advanced at the same time by the interleaved batch search engine.
+ *   Larger values hide more memory latency at the cost of more cache pressure. Defaults to 8.
+ * - \c KCHE_TREE_PACKET_SEARCH_WIDTH: number of queries traversing the tree together in the packet batch search engine.
+ *   Should be between 1 and 32. Defaults to 8.
+ * - \c KCHE_TREE_BOUND_CHECK_COST: cost of a boundary check in bounded distance calculations relative to accumulating one element
+ *   (one dimension, or one SSE register if enabled).
+ *   Used to select the cadence of the checks when calibrating a \link kche_tree::BoundCheckProfile BoundCheckProfile\endlink. Defaults to 1.
+ * - \c KCHE_TREE_BRANCH_MISPREDICTION_COST: cost of a mispredicted boundary check relative to accumulating one element.
+ *   Also used when calibrating the cadence of the checks. Defaults to 16.
  *
  * \section CPP1x About C++1x
  * Kche-trees use by default C++1x features available in the most modern compilers to enhance its use and operations.
@@ -129,6 +138,22 @@ namespace kche_tree {
 #define KCHE_TREE_VERIFY_KDTREE_AFTER_DESERIALIZING true
 #endif
 
+#if !defined(KCHE_TREE_INTERLEAVED_SEARCH_WIDTH)
+#define KCHE_TREE_INTERLEAVED_SEARCH_WIDTH 8
+#endif
+
+#if !defined(KCHE_TREE_PACKET_SEARCH_WIDTH)
+#define KCHE_TREE_PACKET_SEARCH_WIDTH 8
+#endif
+
+#if !defined(KCHE_TREE_BOUND_CHECK_COST)
+#define KCHE_TREE_BOUND_CHECK_COST 1
+#endif
+
+#if !defined(KCHE_TREE_BRANCH_MISPREDICTION_COST)
+#define KCHE_TREE_BRANCH_MISPREDICTION_COST 16
+#endif
+
 #if !defined(KCHE_TREE_ENABLE_SSE)
 #define KCHE_TREE_ENABLE_SSE false
 #endif
@@ -171,6 +196,18 @@ struct Settings {
   /// Enable SSE optimizations. Any specific required flags are assumed to be passed to the compiler.
   /// \warning This only works with some metrics, types (including accumulator types) and the number of dimensions should be a multiple of 4.
   static const bool enable_sse = KCHE_TREE_ENABLE_SSE;
+
+  /// Number of queries advanced at the same time by the interleaved batch search engine.
+  static const unsigned int interleaved_search_width = KCHE_TREE_INTERLEAVED_SEARCH_WIDTH;
+
+  /// Number of queries traversing the tree together in the packet batch search engine.
+  static const unsigned int packet_search_width = KCHE_TREE_PACKET_SEARCH_WIDTH;
+
+  /// Cost of a boundary check relative to accumulating one element of a distance, used when calibrating the cadence of the checks.
+  static const unsigned int bound_check_cost = KCHE_TREE_BOUND_CHECK_COST;
+
+  /// Cost of a mispredicted boundary check relative to accumulating one element of a distance, used when calibrating the cadence of the checks.
+  static const unsigned int branch_misprediction_cost = KCHE_TREE_BRANCH_MISPREDICTION_COST;
 };
 
 } // namespace kche_tree
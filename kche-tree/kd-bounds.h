@@ -0,0 +1,100 @@
+/***************************************************************************
+ *   Copyright (C) 2011, 2012 by Leandro Graciá Gil                        *
+ *   leandro.gracia.gil@gmail.com                                          *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/**
+ * \file kd-bounds.h
+ * \brief Template for a flat copy of the kd-tree hierarchy with the bounding box of each branch.
+ * \author Leandro Graciá Gil
+ */
+
+#ifndef _KCHE_TREE_KD_BOUNDS_H_
+#define _KCHE_TREE_KD_BOUNDS_H_
+
+// Include fixed size integer types and STL vectors.
+#include <stdint.h>
+#include <vector>
+
+#include "dataset.h"
+
+namespace kche_tree {
+
+/**
+ * \brief Flat copy of the hierarchy of a kd-tree with the tight bounding box and weight of each branch.
+ *
+ * Used by dual-tree algorithms, where the regions of two branches have to be compared without
+ * tracking the split values of their ancestors. Branches are stored in depth-first order, so the root is always the first one.
+ *
+ * \tparam ElementType Type of the elements in the feature vectors.
+ * \tparam NumDimensions Number of dimensions of the feature vectors.
+ */
+template <typename ElementType, unsigned int NumDimensions>
+class KDBounds {
+public:
+  /// Type of the elements in the feature vectors.
+  typedef ElementType Element;
+
+  /// Number of dimensions of the feature vectors.
+  static const unsigned int Dimensions = NumDimensions;
+
+  /// Alias of compatible non-labeled data sets.
+  typedef typename kche_tree::DataSet<Element, Dimensions> DataSet;
+
+  /// Range of points and children of a branch.
+  struct Branch {
+    uint32_t begin; ///< Permuted index of the first point in the branch.
+    uint32_t end; ///< Permuted index following the last point in the branch.
+    uint32_t weight; ///< Number of original vectors in the branch, including identical ones collapsed in the kd-tree.
+    uint32_t left; ///< Index of the left child branch. Zero if the branch is a leaf.
+    uint32_t right; ///< Index of the right child branch. Zero if the branch is a leaf.
+  };
+
+  // Construction from a kd-tree.
+  template <typename KDNode>
+  void build(const KDNode *root, const DataSet &data, const uint32_t *cumulative_counts = NULL);
+
+  // Access to the branches.
+  unsigned int size() const { return static_cast<unsigned int>(branches_.size()); } ///< Number of branches, including leaves.
+  const Branch &operator [] (unsigned int index) const { return branches_[index]; } ///< Access a branch by its index.
+  bool is_leaf(unsigned int index) const { return branches_[index].left == 0; } ///< Check if a branch is a leaf.
+  const Element *lower(unsigned int index) const { return &boxes_[2 * index * Dimensions]; } ///< Lower corner of the bounding box of a branch.
+  const Element *upper(unsigned int index) const { return &boxes_[(2 * index + 1) * Dimensions]; } ///< Upper corner of the bounding box of a branch.
+
+  // Squared Euclidean distances between boxes.
+  static double min_squared_distance(const Element *lower1, const Element *upper1, const Element *lower2, const Element *upper2);
+  static double max_squared_distance(const Element *lower1, const Element *upper1, const Element *lower2, const Element *upper2);
+
+private:
+  // Recursive construction.
+  template <typename KDNode>
+  uint32_t add_branch(const KDNode *node, const DataSet &data, const uint32_t *cumulative_counts);
+
+  template <typename KDLeaf>
+  uint32_t add_leaf(const KDLeaf *leaf, const DataSet &data, const uint32_t *cumulative_counts);
+
+  std::vector<Branch> branches_; ///< Branches in depth-first order.
+  std::vector<Element> boxes_; ///< Lower and upper corners of the bounding box of each branch, stored contiguously.
+};
+
+} // namespace kche_tree
+
+// Template implementation.
+#include "kd-bounds.tpp"
+
+#endif
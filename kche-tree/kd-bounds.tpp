@@ -0,0 +1,151 @@
+/***************************************************************************
+ *   Copyright (C) 2011, 2012 by Leandro Graciá Gil                        *
+ *   leandro.gracia.gil@gmail.com                                          *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/**
+ * \file kd-bounds.tpp
+ * \brief Template implementation for a flat copy of the kd-tree hierarchy with the bounding box of each branch.
+ * \author Leandro Graciá Gil
+ */
+
+namespace kche_tree {
+
+/**
+ * Build the flat hierarchy of a kd-tree, calculating the tight bounding box of each branch from its points.
+ *
+ * \tparam KDNode Type of the internal nodes of the kd-tree.
+ * \param root Root node of the kd-tree.
+ * \param data Permuted data stored by the kd-tree.
+ * \param cumulative_counts Number of original vectors before each permuted index, followed by the total. \c NULL if no vectors were collapsed.
+ */
+template <typename T, unsigned int D> template <typename KDNode>
+void KDBounds<T, D>::build(const KDNode *root, const DataSet &data, const uint32_t *cumulative_counts) {
+  branches_.clear();
+  boxes_.clear();
+  if (root)
+    add_branch(root, data, cumulative_counts);
+}
+
+/**
+ * Add an internal node and its descendants, merging the bounding boxes of its children.
+ *
+ * \return Index of the added branch.
+ */
+template <typename T, unsigned int D> template <typename KDNode>
+uint32_t KDBounds<T, D>::add_branch(const KDNode *node, const DataSet &data, const uint32_t *cumulative_counts) {
+  const uint32_t index = static_cast<uint32_t>(branches_.size());
+  branches_.push_back(Branch());
+  boxes_.resize(boxes_.size() + 2 * D);
+
+  const uint32_t left = (node->is_leaf & KDNode::left_bit) ?
+      add_leaf(node->left_leaf, data, cumulative_counts) : add_branch(node->left_branch, data, cumulative_counts);
+  const uint32_t right = (node->is_leaf & KDNode::right_bit) ?
+      add_leaf(node->right_leaf, data, cumulative_counts) : add_branch(node->right_branch, data, cumulative_counts);
+
+  Branch &branch = branches_[index];
+  branch.begin = branches_[left].begin;
+  branch.end = branches_[right].end;
+  branch.weight = branches_[left].weight + branches_[right].weight;
+  branch.left = left;
+  branch.right = right;
+
+  T *box_lower = &boxes_[2 * index * D], *box_upper = box_lower + D;
+  for (unsigned int d=0; d<D; ++d) {
+    box_lower[d] = lower(right)[d] < lower(left)[d] ? lower(right)[d] : lower(left)[d];
+    box_upper[d] = upper(right)[d] > upper(left)[d] ? upper(right)[d] : upper(left)[d];
+  }
+
+  return index;
+}
+
+/**
+ * Add a leaf node, calculating the bounding box of its points.
+ *
+ * \return Index of the added branch.
+ */
+template <typename T, unsigned int D> template <typename KDLeaf>
+uint32_t KDBounds<T, D>::add_leaf(const KDLeaf *leaf, const DataSet &data, const uint32_t *cumulative_counts) {
+  const uint32_t index = static_cast<uint32_t>(branches_.size());
+  Branch branch;
+  branch.begin = leaf->first_index;
+  branch.end = leaf->first_index + leaf->num_elements;
+  branch.weight = cumulative_counts ? cumulative_counts[branch.end] - cumulative_counts[branch.begin] : branch.end - branch.begin;
+  branch.left = branch.right = 0;
+  branches_.push_back(branch);
+  boxes_.resize(boxes_.size() + 2 * D);
+
+  if (branch.begin == branch.end)
+    return index;
+
+  T *box_lower = &boxes_[2 * index * D], *box_upper = box_lower + D;
+  const typename DataSet::Vector &first = data.get_permuted(branch.begin);
+  for (unsigned int d=0; d<D; ++d)
+    box_lower[d] = box_upper[d] = first[d];
+
+  for (unsigned int i=branch.begin + 1; i<branch.end; ++i) {
+    const typename DataSet::Vector &v = data.get_permuted(i);
+    for (unsigned int d=0; d<D; ++d) {
+      if (v[d] < box_lower[d])
+        box_lower[d] = v[d];
+      if (v[d] > box_upper[d])
+        box_upper[d] = v[d];
+    }
+  }
+
+  return index;
+}
+
+/**
+ * Calculate the minimum squared Euclidean distance between the points of two boxes.
+ * Points can be passed as boxes with identical corners.
+ *
+ * \return Minimum squared distance, zero if the boxes intersect.
+ */
+template <typename T, unsigned int D>
+double KDBounds<T, D>::min_squared_distance(const Element *lower1, const Element *upper1, const Element *lower2, const Element *upper2) {
+  double distance = 0.0;
+  for (unsigned int d=0; d<D; ++d) {
+    double gap = 0.0;
+    if (upper1[d] < lower2[d])
+      gap = static_cast<double>(lower2[d]) - static_cast<double>(upper1[d]);
+    else if (upper2[d] < lower1[d])
+      gap = static_cast<double>(lower1[d]) - static_cast<double>(upper2[d]);
+    distance += gap * gap;
+  }
+  return distance;
+}
+
+/**
+ * Calculate the maximum squared Euclidean distance between the points of two boxes.
+ *
+ * \return Maximum squared distance.
+ */
+template <typename T, unsigned int D>
+double KDBounds<T, D>::max_squared_distance(const Element *lower1, const Element *upper1, const Element *lower2, const Element *upper2) {
+  double distance = 0.0;
+  for (unsigned int d=0; d<D; ++d) {
+    double span1 = static_cast<double>(upper1[d]) - static_cast<double>(lower2[d]);
+    double span2 = static_cast<double>(upper2[d]) - static_cast<double>(lower1[d]);
+    double span = span1 > span2 ? span1 : span2;
+    distance += span * span;
+  }
+  return distance;
+}
+
+} // namespace kche_tree
@@ -0,0 +1,141 @@
+/***************************************************************************
+ *   Copyright (C) 2011, 2012 by Leandro Graciá Gil                        *
+ *   leandro.gracia.gil@gmail.com                                          *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/**
+ * \file kd-box.h
+ * \brief Template for data used when searching the points of the kd-tree inside an axis-aligned box.
+ * \author Leandro Graciá Gil
+ */
+
+#ifndef _KCHE_TREE_KD_BOX_H_
+#define _KCHE_TREE_KD_BOX_H_
+
+// Include STL vectors.
+#include <vector>
+
+#include "dataset.h"
+#include "duplicates.h"
+#include "vector.h"
+
+namespace kche_tree {
+
+/**
+ * \brief Structure holding the data specific to searching the points inside an axis-aligned box.
+ *
+ * Keeps the bounds of the region of the node being visited, so that whole branches contained in the box
+ * can be reported without checking their points.
+ */
+template <typename ElementType, unsigned int NumDimensions>
+struct KDBoxSearch {
+
+  /// Type of the elements in the feature vectors.
+  typedef ElementType Element;
+
+  /// Number of dimensions of the feature vectors.
+  static const unsigned int Dimensions = NumDimensions;
+
+  /// Alias of compatible feature vectors.
+  typedef typename kche_tree::Vector<Element, Dimensions> Vector;
+
+  /// Alias of compatible non-labeled data sets.
+  typedef typename kche_tree::DataSet<Element, Dimensions> DataSet;
+
+  const Vector &lower; ///< Lower corner of the box, included.
+  const Vector &upper; ///< Upper corner of the box, included.
+  const DataSet &data; ///< Permuted training set.
+
+  Vector region_lower; ///< Lower corner of the region of the node being visited.
+  Vector region_upper; ///< Upper corner of the region of the node being visited.
+  unsigned int num_uncontained; ///< Number of axes where the region of the node being visited is not contained in the box.
+
+  /// Initialize data for a box search starting from the bounding box of the training set.
+  KDBoxSearch(const Vector &lower, const Vector &upper, const DataSet &data, const Vector &data_lower, const Vector &data_upper);
+
+  // Region checks.
+  inline bool is_contained(unsigned int axis) const;
+  inline bool contains(const Vector &v) const;
+  bool intersects() const;
+};
+
+/**
+ * \brief Report the original indices of the points found by a box search to a visitor.
+ *
+ * Identical vectors collapsed in the kd-tree are expanded into all their original indices.
+ *
+ * \tparam Visitor Type of the visitor. Called as \c visitor(index) for each original index.
+ */
+template <typename ElementType, unsigned int NumDimensions, typename Visitor>
+struct KDBoxIndexVisitor {
+  const kche_tree::DataSet<ElementType, NumDimensions> &data; ///< Permuted training set.
+  const Duplicates *duplicates; ///< Groups of identical vectors stored once, or \c NULL if not collapsed.
+  Visitor &visitor; ///< Visitor receiving the original indices.
+
+  /// Report the point with the given permuted index.
+  void visit(unsigned int index) {
+    unsigned int original = data.get_original_index(index);
+    if (!duplicates) {
+      visitor(original);
+      return;
+    }
+
+    const uint32_t *indices = duplicates->indices(original);
+    for (unsigned int i=0; i<duplicates->count(original); ++i)
+      visitor(indices[i]);
+  }
+
+  /// Report the points in a range of permuted indices.
+  void visit_range(unsigned int begin, unsigned int end) {
+    for (unsigned int i=begin; i<end; ++i)
+      visit(i);
+  }
+};
+
+/// Visitor appending the original indices of the points found by a box search to an STL vector.
+struct KDBoxIndexCollector {
+  std::vector<unsigned int> &output; ///< Vector where the indices are appended.
+
+  /// Append an index to the output.
+  void operator () (unsigned int index) { output.push_back(index); }
+};
+
+/**
+ * \brief Count the points found by a box search, including identical vectors collapsed in the kd-tree.
+ */
+struct KDBoxCounter {
+  const uint32_t *cumulative_counts; ///< Number of original vectors before each permuted index, or \c NULL if none were collapsed.
+  unsigned int count; ///< Number of points found.
+
+  /// Count the point with the given permuted index.
+  void visit(unsigned int index) {
+    count += cumulative_counts ? cumulative_counts[index + 1] - cumulative_counts[index] : 1;
+  }
+
+  /// Count the points in a range of permuted indices in constant time.
+  void visit_range(unsigned int begin, unsigned int end) {
+    count += cumulative_counts ? cumulative_counts[end] - cumulative_counts[begin] : end - begin;
+  }
+};
+
+} // namespace kche_tree
+
+// Template implementation.
+#include "kd-box.tpp"
+
+#endif
@@ -0,0 +1,93 @@
+/***************************************************************************
+ *   Copyright (C) 2011, 2012 by Leandro Graciá Gil                        *
+ *   leandro.gracia.gil@gmail.com                                          *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/**
+ * \file kd-box.tpp
+ * \brief Template implementation for the data used when searching the points of the kd-tree inside an axis-aligned box.
+ * \author Leandro Graciá Gil
+ */
+
+namespace kche_tree {
+
+/**
+ * Initialize a box searching structure with the region of the root node.
+ *
+ * \param lower Lower corner of the box, included.
+ * \param upper Upper corner of the box, included.
+ * \param data Permuted training set stored by the tree.
+ * \param data_lower Lower corner of the bounding box of the training set.
+ * \param data_upper Upper corner of the bounding box of the training set.
+ */
+template <typename T, unsigned int D>
+KDBoxSearch<T, D>::KDBoxSearch(const Vector &lower, const Vector &upper, const DataSet &data, const Vector &data_lower, const Vector &data_upper)
+  : lower(lower),
+    upper(upper),
+    data(data),
+    region_lower(data_lower),
+    region_upper(data_upper),
+    num_uncontained(0) {
+
+  for (unsigned int d=0; d<D; ++d) {
+    if (!is_contained(d))
+      ++num_uncontained;
+  }
+}
+
+/**
+ * Check if the region of the node being visited is contained in the box along an axis.
+ *
+ * \param axis Axis to check.
+ * \return \c true if the region is contained along the axis, \c false otherwise.
+ */
+template <typename T, unsigned int D>
+bool KDBoxSearch<T, D>::is_contained(unsigned int axis) const {
+  return !(region_lower[axis] < lower[axis]) && !(region_upper[axis] > upper[axis]);
+}
+
+/**
+ * Check if a point is inside the box.
+ *
+ * \param v Point to check.
+ * \return \c true if the point is inside the box or on its boundary, \c false otherwise.
+ */
+template <typename T, unsigned int D>
+bool KDBoxSearch<T, D>::contains(const Vector &v) const {
+  for (unsigned int d=0; d<D; ++d) {
+    if (v[d] < lower[d] || v[d] > upper[d])
+      return false;
+  }
+  return true;
+}
+
+/**
+ * Check if the region of the node being visited intersects the box.
+ *
+ * \return \c true if they intersect, \c false if they are disjoint or the box is empty.
+ */
+template <typename T, unsigned int D>
+bool KDBoxSearch<T, D>::intersects() const {
+  for (unsigned int d=0; d<D; ++d) {
+    if (upper[d] < lower[d] || region_upper[d] < lower[d] || region_lower[d] > upper[d])
+      return false;
+  }
+  return true;
+}
+
+} // namespace kche_tree
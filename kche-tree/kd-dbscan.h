@@ -0,0 +1,129 @@
+/***************************************************************************
+ *   Copyright (C) 2011, 2012 by Leandro Graciá Gil                        *
+ *   leandro.gracia.gil@gmail.com                                          *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/**
+ * \file kd-dbscan.h
+ * \brief Template for density-based clustering (DBSCAN) over the leaves of a kd-tree.
+ * \author Leandro Graciá Gil
+ */
+
+#ifndef _KCHE_TREE_KD_DBSCAN_H_
+#define _KCHE_TREE_KD_DBSCAN_H_
+
+// Include fixed size integer types, STL pairs and vectors.
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+#include "dataset.h"
+#include "disjoint_sets.h"
+#include "kd-bounds.h"
+
+namespace kche_tree {
+
+/**
+ * \brief Density-based clustering (DBSCAN) of the points stored in a kd-tree using Euclidean distances.
+ *
+ * Points with at least a minimum number of neighbours within a distance, themselves included, are core points.
+ * Core points within the distance of each other belong to the same cluster, and the remaining points join the
+ * cluster of their nearest core point within the distance or are considered noise if there is none.
+ *
+ * The leaves within the distance of each leaf are searched only once and shared by all its points, both to count
+ * their neighbours and to merge their clusters. Clusters are merged by pairs of neighbour leaves, skipping the pairs
+ * whose core points are already in the same cluster, and pairs of leaves closer than the distance everywhere are merged
+ * without calculating any distance. A single pair of core points is searched for leaves already in a single cluster. If OpenMP is enabled, the leaves are split in a contiguous range per thread
+ * whose clusters are merged independently, and the pairs of leaves across ranges are merged in order at the end.
+ *
+ * \tparam ElementType Type of the elements in the feature vectors.
+ * \tparam NumDimensions Number of dimensions of the feature vectors.
+ */
+template <typename ElementType, unsigned int NumDimensions>
+class KDDensityClustering {
+public:
+  /// Type of the elements in the feature vectors.
+  typedef ElementType Element;
+
+  /// Number of dimensions of the feature vectors.
+  static const unsigned int Dimensions = NumDimensions;
+
+  /// Alias of compatible non-labeled data sets.
+  typedef typename kche_tree::DataSet<Element, Dimensions> DataSet;
+
+  /// Alias of the flat hierarchy of the kd-tree.
+  typedef kche_tree::KDBounds<Element, Dimensions> KDBounds;
+
+  // Constructor.
+  KDDensityClustering(const KDBounds &bounds, const DataSet &data, const uint32_t *cumulative_counts, double distance, unsigned int min_points);
+
+  // Cluster the points, returning the lowest permuted index of the core points in the cluster of each one.
+  void run(std::vector<int32_t> &clusters);
+
+private:
+  /// Leaf within the distance of another one.
+  struct NeighborLeaf {
+    uint32_t leaf; ///< Position of the leaf in the list of leaves.
+    bool contained; ///< Indicates if all the points of the leaf are within the distance of all the points of the other one.
+  };
+
+  /// Pair of neighbour leaves, identified by their positions in the list of leaves.
+  typedef std::pair<uint32_t, NeighborLeaf> LeafPair;
+
+  // Processing of a range of leaves.
+  void find_neighbor_leaves(unsigned int leaf, unsigned int branch, std::vector<NeighborLeaf> &neighbors) const;
+  void sort_neighbor_leaves(unsigned int leaf);
+  void find_core_points(unsigned int leaf);
+  void merge_clusters(unsigned int first_leaf, unsigned int last_leaf, std::vector<LeafPair> &cross_pairs);
+  void find_nearest_core_points(unsigned int leaf);
+  unsigned int num_ranges() const;
+
+  // Merging of the core points of two leaves.
+  void merge_leaves(unsigned int leaf1, const NeighborLeaf &leaf2);
+  bool single_cluster(unsigned int leaf, uint32_t &root);
+
+  /// Minimum number of leaves processed by each thread if OpenMP is enabled.
+  static const unsigned int min_leaves_per_range = 64;
+
+  // Access to the points.
+  unsigned int weight(unsigned int index) const; ///< Number of original vectors represented by a permuted index.
+  double squared_distance(unsigned int index1, unsigned int index2) const;
+  double min_squared_distance(unsigned int index, unsigned int leaf) const;
+  double max_squared_distance(unsigned int index, unsigned int leaf) const;
+
+  const KDBounds &bounds_; ///< Hierarchy of the kd-tree.
+  const DataSet &data_; ///< Permuted data stored by the kd-tree.
+  const uint32_t *cumulative_counts_; ///< Number of original vectors before each permuted index, or \c NULL if none were collapsed.
+  const double squared_distance_; ///< Squared distance within which points are neighbours.
+  const unsigned int min_points_; ///< Minimum number of neighbours of core points, including themselves.
+
+  std::vector<uint32_t> leaves_; ///< Index of each non-empty leaf in the hierarchy, in permuted order.
+  std::vector<uint32_t> leaf_positions_; ///< Position of each branch of the hierarchy in the list of leaves, if it is one of them.
+  std::vector<std::vector<NeighborLeaf> > neighbors_; ///< Leaves within the distance of each leaf, including itself.
+  std::vector<char> core_; ///< Indicates if each permuted point is a core point.
+  std::vector<int32_t> first_core_; ///< Lowest permuted index of the core points in each leaf, or -1 if there are none.
+  std::vector<int32_t> nearest_core_; ///< Nearest core point within the distance of each non-core point, or -1 if there is none.
+  DisjointSets clusters_; ///< Clusters of the core points being merged.
+};
+
+} // namespace kche_tree
+
+// Template implementation.
+#include "kd-dbscan.tpp"
+
+#endif
@@ -0,0 +1,435 @@
+/***************************************************************************
+ *   Copyright (C) 2011, 2012 by Leandro Graciá Gil                        *
+ *   leandro.gracia.gil@gmail.com                                          *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/**
+ * \file kd-dbscan.tpp
+ * \brief Template implementation for density-based clustering (DBSCAN) over the leaves of a kd-tree.
+ * \author Leandro Graciá Gil
+ */
+
+// Include STL algorithms.
+#include <algorithm>
+
+// Include OpenMP functions if enabled.
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace kche_tree {
+
+// Static data.
+template <typename T, unsigned int D>
+const unsigned int KDDensityClustering<T, D>::min_leaves_per_range;
+
+/**
+ * Initialize the clustering of the points of a kd-tree.
+ *
+ * \param bounds Hierarchy of the kd-tree.
+ * \param data Permuted data stored by the kd-tree.
+ * \param cumulative_counts Number of original vectors before each permuted index, followed by the total. \c NULL if no vectors were collapsed.
+ * \param distance Euclidean distance within which points are neighbours.
+ * \param min_points Minimum number of neighbours of core points, including themselves and counting identical vectors.
+ */
+template <typename T, unsigned int D>
+KDDensityClustering<T, D>::KDDensityClustering(const KDBounds &bounds, const DataSet &data, const uint32_t *cumulative_counts, double distance, unsigned int min_points)
+    : bounds_(bounds),
+      data_(data),
+      cumulative_counts_(cumulative_counts),
+      squared_distance_(distance * distance),
+      min_points_(min_points) {}
+
+/**
+ * Cluster the points of the kd-tree.
+ *
+ * \param clusters STL vector where the cluster of each point is stored, indexed by permuted index. Clusters are identified
+ *   by the lowest permuted index of their core points. Noise points are assigned -1.
+ */
+template <typename T, unsigned int D>
+void KDDensityClustering<T, D>::run(std::vector<int32_t> &clusters) {
+
+  const unsigned int num_points = data_.size();
+  clusters.assign(num_points, -1);
+  if (!bounds_.size() || !num_points)
+    return;
+
+  // List the non-empty leaves, which are stored in depth-first order and therefore sorted by permuted index.
+  leaves_.clear();
+  leaf_positions_.assign(bounds_.size(), 0);
+  for (unsigned int i=0; i<bounds_.size(); ++i) {
+    if (bounds_.is_leaf(i) && bounds_[i].begin != bounds_[i].end) {
+      leaf_positions_[i] = static_cast<uint32_t>(leaves_.size());
+      leaves_.push_back(i);
+    }
+  }
+
+  const int ranges = static_cast<int>(num_ranges());
+  const unsigned int num_leaves = static_cast<unsigned int>(leaves_.size());
+  neighbors_.assign(num_leaves, std::vector<NeighborLeaf>());
+  core_.assign(num_points, 0);
+  first_core_.assign(num_leaves, -1);
+  nearest_core_.assign(num_points, -1);
+  clusters_.reset(num_points);
+
+  // Search the neighbour leaves of each leaf once, and use them to find the core points.
+  #ifdef _OPENMP
+  #pragma omp parallel for schedule(static)
+  #endif
+  for (int range = 0; range < ranges; ++range) {
+    unsigned int first = static_cast<unsigned int>(static_cast<uint64_t>(num_leaves) * range / ranges);
+    unsigned int last = static_cast<unsigned int>(static_cast<uint64_t>(num_leaves) * (range + 1) / ranges);
+    for (unsigned int leaf = first; leaf < last; ++leaf) {
+      find_neighbor_leaves(leaf, 0, neighbors_[leaf]);
+      sort_neighbor_leaves(leaf);
+      find_core_points(leaf);
+    }
+  }
+
+  // Merge the clusters of the core points in each range, keeping the pairs of leaves across ranges.
+  std::vector<std::vector<LeafPair> > cross_pairs(ranges);
+  #ifdef _OPENMP
+  #pragma omp parallel for schedule(static)
+  #endif
+  for (int range = 0; range < ranges; ++range) {
+    unsigned int first = static_cast<unsigned int>(static_cast<uint64_t>(num_leaves) * range / ranges);
+    unsigned int last = static_cast<unsigned int>(static_cast<uint64_t>(num_leaves) * (range + 1) / ranges);
+    merge_clusters(first, last, cross_pairs[range]);
+    for (unsigned int leaf = first; leaf < last; ++leaf)
+      find_nearest_core_points(leaf);
+  }
+
+  for (int range = 0; range < ranges; ++range) {
+    for (unsigned int i=0; i<cross_pairs[range].size(); ++i)
+      merge_leaves(cross_pairs[range][i].first, cross_pairs[range][i].second);
+  }
+
+  // Assign the core points to their clusters and the rest to the cluster of their nearest core point, if any.
+  for (unsigned int i=0; i<num_points; ++i) {
+    if (core_[i])
+      clusters[i] = static_cast<int32_t>(clusters_.find(i));
+    else if (nearest_core_[i] >= 0)
+      clusters[i] = static_cast<int32_t>(clusters_.find(nearest_core_[i]));
+  }
+
+  // Release the temporary data.
+  std::vector<std::vector<NeighborLeaf> >().swap(neighbors_);
+}
+
+/**
+ * Get the number of contiguous ranges of leaves processed in parallel.
+ *
+ * \return Number of ranges. Always one if OpenMP is not enabled.
+ */
+template <typename T, unsigned int D>
+unsigned int KDDensityClustering<T, D>::num_ranges() const {
+  #ifdef _OPENMP
+  const int ranges = std::min(omp_get_max_threads(), static_cast<int>(leaves_.size() / min_leaves_per_range));
+  if (ranges > 1)
+    return static_cast<unsigned int>(ranges);
+  #endif
+  return 1;
+}
+
+/**
+ * Find the leaves with points within the distance of the points of a leaf.
+ *
+ * \param leaf Position of the leaf in the list of leaves.
+ * \param branch Index of the branch being explored.
+ * \param neighbors STL vector where the neighbour leaves are appended, including \a leaf itself.
+ */
+template <typename T, unsigned int D>
+void KDDensityClustering<T, D>::find_neighbor_leaves(unsigned int leaf, unsigned int branch, std::vector<NeighborLeaf> &neighbors) const {
+
+  const unsigned int index = leaves_[leaf];
+  if (bounds_[branch].begin == bounds_[branch].end ||
+      KDBounds::min_squared_distance(bounds_.lower(index), bounds_.upper(index), bounds_.lower(branch), bounds_.upper(branch)) > squared_distance_)
+    return;
+
+  if (!bounds_.is_leaf(branch)) {
+    find_neighbor_leaves(leaf, bounds_[branch].left, neighbors);
+    find_neighbor_leaves(leaf, bounds_[branch].right, neighbors);
+    return;
+  }
+
+  NeighborLeaf neighbor;
+  neighbor.leaf = leaf_positions_[branch];
+  neighbor.contained = KDBounds::max_squared_distance(bounds_.lower(index), bounds_.upper(index), bounds_.lower(branch), bounds_.upper(branch)) <= squared_distance_;
+  neighbors.push_back(neighbor);
+}
+
+/**
+ * Find the core points of a leaf by counting their neighbours in its neighbour leaves.
+ * Counting stops as soon as the minimum number of neighbours is reached.
+ *
+ * \param leaf Position of the leaf in the list of leaves.
+ */
+template <typename T, unsigned int D>
+void KDDensityClustering<T, D>::find_core_points(unsigned int leaf) {
+
+  const std::vector<NeighborLeaf> &neighbors = neighbors_[leaf];
+  const typename KDBounds::Branch &branch = bounds_[leaves_[leaf]];
+  for (unsigned int i=branch.begin; i<branch.end; ++i) {
+    unsigned int count = 0;
+    for (unsigned int n=0; n<neighbors.size() && count < min_points_; ++n) {
+      const unsigned int neighbor = leaves_[neighbors[n].leaf];
+      if (neighbors[n].contained || max_squared_distance(i, neighbor) <= squared_distance_) {
+        count += bounds_[neighbor].weight;
+        continue;
+      }
+
+      if (min_squared_distance(i, neighbor) > squared_distance_)
+        continue;
+
+      for (unsigned int j=bounds_[neighbor].begin; j<bounds_[neighbor].end && count < min_points_; ++j) {
+        if (squared_distance(i, j) <= squared_distance_)
+          count += weight(j);
+      }
+    }
+
+    if (count >= min_points_) {
+      core_[i] = 1;
+      if (first_core_[leaf] < 0)
+        first_core_[leaf] = static_cast<int32_t>(i);
+    }
+  }
+}
+
+/**
+ * Sort the neighbour leaves of a leaf by the distance between their bounding boxes, so that the nearest points are usually found first.
+ *
+ * \param leaf Position of the leaf in the list of leaves.
+ */
+template <typename T, unsigned int D>
+void KDDensityClustering<T, D>::sort_neighbor_leaves(unsigned int leaf) {
+
+  std::vector<NeighborLeaf> &neighbors = neighbors_[leaf];
+  const unsigned int index = leaves_[leaf];
+  std::vector<std::pair<double, unsigned int> > order(neighbors.size());
+  for (unsigned int n=0; n<neighbors.size(); ++n) {
+    const unsigned int neighbor = leaves_[neighbors[n].leaf];
+    order[n].first = KDBounds::min_squared_distance(bounds_.lower(index), bounds_.upper(index), bounds_.lower(neighbor), bounds_.upper(neighbor));
+    order[n].second = n;
+  }
+  std::sort(order.begin(), order.end());
+
+  std::vector<NeighborLeaf> sorted(neighbors.size());
+  for (unsigned int n=0; n<order.size(); ++n)
+    sorted[n] = neighbors[order[n].second];
+  neighbors.swap(sorted);
+}
+
+/**
+ * Merge the clusters of the core points within the distance of each other in a range of leaves.
+ *
+ * The core points inside each leaf are merged first. Each pair of different neighbour leaves is then merged once, from
+ * the leaf with the lowest position, skipping the pairs already in the same cluster and stopping at the first pair of
+ * core points within the distance if each leaf is in a single cluster.
+ * Only the clusters of the points in the range are modified, so pairs with a leaf out of the range are returned to be merged later.
+ *
+ * \param first_leaf Position of the first leaf of the range.
+ * \param last_leaf Position following the last leaf of the range.
+ * \param cross_pairs STL vector where the pairs of neighbour leaves with one of them out of the range are appended.
+ */
+template <typename T, unsigned int D>
+void KDDensityClustering<T, D>::merge_clusters(unsigned int first_leaf, unsigned int last_leaf, std::vector<LeafPair> &cross_pairs) {
+
+  for (unsigned int leaf = first_leaf; leaf < last_leaf; ++leaf) {
+    const std::vector<NeighborLeaf> &neighbors = neighbors_[leaf];
+    for (unsigned int n=0; n<neighbors.size() && first_core_[leaf] >= 0; ++n) {
+      if (neighbors[n].leaf == leaf) {
+        merge_leaves(leaf, neighbors[n]);
+        break;
+      }
+    }
+  }
+
+  for (unsigned int leaf = first_leaf; leaf < last_leaf; ++leaf) {
+    if (first_core_[leaf] < 0)
+      continue;
+
+    const std::vector<NeighborLeaf> &neighbors = neighbors_[leaf];
+    for (unsigned int n=0; n<neighbors.size(); ++n) {
+      const unsigned int neighbor = neighbors[n].leaf;
+      if (neighbor <= leaf || first_core_[neighbor] < 0)
+        continue;
+
+      if (neighbor >= last_leaf)
+        cross_pairs.push_back(LeafPair(leaf, neighbors[n]));
+      else
+        merge_leaves(leaf, neighbors[n]);
+    }
+  }
+}
+
+/**
+ * Merge the clusters of the core points of two neighbour leaves that are within the distance of each other.
+ *
+ * \param leaf1 Position of the first leaf in the list of leaves.
+ * \param leaf2 Second leaf, with a position not lower than the first one.
+ */
+template <typename T, unsigned int D>
+void KDDensityClustering<T, D>::merge_leaves(unsigned int leaf1, const NeighborLeaf &leaf2) {
+
+  const typename KDBounds::Branch &branch1 = bounds_[leaves_[leaf1]];
+  const typename KDBounds::Branch &branch2 = bounds_[leaves_[leaf2.leaf]];
+  const unsigned int first_core1 = first_core_[leaf1], first_core2 = first_core_[leaf2.leaf];
+
+  // Check if the core points of each leaf are already in a single cluster, in which case a single pair is enough.
+  uint32_t root1 = 0, root2 = 0;
+  const bool single = leaf1 != leaf2.leaf && single_cluster(leaf1, root1) && single_cluster(leaf2.leaf, root2);
+  if (single && root1 == root2)
+    return;
+
+  // All the core points of contained leaves are within the distance of each other.
+  if (leaf2.contained) {
+    if (single) {
+      clusters_.merge(root1, root2);
+      return;
+    }
+    for (unsigned int i=first_core1; i<branch1.end; ++i) {
+      if (core_[i])
+        clusters_.merge(first_core2, i);
+    }
+    for (unsigned int j=first_core2; j<branch2.end; ++j) {
+      if (core_[j])
+        clusters_.merge(first_core1, j);
+    }
+    return;
+  }
+
+  for (unsigned int i=first_core1; i<branch1.end; ++i) {
+    if (!core_[i])
+      continue;
+
+    const bool within = max_squared_distance(i, leaves_[leaf2.leaf]) <= squared_distance_;
+    if (!within && min_squared_distance(i, leaves_[leaf2.leaf]) > squared_distance_)
+      continue;
+
+    // Pairs inside the same leaf are checked once, from the point with the lowest index.
+    uint32_t root = clusters_.find(i);
+    for (unsigned int j=leaf1 == leaf2.leaf ? i + 1 : first_core2; j<branch2.end; ++j) {
+      if (core_[j] && clusters_.find(j) != root && (within || squared_distance(i, j) <= squared_distance_)) {
+        clusters_.merge(root, j);
+        if (single)
+          return;
+        root = clusters_.find(root);
+      }
+    }
+  }
+}
+
+/**
+ * Check if all the core points of a leaf are in the same cluster.
+ *
+ * \param leaf Position of the leaf in the list of leaves.
+ * \param root Set to the cluster of the first core point of the leaf.
+ * \return \c true if all the core points of the leaf are in the cluster, \c false otherwise.
+ */
+template <typename T, unsigned int D>
+bool KDDensityClustering<T, D>::single_cluster(unsigned int leaf, uint32_t &root) {
+
+  root = clusters_.find(first_core_[leaf]);
+  const typename KDBounds::Branch &branch = bounds_[leaves_[leaf]];
+  for (unsigned int i=first_core_[leaf] + 1; i<branch.end; ++i) {
+    if (core_[i] && clusters_.find(i) != root)
+      return false;
+  }
+  return true;
+}
+
+/**
+ * Find the nearest core point within the distance of each non-core point of a leaf, breaking ties by the lowest index.
+ *
+ * \param leaf Position of the leaf in the list of leaves.
+ */
+template <typename T, unsigned int D>
+void KDDensityClustering<T, D>::find_nearest_core_points(unsigned int leaf) {
+
+  const std::vector<NeighborLeaf> &neighbors = neighbors_[leaf];
+  const typename KDBounds::Branch &branch = bounds_[leaves_[leaf]];
+  for (unsigned int i=branch.begin; i<branch.end; ++i) {
+    if (core_[i])
+      continue;
+
+    double nearest_distance = squared_distance_;
+    for (unsigned int n=0; n<neighbors.size(); ++n) {
+      const int32_t first_core = first_core_[neighbors[n].leaf];
+      const unsigned int neighbor = leaves_[neighbors[n].leaf];
+      if (first_core < 0 || min_squared_distance(i, neighbor) > nearest_distance)
+        continue;
+
+      for (unsigned int j=first_core; j<bounds_[neighbor].end; ++j) {
+        if (!core_[j])
+          continue;
+
+        double distance = squared_distance(i, j);
+        if (distance < nearest_distance || (distance == nearest_distance && (nearest_core_[i] < 0 || j < static_cast<unsigned int>(nearest_core_[i])))) {
+          nearest_distance = distance;
+          nearest_core_[i] = static_cast<int32_t>(j);
+        }
+      }
+    }
+  }
+}
+
+/**
+ * Get the number of original vectors represented by a permuted index, including identical ones collapsed in the kd-tree.
+ */
+template <typename T, unsigned int D>
+unsigned int KDDensityClustering<T, D>::weight(unsigned int index) const {
+  return cumulative_counts_ ? cumulative_counts_[index + 1] - cumulative_counts_[index] : 1;
+}
+
+/**
+ * Calculate the squared Euclidean distance between two points.
+ *
+ * \param index1 Permuted index of the first point.
+ * \param index2 Permuted index of the second point.
+ */
+template <typename T, unsigned int D>
+double KDDensityClustering<T, D>::squared_distance(unsigned int index1, unsigned int index2) const {
+  const T *p = data_.get_permuted(index1).data(), *q = data_.get_permuted(index2).data();
+  return KDBounds::min_squared_distance(p, p, q, q);
+}
+
+/**
+ * Calculate the minimum squared Euclidean distance between a point and the bounding box of a leaf.
+ *
+ * \param index Permuted index of the point.
+ * \param leaf Index of the leaf in the hierarchy.
+ */
+template <typename T, unsigned int D>
+double KDDensityClustering<T, D>::min_squared_distance(unsigned int index, unsigned int leaf) const {
+  const T *p = data_.get_permuted(index).data();
+  return KDBounds::min_squared_distance(p, p, bounds_.lower(leaf), bounds_.upper(leaf));
+}
+
+/**
+ * Calculate the maximum squared Euclidean distance between a point and the bounding box of a leaf.
+ *
+ * \param index Permuted index of the point.
+ * \param leaf Index of the leaf in the hierarchy.
+ */
+template <typename T, unsigned int D>
+double KDDensityClustering<T, D>::max_squared_distance(unsigned int index, unsigned int leaf) const {
+  const T *p = data_.get_permuted(index).data();
+  return KDBounds::max_squared_distance(p, p, bounds_.lower(leaf), bounds_.upper(leaf));
+}
+
+} // namespace kche_tree
@@ -0,0 +1,138 @@
+/***************************************************************************
+ *   Copyright (C) 2011, 2012 by Leandro Graciá Gil                        *
+ *   leandro.gracia.gil@gmail.com                                          *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/**
+ * \file kd-emst.h
+ * \brief Template for Euclidean minimum spanning trees over the points of a kd-tree using a dual-tree Borůvka algorithm.
+ * \author Leandro Graciá Gil
+ */
+
+#ifndef _KCHE_TREE_KD_EMST_H_
+#define _KCHE_TREE_KD_EMST_H_
+
+// Include fixed size integer types and STL vectors.
+#include <stdint.h>
+#include <vector>
+
+#include "dataset.h"
+#include "disjoint_sets.h"
+#include "kd-bounds.h"
+
+namespace kche_tree {
+
+/**
+ * \brief Edge of a minimum spanning tree, connecting two vectors by their indices.
+ */
+struct SpanningTreeEdge {
+  unsigned int first; ///< Index of the first vector of the edge, always lower than the second one.
+  unsigned int second; ///< Index of the second vector of the edge.
+  double distance; ///< Euclidean distance between both vectors.
+
+  // Ordering by distance.
+  bool operator < (const SpanningTreeEdge &edge) const;
+};
+
+/**
+ * \brief Euclidean minimum spanning tree of the points stored in a kd-tree using a dual-tree Borůvka algorithm.
+ *
+ * Each round of Borůvka's algorithm finds the shortest edge leaving each component and adds them all to the tree,
+ * at least halving the number of components. Edges are found by traversing pairs of branches of the kd-tree: the
+ * component of each branch is tracked when all its points belong to the same one, pruning the pairs of branches in
+ * the same component, and pairs farther than the longest candidate edge of the components of a branch are also pruned.
+ * The nearest point of another component found for each point is remembered, and the ones still in another component
+ * after merging provide the initial candidate edges of the next round.
+ * If OpenMP is enabled, the subtrees below the first levels are split in a contiguous range per thread, each one
+ * keeping its own candidate edges for each component, which are merged in order at the end of each round.
+ *
+ * Ties are broken by the lowest pair of permuted indices, so the resulting tree does not depend on the number of threads.
+ *
+ * \tparam ElementType Type of the elements in the feature vectors.
+ * \tparam NumDimensions Number of dimensions of the feature vectors.
+ */
+template <typename ElementType, unsigned int NumDimensions>
+class KDSpanningTree {
+public:
+  /// Type of the elements in the feature vectors.
+  typedef ElementType Element;
+
+  /// Number of dimensions of the feature vectors.
+  static const unsigned int Dimensions = NumDimensions;
+
+  /// Alias of compatible non-labeled data sets.
+  typedef typename kche_tree::DataSet<Element, Dimensions> DataSet;
+
+  /// Alias of the flat hierarchy of the kd-tree.
+  typedef kche_tree::KDBounds<Element, Dimensions> KDBounds;
+
+  // Constructor.
+  KDSpanningTree(const KDBounds &bounds, const DataSet &data);
+
+  // Build the spanning tree, returning its edges by permuted indices in the order they were added.
+  void run(std::vector<SpanningTreeEdge> &edges);
+
+private:
+  /// Shortest edge found from the points of a component to the points of other components.
+  struct Candidate {
+    double squared_distance; ///< Squared distance between the points of the edge.
+    uint32_t first; ///< Permuted index of the first point of the edge, always lower than the second one.
+    uint32_t second; ///< Permuted index of the second point of the edge.
+
+    // Ordering by distance, breaking ties by the indices.
+    bool operator < (const Candidate &candidate) const;
+  };
+
+  // Rounds of the algorithm.
+  unsigned int update_components();
+  void seed_candidates(std::vector<Candidate> &candidates);
+  void find_candidates(unsigned int query, unsigned int reference, Candidate *candidates);
+  void search_leaves(unsigned int query, unsigned int reference, Candidate *candidates);
+
+  // Preparation of the hierarchy.
+  void find_subtrees(unsigned int num_subtrees);
+
+  /// Minimum number of subtrees per thread if OpenMP is enabled.
+  static const unsigned int subtrees_per_range = 4;
+
+  /// Minimum number of points per thread if OpenMP is enabled.
+  static const unsigned int min_points_per_range = 4096;
+
+  // Access to the points.
+  double squared_distance(unsigned int index1, unsigned int index2, double bound) const;
+  double min_squared_distance(unsigned int index, unsigned int branch) const;
+
+  const KDBounds &bounds_; ///< Hierarchy of the kd-tree.
+  const DataSet &data_; ///< Permuted data stored by the kd-tree.
+
+  DisjointSets components_; ///< Components of the spanning tree being built.
+  std::vector<uint32_t> point_components_; ///< Component of each permuted point in the current round, numbered consecutively.
+  std::vector<int32_t> branch_components_; ///< Component of all the points of each branch, or -1 if they belong to different ones.
+  std::vector<uint32_t> nearest_; ///< Nearest point of another component found for each permuted point, or the point itself if none.
+  std::vector<double> nearest_distances_; ///< Squared distance to the nearest point of another component found for each permuted point.
+  std::vector<double> branch_bounds_; ///< Longest squared distance of the candidate edges of the components in each branch.
+  std::vector<uint32_t> subtrees_; ///< Disjoint subtrees covering the hierarchy, processed independently.
+  unsigned int num_ranges_; ///< Number of contiguous ranges of subtrees processed in parallel.
+};
+
+} // namespace kche_tree
+
+// Template implementation.
+#include "kd-emst.tpp"
+
+#endif
@@ -0,0 +1,390 @@
+/***************************************************************************
+ *   Copyright (C) 2011, 2012 by Leandro Graciá Gil                        *
+ *   leandro.gracia.gil@gmail.com                                          *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/**
+ * \file kd-emst.tpp
+ * \brief Template implementation for Euclidean minimum spanning trees over the points of a kd-tree using a dual-tree Borůvka algorithm.
+ * \author Leandro Graciá Gil
+ */
+
+// Include STL algorithms, numeric limits and math functions.
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// Include OpenMP functions if enabled.
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace kche_tree {
+
+// Static data.
+template <typename T, unsigned int D>
+const unsigned int KDSpanningTree<T, D>::subtrees_per_range;
+
+template <typename T, unsigned int D>
+const unsigned int KDSpanningTree<T, D>::min_points_per_range;
+
+/**
+ * Compare two edges by their distance, breaking ties by their indices.
+ *
+ * \param edge Edge to compare with.
+ * \return \c true if this edge is shorter than \a edge or equally long with lower indices, \c false otherwise.
+ */
+inline bool SpanningTreeEdge::operator < (const SpanningTreeEdge &edge) const {
+  if (distance != edge.distance)
+    return distance < edge.distance;
+  return first != edge.first ? first < edge.first : second < edge.second;
+}
+
+/**
+ * Prepare the spanning tree of the points of a kd-tree.
+ *
+ * \param bounds Hierarchy of the kd-tree.
+ * \param data Permuted data stored by the kd-tree.
+ */
+template <typename T, unsigned int D>
+KDSpanningTree<T, D>::KDSpanningTree(const KDBounds &bounds, const DataSet &data)
+    : bounds_(bounds),
+      data_(data),
+      num_ranges_(1) {
+
+  if (!bounds_.size())
+    return;
+
+  #ifdef _OPENMP
+  const int ranges = std::min(omp_get_max_threads(), static_cast<int>(data_.size() / min_points_per_range));
+  if (ranges > 1)
+    num_ranges_ = static_cast<unsigned int>(ranges);
+  #endif
+
+  find_subtrees(num_ranges_ > 1 ? num_ranges_ * subtrees_per_range : 1);
+}
+
+/**
+ * Build the minimum spanning tree of the points of the kd-tree.
+ *
+ * \param edges STL vector where the edges of the tree are stored by permuted indices, in the order they were added.
+ */
+template <typename T, unsigned int D>
+void KDSpanningTree<T, D>::run(std::vector<SpanningTreeEdge> &edges) {
+
+  edges.clear();
+  const unsigned int num_points = data_.size();
+  if (!bounds_.size() || num_points < 2)
+    return;
+
+  components_.reset(num_points);
+  point_components_.resize(num_points);
+  branch_components_.resize(bounds_.size());
+  nearest_.resize(num_points);
+  nearest_distances_.assign(num_points, std::numeric_limits<double>::infinity());
+  for (unsigned int i=0; i<num_points; ++i)
+    nearest_[i] = i;
+
+  const int ranges = static_cast<int>(num_ranges_);
+  const unsigned int num_subtrees = static_cast<unsigned int>(subtrees_.size());
+
+  Candidate none;
+  none.squared_distance = std::numeric_limits<double>::infinity();
+  none.first = none.second = 0;
+
+  for (unsigned int num_components = update_components(); num_components > 1; num_components = update_components()) {
+    branch_bounds_.assign(bounds_.size(), std::numeric_limits<double>::infinity());
+
+    // Find the shortest edge leaving each component from the points of each range, starting from the ones still valid.
+    std::vector<Candidate> seeds(num_components, none);
+    seed_candidates(seeds);
+    std::vector<std::vector<Candidate> > candidates(ranges, seeds);
+    #ifdef _OPENMP
+    #pragma omp parallel for schedule(static)
+    #endif
+    for (int range = 0; range < ranges; ++range) {
+      unsigned int first = static_cast<unsigned int>(static_cast<uint64_t>(num_subtrees) * range / ranges);
+      unsigned int last = static_cast<unsigned int>(static_cast<uint64_t>(num_subtrees) * (range + 1) / ranges);
+      for (unsigned int s=first; s<last; ++s)
+        find_candidates(subtrees_[s], 0, &candidates[range][0]);
+    }
+
+    for (int range = 1; range < ranges; ++range) {
+      for (unsigned int c=0; c<num_components; ++c) {
+        if (candidates[range][c] < candidates[0][c])
+          candidates[0][c] = candidates[range][c];
+      }
+    }
+
+    // Add the shortest edge of each component to the tree.
+    for (unsigned int c=0; c<num_components; ++c) {
+      const Candidate &candidate = candidates[0][c];
+      if (components_.merge(candidate.first, candidate.second)) {
+        SpanningTreeEdge edge;
+        edge.first = candidate.first;
+        edge.second = candidate.second;
+        edge.distance = std::sqrt(candidate.squared_distance);
+        edges.push_back(edge);
+      }
+    }
+  }
+
+  // Release the temporary data.
+  std::vector<uint32_t>().swap(point_components_);
+  std::vector<uint32_t>().swap(nearest_);
+  std::vector<double>().swap(nearest_distances_);
+}
+
+/**
+ * Number the components of the points consecutively at the beginning of a round, and find the component of each branch.
+ *
+ * \return Number of components.
+ */
+template <typename T, unsigned int D>
+unsigned int KDSpanningTree<T, D>::update_components() {
+
+  // Representatives are the lowest index of each component, so they are numbered before the rest of their points.
+  const unsigned int num_points = data_.size();
+  unsigned int num_components = 0;
+  for (unsigned int i=0; i<num_points; ++i) {
+    const uint32_t root = components_.find(i);
+    point_components_[i] = root == i ? num_components++ : point_components_[root];
+  }
+
+  // Children are always stored after their parents.
+  for (unsigned int b=bounds_.size(); b-- > 0; ) {
+    const typename KDBounds::Branch &branch = bounds_[b];
+    int32_t &component = branch_components_[b];
+    if (branch.begin == branch.end) {
+      component = -1;
+      continue;
+    }
+
+    if (!bounds_.is_leaf(b)) {
+      const bool left_empty = bounds_[branch.left].begin == bounds_[branch.left].end;
+      const bool right_empty = bounds_[branch.right].begin == bounds_[branch.right].end;
+      const int32_t left = branch_components_[branch.left], right = branch_components_[branch.right];
+      component = left_empty ? right : right_empty ? left : left == right ? left : -1;
+      continue;
+    }
+
+    component = static_cast<int32_t>(point_components_[branch.begin]);
+    for (unsigned int i=branch.begin + 1; i<branch.end && component >= 0; ++i) {
+      if (point_components_[i] != static_cast<uint32_t>(component))
+        component = -1;
+    }
+  }
+
+  return num_components;
+}
+
+/**
+ * Set the initial candidate edges of a round from the nearest points of other components found in the previous one.
+ * Nearest points now in the same component are discarded.
+ *
+ * \param candidates Initial shortest edge of each component, updated with the nearest points still in other components.
+ */
+template <typename T, unsigned int D>
+void KDSpanningTree<T, D>::seed_candidates(std::vector<Candidate> &candidates) {
+
+  const unsigned int num_points = data_.size();
+  for (unsigned int i=0; i<num_points; ++i) {
+    const uint32_t j = nearest_[i];
+    if (j == i)
+      continue;
+
+    if (point_components_[j] == point_components_[i]) {
+      nearest_[i] = i;
+      nearest_distances_[i] = std::numeric_limits<double>::infinity();
+      continue;
+    }
+
+    Candidate edge;
+    edge.squared_distance = nearest_distances_[i];
+    edge.first = std::min(i, j);
+    edge.second = std::max(i, j);
+    if (edge < candidates[point_components_[i]])
+      candidates[point_components_[i]] = edge;
+  }
+}
+
+/**
+ * Search the candidate edges from the points of a query branch to the points of a reference branch.
+ *
+ * Pairs of branches in the same component or farther than the longest candidate edge of the query branch are pruned.
+ * Query branches are split first if they have more points, and the nearest reference branches are explored first.
+ *
+ * \param query Index of the query branch.
+ * \param reference Index of the reference branch.
+ * \param candidates Shortest edge found for each component, updated with the ones leaving from the query branch.
+ */
+template <typename T, unsigned int D>
+void KDSpanningTree<T, D>::find_candidates(unsigned int query, unsigned int reference, Candidate *candidates) {
+
+  const typename KDBounds::Branch &query_branch = bounds_[query], &reference_branch = bounds_[reference];
+  if (query_branch.begin == query_branch.end || reference_branch.begin == reference_branch.end)
+    return;
+
+  const int32_t component = branch_components_[query];
+  if (component >= 0 && component == branch_components_[reference])
+    return;
+
+  // The bound of branches in a single component is the one of the component, which may have been lowered elsewhere.
+  if (component >= 0)
+    branch_bounds_[query] = candidates[component].squared_distance;
+  if (KDBounds::min_squared_distance(bounds_.lower(query), bounds_.upper(query), bounds_.lower(reference), bounds_.upper(reference)) > branch_bounds_[query])
+    return;
+
+  const bool query_leaf = bounds_.is_leaf(query), reference_leaf = bounds_.is_leaf(reference);
+  if (query_leaf && reference_leaf) {
+    search_leaves(query, reference, candidates);
+    return;
+  }
+
+  if (!query_leaf && (reference_leaf || query_branch.end - query_branch.begin >= reference_branch.end - reference_branch.begin)) {
+    find_candidates(query_branch.left, reference, candidates);
+    find_candidates(query_branch.right, reference, candidates);
+    branch_bounds_[query] = std::max(branch_bounds_[query_branch.left], branch_bounds_[query_branch.right]);
+    return;
+  }
+
+  unsigned int nearest = reference_branch.left, farthest = reference_branch.right;
+  if (KDBounds::min_squared_distance(bounds_.lower(query), bounds_.upper(query), bounds_.lower(farthest), bounds_.upper(farthest)) <
+      KDBounds::min_squared_distance(bounds_.lower(query), bounds_.upper(query), bounds_.lower(nearest), bounds_.upper(nearest)))
+    std::swap(nearest, farthest);
+
+  find_candidates(query, nearest, candidates);
+  find_candidates(query, farthest, candidates);
+}
+
+/**
+ * Search the candidate edges from the points of a query leaf to the points of a reference leaf.
+ *
+ * \param query Index of the query leaf.
+ * \param reference Index of the reference leaf.
+ * \param candidates Shortest edge found for each component, updated with the ones leaving from the query leaf.
+ */
+template <typename T, unsigned int D>
+void KDSpanningTree<T, D>::search_leaves(unsigned int query, unsigned int reference, Candidate *candidates) {
+
+  const typename KDBounds::Branch &query_branch = bounds_[query], &reference_branch = bounds_[reference];
+  const int32_t reference_component = branch_components_[reference];
+  for (unsigned int i=query_branch.begin; i<query_branch.end; ++i) {
+    const uint32_t component = point_components_[i];
+    Candidate &candidate = candidates[component];
+    if (reference_component == static_cast<int32_t>(component) || min_squared_distance(i, reference) > candidate.squared_distance)
+      continue;
+
+    // The nearest point found is never closer than the candidate edge of the component, so it bounds both.
+    for (unsigned int j=reference_branch.begin; j<reference_branch.end; ++j) {
+      if (point_components_[j] == component)
+        continue;
+
+      Candidate edge;
+      edge.squared_distance = squared_distance(i, j, nearest_distances_[i]);
+      if (edge.squared_distance > nearest_distances_[i])
+        continue;
+
+      edge.first = std::min(i, j);
+      edge.second = std::max(i, j);
+      if (edge < candidate)
+        candidate = edge;
+      if (edge.squared_distance < nearest_distances_[i]) {
+        nearest_distances_[i] = edge.squared_distance;
+        nearest_[i] = j;
+      }
+    }
+  }
+
+  double bound = 0.0;
+  for (unsigned int i=query_branch.begin; i<query_branch.end; ++i)
+    bound = std::max(bound, candidates[point_components_[i]].squared_distance);
+  branch_bounds_[query] = bound;
+}
+
+/**
+ * Compare two candidate edges by their distance, breaking ties by their indices.
+ *
+ * \param candidate Candidate edge to compare with.
+ * \return \c true if this edge is shorter than \a candidate or equally long with lower indices, \c false otherwise.
+ */
+template <typename T, unsigned int D>
+bool KDSpanningTree<T, D>::Candidate::operator < (const Candidate &candidate) const {
+  if (squared_distance != candidate.squared_distance)
+    return squared_distance < candidate.squared_distance;
+  return first != candidate.first ? first < candidate.first : second < candidate.second;
+}
+
+/**
+ * Split the hierarchy in disjoint subtrees by expanding its levels, keeping them sorted by their permuted indices.
+ *
+ * \param num_subtrees Minimum number of subtrees, if the hierarchy has enough branches.
+ */
+template <typename T, unsigned int D>
+void KDSpanningTree<T, D>::find_subtrees(unsigned int num_subtrees) {
+
+  subtrees_.assign(1, 0);
+  while (subtrees_.size() < num_subtrees) {
+    std::vector<uint32_t> expanded;
+    for (unsigned int i=0; i<subtrees_.size(); ++i) {
+      if (bounds_.is_leaf(subtrees_[i])) {
+        expanded.push_back(subtrees_[i]);
+      } else {
+        expanded.push_back(bounds_[subtrees_[i]].left);
+        expanded.push_back(bounds_[subtrees_[i]].right);
+      }
+    }
+
+    if (expanded.size() == subtrees_.size())
+      break;
+    subtrees_.swap(expanded);
+  }
+}
+
+/**
+ * Calculate the squared Euclidean distance between two points, stopping as soon as it exceeds a bound.
+ *
+ * \param index1 Permuted index of the first point.
+ * \param index2 Permuted index of the second point.
+ * \param bound Squared distance beyond which the calculation stops.
+ * \return Squared distance between the points, or a partial value greater than \a bound.
+ */
+template <typename T, unsigned int D>
+double KDSpanningTree<T, D>::squared_distance(unsigned int index1, unsigned int index2, double bound) const {
+  const T *p = data_.get_permuted(index1).data(), *q = data_.get_permuted(index2).data();
+  double distance = 0.0;
+  for (unsigned int d=0; d<D && distance <= bound; ++d) {
+    double difference = static_cast<double>(p[d]) - static_cast<double>(q[d]);
+    distance += difference * difference;
+  }
+  return distance;
+}
+
+/**
+ * Calculate the minimum squared Euclidean distance between a point and the bounding box of a branch.
+ *
+ * \param index Permuted index of the point.
+ * \param branch Index of the branch in the hierarchy.
+ */
+template <typename T, unsigned int D>
+double KDSpanningTree<T, D>::min_squared_distance(unsigned int index, unsigned int branch) const {
+  const T *p = data_.get_permuted(index).data();
+  return KDBounds::min_squared_distance(p, p, bounds_.lower(branch), bounds_.upper(branch));
+}
+
+} // namespace kche_tree
@@ -0,0 +1,181 @@
+/***************************************************************************
+ *   Copyright (C) 2011, 2012 by Leandro Graciá Gil                        *
+ *   leandro.gracia.gil@gmail.com                                          *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/**
+ * \file kd-interleaved.h
+ * \brief Template for the interleaved search of batches of queries in a kd-tree.
+ * \author Leandro Graciá Gil
+ */
+
+#ifndef _KCHE_TREE_KD_INTERLEAVED_H_
+#define _KCHE_TREE_KD_INTERLEAVED_H_
+
+// Include STL vectors for the batch output.
+#include <vector>
+
+#include "dataset.h"
+#include "kd-node.h"
+#include "kd-search.h"
+#include "neighbor.h"
+#include "scoped_ptr.h"
+#include "traits.h"
+#include "utils.h"
+
+namespace kche_tree {
+
+/**
+ * \brief Search the K nearest neighbours of a batch of queries interleaving their kd-tree traversals.
+ *
+ * Each query traverses the tree in the same order and with the same pruning as KDNode::explore and KDNode::intersect,
+ * but the recursion is replaced by an explicit stack so the traversal can be suspended at any node. Whenever a query
+ * is about to visit a node or a leaf bucket its memory is prefetched and the engine switches to the next query
+ * in a round-robin of several active ones, hiding the latency of the cache misses behind the work of the others.
+ *
+ * \tparam ElementType Type of the elements in the kd-tree.
+ * \tparam NumDimensions Number of dimensions of the feature vectors.
+ * \tparam MetricType Metric functor used to calculate distances between points.
+ * \tparam ContainerType Container used to keep the K nearest neighbour candidates of each query.
+ */
+template <typename ElementType, unsigned int NumDimensions, typename MetricType, typename ContainerType>
+class KDInterleavedSearch : NonCopyable {
+public:
+  /// Type of the elements in the kd-tree.
+  typedef ElementType Element;
+
+  /// Number of dimensions of the feature vectors.
+  static const unsigned int Dimensions = NumDimensions;
+
+  /// Type of the metric used in the search.
+  typedef MetricType Metric;
+
+  /// Type of the containers holding the neighbour candidates.
+  typedef ContainerType Container;
+
+  /// Distance type associated with the elements.
+  typedef typename Traits<Element>::Distance Distance;
+
+  /// Use optimized const reference types for distances.
+  typedef typename RParam<Distance>::Type ConstRef_Distance;
+
+  /// Alias of compatible non-labeled data sets.
+  typedef typename kche_tree::DataSet<Element, Dimensions> DataSet;
+
+  /// Type of the kd-tree branch nodes.
+  typedef kche_tree::KDNode<Element, Dimensions> KDNode;
+
+  /// Type of the kd-tree leaf nodes.
+  typedef kche_tree::KDLeaf<Element, Dimensions> KDLeaf;
+
+  /// Type of the search data of each query.
+  typedef kche_tree::KDSearch<Element, Dimensions, Metric> KDSearch;
+
+  /// Type of the neighbour results.
+  typedef kche_tree::Neighbor<Distance> Neighbor;
+
+  /// Type of the k-neighbour results.
+  typedef std::vector<Neighbor> KNeighbors;
+
+  /// Maximum number of queries that can be advanced at the same time.
+  static const unsigned int max_width = 32;
+
+  // Constructor.
+  KDInterleavedSearch(const KDNode *root, const DataSet &data, const Metric &metric, unsigned int K,
+      ConstRef_Distance epsilon, bool ignore_null_distances, unsigned int width, const Distance *squared_norms = NULL);
+
+  // Search the K nearest neighbours of a range of queries in the batch.
+  void run(const DataSet &queries, std::vector<KNeighbors> &output, unsigned int first_query, unsigned int last_query);
+
+private:
+  /// Incremental updater type applied when entering a branch node.
+  typedef typename Metric::IncrementalUpdater IncrementalUpdater;
+
+  /// Traversal modes, equivalent to the KDNode::explore and KDNode::intersect methods.
+  enum Mode {
+    Explore = 0, ///< Traverse without discarding regions of the space.
+    Intersect    ///< Traverse discarding regions that do not intersect the current candidate hypersphere.
+  };
+
+  /// Node whose memory has been prefetched and is waiting to be processed when the query is resumed.
+  enum Pending {
+    PendingNone = 0, ///< No node is pending. Continue with the next child of the current branch.
+    PendingBranch,   ///< A branch node has been entered and is pending to choose the order of its children.
+    PendingLeaf,     ///< A leaf node is pending to prefetch its bucket.
+    PendingBucket    ///< The bucket of a leaf node is pending to be processed.
+  };
+
+  /// Branch node currently being traversed by a query. Replaces the recursion frames of the single-query traversal.
+  struct Frame {
+    const KDNode *node; ///< Branch node being traversed.
+    uint8_t mode; ///< Traversal mode of the node.
+    uint8_t next_child; ///< Number of children already visited.
+    bool right_first; ///< Indicates if the right child is visited before the left one.
+
+    /// Storage for the incremental updater of the node, which is constructed in place when entering it and destroyed when leaving it.
+    union {
+      char bytes[sizeof(IncrementalUpdater)]; ///< Raw storage of the updater.
+      long double align_long_double; ///< Alignment enforcement.
+      uint64_t align_uint64; ///< Alignment enforcement.
+      void *align_pointer; ///< Alignment enforcement.
+    } updater;
+  };
+
+  /// Search state of each of the queries being advanced at the same time.
+  struct Slot {
+    unsigned int query; ///< Index of the query in the batch.
+    bool active; ///< Indicates if the slot is currently searching a query.
+    ScopedPtr<KDSearch> search_data; ///< Search data of the query.
+    ScopedPtr<Container> candidates; ///< Current neighbour candidates of the query.
+    Frame *stack; ///< Stack of branch nodes being traversed.
+    unsigned int depth; ///< Number of frames in the stack.
+    Pending pending; ///< Kind of the node waiting to be processed.
+    Mode pending_mode; ///< Traversal mode of the node waiting to be processed.
+    const void *pending_node; ///< Node waiting to be processed.
+  };
+
+  // Query processing.
+  void start(Slot &slot, const DataSet &queries, unsigned int query);
+  bool resume(Slot &slot);
+  void finish(Slot &slot, std::vector<KNeighbors> &output);
+
+  // Node processing.
+  bool enter(Slot &slot, const KDNode *node, Mode mode);
+  void process(Slot &slot, const KDLeaf *leaf, Mode mode);
+  void prefetch_bucket(const KDLeaf *leaf) const;
+
+  const KDNode *root_; ///< Root of the kd-tree.
+  const DataSet &data_; ///< Permuted training set stored by the tree.
+  const Metric &metric_; ///< Metric functor used to calculate distances between points.
+  unsigned int K_; ///< Number of neighbours to retrieve.
+  Distance squared_epsilon_; ///< Initial hyperrectangle distance of each query.
+  bool ignore_null_distances_; ///< Exclude points with null distance to the queries.
+  const Distance *squared_norms_; ///< Squared norms of the points in the permuted training set, if available.
+
+  unsigned int width_; ///< Number of queries advanced at the same time.
+  unsigned int max_depth_; ///< Maximum number of branch nodes in a path of the tree.
+  ScopedArray<Slot> slots_; ///< Search state of each of the queries being advanced.
+  ScopedArray<Frame> frames_; ///< Traversal stacks of all the slots.
+};
+
+} // namespace kche_tree
+
+// Template implementation.
+#include "kd-interleaved.tpp"
+
+#endif
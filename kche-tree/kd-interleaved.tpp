@@ -0,0 +1,304 @@
+/***************************************************************************
+ *   Copyright (C) 2011, 2012 by Leandro Graciá Gil                        *
+ *   leandro.gracia.gil@gmail.com                                          *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/**
+ * \file kd-interleaved.tpp
+ * \brief Template implementation for the interleaved search of batches of queries in a kd-tree.
+ * \author Leandro Graciá Gil
+ */
+
+// Include placement new and STL min/max.
+#include <algorithm>
+#include <new>
+
+namespace kche_tree {
+
+// Static data.
+template <typename T, unsigned int D, typename M, typename C>
+const unsigned int KDInterleavedSearch<T, D, M, C>::max_width;
+
+/**
+ * \brief Prepare an interleaved search in a kd-tree.
+ *
+ * \param root Root node of the kd-tree.
+ * \param data Permuted training set stored by the kd-tree.
+ * \param metric Metric functor used to calculate distances between points.
+ * \param K Number of neighbours to retrieve for each query.
+ * \param epsilon Acceptable distance margin to ignore regions during kd-tree exploration.
+ * \param ignore_null_distances Ignore points at null distance from the queries.
+ * \param width Number of queries advanced at the same time. Clamped to the range [1, max_width].
+ * \param squared_norms Squared norms of the points precalculated by the kd-tree, if available. Only used by the Euclidean metric with floating point types.
+ */
+template <typename T, unsigned int D, typename M, typename C>
+KDInterleavedSearch<T, D, M, C>::KDInterleavedSearch(const KDNode *root, const DataSet &data, const Metric &metric, unsigned int K,
+    ConstRef_Distance epsilon, bool ignore_null_distances, unsigned int width, const Distance *squared_norms)
+  : root_(root),
+    data_(data),
+    metric_(metric),
+    K_(K),
+    squared_epsilon_(epsilon),
+    ignore_null_distances_(ignore_null_distances),
+    squared_norms_(squared_norms),
+    width_(std::min(std::max(width, 1U), max_width)),
+    max_depth_(root ? root->depth() : 0),
+    slots_(new Slot[width_]),
+    frames_(new Frame[width_ * max_depth_]) {
+
+  KCHE_TREE_DCHECK(root);
+  squared_epsilon_ *= epsilon;
+
+  // Each slot owns a fixed region of the frame array large enough for the deepest path of the tree.
+  for (unsigned int i=0; i<width_; ++i) {
+    slots_[i].active = false;
+    slots_[i].stack = frames_.get() + i * max_depth_;
+    slots_[i].depth = 0;
+    slots_[i].candidates.reset(new Container(K_));
+  }
+}
+
+/**
+ * \brief Search the K nearest neighbours of a range of queries in the batch.
+ *
+ * \param queries Points whose neighbours should be retrieved.
+ * \param output Vector resized to the number of queries. The nearest neighbours of each query are appended to its entry sorted by increasing distance.
+ * \param first_query Index of the first query to search. Any previous queries are skipped.
+ * \param last_query Index after the last query to search.
+ */
+template <typename T, unsigned int D, typename M, typename C>
+void KDInterleavedSearch<T, D, M, C>::run(const DataSet &queries, std::vector<KNeighbors> &output, unsigned int first_query, unsigned int last_query) {
+
+  output.resize(queries.size());
+  unsigned int next_query = first_query, num_active = 0;
+
+  // Fill the slots with the first queries of the batch.
+  for (unsigned int i=0; i<width_ && next_query < last_query; ++i, ++num_active)
+    start(slots_[i], queries, next_query++);
+
+  // Advance each active query until it needs to wait for memory, then switch to the next one.
+  while (num_active > 0) {
+    for (unsigned int i=0; i<width_; ++i) {
+      Slot &slot = slots_[i];
+      if (!slot.active || resume(slot))
+        continue;
+
+      // The query has been completed. Replace it with the next one in the batch, if any.
+      finish(slot, output);
+      if (next_query < last_query)
+        start(slot, queries, next_query++);
+      else
+        --num_active;
+    }
+  }
+}
+
+/**
+ * \brief Start the search of a new query in a slot.
+ *
+ * \param slot Slot where the query is searched.
+ * \param queries Batch of queries.
+ * \param query Index of the query in the batch.
+ */
+template <typename T, unsigned int D, typename M, typename C>
+void KDInterleavedSearch<T, D, M, C>::start(Slot &slot, const DataSet &queries, unsigned int query) {
+
+  slot.query = query;
+  slot.active = true;
+  slot.depth = 0;
+
+  // Create the search data of the query, using epsilon as initial hyperrectangle distance as knn does.
+  slot.search_data.reset(new KDSearch(queries[query], data_, metric_, K_, ignore_null_distances_));
+  slot.search_data->hyperrect_distance = squared_epsilon_;
+  slot.search_data->use_squared_norms(squared_norms_);
+
+  // The root will be explored when the query is first resumed.
+  enter(slot, root_, Explore);
+  slot.pending = PendingBranch;
+  prefetch(root_);
+}
+
+/**
+ * \brief Advance the search of a query until it needs to wait for the memory of a node to be loaded.
+ *
+ * \param slot Slot of the query being advanced.
+ * \return \c true if the query was suspended, \c false if its search has been completed.
+ */
+template <typename T, unsigned int D, typename M, typename C>
+bool KDInterleavedSearch<T, D, M, C>::resume(Slot &slot) {
+
+  KDSearch &search_data = *slot.search_data;
+  Container &candidates = *slot.candidates;
+
+  // Process the node prefetched before the query was suspended.
+  switch (slot.pending) {
+    case PendingBranch: {
+      // The branch node should be now in cache. Check which of its children should be visited first.
+      Frame &frame = slot.stack[slot.depth - 1];
+      frame.right_first = frame.mode == Explore && search_data.p[frame.node->axis & KDNode::axis_mask] > frame.node->split_element;
+      break;
+    }
+
+    case PendingLeaf:
+      // The leaf node should be now in cache. Prefetch its bucket and suspend the query again.
+      prefetch_bucket(static_cast<const KDLeaf *>(slot.pending_node));
+      slot.pending = PendingBucket;
+      return true;
+
+    case PendingBucket:
+      process(slot, static_cast<const KDLeaf *>(slot.pending_node), slot.pending_mode);
+      break;
+
+    case PendingNone:
+      break;
+  }
+  slot.pending = PendingNone;
+
+  while (slot.depth > 0) {
+
+    // Leave the current branch node if all its children have been visited, restoring its incremental update.
+    Frame &frame = slot.stack[slot.depth - 1];
+    if (frame.next_child == 2) {
+      reinterpret_cast<IncrementalUpdater *>(frame.updater.bytes)->~IncrementalUpdater();
+      --slot.depth;
+      continue;
+    }
+
+    // Select the next child and its traversal mode as KDNode::explore and KDNode::intersect do.
+    const KDNode *node = frame.node;
+    bool left = (frame.next_child++ == 0) != frame.right_first;
+    Mode mode = (frame.mode == Intersect || candidates.size() >= search_data.K) ? Intersect : Explore;
+
+    // Prefetch leaf nodes and suspend the query.
+    if (node->is_leaf & (left ? KDNode::left_bit : KDNode::right_bit)) {
+      slot.pending = PendingLeaf;
+      slot.pending_mode = mode;
+      slot.pending_node = left ? node->left_leaf : node->right_leaf;
+      prefetch(slot.pending_node);
+      return true;
+    }
+
+    // Branch nodes can be discarded without accessing their memory, since the incremental update only depends on the parent.
+    // Prefetch them and suspend the query only if they need to be traversed.
+    const KDNode *branch = left ? node->left_branch : node->right_branch;
+    if (enter(slot, branch, mode)) {
+      slot.pending = PendingBranch;
+      prefetch(branch);
+      return true;
+    }
+  }
+
+  // The search has been completed.
+  return false;
+}
+
+/**
+ * \brief Append the results of a completed query to the output and release its slot.
+ *
+ * \param slot Slot of the completed query.
+ * \param output Output vector of the batch.
+ */
+template <typename T, unsigned int D, typename M, typename C>
+void KDInterleavedSearch<T, D, M, C>::finish(Slot &slot, std::vector<KNeighbors> &output) {
+
+  // Append the nearest neighbours in increasing distance correcting index permutations. This also empties the container for the next query.
+  Container &candidates = *slot.candidates;
+  KNeighbors &neighbors = output[slot.query];
+  while (!candidates.empty()) {
+    const Neighbor &neighbor = candidates.back();
+    neighbors.push_back(Neighbor(data_.get_original_index(neighbor.index()), neighbor.squared_distance()));
+    candidates.pop_back();
+  }
+
+  slot.search_data.reset();
+  slot.active = false;
+}
+
+/**
+ * \brief Enter a branch node, applying its incremental hyperrectangle update.
+ *
+ * \param slot Slot of the query entering the node.
+ * \param node Branch node being entered.
+ * \param mode Traversal mode of the node.
+ * \return \c true if the node was pushed in the stack of the query, \c false if it was discarded.
+ */
+template <typename T, unsigned int D, typename M, typename C>
+bool KDInterleavedSearch<T, D, M, C>::enter(Slot &slot, const KDNode *node, Mode mode) {
+
+  KCHE_TREE_DCHECK(slot.depth < max_depth_);
+  KDSearch &search_data = *slot.search_data;
+  const KDNode *parent = slot.depth > 0 ? slot.stack[slot.depth - 1].node : NULL;
+
+  // Intersection data is updated incrementally when the updater is created, and restored when destroyed.
+  Frame &frame = slot.stack[slot.depth];
+  IncrementalUpdater *updater = new (frame.updater.bytes) IncrementalUpdater(node, parent, search_data);
+
+  // Discard the node if it does not intersect the hypersphere of the current candidates.
+  if (mode == Intersect && !(search_data.hyperrect_distance < search_data.farthest_distance)) {
+    updater->~IncrementalUpdater();
+    return false;
+  }
+
+  frame.node = node;
+  frame.mode = mode;
+  frame.next_child = 0;
+  frame.right_first = false;
+  ++slot.depth;
+  return true;
+}
+
+/**
+ * \brief Process the bucket of a leaf node.
+ *
+ * \param slot Slot of the query processing the leaf.
+ * \param leaf Leaf node being processed.
+ * \param mode Traversal mode of the leaf.
+ */
+template <typename T, unsigned int D, typename M, typename C>
+void KDInterleavedSearch<T, D, M, C>::process(Slot &slot, const KDLeaf *leaf, Mode mode) {
+
+  KDSearch &search_data = *slot.search_data;
+  Container &candidates = *slot.candidates;
+
+  if (mode == Explore)
+    leaf->explore(search_data, candidates);
+  else if (search_data.ignore_null_distances)
+    leaf->intersect_ignoring_same(search_data, candidates);
+  else
+    leaf->intersect(search_data, candidates);
+}
+
+/**
+ * \brief Prefetch the feature vectors in the bucket of a leaf node.
+ *
+ * \param leaf Leaf node whose bucket is prefetched.
+ */
+template <typename T, unsigned int D, typename M, typename C>
+void KDInterleavedSearch<T, D, M, C>::prefetch_bucket(const KDLeaf *leaf) const {
+
+  if (leaf->num_elements == 0)
+    return;
+
+  // Feature vectors of a bucket are contiguous in the permuted training set.
+  const char *begin = reinterpret_cast<const char *>(&data_.get_permuted(leaf->first_index));
+  const char *end = begin + leaf->num_elements * sizeof(typename DataSet::Vector);
+  for (const char *address = begin; address < end; address += cache_line_size)
+    prefetch(address);
+}
+
+} // namespace kche_tree
@@ -0,0 +1,126 @@
+/***************************************************************************
+ *   Copyright (C) 2011, 2012 by Leandro Graciá Gil                        *
+ *   leandro.gracia.gil@gmail.com                                          *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/**
+ * \file kd-join.h
+ * \brief Template for dual-tree joins between the points of two kd-trees.
+ * \author Leandro Graciá Gil
+ */
+
+#ifndef _KCHE_TREE_KD_JOIN_H_
+#define _KCHE_TREE_KD_JOIN_H_
+
+// Include fixed size integer types and STL vectors.
+#include <stdint.h>
+#include <vector>
+
+#include "dataset.h"
+#include "kd-bounds.h"
+
+namespace kche_tree {
+
+/**
+ * \brief Dual-tree joins between the points of two kd-trees using Euclidean distances.
+ *
+ * Pairs of branches of both kd-trees are traversed together, splitting the one with more points first and exploring
+ * the nearest reference branches first. Pairs of branches farther than the longest distance still of interest for the
+ * query branch are pruned: the distance to the nearest reference point found for any of its points, or the closest
+ * pair found so far. Once a query leaf is reached, the nearest reference points of its points are searched individually
+ * in the remaining reference branch, pruning it with the bound of each point. If OpenMP is enabled, the query subtrees below the first levels are split in a contiguous range
+ * per thread, each one traversing its pairs of branches independently.
+ *
+ * Both kd-trees must store their dimensions in the same order, reordering the reference data beforehand if needed. Ties are broken by the lowest permuted indices, so
+ * the results do not depend on the number of threads.
+ *
+ * \tparam ElementType Type of the elements in the feature vectors.
+ * \tparam NumDimensions Number of dimensions of the feature vectors.
+ */
+template <typename ElementType, unsigned int NumDimensions>
+class KDJoin {
+public:
+  /// Type of the elements in the feature vectors.
+  typedef ElementType Element;
+
+  /// Number of dimensions of the feature vectors.
+  static const unsigned int Dimensions = NumDimensions;
+
+  /// Alias of compatible non-labeled data sets.
+  typedef typename kche_tree::DataSet<Element, Dimensions> DataSet;
+
+  /// Alias of the flat hierarchy of the kd-tree.
+  typedef kche_tree::KDBounds<Element, Dimensions> KDBounds;
+
+  // Constructor.
+  KDJoin(const KDBounds &queries, const DataSet &query_data, const KDBounds &references, const DataSet &reference_data);
+
+  // Joins.
+  void nearest(double distance, std::vector<int32_t> &nearest, std::vector<double> &squared_distances);
+  bool closest_pair(uint32_t &query, uint32_t &reference, double &squared_distance);
+
+private:
+  /// Closest pair of points found, identified by their permuted indices.
+  struct Pair {
+    double squared_distance; ///< Squared distance between the points.
+    uint32_t query; ///< Permuted index of the query point.
+    uint32_t reference; ///< Permuted index of the reference point.
+
+    // Ordering by distance, breaking ties by the indices.
+    bool operator < (const Pair &pair) const;
+  };
+
+  // Traversal of the pairs of branches.
+  void find_nearest(unsigned int query, unsigned int reference);
+  void find_nearest_point(unsigned int index, unsigned int reference);
+  void find_closest(unsigned int query, unsigned int reference, Pair &closest) const;
+  bool split_query(unsigned int query, unsigned int reference) const;
+  void order_references(unsigned int query, unsigned int reference, unsigned int &nearest, unsigned int &farthest) const;
+
+  // Preparation of the hierarchy.
+  void find_subtrees(unsigned int num_subtrees);
+
+  /// Minimum number of subtrees per thread if OpenMP is enabled.
+  static const unsigned int subtrees_per_range = 4;
+
+  /// Minimum number of query points per thread if OpenMP is enabled.
+  static const unsigned int min_points_per_range = 4096;
+
+  // Access to the points.
+  double squared_distance(unsigned int query, unsigned int reference, double bound) const;
+  double min_squared_distance(unsigned int query, unsigned int reference) const;
+  double min_squared_distance_to_branch(unsigned int index, unsigned int reference) const;
+
+  const KDBounds &queries_; ///< Hierarchy of the query kd-tree.
+  const DataSet &query_data_; ///< Permuted data stored by the query kd-tree.
+  const KDBounds &references_; ///< Hierarchy of the reference kd-tree.
+  const DataSet &reference_data_; ///< Permuted data stored by the reference kd-tree.
+
+  std::vector<int32_t> *nearest_; ///< Nearest reference point found for each query point, or -1 if none.
+  std::vector<double> *nearest_distances_; ///< Squared distance to the nearest reference point found for each query point.
+  std::vector<double> branch_bounds_; ///< Longest squared distance to the nearest reference point of the points of each query branch.
+  std::vector<uint32_t> subtrees_; ///< Disjoint query subtrees covering the query hierarchy, processed independently.
+  unsigned int num_ranges_; ///< Number of contiguous ranges of query subtrees processed in parallel.
+};
+
+} // namespace kche_tree
+
+// Template implementation.
+#include "kd-join.tpp"
+
+#endif
@@ -0,0 +1,383 @@
+/***************************************************************************
+ *   Copyright (C) 2011, 2012 by Leandro Graciá Gil                        *
+ *   leandro.gracia.gil@gmail.com                                          *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/**
+ * \file kd-join.tpp
+ * \brief Template implementation for dual-tree joins between the points of two kd-trees.
+ * \author Leandro Graciá Gil
+ */
+
+// Include STL algorithms and numeric limits.
+#include <algorithm>
+#include <limits>
+
+// Include OpenMP functions if enabled.
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace kche_tree {
+
+// Static data.
+template <typename T, unsigned int D>
+const unsigned int KDJoin<T, D>::subtrees_per_range;
+
+template <typename T, unsigned int D>
+const unsigned int KDJoin<T, D>::min_points_per_range;
+
+/**
+ * Prepare the joins between the points of two kd-trees.
+ *
+ * \param queries Hierarchy of the query kd-tree.
+ * \param query_data Permuted data stored by the query kd-tree.
+ * \param references Hierarchy of the reference kd-tree.
+ * \param reference_data Permuted data stored by the reference kd-tree.
+ */
+template <typename T, unsigned int D>
+KDJoin<T, D>::KDJoin(const KDBounds &queries, const DataSet &query_data, const KDBounds &references, const DataSet &reference_data)
+    : queries_(queries),
+      query_data_(query_data),
+      references_(references),
+      reference_data_(reference_data),
+      nearest_(NULL),
+      nearest_distances_(NULL),
+      num_ranges_(1) {
+
+  if (!queries_.size())
+    return;
+
+  #ifdef _OPENMP
+  const int ranges = std::min(omp_get_max_threads(), static_cast<int>(query_data_.size() / min_points_per_range));
+  if (ranges > 1)
+    num_ranges_ = static_cast<unsigned int>(ranges);
+  #endif
+
+  find_subtrees(num_ranges_ > 1 ? num_ranges_ * subtrees_per_range : 1);
+}
+
+/**
+ * Find the nearest reference point within a distance of each query point, breaking ties by the lowest index.
+ *
+ * \param distance Euclidean distance within which reference points are searched.
+ * \param nearest STL vector where the nearest reference point of each query point is stored by their permuted indices. Set to -1 if none is within the distance.
+ * \param squared_distances STL vector where the squared distance to the nearest reference point of each query point is stored.
+ *   Set to the squared \a distance if none is within it.
+ */
+template <typename T, unsigned int D>
+void KDJoin<T, D>::nearest(double distance, std::vector<int32_t> &nearest, std::vector<double> &squared_distances) {
+
+  nearest.assign(query_data_.size(), -1);
+  squared_distances.assign(query_data_.size(), distance * distance);
+  if (!queries_.size() || !references_.size() || nearest.empty())
+    return;
+
+  nearest_ = &nearest;
+  nearest_distances_ = &squared_distances;
+  branch_bounds_.assign(queries_.size(), distance * distance);
+
+  const int ranges = static_cast<int>(num_ranges_);
+  const unsigned int num_subtrees = static_cast<unsigned int>(subtrees_.size());
+
+  #ifdef _OPENMP
+  #pragma omp parallel for schedule(static)
+  #endif
+  for (int range = 0; range < ranges; ++range) {
+    unsigned int first = static_cast<unsigned int>(static_cast<uint64_t>(num_subtrees) * range / ranges);
+    unsigned int last = static_cast<unsigned int>(static_cast<uint64_t>(num_subtrees) * (range + 1) / ranges);
+    for (unsigned int s=first; s<last; ++s)
+      find_nearest(subtrees_[s], 0);
+  }
+
+  nearest_ = NULL;
+  nearest_distances_ = NULL;
+}
+
+/**
+ * Find the closest pair of query and reference points, breaking ties by the lowest indices.
+ *
+ * \param query Set to the permuted index of the query point of the pair.
+ * \param reference Set to the permuted index of the reference point of the pair.
+ * \param squared_distance Set to the squared distance between the points of the pair.
+ * \return \c true if the pair was found, \c false if any of the kd-trees is empty.
+ */
+template <typename T, unsigned int D>
+bool KDJoin<T, D>::closest_pair(uint32_t &query, uint32_t &reference, double &squared_distance) {
+
+  if (!queries_.size() || !references_.size() || !query_data_.size() || !reference_data_.size())
+    return false;
+
+  const int ranges = static_cast<int>(num_ranges_);
+  const unsigned int num_subtrees = static_cast<unsigned int>(subtrees_.size());
+
+  Pair none;
+  none.squared_distance = std::numeric_limits<double>::infinity();
+  none.query = none.reference = 0;
+  std::vector<Pair> closest(ranges, none);
+
+  #ifdef _OPENMP
+  #pragma omp parallel for schedule(static)
+  #endif
+  for (int range = 0; range < ranges; ++range) {
+    unsigned int first = static_cast<unsigned int>(static_cast<uint64_t>(num_subtrees) * range / ranges);
+    unsigned int last = static_cast<unsigned int>(static_cast<uint64_t>(num_subtrees) * (range + 1) / ranges);
+    for (unsigned int s=first; s<last; ++s)
+      find_closest(subtrees_[s], 0, closest[range]);
+  }
+
+  for (int range = 1; range < ranges; ++range) {
+    if (closest[range] < closest[0])
+      closest[0] = closest[range];
+  }
+
+  query = closest[0].query;
+  reference = closest[0].reference;
+  squared_distance = closest[0].squared_distance;
+  return true;
+}
+
+/**
+ * Search the nearest reference points of the points of a query branch in a reference branch.
+ *
+ * \param query Index of the query branch.
+ * \param reference Index of the reference branch.
+ */
+template <typename T, unsigned int D>
+void KDJoin<T, D>::find_nearest(unsigned int query, unsigned int reference) {
+
+  const typename KDBounds::Branch &query_branch = queries_[query], &reference_branch = references_[reference];
+  if (query_branch.begin == query_branch.end || reference_branch.begin == reference_branch.end ||
+      min_squared_distance(query, reference) > branch_bounds_[query])
+    return;
+
+  if (split_query(query, reference)) {
+    find_nearest(query_branch.left, reference);
+    find_nearest(query_branch.right, reference);
+    branch_bounds_[query] = std::max(branch_bounds_[query_branch.left], branch_bounds_[query_branch.right]);
+    return;
+  }
+
+  // Search the points of query leaves individually, pruning each reference branch with their own bounds.
+  std::vector<double> &distances = *nearest_distances_;
+  double bound = 0.0;
+  for (unsigned int i=query_branch.begin; i<query_branch.end; ++i) {
+    if (min_squared_distance_to_branch(i, reference) <= distances[i])
+      find_nearest_point(i, reference);
+    bound = std::max(bound, distances[i]);
+  }
+  branch_bounds_[query] = bound;
+}
+
+/**
+ * Search the nearest reference point of a query point in a reference branch within its current bound.
+ *
+ * \param index Permuted index of the query point.
+ * \param reference Index of the reference branch, which must not be empty.
+ */
+template <typename T, unsigned int D>
+void KDJoin<T, D>::find_nearest_point(unsigned int index, unsigned int reference) {
+
+  std::vector<double> &distances = *nearest_distances_;
+  const typename KDBounds::Branch &reference_branch = references_[reference];
+  if (!references_.is_leaf(reference)) {
+    unsigned int nearest = reference_branch.left, farthest = reference_branch.right;
+    double nearest_distance = min_squared_distance_to_branch(index, nearest), farthest_distance = min_squared_distance_to_branch(index, farthest);
+    if (farthest_distance < nearest_distance) {
+      std::swap(nearest, farthest);
+      std::swap(nearest_distance, farthest_distance);
+    }
+
+    if (references_[nearest].begin != references_[nearest].end && nearest_distance <= distances[index])
+      find_nearest_point(index, nearest);
+    if (references_[farthest].begin != references_[farthest].end && farthest_distance <= distances[index])
+      find_nearest_point(index, farthest);
+    return;
+  }
+
+  std::vector<int32_t> &nearest = *nearest_;
+  for (unsigned int j=reference_branch.begin; j<reference_branch.end; ++j) {
+    double distance = squared_distance(index, j, distances[index]);
+    if (distance < distances[index] || (distance == distances[index] && (nearest[index] < 0 || j < static_cast<uint32_t>(nearest[index])))) {
+      distances[index] = distance;
+      nearest[index] = static_cast<int32_t>(j);
+    }
+  }
+}
+
+/**
+ * Search the closest pair of points between a query branch and a reference branch.
+ *
+ * \param query Index of the query branch.
+ * \param reference Index of the reference branch.
+ * \param closest Closest pair found so far, updated if a closer one is found.
+ */
+template <typename T, unsigned int D>
+void KDJoin<T, D>::find_closest(unsigned int query, unsigned int reference, Pair &closest) const {
+
+  const typename KDBounds::Branch &query_branch = queries_[query], &reference_branch = references_[reference];
+  if (query_branch.begin == query_branch.end || reference_branch.begin == reference_branch.end ||
+      min_squared_distance(query, reference) > closest.squared_distance)
+    return;
+
+  if (split_query(query, reference)) {
+    unsigned int nearest = query_branch.left, farthest = query_branch.right;
+    if (min_squared_distance(farthest, reference) < min_squared_distance(nearest, reference))
+      std::swap(nearest, farthest);
+    find_closest(nearest, reference, closest);
+    find_closest(farthest, reference, closest);
+    return;
+  }
+
+  if (!references_.is_leaf(reference)) {
+    unsigned int nearest, farthest;
+    order_references(query, reference, nearest, farthest);
+    find_closest(query, nearest, closest);
+    find_closest(query, farthest, closest);
+    return;
+  }
+
+  for (unsigned int i=query_branch.begin; i<query_branch.end; ++i) {
+    if (min_squared_distance_to_branch(i, reference) > closest.squared_distance)
+      continue;
+
+    for (unsigned int j=reference_branch.begin; j<reference_branch.end; ++j) {
+      Pair pair;
+      pair.squared_distance = squared_distance(i, j, closest.squared_distance);
+      pair.query = i;
+      pair.reference = j;
+      if (pair < closest)
+        closest = pair;
+    }
+  }
+}
+
+/**
+ * Check if the query branch of a pair should be split before the reference one: always if the reference branch
+ * is a leaf, never if the query branch is, and otherwise if the query branch has at least as many points.
+ *
+ * \param query Index of the query branch.
+ * \param reference Index of the reference branch.
+ */
+template <typename T, unsigned int D>
+bool KDJoin<T, D>::split_query(unsigned int query, unsigned int reference) const {
+  if (queries_.is_leaf(query))
+    return false;
+  if (references_.is_leaf(reference))
+    return true;
+  return queries_[query].end - queries_[query].begin >= references_[reference].end - references_[reference].begin;
+}
+
+/**
+ * Sort the children of a reference branch by their distance to a query branch.
+ *
+ * \param query Index of the query branch.
+ * \param reference Index of the reference branch.
+ * \param nearest Set to the child nearest to the query branch.
+ * \param farthest Set to the other child.
+ */
+template <typename T, unsigned int D>
+void KDJoin<T, D>::order_references(unsigned int query, unsigned int reference, unsigned int &nearest, unsigned int &farthest) const {
+  nearest = references_[reference].left;
+  farthest = references_[reference].right;
+  if (min_squared_distance(query, farthest) < min_squared_distance(query, nearest))
+    std::swap(nearest, farthest);
+}
+
+/**
+ * Compare two pairs of points by their distance, breaking ties by their indices.
+ *
+ * \param pair Pair to compare with.
+ * \return \c true if this pair is closer than \a pair or equally close with lower indices, \c false otherwise.
+ */
+template <typename T, unsigned int D>
+bool KDJoin<T, D>::Pair::operator < (const Pair &pair) const {
+  if (squared_distance != pair.squared_distance)
+    return squared_distance < pair.squared_distance;
+  return query != pair.query ? query < pair.query : reference < pair.reference;
+}
+
+/**
+ * Split the query hierarchy in disjoint subtrees by expanding its levels, keeping them sorted by their permuted indices.
+ *
+ * \param num_subtrees Minimum number of subtrees, if the hierarchy has enough branches.
+ */
+template <typename T, unsigned int D>
+void KDJoin<T, D>::find_subtrees(unsigned int num_subtrees) {
+
+  subtrees_.assign(1, 0);
+  while (subtrees_.size() < num_subtrees) {
+    std::vector<uint32_t> expanded;
+    for (unsigned int i=0; i<subtrees_.size(); ++i) {
+      if (queries_.is_leaf(subtrees_[i])) {
+        expanded.push_back(subtrees_[i]);
+      } else {
+        expanded.push_back(queries_[subtrees_[i]].left);
+        expanded.push_back(queries_[subtrees_[i]].right);
+      }
+    }
+
+    if (expanded.size() == subtrees_.size())
+      break;
+    subtrees_.swap(expanded);
+  }
+}
+
+/**
+ * Calculate the squared Euclidean distance between a query point and a reference point, stopping as soon as it exceeds a bound.
+ *
+ * \param query Permuted index of the query point.
+ * \param reference Permuted index of the reference point.
+ * \param bound Squared distance beyond which the calculation stops.
+ * \return Squared distance between the points, or a partial value greater than \a bound.
+ */
+template <typename T, unsigned int D>
+double KDJoin<T, D>::squared_distance(unsigned int query, unsigned int reference, double bound) const {
+  const T *p = query_data_.get_permuted(query).data(), *q = reference_data_.get_permuted(reference).data();
+  double distance = 0.0;
+  for (unsigned int d=0; d<D && distance <= bound; ++d) {
+    double difference = static_cast<double>(p[d]) - static_cast<double>(q[d]);
+    distance += difference * difference;
+  }
+  return distance;
+}
+
+/**
+ * Calculate the minimum squared Euclidean distance between the bounding boxes of a query branch and a reference branch.
+ *
+ * \param query Index of the query branch.
+ * \param reference Index of the reference branch.
+ */
+template <typename T, unsigned int D>
+double KDJoin<T, D>::min_squared_distance(unsigned int query, unsigned int reference) const {
+  return KDBounds::min_squared_distance(queries_.lower(query), queries_.upper(query), references_.lower(reference), references_.upper(reference));
+}
+
+/**
+ * Calculate the minimum squared Euclidean distance between a query point and the bounding box of a reference branch.
+ *
+ * \param index Permuted index of the query point.
+ * \param reference Index of the reference branch.
+ */
+template <typename T, unsigned int D>
+double KDJoin<T, D>::min_squared_distance_to_branch(unsigned int index, unsigned int reference) const {
+  const T *p = query_data_.get_permuted(index).data();
+  return KDBounds::min_squared_distance(p, p, references_.lower(reference), references_.upper(reference));
+}
+
+} // namespace kche_tree
@@ -0,0 +1,179 @@
+/***************************************************************************
+ *   Copyright (C) 2011, 2012 by Leandro Graciá Gil                        *
+ *   leandro.gracia.gil@gmail.com                                          *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/**
+ * \file kd-kernel.h
+ * \brief Templates for data used when estimating kernel densities with the kd-tree.
+ * \author Leandro Graciá Gil
+ */
+
+#ifndef _KCHE_TREE_KD_KERNEL_H_
+#define _KCHE_TREE_KD_KERNEL_H_
+
+// Include exponentials, fixed size integer types and STL vectors.
+#include <cmath>
+#include <stdint.h>
+#include <vector>
+
+#include "dataset.h"
+#include "kd-bounds.h"
+#include "vector.h"
+
+namespace kche_tree {
+
+/**
+ * \brief Bounds of the kernel sums of a point, used to decide if a branch can be approximated.
+ *
+ * Approximating a branch of weight \f$ W_b \f$ by the midpoint of its kernel bounds introduces an error of at most
+ * \f$ \delta W_b \f$, half the width of the bounds. The sum stays within a relative error \f$ \epsilon \f$ if each approximation
+ * satisfies \f$ \delta W_b \le (\epsilon L - E) W_b / (W - A) \f$, where \f$ L \f$ is a lower bound of the sum, \f$ E \f$ the error
+ * introduced so far and \f$ A \f$ the weight of the points already accounted for. Error not used by exact calculations is
+ * therefore available to later approximations.
+ */
+struct KernelSumBounds {
+  double lower; ///< Lower bound of the kernel sum.
+  double error; ///< Maximum error introduced by the approximations made so far.
+  double weight; ///< Weight of the points already accounted for, either exactly or approximately.
+
+  /// Check if a branch can be approximated given the half width of its kernel bounds, the relative error and the total weight.
+  bool can_approximate(double half_width, double relative_error, double total_weight) const {
+    return half_width * (total_weight - weight) <= relative_error * lower - error;
+  }
+};
+
+/**
+ * \brief Structure holding the data specific to estimating the Gaussian kernel density at a point.
+ *
+ * Keeps the region of the node being visited and the bounds of the kernel sum.
+ * Branches are approximated by the midpoint of their kernel bounds if allowed by the requested relative error.
+ */
+template <typename ElementType, unsigned int NumDimensions>
+struct KDKernelSearch {
+
+  /// Type of the elements in the feature vectors.
+  typedef ElementType Element;
+
+  /// Number of dimensions of the feature vectors.
+  static const unsigned int Dimensions = NumDimensions;
+
+  /// Alias of compatible feature vectors.
+  typedef typename kche_tree::Vector<Element, Dimensions> Vector;
+
+  /// Alias of compatible non-labeled data sets.
+  typedef typename kche_tree::DataSet<Element, Dimensions> DataSet;
+
+  /// Alias of the bounding boxes used to calculate distances.
+  typedef kche_tree::KDBounds<Element, Dimensions> KDBounds;
+
+  const Vector &p; ///< Point where the density is estimated.
+  const DataSet &data; ///< Permuted training set.
+  const uint32_t *cumulative_counts; ///< Number of original vectors before each permuted index, or \c NULL if none were collapsed.
+  const double factor; ///< Factor applied to the squared distances in the exponent of the kernel.
+  const double relative_error; ///< Maximum error of the kernel sum relative to its value.
+  const double total_weight; ///< Number of original vectors in the training set.
+
+  Vector region_lower; ///< Lower corner of the region of the node being visited.
+  Vector region_upper; ///< Upper corner of the region of the node being visited.
+  double sum; ///< Sum of the kernel values of the points visited so far.
+  KernelSumBounds bounds; ///< Bounds of the kernel sum.
+
+  /// Initialize data for a kernel density estimation starting from the bounding box of the training set.
+  KDKernelSearch(const Vector &p, const DataSet &data, const uint32_t *cumulative_counts, unsigned int total_weight,
+      double bandwidth, double relative_error, const Vector &data_lower, const Vector &data_upper);
+
+  // Kernel evaluation.
+  double kernel(double squared_distance) const { return std::exp(factor * squared_distance); } ///< Gaussian kernel of a squared distance.
+  unsigned int weight(unsigned int begin, unsigned int end) const; ///< Number of original vectors in a range of permuted indices.
+  void region_bounds(double &min_kernel, double &max_kernel) const;
+
+  // Approximation of whole branches.
+  bool approximate(unsigned int weight, double min_kernel, double max_kernel);
+};
+
+/**
+ * \brief Dual-tree estimation of the Gaussian kernel densities of a set of queries.
+ *
+ * Traverses pairs of branches from the query and reference hierarchies. Approximations of a reference branch are
+ * kept pending in the query branch, and the bounds of the sums of its queries are tracked as the worst ones among
+ * its descendants, so a single check approximates a reference branch for many queries at once. The lower bounds are
+ * also seeded with the exact sum of each query over its closest reference leaf, so that far branches can be
+ * approximated regardless of the order in which the pairs are visited.
+ *
+ * \tparam ElementType Type of the elements in the feature vectors.
+ * \tparam NumDimensions Number of dimensions of the feature vectors.
+ */
+template <typename ElementType, unsigned int NumDimensions>
+class KDKernelDualSearch {
+public:
+  /// Type of the elements in the feature vectors.
+  typedef ElementType Element;
+
+  /// Number of dimensions of the feature vectors.
+  static const unsigned int Dimensions = NumDimensions;
+
+  /// Alias of compatible non-labeled data sets.
+  typedef typename kche_tree::DataSet<Element, Dimensions> DataSet;
+
+  /// Alias of the flat hierarchies used for the queries and the references.
+  typedef kche_tree::KDBounds<Element, Dimensions> KDBounds;
+
+  // Constructor.
+  KDKernelDualSearch(const KDBounds &queries, const DataSet &query_data, const KDBounds &references, const DataSet &reference_data,
+      const uint32_t *cumulative_counts, double bandwidth, double relative_error);
+
+  // Estimate the kernel sums of all the queries, indexed by their permuted indices.
+  void run(std::vector<double> &sums);
+
+private:
+  // Dual-tree traversal.
+  void traverse(unsigned int query, unsigned int reference, const KernelSumBounds &inherited, double min_kernel, double max_kernel);
+  void base_case(unsigned int query, unsigned int reference, const KernelSumBounds &inherited, double min_kernel);
+  void push_pending(unsigned int query, double inherited_sum, std::vector<double> &sums) const;
+  double seed(unsigned int query);
+  double leaf_sum(const Element *q, unsigned int reference) const;
+  void bounds(unsigned int query, unsigned int reference, double &min_kernel, double &max_kernel) const;
+  KernelSumBounds pending_bounds(unsigned int query, const KernelSumBounds &inherited) const;
+  void update_worst(unsigned int query, const KernelSumBounds &bounds, bool first);
+  static double diagonal(const KDBounds &bounds, unsigned int index);
+
+  const KDBounds &queries_; ///< Hierarchy of the query tree.
+  const DataSet &query_data_; ///< Permuted queries.
+  const KDBounds &references_; ///< Hierarchy of the reference tree.
+  const DataSet &reference_data_; ///< Permuted reference data.
+  const uint32_t *cumulative_counts_; ///< Number of original reference vectors before each permuted index, or \c NULL if none were collapsed.
+  const double factor_; ///< Factor applied to the squared distances in the exponent of the kernel.
+  const double relative_error_; ///< Maximum error of each kernel sum relative to its value.
+  const double total_weight_; ///< Number of original vectors in the reference data.
+
+  std::vector<double> pending_sum_; ///< Approximated kernel sums pending to be added to all the queries of each query branch.
+  std::vector<KernelSumBounds> pending_; ///< Changes in the bounds applying to all the queries of each query branch.
+  std::vector<KernelSumBounds> worst_; ///< Worst bounds among the queries of each branch, excluding the changes pending in the branch and its ancestors.
+  std::vector<double> sums_; ///< Exact kernel sums of each query.
+  std::vector<KernelSumBounds> query_bounds_; ///< Bounds of the kernel sum of each query, excluding the changes pending in its branches.
+  std::vector<double> seed_lower_; ///< Lowest seed lower bound among the queries of each branch.
+  std::vector<double> query_seed_lower_; ///< Exact kernel sum between each query and its closest reference leaf, used as a lower bound of its sum.
+};
+
+} // namespace kche_tree
+
+// Template implementation.
+#include "kd-kernel.tpp"
+
+#endif
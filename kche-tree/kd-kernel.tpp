@@ -0,0 +1,416 @@
+/***************************************************************************
+ *   Copyright (C) 2011, 2012 by Leandro Graciá Gil                        *
+ *   leandro.gracia.gil@gmail.com                                          *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/**
+ * \file kd-kernel.tpp
+ * \brief Template implementation for the data used when estimating kernel densities with the kd-tree.
+ * \author Leandro Graciá Gil
+ */
+
+namespace kche_tree {
+
+/**
+ * Initialize a kernel density search with the region of the root node.
+ *
+ * \param p Point where the density is estimated, in the dimension order of the stored vectors.
+ * \param data Permuted training set stored by the tree.
+ * \param cumulative_counts Number of original vectors before each permuted index, followed by the total. \c NULL if no vectors were collapsed.
+ * \param total_weight Number of original vectors in the training set.
+ * \param bandwidth Standard deviation of the Gaussian kernel.
+ * \param relative_error Maximum error of the kernel sum relative to its value.
+ * \param data_lower Lower corner of the bounding box of the training set.
+ * \param data_upper Upper corner of the bounding box of the training set.
+ */
+template <typename T, unsigned int D>
+KDKernelSearch<T, D>::KDKernelSearch(const Vector &p, const DataSet &data, const uint32_t *cumulative_counts, unsigned int total_weight,
+    double bandwidth, double relative_error, const Vector &data_lower, const Vector &data_upper)
+  : p(p),
+    data(data),
+    cumulative_counts(cumulative_counts),
+    factor(-0.5 / (bandwidth * bandwidth)),
+    relative_error(relative_error),
+    total_weight(total_weight),
+    region_lower(data_lower),
+    region_upper(data_upper),
+    sum(0.0) {
+
+  bounds.lower = bounds.error = bounds.weight = 0.0;
+}
+
+/**
+ * Get the number of original vectors in a range of permuted indices, including identical ones collapsed in the kd-tree.
+ *
+ * \param begin First permuted index of the range.
+ * \param end Permuted index following the last one in the range.
+ * \return Number of original vectors in the range.
+ */
+template <typename T, unsigned int D>
+unsigned int KDKernelSearch<T, D>::weight(unsigned int begin, unsigned int end) const {
+  return cumulative_counts ? cumulative_counts[end] - cumulative_counts[begin] : end - begin;
+}
+
+/**
+ * Calculate the range of the kernel values between the point and the region of the node being visited.
+ *
+ * \param min_kernel Lower bound of the kernel values, given by the farthest point in the region.
+ * \param max_kernel Upper bound of the kernel values, given by the closest point in the region.
+ */
+template <typename T, unsigned int D>
+void KDKernelSearch<T, D>::region_bounds(double &min_kernel, double &max_kernel) const {
+  min_kernel = kernel(KDBounds::max_squared_distance(p.data(), p.data(), region_lower.data(), region_upper.data()));
+  max_kernel = kernel(KDBounds::min_squared_distance(p.data(), p.data(), region_lower.data(), region_upper.data()));
+}
+
+/**
+ * Approximate a branch by the midpoint of its kernel bounds if allowed by the relative error.
+ *
+ * \param weight Number of original vectors in the branch.
+ * \param min_kernel Lower bound of the kernel values in the branch, already included in the lower bound of the sum.
+ * \param max_kernel Upper bound of the kernel values in the branch.
+ * \return \c true if the branch was approximated, \c false if it has to be expanded.
+ */
+template <typename T, unsigned int D>
+bool KDKernelSearch<T, D>::approximate(unsigned int weight, double min_kernel, double max_kernel) {
+  const double half_width = 0.5 * (max_kernel - min_kernel);
+  if (!bounds.can_approximate(half_width, relative_error, total_weight))
+    return false;
+
+  sum += 0.5 * weight * (min_kernel + max_kernel);
+  bounds.error += weight * half_width;
+  bounds.weight += weight;
+  return true;
+}
+
+/**
+ * Initialize a dual-tree kernel density search.
+ *
+ * \param queries Hierarchy of the tree built from the queries.
+ * \param query_data Permuted queries.
+ * \param references Hierarchy of the kd-tree with the training data.
+ * \param reference_data Permuted training set.
+ * \param cumulative_counts Number of original training vectors before each permuted index, followed by the total. \c NULL if no vectors were collapsed.
+ * \param bandwidth Standard deviation of the Gaussian kernel.
+ * \param relative_error Maximum error of each kernel sum relative to its value.
+ */
+template <typename T, unsigned int D>
+KDKernelDualSearch<T, D>::KDKernelDualSearch(const KDBounds &queries, const DataSet &query_data, const KDBounds &references, const DataSet &reference_data,
+    const uint32_t *cumulative_counts, double bandwidth, double relative_error)
+  : queries_(queries),
+    query_data_(query_data),
+    references_(references),
+    reference_data_(reference_data),
+    cumulative_counts_(cumulative_counts),
+    factor_(-0.5 / (bandwidth * bandwidth)),
+    relative_error_(relative_error),
+    total_weight_(references[0].weight) {}
+
+/**
+ * Estimate the sums of the kernel values between each query and all the reference points.
+ *
+ * \param sums Vector where the kernel sums will be stored, indexed by the permuted indices of the queries.
+ */
+template <typename T, unsigned int D>
+void KDKernelDualSearch<T, D>::run(std::vector<double> &sums) {
+  const KernelSumBounds zero = { 0.0, 0.0, 0.0 };
+  pending_sum_.assign(queries_.size(), 0.0);
+  pending_.assign(queries_.size(), zero);
+  worst_.assign(queries_.size(), zero);
+  sums_.assign(query_data_.size(), 0.0);
+  query_bounds_.assign(query_data_.size(), zero);
+  seed_lower_.resize(queries_.size());
+  query_seed_lower_.resize(query_data_.size());
+  seed(0);
+
+  // All the reference points contribute at least the kernel value of the farthest point between both roots.
+  double min_kernel, max_kernel;
+  bounds(0, 0, min_kernel, max_kernel);
+  pending_[0].lower = total_weight_ * min_kernel;
+  traverse(0, 0, zero, min_kernel, max_kernel);
+
+  sums.resize(query_data_.size());
+  push_pending(0, 0.0, sums);
+}
+
+/**
+ * Process a pair of query and reference branches. The lower bounds of the queries must already include the
+ * minimum kernel value of the pair for all the points in the reference branch.
+ *
+ * \param query Index of the query branch.
+ * \param reference Index of the reference branch.
+ * \param inherited Changes in the bounds pending in the ancestors of the query branch.
+ * \param min_kernel Lower bound of the kernel values between the points of both branches.
+ * \param max_kernel Upper bound of the kernel values between the points of both branches.
+ */
+template <typename T, unsigned int D>
+void KDKernelDualSearch<T, D>::traverse(unsigned int query, unsigned int reference, const KernelSumBounds &inherited, double min_kernel, double max_kernel) {
+  const typename KDBounds::Branch &query_branch = queries_[query];
+  const typename KDBounds::Branch &reference_branch = references_[reference];
+
+  // Approximate the reference branch for all the queries in the query branch if allowed for the worst of them.
+  const double half_width = 0.5 * (max_kernel - min_kernel);
+  KernelSumBounds current = pending_bounds(query, inherited);
+  if (current.lower < seed_lower_[query])
+    current.lower = seed_lower_[query];
+  if (current.can_approximate(half_width, relative_error_, total_weight_)) {
+    pending_sum_[query] += 0.5 * reference_branch.weight * (min_kernel + max_kernel);
+    pending_[query].error += reference_branch.weight * half_width;
+    pending_[query].weight += reference_branch.weight;
+    return;
+  }
+
+  const bool query_leaf = queries_.is_leaf(query);
+  const bool reference_leaf = references_.is_leaf(reference);
+  if (query_leaf && reference_leaf) {
+    base_case(query, reference, inherited, min_kernel);
+    return;
+  }
+
+  // Split the query branch if its bounding box is the largest one, tightening the lower bounds of its children.
+  if (reference_leaf || (!query_leaf && diagonal(queries_, query) >= diagonal(references_, reference))) {
+    const unsigned int children[2] = { query_branch.left, query_branch.right };
+    KernelSumBounds children_inherited = inherited;
+    children_inherited.lower += pending_[query].lower;
+    children_inherited.error += pending_[query].error;
+    children_inherited.weight += pending_[query].weight;
+    for (unsigned int i=0; i<2; ++i) {
+      double child_min_kernel, child_max_kernel;
+      bounds(children[i], reference, child_min_kernel, child_max_kernel);
+      pending_[children[i]].lower += reference_branch.weight * (child_min_kernel - min_kernel);
+      traverse(children[i], reference, children_inherited, child_min_kernel, child_max_kernel);
+    }
+
+    update_worst(query, pending_bounds(children[0], KernelSumBounds()), true);
+    update_worst(query, pending_bounds(children[1], KernelSumBounds()), false);
+    return;
+  }
+
+  // Split the reference branch, replacing its contribution to the lower bounds by the ones of its children.
+  const unsigned int left = reference_branch.left, right = reference_branch.right;
+  double left_min_kernel, left_max_kernel, right_min_kernel, right_max_kernel;
+  bounds(query, left, left_min_kernel, left_max_kernel);
+  bounds(query, right, right_min_kernel, right_max_kernel);
+  pending_[query].lower += references_[left].weight * left_min_kernel + references_[right].weight * right_min_kernel - reference_branch.weight * min_kernel;
+
+  // Visit first the child with the highest potential contribution to tighten the lower bounds sooner.
+  if (left_max_kernel >= right_max_kernel) {
+    traverse(query, left, inherited, left_min_kernel, left_max_kernel);
+    traverse(query, right, inherited, right_min_kernel, right_max_kernel);
+  } else {
+    traverse(query, right, inherited, right_min_kernel, right_max_kernel);
+    traverse(query, left, inherited, left_min_kernel, left_max_kernel);
+  }
+}
+
+/**
+ * Add the kernel values between the queries of a leaf and the points of a reference leaf.
+ * The reference leaf is still approximated for each query whose own bounds allow it, calculating the sums exactly otherwise.
+ *
+ * \param query Index of the query leaf.
+ * \param reference Index of the reference leaf.
+ * \param inherited Changes in the bounds pending in the ancestors of the query leaf.
+ * \param min_kernel Lower bound of the kernel values between both leaves, already included in the lower bounds of the queries.
+ */
+template <typename T, unsigned int D>
+void KDKernelDualSearch<T, D>::base_case(unsigned int query, unsigned int reference, const KernelSumBounds &inherited, double min_kernel) {
+  const typename KDBounds::Branch &query_branch = queries_[query];
+  const typename KDBounds::Branch &reference_branch = references_[reference];
+  const Element *reference_lower = references_.lower(reference), *reference_upper = references_.upper(reference);
+
+  for (unsigned int i=query_branch.begin; i<query_branch.end; ++i) {
+    const Element *q = query_data_.get_permuted(i).data();
+    KernelSumBounds &bounds = query_bounds_[i];
+
+    // Tighten the lower bound of the query with the kernel bounds of its own point.
+    const double point_min_kernel = std::exp(factor_ * KDBounds::max_squared_distance(q, q, reference_lower, reference_upper));
+    const double point_max_kernel = std::exp(factor_ * KDBounds::min_squared_distance(q, q, reference_lower, reference_upper));
+    bounds.lower += reference_branch.weight * (point_min_kernel - min_kernel);
+
+    KernelSumBounds current = bounds;
+    current.lower += pending_[query].lower + inherited.lower;
+    current.error += pending_[query].error + inherited.error;
+    current.weight += pending_[query].weight + inherited.weight;
+    if (current.lower < query_seed_lower_[i])
+      current.lower = query_seed_lower_[i];
+
+    const double half_width = 0.5 * (point_max_kernel - point_min_kernel);
+    if (current.can_approximate(half_width, relative_error_, total_weight_)) {
+      sums_[i] += 0.5 * reference_branch.weight * (point_min_kernel + point_max_kernel);
+      bounds.error += reference_branch.weight * half_width;
+    } else {
+      double sum = leaf_sum(q, reference);
+      sums_[i] += sum;
+      bounds.lower += sum - reference_branch.weight * point_min_kernel;
+    }
+
+    bounds.weight += reference_branch.weight;
+    update_worst(query, bounds, i == query_branch.begin);
+  }
+}
+
+/**
+ * Calculate the seed lower bounds of the kernel sums of the queries in a branch and its descendants.
+ *
+ * The exact kernel sum between a query and the reference leaf closest to it is a lower bound of its total sum independent
+ * of the traversal. Used in addition to the lower bounds tracked during the traversal, so that reference branches far
+ * from all the queries of a branch can be approximated before the closest ones are visited.
+ *
+ * \param query Index of the query branch.
+ * \return Lowest seed lower bound among the queries of the branch.
+ */
+template <typename T, unsigned int D>
+double KDKernelDualSearch<T, D>::seed(unsigned int query) {
+  const typename KDBounds::Branch &query_branch = queries_[query];
+
+  if (!queries_.is_leaf(query)) {
+    double left_seed = seed(query_branch.left);
+    double right_seed = seed(query_branch.right);
+    seed_lower_[query] = left_seed < right_seed ? left_seed : right_seed;
+    return seed_lower_[query];
+  }
+
+  double min_seed = 0.0;
+  for (unsigned int i=query_branch.begin; i<query_branch.end; ++i) {
+    const Element *q = query_data_.get_permuted(i).data();
+
+    // Descend to the reference leaf closest to the query.
+    unsigned int reference = 0;
+    while (!references_.is_leaf(reference)) {
+      unsigned int left = references_[reference].left, right = references_[reference].right;
+      reference = KDBounds::min_squared_distance(q, q, references_.lower(right), references_.upper(right)) <
+                  KDBounds::min_squared_distance(q, q, references_.lower(left), references_.upper(left)) ? right : left;
+    }
+
+    query_seed_lower_[i] = leaf_sum(q, reference);
+    if (i == query_branch.begin || query_seed_lower_[i] < min_seed)
+      min_seed = query_seed_lower_[i];
+  }
+
+  seed_lower_[query] = min_seed;
+  return min_seed;
+}
+
+/**
+ * Calculate the exact kernel sum between a query and the points of a reference leaf.
+ *
+ * \param q Query point.
+ * \param reference Index of the reference leaf.
+ * \return Sum of the kernel values, weighted by the number of original vectors of each point.
+ */
+template <typename T, unsigned int D>
+double KDKernelDualSearch<T, D>::leaf_sum(const Element *q, unsigned int reference) const {
+  const typename KDBounds::Branch &reference_branch = references_[reference];
+
+  double sum = 0.0;
+  for (unsigned int j=reference_branch.begin; j<reference_branch.end; ++j) {
+    const Element *r = reference_data_.get_permuted(j).data();
+    double weight = cumulative_counts_ ? cumulative_counts_[j + 1] - cumulative_counts_[j] : 1.0;
+    sum += weight * std::exp(factor_ * KDBounds::min_squared_distance(q, q, r, r));
+  }
+  return sum;
+}
+
+/**
+ * Add the approximated sums pending in the query branches to the exact sums of their queries.
+ *
+ * \param query Index of the query branch.
+ * \param inherited_sum Approximated sums pending in the ancestors of the branch.
+ * \param sums Vector where the final kernel sums are stored, indexed by the permuted indices of the queries.
+ */
+template <typename T, unsigned int D>
+void KDKernelDualSearch<T, D>::push_pending(unsigned int query, double inherited_sum, std::vector<double> &sums) const {
+  const typename KDBounds::Branch &query_branch = queries_[query];
+  inherited_sum += pending_sum_[query];
+
+  if (!queries_.is_leaf(query)) {
+    push_pending(query_branch.left, inherited_sum, sums);
+    push_pending(query_branch.right, inherited_sum, sums);
+    return;
+  }
+
+  for (unsigned int i=query_branch.begin; i<query_branch.end; ++i)
+    sums[i] = sums_[i] + inherited_sum;
+}
+
+/**
+ * Calculate the range of the kernel values between the points of a query branch and a reference branch.
+ *
+ * \param query Index of the query branch.
+ * \param reference Index of the reference branch.
+ * \param min_kernel Lower bound of the kernel values, given by the farthest points of the bounding boxes.
+ * \param max_kernel Upper bound of the kernel values, given by the closest points of the bounding boxes.
+ */
+template <typename T, unsigned int D>
+void KDKernelDualSearch<T, D>::bounds(unsigned int query, unsigned int reference, double &min_kernel, double &max_kernel) const {
+  min_kernel = std::exp(factor_ * KDBounds::max_squared_distance(queries_.lower(query), queries_.upper(query), references_.lower(reference), references_.upper(reference)));
+  max_kernel = std::exp(factor_ * KDBounds::min_squared_distance(queries_.lower(query), queries_.upper(query), references_.lower(reference), references_.upper(reference)));
+}
+
+/**
+ * Get the worst bounds among the queries of a branch, including the changes pending in it and its ancestors.
+ *
+ * \param query Index of the query branch.
+ * \param inherited Changes in the bounds pending in the ancestors of the branch.
+ * \return Lowest lower bound, largest error and smallest accounted weight among the queries of the branch.
+ */
+template <typename T, unsigned int D>
+KernelSumBounds KDKernelDualSearch<T, D>::pending_bounds(unsigned int query, const KernelSumBounds &inherited) const {
+  KernelSumBounds bounds = worst_[query];
+  bounds.lower += pending_[query].lower + inherited.lower;
+  bounds.error += pending_[query].error + inherited.error;
+  bounds.weight += pending_[query].weight + inherited.weight;
+  return bounds;
+}
+
+/**
+ * Update the worst bounds of a query branch with the ones of one of its queries or children.
+ *
+ * \param query Index of the query branch.
+ * \param bounds Bounds of the query or child, excluding the changes pending in the branch and its ancestors.
+ * \param first Indicates if the bounds replace the current worst ones instead of being combined with them.
+ */
+template <typename T, unsigned int D>
+void KDKernelDualSearch<T, D>::update_worst(unsigned int query, const KernelSumBounds &bounds, bool first) {
+  KernelSumBounds &worst = worst_[query];
+  if (first) {
+    worst = bounds;
+    return;
+  }
+
+  if (bounds.lower < worst.lower)
+    worst.lower = bounds.lower;
+  if (bounds.error > worst.error)
+    worst.error = bounds.error;
+  if (bounds.weight < worst.weight)
+    worst.weight = bounds.weight;
+}
+
+/**
+ * Calculate the squared length of the diagonal of the bounding box of a branch.
+ *
+ * \param bounds Hierarchy containing the branch.
+ * \param index Index of the branch.
+ * \return Squared length of the diagonal.
+ */
+template <typename T, unsigned int D>
+double KDKernelDualSearch<T, D>::diagonal(const KDBounds &bounds, unsigned int index) {
+  return KDBounds::max_squared_distance(bounds.lower(index), bounds.upper(index), bounds.lower(index), bounds.upper(index));
+}
+
+} // namespace kche_tree
@@ -0,0 +1,123 @@
+/***************************************************************************
+ *   Copyright (C) 2011, 2012 by Leandro Graciá Gil                        *
+ *   leandro.gracia.gil@gmail.com                                          *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/**
+ * \file kd-kmeans.h
+ * \brief Template for k-means clustering with the filtering algorithm over a kd-tree.
+ * \author Leandro Graciá Gil
+ */
+
+#ifndef _KCHE_TREE_KD_KMEANS_H_
+#define _KCHE_TREE_KD_KMEANS_H_
+
+// Include fixed size integer types and STL vectors.
+#include <stdint.h>
+#include <vector>
+
+#include "dataset.h"
+#include "kd-bounds.h"
+
+namespace kche_tree {
+
+/**
+ * \brief K-means clustering of the points stored in a kd-tree using the filtering algorithm of Kanungo et al.
+ *
+ * Each iteration of Lloyd's algorithm traverses the hierarchy of the kd-tree keeping the candidate centers of each
+ * branch. Candidates farther than another one from every point of the bounding box of the branch are filtered out, and
+ * branches left with a single candidate are assigned to it as a whole using their precalculated weighted sums, without
+ * calculating the distances of their points. If OpenMP is enabled, the subtrees below the first levels are split in
+ * a contiguous range per thread whose partial sums are merged in order at the end of each iteration.
+ *
+ * Centers are handled in double precision and in the dimension order of the stored points.
+ *
+ * \tparam ElementType Type of the elements in the feature vectors.
+ * \tparam NumDimensions Number of dimensions of the feature vectors.
+ */
+template <typename ElementType, unsigned int NumDimensions>
+class KDKMeans {
+public:
+  /// Type of the elements in the feature vectors.
+  typedef ElementType Element;
+
+  /// Number of dimensions of the feature vectors.
+  static const unsigned int Dimensions = NumDimensions;
+
+  /// Alias of compatible non-labeled data sets.
+  typedef typename kche_tree::DataSet<Element, Dimensions> DataSet;
+
+  /// Alias of the flat hierarchy of the kd-tree.
+  typedef kche_tree::KDBounds<Element, Dimensions> KDBounds;
+
+  // Constructor.
+  KDKMeans(const KDBounds &bounds, const DataSet &data, const uint32_t *cumulative_counts);
+
+  // Iterate until convergence, returning the number of iterations.
+  unsigned int run(std::vector<double> &centers, unsigned int max_iterations);
+
+  // Assign each point to its nearest center, returning the sum of squared distances.
+  double assign(const std::vector<double> &centers, std::vector<uint32_t> &labels);
+
+private:
+  /// Weighted sums of the points assigned to each center by a range of subtrees.
+  struct Partial {
+    std::vector<double> sums; ///< Sum of the points assigned to each center.
+    std::vector<double> weights; ///< Number of original vectors assigned to each center.
+    double inertia; ///< Sum of the squared distances of the points to their centers.
+    uint32_t *labels; ///< Center assigned to each permuted point. Not recorded if \c NULL.
+  };
+
+  // Traversal of all the subtrees.
+  void iterate(const std::vector<double> &centers, Partial &total);
+  void filter(unsigned int branch, const uint32_t *candidates, unsigned int num_candidates, uint32_t *scratch, Partial &partial) const;
+  void assign_branch(unsigned int branch, unsigned int center, Partial &partial) const;
+  bool dominated(unsigned int branch, unsigned int center, unsigned int closest) const;
+  double squared_distance(const double *center, const Element *point) const;
+
+  // Preparation of the hierarchy.
+  void add_branch_sums();
+  void find_subtrees(unsigned int num_subtrees);
+  unsigned int depth(unsigned int branch) const;
+
+  /// Minimum number of subtrees per thread if OpenMP is enabled.
+  static const unsigned int subtrees_per_range = 4;
+
+  /// Minimum number of points per thread if OpenMP is enabled.
+  static const unsigned int min_points_per_range = 4096;
+
+  const KDBounds &bounds_; ///< Hierarchy of the kd-tree.
+  const DataSet &data_; ///< Permuted data stored by the kd-tree.
+  const uint32_t *cumulative_counts_; ///< Number of original vectors before each permuted index, or \c NULL if none were collapsed.
+
+  std::vector<double> sums_; ///< Weighted sum of the points of each branch.
+  std::vector<double> squared_norms_; ///< Weighted sum of the squared norms of the points of each branch.
+  std::vector<uint32_t> subtrees_; ///< Disjoint subtrees covering the hierarchy, processed independently.
+  unsigned int num_ranges_; ///< Number of contiguous ranges of subtrees processed in parallel.
+  unsigned int depth_; ///< Number of levels of the hierarchy.
+
+  const double *centers_; ///< Centers of the current iteration.
+  unsigned int num_centers_; ///< Number of centers of the current iteration.
+};
+
+} // namespace kche_tree
+
+// Template implementation.
+#include "kd-kmeans.tpp"
+
+#endif
@@ -0,0 +1,390 @@
+/***************************************************************************
+ *   Copyright (C) 2011, 2012 by Leandro Graciá Gil                        *
+ *   leandro.gracia.gil@gmail.com                                          *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/**
+ * \file kd-kmeans.tpp
+ * \brief Template implementation for k-means clustering with the filtering algorithm over a kd-tree.
+ * \author Leandro Graciá Gil
+ */
+
+// Include STL algorithms.
+#include <algorithm>
+
+// Include OpenMP functions if enabled.
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace kche_tree {
+
+// Static data.
+template <typename T, unsigned int D>
+const unsigned int KDKMeans<T, D>::subtrees_per_range;
+
+template <typename T, unsigned int D>
+const unsigned int KDKMeans<T, D>::min_points_per_range;
+
+/**
+ * Prepare the k-means clustering of the points of a kd-tree, calculating the weighted sums of the points of each branch.
+ *
+ * \param bounds Hierarchy of the kd-tree.
+ * \param data Permuted data stored by the kd-tree.
+ * \param cumulative_counts Number of original vectors before each permuted index, followed by the total. \c NULL if no vectors were collapsed.
+ */
+template <typename T, unsigned int D>
+KDKMeans<T, D>::KDKMeans(const KDBounds &bounds, const DataSet &data, const uint32_t *cumulative_counts)
+    : bounds_(bounds),
+      data_(data),
+      cumulative_counts_(cumulative_counts),
+      num_ranges_(1),
+      depth_(0),
+      centers_(NULL),
+      num_centers_(0) {
+
+  if (!bounds_.size())
+    return;
+
+  add_branch_sums();
+  depth_ = depth(0);
+
+  #ifdef _OPENMP
+  const int ranges = std::min(omp_get_max_threads(), static_cast<int>(data_.size() / min_points_per_range));
+  if (ranges > 1)
+    num_ranges_ = static_cast<unsigned int>(ranges);
+  #endif
+
+  find_subtrees(num_ranges_ > 1 ? num_ranges_ * subtrees_per_range : 1);
+}
+
+/**
+ * Run Lloyd's algorithm until the centers do not change or the maximum number of iterations is reached.
+ * Centers without any point assigned keep their position.
+ *
+ * \param centers Coordinates of the initial centers, stored contiguously. Replaced by the final ones.
+ * \param max_iterations Maximum number of iterations.
+ * \return Number of iterations run.
+ */
+template <typename T, unsigned int D>
+unsigned int KDKMeans<T, D>::run(std::vector<double> &centers, unsigned int max_iterations) {
+
+  unsigned int iteration = 0;
+  while (iteration < max_iterations && bounds_.size()) {
+    Partial total;
+    total.labels = NULL;
+    iterate(centers, total);
+    ++iteration;
+
+    bool changed = false;
+    for (unsigned int c=0; c<num_centers_; ++c) {
+      if (!(total.weights[c] > 0.0))
+        continue;
+
+      for (unsigned int d=0; d<D; ++d) {
+        double coordinate = total.sums[c * D + d] / total.weights[c];
+        if (coordinate != centers[c * D + d]) {
+          centers[c * D + d] = coordinate;
+          changed = true;
+        }
+      }
+    }
+
+    if (!changed)
+      break;
+  }
+
+  return iteration;
+}
+
+/**
+ * Assign each point to its nearest center, breaking ties by the lowest center index.
+ *
+ * \param centers Coordinates of the centers, stored contiguously.
+ * \param labels STL vector where the center of each point is stored, indexed by permuted index.
+ * \return Sum of the squared distances of the original vectors to their centers.
+ */
+template <typename T, unsigned int D>
+double KDKMeans<T, D>::assign(const std::vector<double> &centers, std::vector<uint32_t> &labels) {
+
+  labels.assign(data_.size(), 0);
+  if (!bounds_.size() || labels.empty())
+    return 0.0;
+
+  Partial total;
+  total.labels = &labels[0];
+  iterate(centers, total);
+  return total.inertia;
+}
+
+/**
+ * Assign all the points to the centers by filtering the candidates of each subtree.
+ *
+ * \param centers Coordinates of the centers, stored contiguously.
+ * \param total Sums of the points assigned to each center. The labels are recorded if not \c NULL.
+ */
+template <typename T, unsigned int D>
+void KDKMeans<T, D>::iterate(const std::vector<double> &centers, Partial &total) {
+
+  centers_ = &centers[0];
+  num_centers_ = static_cast<unsigned int>(centers.size() / D);
+  total.sums.assign(num_centers_ * D, 0.0);
+  total.weights.assign(num_centers_, 0.0);
+  total.inertia = 0.0;
+
+  const int ranges = static_cast<int>(num_ranges_);
+  const unsigned int num_subtrees = static_cast<unsigned int>(subtrees_.size());
+  std::vector<Partial> partial(ranges, total);
+
+  #ifdef _OPENMP
+  #pragma omp parallel for schedule(static)
+  #endif
+  for (int range = 0; range < ranges; ++range) {
+    unsigned int first = static_cast<unsigned int>(static_cast<uint64_t>(num_subtrees) * range / ranges);
+    unsigned int last = static_cast<unsigned int>(static_cast<uint64_t>(num_subtrees) * (range + 1) / ranges);
+
+    // Keep the candidates of each level of the hierarchy, starting with all the centers.
+    std::vector<uint32_t> candidates((depth_ + 1) * num_centers_);
+    for (unsigned int c=0; c<num_centers_; ++c)
+      candidates[c] = c;
+
+    for (unsigned int s=first; s<last; ++s)
+      filter(subtrees_[s], &candidates[0], num_centers_, &candidates[num_centers_], partial[range]);
+  }
+
+  for (int range = 0; range < ranges; ++range) {
+    for (unsigned int i=0; i<total.sums.size(); ++i)
+      total.sums[i] += partial[range].sums[i];
+    for (unsigned int c=0; c<num_centers_; ++c)
+      total.weights[c] += partial[range].weights[c];
+    total.inertia += partial[range].inertia;
+  }
+}
+
+/**
+ * Filter the candidate centers of a branch, assigning it as a whole if only one is left and recursing otherwise.
+ *
+ * \param branch Index of the branch in the hierarchy.
+ * \param candidates Candidate centers of the branch, in increasing order.
+ * \param num_candidates Number of candidate centers.
+ * \param scratch Memory where the candidates of the branch and its descendants are stored.
+ * \param partial Sums where the points of the branch are added.
+ */
+template <typename T, unsigned int D>
+void KDKMeans<T, D>::filter(unsigned int branch, const uint32_t *candidates, unsigned int num_candidates, uint32_t *scratch, Partial &partial) const {
+
+  const typename KDBounds::Branch &node = bounds_[branch];
+  if (node.begin == node.end)
+    return;
+
+  if (num_candidates == 1) {
+    assign_branch(branch, candidates[0], partial);
+    return;
+  }
+
+  // Assign each point of the leaves to its nearest candidate.
+  if (bounds_.is_leaf(branch)) {
+    for (unsigned int i=node.begin; i<node.end; ++i) {
+      const T *point = data_.get_permuted(i).data();
+      unsigned int nearest = candidates[0];
+      double nearest_distance = squared_distance(centers_ + nearest * D, point);
+      for (unsigned int c=1; c<num_candidates; ++c) {
+        double distance = squared_distance(centers_ + candidates[c] * D, point);
+        if (distance < nearest_distance) {
+          nearest_distance = distance;
+          nearest = candidates[c];
+        }
+      }
+
+      const double weight = cumulative_counts_ ? cumulative_counts_[i + 1] - cumulative_counts_[i] : 1.0;
+      for (unsigned int d=0; d<D; ++d)
+        partial.sums[nearest * D + d] += weight * static_cast<double>(point[d]);
+      partial.weights[nearest] += weight;
+      partial.inertia += weight * nearest_distance;
+      if (partial.labels)
+        partial.labels[i] = nearest;
+    }
+    return;
+  }
+
+  // Find the candidate closest to the midpoint of the bounding box.
+  double midpoint[D];
+  for (unsigned int d=0; d<D; ++d)
+    midpoint[d] = 0.5 * (static_cast<double>(bounds_.lower(branch)[d]) + static_cast<double>(bounds_.upper(branch)[d]));
+
+  unsigned int closest = candidates[0];
+  double closest_distance = 0.0;
+  for (unsigned int c=0; c<num_candidates; ++c) {
+    double distance = 0.0;
+    for (unsigned int d=0; d<D; ++d) {
+      double difference = centers_[candidates[c] * D + d] - midpoint[d];
+      distance += difference * difference;
+    }
+    if (c == 0 || distance < closest_distance) {
+      closest_distance = distance;
+      closest = candidates[c];
+    }
+  }
+
+  // Filter out the candidates farther than the closest one from every point of the box.
+  unsigned int num_filtered = 0;
+  for (unsigned int c=0; c<num_candidates; ++c) {
+    if (candidates[c] == closest || !dominated(branch, candidates[c], closest))
+      scratch[num_filtered++] = candidates[c];
+  }
+
+  if (num_filtered == 1) {
+    assign_branch(branch, closest, partial);
+    return;
+  }
+
+  filter(node.left, scratch, num_filtered, scratch + num_centers_, partial);
+  filter(node.right, scratch, num_filtered, scratch + num_centers_, partial);
+}
+
+/**
+ * Assign all the points of a branch to a center using the weighted sums of the branch.
+ *
+ * \param branch Index of the branch in the hierarchy.
+ * \param center Index of the center.
+ * \param partial Sums where the points of the branch are added.
+ */
+template <typename T, unsigned int D>
+void KDKMeans<T, D>::assign_branch(unsigned int branch, unsigned int center, Partial &partial) const {
+
+  // Sum of squared distances expanded as the squared norms of the points minus twice their dot products with the center plus its squared norm.
+  const typename KDBounds::Branch &node = bounds_[branch];
+  const double *sum = &sums_[branch * D], *coordinates = centers_ + center * D;
+  double dot_product = 0.0, center_norm = 0.0;
+  for (unsigned int d=0; d<D; ++d) {
+    partial.sums[center * D + d] += sum[d];
+    dot_product += coordinates[d] * sum[d];
+    center_norm += coordinates[d] * coordinates[d];
+  }
+
+  partial.weights[center] += node.weight;
+  partial.inertia += std::max(0.0, squared_norms_[branch] - 2.0 * dot_product + node.weight * center_norm);
+  if (partial.labels)
+    std::fill(partial.labels + node.begin, partial.labels + node.end, center);
+}
+
+/**
+ * Check if a candidate center is farther than another one from every point of the bounding box of a branch.
+ * Only the vertex of the box farthest in the direction from the other center to the candidate needs to be checked.
+ *
+ * \param branch Index of the branch in the hierarchy.
+ * \param center Index of the candidate center.
+ * \param closest Index of the center closest to the midpoint of the box.
+ * \return \c true if the candidate cannot be the nearest center of any point in the box, \c false otherwise.
+ */
+template <typename T, unsigned int D>
+bool KDKMeans<T, D>::dominated(unsigned int branch, unsigned int center, unsigned int closest) const {
+
+  const double *z = centers_ + center * D, *z_closest = centers_ + closest * D;
+  double distance = 0.0, closest_distance = 0.0;
+  for (unsigned int d=0; d<D; ++d) {
+    double vertex = static_cast<double>(z[d] > z_closest[d] ? bounds_.upper(branch)[d] : bounds_.lower(branch)[d]);
+    distance += (z[d] - vertex) * (z[d] - vertex);
+    closest_distance += (z_closest[d] - vertex) * (z_closest[d] - vertex);
+  }
+  return distance > closest_distance;
+}
+
+/**
+ * Calculate the squared Euclidean distance between a center and a point.
+ */
+template <typename T, unsigned int D>
+double KDKMeans<T, D>::squared_distance(const double *center, const Element *point) const {
+  double distance = 0.0;
+  for (unsigned int d=0; d<D; ++d) {
+    double difference = center[d] - static_cast<double>(point[d]);
+    distance += difference * difference;
+  }
+  return distance;
+}
+
+/**
+ * Calculate the weighted sums of the points and their squared norms for each branch, adding the ones of the children to their parents.
+ */
+template <typename T, unsigned int D>
+void KDKMeans<T, D>::add_branch_sums() {
+
+  sums_.assign(bounds_.size() * D, 0.0);
+  squared_norms_.assign(bounds_.size(), 0.0);
+
+  // Children are always stored after their parents.
+  for (unsigned int branch = bounds_.size(); branch-- > 0; ) {
+    const typename KDBounds::Branch &node = bounds_[branch];
+    double *sum = &sums_[branch * D];
+
+    if (!bounds_.is_leaf(branch)) {
+      for (unsigned int d=0; d<D; ++d)
+        sum[d] = sums_[node.left * D + d] + sums_[node.right * D + d];
+      squared_norms_[branch] = squared_norms_[node.left] + squared_norms_[node.right];
+      continue;
+    }
+
+    for (unsigned int i=node.begin; i<node.end; ++i) {
+      const T *point = data_.get_permuted(i).data();
+      const double weight = cumulative_counts_ ? cumulative_counts_[i + 1] - cumulative_counts_[i] : 1.0;
+      for (unsigned int d=0; d<D; ++d) {
+        const double coordinate = static_cast<double>(point[d]);
+        sum[d] += weight * coordinate;
+        squared_norms_[branch] += weight * coordinate * coordinate;
+      }
+    }
+  }
+}
+
+/**
+ * Split the hierarchy in disjoint subtrees by expanding its levels, keeping them sorted by their permuted indices.
+ *
+ * \param num_subtrees Minimum number of subtrees, if the hierarchy has enough branches.
+ */
+template <typename T, unsigned int D>
+void KDKMeans<T, D>::find_subtrees(unsigned int num_subtrees) {
+
+  subtrees_.assign(1, 0);
+  while (subtrees_.size() < num_subtrees) {
+    std::vector<uint32_t> expanded;
+    for (unsigned int i=0; i<subtrees_.size(); ++i) {
+      if (bounds_.is_leaf(subtrees_[i])) {
+        expanded.push_back(subtrees_[i]);
+      } else {
+        expanded.push_back(bounds_[subtrees_[i]].left);
+        expanded.push_back(bounds_[subtrees_[i]].right);
+      }
+    }
+
+    if (expanded.size() == subtrees_.size())
+      break;
+    subtrees_.swap(expanded);
+  }
+}
+
+/**
+ * Get the number of levels of a branch, counting itself.
+ */
+template <typename T, unsigned int D>
+unsigned int KDKMeans<T, D>::depth(unsigned int branch) const {
+  if (bounds_.is_leaf(branch))
+    return 1;
+  return 1 + std::max(depth(bounds_[branch].left), depth(bounds_[branch].right));
+}
+
+} // namespace kche_tree
@@ -27,6 +27,11 @@
 #ifndef _KCHE_TREE_KD_NODE_H_
 #define _KCHE_TREE_KD_NODE_H_
 
+#include <vector>
+
+#include "build_report.h"
+#include "kd-box.h"
+#include "kd-kernel.h"
 #include "kd-search.h"
 #include "traits.h"
 #include "vector.h"
@@ -77,6 +82,17 @@ struct KDLeaf {
   template <typename Metric, typename Container>
   void intersect_ignoring_same(KDSearch<Element, NumDimensions, Metric> &data, Container &candidates) const;
 
+  // Process a leaf node skipping the points excluded in data.
+  template <typename Metric, typename Container>
+  void intersect_excluding(KDSearch<Element, NumDimensions, Metric> &data, Container &candidates) const;
+
+  // Report the points of a leaf node inside an axis-aligned box.
+  template <typename Visitor>
+  void visit_box(KDBoxSearch<Element, NumDimensions> &data, Visitor &visitor) const;
+
+  // Add the kernel values of the points of a leaf node, approximating them if possible.
+  void kernel_density(KDKernelSearch<Element, NumDimensions> &data, double min_kernel, double max_kernel) const;
+
   // Write to stream.
   void serialize(std::ostream &out);
 
@@ -157,15 +173,53 @@ struct KDNode {
 
   // --- Training-related --- //
 
+  /**
+   * \brief Allocator of the nodes created during a build.
+   *
+   * Nodes are preallocated in batches whether a report is requested or not, so that timed and untimed builds
+   * allocate memory in the same way. If a report is requested each batch is timed as a whole, with no clock calls
+   * per node. Preallocated nodes not used by the build are deleted with the allocator.
+   */
+  class BuildAllocator : NonCopyable {
+  public:
+    // Constructor and destructor.
+    explicit BuildAllocator(BuildReport *report);
+    ~BuildAllocator();
+
+    // Allocate new nodes.
+    KDNode *new_branch();
+    KDLeaf *new_leaf(unsigned int first_index, unsigned int num_elements);
+
+    /// Report where the build times are accumulated. \c NULL if not requested.
+    BuildReport *report() const { return report_; }
+
+  private:
+    /// Number of nodes of each type allocated at once.
+    static const unsigned int batch_size = 256;
+
+    // Preallocate a new batch of nodes.
+    void allocate_branches();
+    void allocate_leaves();
+
+    BuildReport *report_; ///< Report where the build times are accumulated.
+    std::vector<KDNode *> branches_; ///< Preallocated branch nodes not used yet.
+    std::vector<KDLeaf *> leaves_; ///< Preallocated leaf nodes not used yet.
+    double batch_time_; ///< Time spent preallocating all batches.
+    unsigned int num_allocated_; ///< Number of nodes preallocated in all batches.
+  };
+
   // Build the kd-tree recursively.
   static KDNode* build(const DataSet &data, unsigned int *index, unsigned int n,
-      KDNode *parent, unsigned int bucket_size, unsigned int &processed);
+      KDNode *parent, unsigned int bucket_size, unsigned int &processed, BuildAllocator &allocator);
 
   // Find a pivot to split the space in two by a chosen dimension during training.
   unsigned int split(unsigned int *index, unsigned int n, const AxisComparer &comparer);
 
   // --- Search-related --- //
 
+  // Get the maximum number of branch nodes in a path from this node to a leaf, including itself.
+  unsigned int depth() const;
+
   // Traverse the kd-tree looking for nearest neighbours candidates based on Manhattan distances.
   template <typename Metric, typename Container>
   void explore(const KDNode *parent, KDSearch<Element, NumDimensions, Metric> &data, Container &candidates) const;
@@ -174,6 +228,18 @@ struct KDNode {
   template <typename Metric, typename Container>
   void intersect(const KDNode *parent, KDSearch<Element, NumDimensions, Metric> &data, Container &candidates) const;
 
+  // Range of the permuted indices of the points contained in the branch.
+  unsigned int begin_index() const;
+  unsigned int end_index() const;
+
+  // Traverse the kd-tree reporting the points inside an axis-aligned box. Branches contained in the box are reported as whole index ranges.
+  template <typename Visitor>
+  void visit_box(KDBoxSearch<Element, NumDimensions> &data, Visitor &visitor) const;
+
+  // Traverse the kd-tree adding the kernel values of its points. Branches are approximated when their kernel bounds are tight enough.
+  void kernel_density(KDKernelSearch<Element, NumDimensions> &data, unsigned int begin, unsigned int end, double min_kernel, double max_kernel) const;
+  void kernel_density_child(KDKernelSearch<Element, NumDimensions> &data, bool right, unsigned int begin, unsigned int end, double min_kernel, double max_kernel) const;
+
   // --- IO-related --- //
 
   // Write to stream.
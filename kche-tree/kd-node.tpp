@@ -41,18 +41,20 @@ namespace kche_tree {
  * \param parent Parent node.
  * \param bucket_size Number of elements that should be grouped in leaf nodes.
  * \param processed Number of elements already processed and stored in the tree. Updated as the building expands.
+ * \param allocator Allocator of the new nodes. The time spent splitting the data is accumulated in its report, if any.
  * \return Node of the tree completely initialized.
  */
 template <typename T, unsigned int D>
 KDNode<T, D>* KDNode<T, D>::build(const DataSet &data, unsigned int *indices, unsigned int n,
-    KDNode *parent, unsigned int bucket_size, unsigned int &processed) {
+    KDNode *parent, unsigned int bucket_size, unsigned int &processed, BuildAllocator &allocator) {
 
   // Handle empty nodes (only for degenerate bucket sizes).
   if (n == 0)
     return NULL;
 
   // Allocate a new node.
-  KDNode *node = new KDNode();
+  KDNode *node = allocator.new_branch();
+  BuildReport *report = allocator.report();
 
   // Split the data with a basic cycle over the dimension indices.
   node->axis = parent ? (parent->axis + 1) % Dimensions : 0;
@@ -61,7 +63,11 @@ KDNode<T, D>* KDNode<T, D>::build(const DataSet &data, unsigned int *indices, un
   AxisComparer comparer = { data, node->axis };
 
   // Find a pivot to split data appropiately (may involve index sorting or partitioning).
+  // Each split is timed on its own, so the split time includes the overhead of two clock calls per branch.
+  clock_t t_split = report ? clock() : 0;
   unsigned int pivot = node->split(indices, n, comparer);
+  if (report)
+    report->split_time += BuildReport::elapsed(t_split);
 
   // Split the data in two segments: left to pivot inclusive, and elements right to it.
   unsigned int left_elements = pivot + 1;
@@ -73,18 +79,18 @@ KDNode<T, D>* KDNode<T, D>::build(const DataSet &data, unsigned int *indices, un
 
   // Process the left part recursively, creating a leaf is remaining data is not greater than the bucket size.
   if (left_elements > bucket_size)
-    node->left_branch = build(data, indices, left_elements, node, bucket_size, processed);
+    node->left_branch = build(data, indices, left_elements, node, bucket_size, processed, allocator);
   else {
-    node->left_leaf = new KDLeaf(processed, left_elements);
+    node->left_leaf = allocator.new_leaf(processed, left_elements);
     node->is_leaf |= left_bit;
     processed += left_elements;
   }
 
   // Process the right part recursively, creating a leaf is remaining data is not greater than the bucket size.
   if (right_elements > bucket_size)
-    node->right_branch = build(data, right_indices, right_elements, node, bucket_size, processed);
+    node->right_branch = build(data, right_indices, right_elements, node, bucket_size, processed, allocator);
   else {
-    node->right_leaf = new KDLeaf(processed, right_elements);
+    node->right_leaf = allocator.new_leaf(processed, right_elements);
     node->is_leaf |= right_bit;
     processed += right_elements;
   }
@@ -93,6 +99,96 @@ KDNode<T, D>* KDNode<T, D>::build(const DataSet &data, unsigned int *indices, un
   return node;
 }
 
+/**
+ * \brief Create a node allocator for a build.
+ *
+ * \param report Optional report where the allocation time and the number of nodes are accumulated. Ignored if \c NULL.
+ */
+template <typename T, unsigned int D>
+KDNode<T, D>::BuildAllocator::BuildAllocator(BuildReport *report)
+  : report_(report),
+    batch_time_(0.0),
+    num_allocated_(0) {
+  branches_.reserve(batch_size);
+  leaves_.reserve(batch_size);
+}
+
+/**
+ * \brief Delete the preallocated nodes not used by the build.
+ *
+ * The time spent preallocating nodes is accounted in proportion to the number of nodes actually used.
+ */
+template <typename T, unsigned int D>
+KDNode<T, D>::BuildAllocator::~BuildAllocator() {
+  if (report_ && num_allocated_ > 0) {
+    unsigned int num_used = num_allocated_ - branches_.size() - leaves_.size();
+    report_->allocation_time += batch_time_ * num_used / num_allocated_;
+  }
+
+  for (unsigned int i=0; i<branches_.size(); ++i)
+    delete branches_[i];
+  for (unsigned int i=0; i<leaves_.size(); ++i)
+    delete leaves_[i];
+}
+
+/**
+ * \brief Allocate a new branch node during the build.
+ *
+ * \return Newly allocated branch node.
+ */
+template <typename T, unsigned int D>
+KDNode<T, D> *KDNode<T, D>::BuildAllocator::new_branch() {
+  if (branches_.empty())
+    allocate_branches();
+  KDNode *branch = branches_.back();
+  branches_.pop_back();
+  if (report_)
+    ++report_->num_branches;
+  return branch;
+}
+
+/**
+ * \brief Allocate a new leaf node during the build.
+ *
+ * \param first_index Index of the first element contained by the leaf.
+ * \param num_elements Number of elements contained by the leaf.
+ * \return Newly allocated leaf node.
+ */
+template <typename T, unsigned int D>
+typename KDNode<T, D>::KDLeaf *KDNode<T, D>::BuildAllocator::new_leaf(unsigned int first_index, unsigned int num_elements) {
+  if (leaves_.empty())
+    allocate_leaves();
+  KDLeaf *leaf = leaves_.back();
+  leaves_.pop_back();
+  leaf->first_index = first_index;
+  leaf->num_elements = num_elements;
+  if (report_)
+    ++report_->num_leaves;
+  return leaf;
+}
+
+/// Preallocate a new batch of branch nodes, timing the batch as a whole if a report is requested.
+template <typename T, unsigned int D>
+void KDNode<T, D>::BuildAllocator::allocate_branches() {
+  clock_t t_alloc = report_ ? clock() : 0;
+  for (unsigned int i=0; i<batch_size; ++i)
+    branches_.push_back(new KDNode());
+  if (report_)
+    batch_time_ += BuildReport::elapsed(t_alloc);
+  num_allocated_ += batch_size;
+}
+
+/// Preallocate a new batch of leaf nodes, timing the batch as a whole if a report is requested.
+template <typename T, unsigned int D>
+void KDNode<T, D>::BuildAllocator::allocate_leaves() {
+  clock_t t_alloc = report_ ? clock() : 0;
+  for (unsigned int i=0; i<batch_size; ++i)
+    leaves_.push_back(new KDLeaf(0, 0));
+  if (report_)
+    batch_time_ += BuildReport::elapsed(t_alloc);
+  num_allocated_ += batch_size;
+}
+
 /**
  * \brief Split the provided data subset by one dimension. Should be near to the median to get a balanced kd-tree.
  *
@@ -142,6 +238,18 @@ KDNode<T, D>::~KDNode() {
     delete right_branch;
 }
 
+/**
+ * \brief Get the maximum number of branch nodes in a path from this node to a leaf, including itself.
+ *
+ * Used to size the explicit traversal stacks of the interleaved search.
+ */
+template <typename T, unsigned int D>
+unsigned int KDNode<T, D>::depth() const {
+  unsigned int left_depth = (is_leaf & left_bit) ? 0 : left_branch->depth();
+  unsigned int right_depth = (is_leaf & right_bit) ? 0 : right_branch->depth();
+  return 1 + std::max(left_depth, right_depth);
+}
+
 /**
  * \brief Traverse the kd-tree looking for nearest neighbours candidates, but do not discard any regions of the space.
  *
@@ -187,7 +295,11 @@ void KDNode<T, D>::explore(const KDNode *parent, KDSearch<T, D, Metric> &search_
   // Traverse the first (manhattan nearest) branch.
   bool full = candidates.size() >= search_data.K;
   if (first_leaf != NULL) {
-    if (full)
+    if (full && search_data.ignore_null_distances)
+      first_leaf->intersect_ignoring_same(search_data, candidates);
+    else if (full && search_data.excluded)
+      first_leaf->intersect_excluding(search_data, candidates);
+    else if (full)
       first_leaf->intersect(search_data, candidates);
     else
       first_leaf->explore(search_data, candidates);
@@ -202,7 +314,11 @@ void KDNode<T, D>::explore(const KDNode *parent, KDSearch<T, D, Metric> &search_
   // Traverse the second (manhattan farthest) branch.
   full = candidates.size() >= search_data.K;
   if (second_leaf != NULL) {
-    if (full)
+    if (full && search_data.ignore_null_distances)
+      second_leaf->intersect_ignoring_same(search_data, candidates);
+    else if (full && search_data.excluded)
+      second_leaf->intersect_excluding(search_data, candidates);
+    else if (full)
       second_leaf->intersect(search_data, candidates);
     else
       second_leaf->explore(search_data, candidates);
@@ -236,6 +352,8 @@ void KDNode<T, D>::intersect(const KDNode *parent, KDSearch<T, D, Metric> &searc
   if (is_leaf & left_bit) {
     if (search_data.ignore_null_distances)
       left_leaf->intersect_ignoring_same(search_data, candidates);
+    else if (search_data.excluded)
+      left_leaf->intersect_excluding(search_data, candidates);
     else
       left_leaf->intersect(search_data, candidates);
   } else {
@@ -246,6 +364,8 @@ void KDNode<T, D>::intersect(const KDNode *parent, KDSearch<T, D, Metric> &searc
   if (is_leaf & right_bit) {
     if (search_data.ignore_null_distances)
       right_leaf->intersect_ignoring_same(search_data, candidates);
+    else if (search_data.excluded)
+      right_leaf->intersect_excluding(search_data, candidates);
     else
       right_leaf->intersect(search_data, candidates);
   } else {
@@ -253,6 +373,215 @@ void KDNode<T, D>::intersect(const KDNode *parent, KDSearch<T, D, Metric> &searc
   }
 }
 
+/**
+ * \brief Get the permuted index of the first point contained in the branch.
+ * Leaves store contiguous ranges of permuted indices, so the points of a branch go from its leftmost leaf to its rightmost one.
+ */
+template <typename T, unsigned int D>
+unsigned int KDNode<T, D>::begin_index() const {
+  const KDNode *node = this;
+  while (!(node->is_leaf & left_bit))
+    node = node->left_branch;
+  return node->left_leaf->first_index;
+}
+
+/**
+ * \brief Get the permuted index following the last point contained in the branch.
+ */
+template <typename T, unsigned int D>
+unsigned int KDNode<T, D>::end_index() const {
+  const KDNode *node = this;
+  while (!(node->is_leaf & right_bit))
+    node = node->right_branch;
+  return node->right_leaf->first_index + node->right_leaf->num_elements;
+}
+
+/**
+ * \brief Traverse the kd-tree reporting the points inside an axis-aligned box.
+ *
+ * The region of each branch is bounded by the split values of its ancestors. Branches whose region is disjoint from the box
+ * are skipped, and branches whose region is contained in it are reported as a range of permuted indices without checking their points.
+ *
+ * \param search_data Box and region of the node being visited.
+ * \param visitor Object receiving the permuted indices of the points inside the box through its \c visit(index) and \c visit_range(begin, end) methods.
+ */
+template <typename T, unsigned int D> template <typename Visitor>
+void KDNode<T, D>::visit_box(KDBoxSearch<T, D> &search_data, Visitor &visitor) const {
+
+  // Report the whole branch if its region is contained in the box.
+  if (search_data.num_uncontained == 0) {
+    visitor.visit_range(begin_index(), end_index());
+    return;
+  }
+
+  const unsigned int split_axis = axis & axis_mask;
+  const bool was_contained = search_data.is_contained(split_axis);
+
+  // Visit the left branch, bounded above by the split value, unless the box is entirely on its right.
+  if (!(split_element < search_data.lower[split_axis])) {
+    Element previous = search_data.region_upper[split_axis];
+    if (split_element < previous)
+      search_data.region_upper[split_axis] = split_element;
+    if (!was_contained && search_data.is_contained(split_axis))
+      --search_data.num_uncontained;
+
+    if (is_leaf & left_bit)
+      left_leaf->visit_box(search_data, visitor);
+    else
+      left_branch->visit_box(search_data, visitor);
+
+    if (!was_contained && search_data.is_contained(split_axis))
+      ++search_data.num_uncontained;
+    search_data.region_upper[split_axis] = previous;
+  }
+
+  // Visit the right branch, bounded below by the split value, unless the box is entirely on its left.
+  if (!(split_element > search_data.upper[split_axis])) {
+    Element previous = search_data.region_lower[split_axis];
+    if (split_element > previous)
+      search_data.region_lower[split_axis] = split_element;
+    if (!was_contained && search_data.is_contained(split_axis))
+      --search_data.num_uncontained;
+
+    if (is_leaf & right_bit)
+      right_leaf->visit_box(search_data, visitor);
+    else
+      right_branch->visit_box(search_data, visitor);
+
+    if (!was_contained && search_data.is_contained(split_axis))
+      ++search_data.num_uncontained;
+    search_data.region_lower[split_axis] = previous;
+  }
+}
+
+/**
+ * \brief Report the points of a leaf node inside an axis-aligned box.
+ * Points are only checked if the region of the leaf is not contained in the box.
+ *
+ * \param search_data Box and region of the leaf.
+ * \param visitor Object receiving the permuted indices of the points inside the box.
+ */
+template <typename T, unsigned int D> template <typename Visitor>
+void KDLeaf<T, D>::visit_box(KDBoxSearch<T, D> &search_data, Visitor &visitor) const {
+  if (search_data.num_uncontained == 0) {
+    visitor.visit_range(first_index, first_index + num_elements);
+    return;
+  }
+
+  for (unsigned int i=first_index; i < first_index + num_elements; ++i) {
+    if (search_data.contains(search_data.data.get_permuted(i)))
+      visitor.visit(i);
+  }
+}
+
+/**
+ * \brief Traverse the kd-tree adding the Gaussian kernel values between a point and the points of the branch.
+ *
+ * Branches are approximated by the midpoint of their kernel bounds if allowed by the relative error. Otherwise the bounds of the
+ * children replace the ones of the branch in the lower bound of the sum, and the child closest to the point is visited first.
+ *
+ * \param search_data Point, region of the node being visited and accumulated sums.
+ * \param begin Permuted index of the first point in the branch.
+ * \param end Permuted index following the last point in the branch.
+ * \param min_kernel Lower bound of the kernel values in the region of the branch, already included in the lower bound of the sum.
+ * \param max_kernel Upper bound of the kernel values in the region of the branch.
+ */
+template <typename T, unsigned int D>
+void KDNode<T, D>::kernel_density(KDKernelSearch<T, D> &search_data, unsigned int begin, unsigned int end, double min_kernel, double max_kernel) const {
+
+  // Approximate the whole branch if possible.
+  const unsigned int weight = search_data.weight(begin, end);
+  if (search_data.approximate(weight, min_kernel, max_kernel))
+    return;
+
+  // Calculate the kernel bounds of both children by restricting the region along the split axis.
+  const unsigned int split_axis = axis & axis_mask;
+  const unsigned int middle = (is_leaf & right_bit) ? right_leaf->first_index : right_branch->begin_index();
+  double left_min_kernel, left_max_kernel, right_min_kernel, right_max_kernel;
+
+  Element previous = search_data.region_upper[split_axis];
+  if (split_element < previous)
+    search_data.region_upper[split_axis] = split_element;
+  search_data.region_bounds(left_min_kernel, left_max_kernel);
+  search_data.region_upper[split_axis] = previous;
+
+  previous = search_data.region_lower[split_axis];
+  if (split_element > previous)
+    search_data.region_lower[split_axis] = split_element;
+  search_data.region_bounds(right_min_kernel, right_max_kernel);
+  search_data.region_lower[split_axis] = previous;
+
+  search_data.bounds.lower += search_data.weight(begin, middle) * left_min_kernel + search_data.weight(middle, end) * right_min_kernel - weight * min_kernel;
+
+  // Visit first the child with the highest potential contribution to tighten the lower bound sooner.
+  if (left_max_kernel >= right_max_kernel) {
+    kernel_density_child(search_data, false, begin, middle, left_min_kernel, left_max_kernel);
+    kernel_density_child(search_data, true, middle, end, right_min_kernel, right_max_kernel);
+  } else {
+    kernel_density_child(search_data, true, middle, end, right_min_kernel, right_max_kernel);
+    kernel_density_child(search_data, false, begin, middle, left_min_kernel, left_max_kernel);
+  }
+}
+
+/**
+ * \brief Visit one of the children of a node when estimating kernel densities, restricting the region to the one of the child.
+ *
+ * \param search_data Point, region of the node being visited and accumulated sums.
+ * \param right Indicates if the right child should be visited instead of the left one.
+ * \param begin Permuted index of the first point in the child.
+ * \param end Permuted index following the last point in the child.
+ * \param min_kernel Lower bound of the kernel values in the region of the child.
+ * \param max_kernel Upper bound of the kernel values in the region of the child.
+ */
+template <typename T, unsigned int D>
+void KDNode<T, D>::kernel_density_child(KDKernelSearch<T, D> &search_data, bool right, unsigned int begin, unsigned int end, double min_kernel, double max_kernel) const {
+  const unsigned int split_axis = axis & axis_mask;
+  Element &bound = right ? search_data.region_lower[split_axis] : search_data.region_upper[split_axis];
+  Element previous = bound;
+  if (right ? split_element > previous : split_element < previous)
+    bound = split_element;
+
+  if (right) {
+    if (is_leaf & right_bit)
+      right_leaf->kernel_density(search_data, min_kernel, max_kernel);
+    else
+      right_branch->kernel_density(search_data, begin, end, min_kernel, max_kernel);
+  } else {
+    if (is_leaf & left_bit)
+      left_leaf->kernel_density(search_data, min_kernel, max_kernel);
+    else
+      left_branch->kernel_density(search_data, begin, end, min_kernel, max_kernel);
+  }
+
+  bound = previous;
+}
+
+/**
+ * \brief Add the Gaussian kernel values between a point and the points of a leaf node.
+ * The leaf is approximated by the midpoint of its kernel bounds if allowed by the relative error.
+ *
+ * \param search_data Point, region of the leaf and accumulated sums.
+ * \param min_kernel Lower bound of the kernel values in the region of the leaf, already included in the lower bound of the sum.
+ * \param max_kernel Upper bound of the kernel values in the region of the leaf.
+ */
+template <typename T, unsigned int D>
+void KDLeaf<T, D>::kernel_density(KDKernelSearch<T, D> &search_data, double min_kernel, double max_kernel) const {
+  const unsigned int weight = search_data.weight(first_index, first_index + num_elements);
+  if (search_data.approximate(weight, min_kernel, max_kernel))
+    return;
+
+  const T *p = search_data.p.data();
+  double sum = 0.0;
+  for (unsigned int i=first_index; i < first_index + num_elements; ++i) {
+    const T *v = search_data.data.get_permuted(i).data();
+    sum += search_data.weight(i, i + 1) * search_data.kernel(KDBounds<T, D>::min_squared_distance(p, p, v, v));
+  }
+
+  search_data.sum += sum;
+  search_data.bounds.lower += sum - weight * min_kernel;
+  search_data.bounds.weight += weight;
+}
+
 /**
  * \brief Process a leaf node without using any upper bounds in distance calculation.
  *
@@ -265,16 +594,23 @@ void KDLeaf<T, D>::explore(KDSearch<T, D, Metric> &search_data, Container &candi
   if (search_data.ignore_null_distances) {
     // Process only the bucket elements different to p.
     for (unsigned int i=first_index; i < first_index + num_elements; ++i) {
-      ConstRef_Distance distance = search_data.metric(search_data.p, search_data.data.get_permuted(i));
+      ConstRef_Distance distance = search_data.distance(i);
       if (distance > Traits<Distance>::zero())
-        candidates.push_back(Neighbor<Distance>(i, search_data.metric(search_data.p, search_data.data.get_permuted(i))));
+        candidates.push_back(Neighbor<Distance>(i, distance));
+    }
+
+  } else if (search_data.excluded) {
+    // Process only the bucket elements not excluded, without calculating their distances.
+    for (unsigned int i=first_index; i < first_index + num_elements; ++i) {
+      if (!search_data.is_excluded(i))
+        candidates.push_back(Neighbor<Distance>(i, search_data.distance(i)));
     }
 
   } else {
     // Process all the buckets in the node.
     for (unsigned int i=first_index; i < first_index + num_elements; ++i)
       // Create a new neighbour candidate with the point referenced by this node and push it into the K best ones.
-      candidates.push_back(Neighbor<Distance>(i, search_data.metric(search_data.p, search_data.data.get_permuted(i))));
+      candidates.push_back(Neighbor<Distance>(i, search_data.distance(i)));
   }
 
   // Update current farthest nearest neighbour distance.
@@ -295,7 +631,7 @@ void KDLeaf<T, D>::intersect(KDSearch<T, D, Metric> &search_data, Container &can
   for (unsigned int i=first_index; i < first_index + num_elements; ++i) {
 
     // Calculate the distance to the new candidate, upper bounded by the farthest nearest neighbour distance.
-    ConstRef_Distance new_distance = search_data.metric(search_data.p, search_data.data.get_permuted(i), search_data.farthest_distance);
+    ConstRef_Distance new_distance = search_data.distance(i, search_data.farthest_distance);
 
     // If less or equal than the current farthest nearest neighbour then it's a valid candidate (equal is left for the all_in_range method).
     if (!(new_distance > search_data.farthest_distance)) {
@@ -322,7 +658,7 @@ void KDLeaf<T, D>::intersect_ignoring_same(KDSearch<T, D, Metric> &search_data,
   for (unsigned int i=first_index; i < first_index + num_elements; ++i) {
 
     // Calculate the distance to the new candidate, upper bounded by the farthest nearest neighbour distance.
-    ConstRef_Distance new_distance = search_data.metric(search_data.p, search_data.data.get_permuted(i), search_data.farthest_distance);
+    ConstRef_Distance new_distance = search_data.distance(i, search_data.farthest_distance);
     if (new_distance == Traits<Distance>::zero())
       continue;
 
@@ -338,6 +674,35 @@ void KDLeaf<T, D>::intersect_ignoring_same(KDSearch<T, D, Metric> &search_data,
   }
 }
 
+/**
+ * \brief Process a leaf node using an upper bound in the corresponding metric. Skips the excluded points without calculating their distances.
+ *
+ * \param search_data Auxiliar data structure used for tree traversal and incremental calculations.
+ * \param candidates STL container-like object holding the current neighbour candidates.
+ */
+template <typename T, unsigned int D> template <typename Metric, typename Container>
+void KDLeaf<T, D>::intersect_excluding(KDSearch<T, D, Metric> &search_data, Container &candidates) const {
+
+  // Process all the buckets in the node.
+  for (unsigned int i=first_index; i < first_index + num_elements; ++i) {
+    if (search_data.is_excluded(i))
+      continue;
+
+    // Calculate the distance to the new candidate, upper bounded by the farthest nearest neighbour distance.
+    ConstRef_Distance new_distance = search_data.distance(i, search_data.farthest_distance);
+
+    // If less or equal than the current farthest nearest neighbour then it's a valid candidate (equal is left for the all_in_range method).
+    if (!(new_distance > search_data.farthest_distance)) {
+
+      // Push it in the nearest neighbour container (will reject the previous farthest one).
+      candidates.push_back(Neighbor<Distance>(i, new_distance));
+
+      // Update the distance to the new farthest nearest neighbour.
+      search_data.farthest_distance = candidates.front().squared_distance();
+    }
+  }
+}
+
 /**
  * \brief Verifies the structural integrity of the kd-tree branch hanging by this node.
  *
@@ -0,0 +1,155 @@
+/***************************************************************************
+ *   Copyright (C) 2011, 2012 by Leandro Graciá Gil                        *
+ *   leandro.gracia.gil@gmail.com                                          *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/**
+ * \file kd-packet.h
+ * \brief Template for the packet traversal of batches of queries in a kd-tree.
+ * \author Leandro Graciá Gil
+ */
+
+#ifndef _KCHE_TREE_KD_PACKET_H_
+#define _KCHE_TREE_KD_PACKET_H_
+
+// Include STL vectors for the batch output.
+#include <vector>
+
+#include "dataset.h"
+#include "kd-node.h"
+#include "kd-search.h"
+#include "neighbor.h"
+#include "scoped_ptr.h"
+#include "traits.h"
+#include "utils.h"
+
+namespace kche_tree {
+
+/**
+ * \brief Search the K nearest neighbours of a batch of queries traversing the kd-tree with packets of several queries at once.
+ *
+ * Similar to ray-tracing packets, the queries of a packet (its lanes) visit each node together: each node is loaded once
+ * for all the lanes, which apply their own incremental update and pruning test, and each leaf bucket is loaded once to
+ * calculate the distances to all the lanes still active. Every lane keeps its own KDSearch object with its own
+ * hyperrectangle and farthest neighbour distances, so results are exact.
+ *
+ * Queries are grouped by the leaf where they fall before forming the packets, so that nearby queries are traversed together.
+ * The order of the children of each node is chosen by majority among the lanes still filling their candidates.
+ *
+ * \tparam ElementType Type of the elements in the kd-tree.
+ * \tparam NumDimensions Number of dimensions of the feature vectors.
+ * \tparam MetricType Metric functor used to calculate distances between points.
+ * \tparam ContainerType Container used to keep the K nearest neighbour candidates of each query.
+ * \tparam PacketWidth Number of queries in each packet. Should be between 1 and 32.
+ */
+template <typename ElementType, unsigned int NumDimensions, typename MetricType, typename ContainerType, unsigned int PacketWidth>
+class KDPacketSearch : NonCopyable {
+public:
+  /// Type of the elements in the kd-tree.
+  typedef ElementType Element;
+
+  /// Number of dimensions of the feature vectors.
+  static const unsigned int Dimensions = NumDimensions;
+
+  /// Number of queries in each packet.
+  static const unsigned int Width = PacketWidth;
+
+  /// Type of the metric used in the search.
+  typedef MetricType Metric;
+
+  /// Type of the containers holding the neighbour candidates.
+  typedef ContainerType Container;
+
+  /// Distance type associated with the elements.
+  typedef typename Traits<Element>::Distance Distance;
+
+  /// Use optimized const reference types for distances.
+  typedef typename RParam<Distance>::Type ConstRef_Distance;
+
+  /// Alias of compatible non-labeled data sets.
+  typedef typename kche_tree::DataSet<Element, Dimensions> DataSet;
+
+  /// Alias of compatible feature vectors.
+  typedef typename kche_tree::Vector<Element, Dimensions> Vector;
+
+  /// Type of the kd-tree branch nodes.
+  typedef kche_tree::KDNode<Element, Dimensions> KDNode;
+
+  /// Type of the kd-tree leaf nodes.
+  typedef kche_tree::KDLeaf<Element, Dimensions> KDLeaf;
+
+  /// Type of the search data of each lane.
+  typedef kche_tree::KDSearch<Element, Dimensions, Metric> KDSearch;
+
+  /// Type of the neighbour results.
+  typedef kche_tree::Neighbor<Distance> Neighbor;
+
+  /// Type of the k-neighbour results.
+  typedef std::vector<Neighbor> KNeighbors;
+
+  // Constructor.
+  KDPacketSearch(const KDNode *root, const DataSet &data, const Metric &metric, unsigned int K, ConstRef_Distance epsilon, bool ignore_null_distances,
+      const Distance *squared_norms = NULL);
+
+  // Search the K nearest neighbours of all the queries in the batch.
+  void run(const DataSet &queries, std::vector<KNeighbors> &output, unsigned int first_query = 0);
+
+private:
+  KCHE_TREE_COMPILE_ASSERT((PacketWidth > 0 && PacketWidth <= 32), "Packet width should be between 1 and 32.");
+
+  /// Incremental updater type applied when entering a branch node.
+  typedef typename Metric::IncrementalUpdater IncrementalUpdater;
+
+  /// Bitmask with one bit per lane.
+  typedef uint32_t LaneMask;
+
+  /// Raw storage for the incremental updaters of the lanes, constructed in place when entering a node and destroyed when leaving it.
+  union UpdaterStorage {
+    char bytes[sizeof(IncrementalUpdater)]; ///< Raw storage of the updater.
+    long double align_long_double; ///< Alignment enforcement.
+    uint64_t align_uint64; ///< Alignment enforcement.
+    void *align_pointer; ///< Alignment enforcement.
+  };
+
+  // Packet processing.
+  void search_packet(const DataSet &queries, const unsigned int *query_indices, unsigned int num_lanes, std::vector<KNeighbors> &output);
+  void sort_by_leaf(const DataSet &queries, unsigned int first_query, std::vector<unsigned int> &query_indices) const;
+
+  // Node processing.
+  void branch(const KDNode *node, const KDNode *parent, LaneMask lanes, LaneMask exploring);
+  void child(const KDNode *node, bool left, LaneMask lanes, LaneMask exploring);
+  void leaf(const KDLeaf *leaf, LaneMask lanes, LaneMask exploring);
+
+  const KDNode *root_; ///< Root of the kd-tree.
+  const DataSet &data_; ///< Permuted training set stored by the tree.
+  const Metric &metric_; ///< Metric functor used to calculate distances between points.
+  unsigned int K_; ///< Number of neighbours to retrieve.
+  Distance squared_epsilon_; ///< Initial hyperrectangle distance of each query.
+  bool ignore_null_distances_; ///< Exclude points with null distance to the queries.
+  const Distance *squared_norms_; ///< Squared norms of the points in the permuted training set, if available.
+
+  ScopedPtr<KDSearch> search_data_[Width]; ///< Search data of the query in each lane.
+  ScopedPtr<Container> candidates_[Width]; ///< Current neighbour candidates of each lane.
+};
+
+} // namespace kche_tree
+
+// Template implementation.
+#include "kd-packet.tpp"
+
+#endif
@@ -0,0 +1,279 @@
+/***************************************************************************
+ *   Copyright (C) 2011, 2012 by Leandro Graciá Gil                        *
+ *   leandro.gracia.gil@gmail.com                                          *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/**
+ * \file kd-packet.tpp
+ * \brief Template implementation for the packet traversal of batches of queries in a kd-tree.
+ * \author Leandro Graciá Gil
+ */
+
+// Include placement new, STL sorting and pairs.
+#include <algorithm>
+#include <new>
+#include <utility>
+
+namespace kche_tree {
+
+// Static data.
+template <typename T, unsigned int D, typename M, typename C, unsigned int W>
+const unsigned int KDPacketSearch<T, D, M, C, W>::Width;
+
+/**
+ * \brief Prepare a packet search in a kd-tree.
+ *
+ * \param root Root node of the kd-tree.
+ * \param data Permuted training set stored by the kd-tree.
+ * \param metric Metric functor used to calculate distances between points.
+ * \param K Number of neighbours to retrieve for each query.
+ * \param epsilon Acceptable distance margin to ignore regions during kd-tree exploration.
+ * \param ignore_null_distances Ignore points at null distance from the queries.
+ * \param squared_norms Squared norms of the points precalculated by the kd-tree, if available. Only used by the Euclidean metric with floating point types.
+ */
+template <typename T, unsigned int D, typename M, typename C, unsigned int W>
+KDPacketSearch<T, D, M, C, W>::KDPacketSearch(const KDNode *root, const DataSet &data, const Metric &metric, unsigned int K,
+    ConstRef_Distance epsilon, bool ignore_null_distances, const Distance *squared_norms)
+  : root_(root),
+    data_(data),
+    metric_(metric),
+    K_(K),
+    squared_epsilon_(epsilon),
+    ignore_null_distances_(ignore_null_distances),
+    squared_norms_(squared_norms) {
+
+  KCHE_TREE_DCHECK(root);
+  squared_epsilon_ *= epsilon;
+
+  for (unsigned int lane=0; lane<Width; ++lane)
+    candidates_[lane].reset(new Container(K_));
+}
+
+/**
+ * \brief Search the K nearest neighbours of all the queries in the batch.
+ *
+ * \param queries Points whose neighbours should be retrieved.
+ * \param output Vector resized to the number of queries. The nearest neighbours of each query are appended to its entry sorted by increasing distance.
+ * \param first_query Index of the first query to search. Any previous queries are skipped.
+ */
+template <typename T, unsigned int D, typename M, typename C, unsigned int W>
+void KDPacketSearch<T, D, M, C, W>::run(const DataSet &queries, std::vector<KNeighbors> &output, unsigned int first_query) {
+
+  output.resize(queries.size());
+
+  // Group the queries by the leaf where they fall, so that each packet is made of nearby queries.
+  std::vector<unsigned int> query_indices;
+  sort_by_leaf(queries, first_query, query_indices);
+
+  for (unsigned int first = 0; first < query_indices.size(); first += Width)
+    search_packet(queries, &query_indices[first], std::min(Width, static_cast<unsigned int>(query_indices.size()) - first), output);
+}
+
+/**
+ * \brief Sort the indices of the queries by the leaf node where each of them falls.
+ *
+ * \param queries Batch of queries.
+ * \param first_query Index of the first query to sort.
+ * \param query_indices Vector where the sorted query indices are returned.
+ */
+template <typename T, unsigned int D, typename M, typename C, unsigned int W>
+void KDPacketSearch<T, D, M, C, W>::sort_by_leaf(const DataSet &queries, unsigned int first_query, std::vector<unsigned int> &query_indices) const {
+
+  // Descend the tree for each query as the exploration does first. Leaves are identified by their first permuted index.
+  std::vector<std::pair<uint32_t, unsigned int> > keys(queries.size() - first_query);
+  for (unsigned int i=first_query; i<queries.size(); ++i) {
+    const Vector &p = queries[i];
+    const KDNode *node = root_;
+    while (true) {
+      bool left = !(p[node->axis & KDNode::axis_mask] > node->split_element);
+      if (node->is_leaf & (left ? KDNode::left_bit : KDNode::right_bit)) {
+        keys[i - first_query] = std::make_pair((left ? node->left_leaf : node->right_leaf)->first_index, i);
+        break;
+      }
+      node = left ? node->left_branch : node->right_branch;
+    }
+  }
+
+  std::sort(keys.begin(), keys.end());
+  query_indices.resize(keys.size());
+  for (unsigned int i=0; i<keys.size(); ++i)
+    query_indices[i] = keys[i].second;
+}
+
+/**
+ * \brief Search the K nearest neighbours of a packet of queries.
+ *
+ * \param queries Batch of queries.
+ * \param query_indices Indices of the queries in the packet.
+ * \param num_lanes Number of queries in the packet.
+ * \param output Output vector of the batch.
+ */
+template <typename T, unsigned int D, typename M, typename C, unsigned int W>
+void KDPacketSearch<T, D, M, C, W>::search_packet(const DataSet &queries, const unsigned int *query_indices, unsigned int num_lanes, std::vector<KNeighbors> &output) {
+
+  // Create the search data of each lane, using epsilon as initial hyperrectangle distance as knn does.
+  LaneMask lanes = 0;
+  for (unsigned int lane=0; lane<num_lanes; ++lane) {
+    search_data_[lane].reset(new KDSearch(queries[query_indices[lane]], data_, metric_, K_, ignore_null_distances_));
+    search_data_[lane]->hyperrect_distance = squared_epsilon_;
+    search_data_[lane]->use_squared_norms(squared_norms_);
+    lanes |= 1U << lane;
+  }
+
+  // Start an exploration traversal from the root with all the lanes.
+  branch(root_, NULL, lanes, lanes);
+
+  // Append the nearest neighbours of each lane in increasing distance correcting index permutations.
+  for (unsigned int lane=0; lane<num_lanes; ++lane) {
+    Container &candidates = *candidates_[lane];
+    KNeighbors &neighbors = output[query_indices[lane]];
+    while (!candidates.empty()) {
+      const Neighbor &neighbor = candidates.back();
+      neighbors.push_back(Neighbor(data_.get_original_index(neighbor.index()), neighbor.squared_distance()));
+      candidates.pop_back();
+    }
+    search_data_[lane].reset();
+  }
+}
+
+/**
+ * \brief Traverse a branch node with a packet of lanes.
+ *
+ * Equivalent to KDNode::explore for the exploring lanes and to KDNode::intersect for the rest.
+ *
+ * \param node Branch node being traversed.
+ * \param parent Parent of the node being traversed.
+ * \param lanes Lanes of the packet visiting the node.
+ * \param exploring Subset of \a lanes still exploring the tree without discarding regions of the space.
+ */
+template <typename T, unsigned int D, typename M, typename C, unsigned int W>
+void KDPacketSearch<T, D, M, C, W>::branch(const KDNode *node, const KDNode *parent, LaneMask lanes, LaneMask exploring) {
+
+  // Apply the incremental update of each lane and discard the intersecting lanes whose hypersphere does not reach the node.
+  UpdaterStorage updaters[Width];
+  LaneMask active = 0;
+  for (unsigned int lane=0; lane<Width; ++lane) {
+    if (!(lanes & (1U << lane)))
+      continue;
+
+    KDSearch &search_data = *search_data_[lane];
+    IncrementalUpdater *updater = new (updaters[lane].bytes) IncrementalUpdater(node, parent, search_data);
+    if ((exploring & (1U << lane)) || search_data.hyperrect_distance < search_data.farthest_distance)
+      active |= 1U << lane;
+    else
+      updater->~IncrementalUpdater();
+  }
+
+  if (active) {
+    // Choose the order of the children by majority among the exploring lanes, or visit left first if none is exploring.
+    const unsigned int axis = node->axis & KDNode::axis_mask;
+    unsigned int num_exploring = 0, num_right = 0;
+    for (unsigned int lane=0; lane<Width; ++lane) {
+      if (active & exploring & (1U << lane)) {
+        ++num_exploring;
+        if (search_data_[lane]->p[axis] > node->split_element)
+          ++num_right;
+      }
+    }
+
+    bool right_first = 2 * num_right > num_exploring;
+    child(node, !right_first, active, exploring & active);
+    child(node, right_first, active, exploring & active);
+  }
+
+  // Restore the incremental updates of the lanes that traversed the node.
+  for (unsigned int lane=0; lane<Width; ++lane) {
+    if (active & (1U << lane))
+      reinterpret_cast<IncrementalUpdater *>(updaters[lane].bytes)->~IncrementalUpdater();
+  }
+}
+
+/**
+ * \brief Visit a child of a branch node with a packet of lanes.
+ *
+ * Exploring lanes whose candidate containers are already full switch to intersection, as KDNode::explore does.
+ *
+ * \param node Parent branch node.
+ * \param left Visit the left child if \c true, the right one otherwise.
+ * \param lanes Lanes of the packet visiting the child.
+ * \param exploring Subset of \a lanes exploring the parent node.
+ */
+template <typename T, unsigned int D, typename M, typename C, unsigned int W>
+void KDPacketSearch<T, D, M, C, W>::child(const KDNode *node, bool left, LaneMask lanes, LaneMask exploring) {
+
+  for (unsigned int lane=0; lane<Width; ++lane) {
+    if ((exploring & (1U << lane)) && candidates_[lane]->size() >= K_)
+      exploring &= ~(1U << lane);
+  }
+
+  if (node->is_leaf & (left ? KDNode::left_bit : KDNode::right_bit))
+    leaf(left ? node->left_leaf : node->right_leaf, lanes, exploring);
+  else
+    branch(left ? node->left_branch : node->right_branch, node, lanes, exploring);
+}
+
+/**
+ * \brief Process a leaf node with a packet of lanes.
+ *
+ * Each feature vector in the bucket is loaded once and compared with all the lanes. Exploring lanes behave
+ * as KDLeaf::explore and the rest as KDLeaf::intersect or KDLeaf::intersect_ignoring_same.
+ * Distances are calculated lane by lane through the search data of each lane, using the squared norms if available.
+ *
+ * \param leaf Leaf node being processed.
+ * \param lanes Lanes of the packet visiting the leaf.
+ * \param exploring Subset of \a lanes that should not use any upper bounds in distance calculations.
+ */
+template <typename T, unsigned int D, typename M, typename C, unsigned int W>
+void KDPacketSearch<T, D, M, C, W>::leaf(const KDLeaf *leaf, LaneMask lanes, LaneMask exploring) {
+
+  for (unsigned int i=leaf->first_index; i < leaf->first_index + leaf->num_elements; ++i) {
+    for (unsigned int lane=0; lane<Width; ++lane) {
+      if (!(lanes & (1U << lane)))
+        continue;
+
+      KDSearch &search_data = *search_data_[lane];
+      Container &candidates = *candidates_[lane];
+
+      // Exploring lanes push every candidate and update their farthest distance once the bucket is done.
+      if (exploring & (1U << lane)) {
+        Distance distance = search_data.distance(i);
+        if (!ignore_null_distances_ || distance > Traits<Distance>::zero())
+          candidates.push_back(Neighbor(i, distance));
+        continue;
+      }
+
+      // Calculate the distance to the new candidate, upper bounded by the farthest nearest neighbour distance.
+      Distance new_distance = search_data.distance(i, search_data.farthest_distance);
+      if (ignore_null_distances_ && new_distance == Traits<Distance>::zero())
+        continue;
+
+      if (!(new_distance > search_data.farthest_distance)) {
+        candidates.push_back(Neighbor(i, new_distance));
+        search_data.farthest_distance = candidates.front().squared_distance();
+      }
+    }
+  }
+
+  // Update the farthest nearest neighbour distance of the exploring lanes.
+  for (unsigned int lane=0; lane<Width; ++lane) {
+    if ((exploring & (1U << lane)) && !candidates_[lane]->empty())
+      search_data_[lane]->farthest_distance = candidates_[lane]->front().squared_distance();
+  }
+}
+
+} // namespace kche_tree
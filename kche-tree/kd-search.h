@@ -27,6 +27,12 @@
 #ifndef _KCHE_TREE_KD_SEARCH_H_
 #define _KCHE_TREE_KD_SEARCH_H_
 
+// Include STL binary searches.
+#include <algorithm>
+
+#include "dot_products.h"
+#include "prepared_query.h"
+
 namespace kche_tree {
 
 /**
@@ -55,17 +61,36 @@ struct KDSearch : MetricType::IncrementalUpdater::SearchExtras {
   /// Alias of compatible non-labeled data sets.
   typedef typename kche_tree::DataSet<Element, Dimensions> DataSet;
 
+  /// Use optimized const reference type for distance.
+  typedef typename RParam<Distance>::Type ConstRef_Distance;
+
   const Vector &p; ///< Reference input point.
   const DataSet &data; ///< Permuted training set.
   const Metric &metric; ///< Metric functor used to calculate distances between points.
+  PreparedQuery<Metric> query; ///< Reference point prepared for the distance calculations of the metric.
   unsigned int K; ///< Number of neighbours to retrieve.
 
   Distance hyperrect_distance; ///< Distance to the current nearest point in the hyperrectangle.
   Distance farthest_distance; ///< Current distance from the farthest nearest neighbour to the reference point.
   bool ignore_null_distances;  ///< Used to exclude the source point if it's already in the tree.
+  const unsigned int *excluded; ///< Sorted permuted indices of the points excluded from the search. \c NULL if none.
+  unsigned int num_excluded; ///< Number of points excluded from the search.
+
+  const Distance *squared_norms; ///< Squared norms of the points in the permuted training set. \c NULL if not available or not supported by the metric.
 
   /// Initialize data for a tree search with incremental intersection calculation.
   KDSearch(const Vector &p, const DataSet &data, const Metric &metric, unsigned int K, bool ignore_p_in_tree);
+
+  // Calculate distances using the squared norms of the points, if supported by the metric.
+  void use_squared_norms(const Distance *norms);
+
+  // Exclusion of specific points from the search by their permuted indices.
+  void exclude(const unsigned int *sorted_permuted_indices, unsigned int num_indices);
+  inline bool is_excluded(unsigned int index) const;
+
+  // Distances from the reference point to the points in the permuted training set.
+  inline Distance distance(unsigned int index) const;
+  inline Distance distance(unsigned int index, ConstRef_Distance upper_bound) const;
 };
 
 } // namespace kche_tree
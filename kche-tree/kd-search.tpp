@@ -28,6 +28,7 @@ namespace kche_tree {
 
 /**
  * Initialize a data searching structure with incremental hyperrectangle intersection calculation.
+ * The reference point is prepared here once for the distance calculations of the metric.
  *
  * \param p Reference point being used in the search.
  * \param data Permuted training set stored by the tree.
@@ -41,9 +42,81 @@ KDSearch<T, D, M>::KDSearch(const Vector &p, const DataSet &data, const M &metri
     p(p),
     data(data),
     metric(metric),
+    query(p, metric),
     K(K),
     hyperrect_distance(Traits<Distance>::zero()),
     farthest_distance(Traits<Distance>::zero()),
-    ignore_null_distances(ignore_null_distances_arg) {}
+    ignore_null_distances(ignore_null_distances_arg),
+    excluded(NULL),
+    num_excluded(0),
+    squared_norms(NULL) {}
+
+/**
+ * Calculate the distances to the points of the training set expanded in terms of their squared norms and dot products.
+ * Has no effect if the metric does not support it.
+ *
+ * \param norms Squared norms of the points in the permuted training set, or \c NULL to calculate distances with the metric.
+ */
+template <typename T, unsigned int D, typename M>
+void KDSearch<T, D, M>::use_squared_norms(const Distance *norms) {
+  if (!DotProductDistance<T, D, M>::enabled || !norms)
+    return;
+
+  squared_norms = norms;
+}
+
+/**
+ * Exclude specific points of the training set from the search. Their distances are never calculated.
+ * The indices are not copied and must remain valid during the search.
+ *
+ * \param sorted_permuted_indices Permuted indices of the excluded points in increasing order.
+ * \param num_indices Number of excluded points.
+ */
+template <typename T, unsigned int D, typename M>
+void KDSearch<T, D, M>::exclude(const unsigned int *sorted_permuted_indices, unsigned int num_indices) {
+  excluded = num_indices ? sorted_permuted_indices : NULL;
+  num_excluded = num_indices;
+}
+
+/**
+ * Check if a point of the training set is excluded from the search.
+ *
+ * \param index Permuted index of the point in the training set.
+ * \return \c true if the point is excluded, \c false otherwise.
+ */
+template <typename T, unsigned int D, typename M>
+bool KDSearch<T, D, M>::is_excluded(unsigned int index) const {
+  if (num_excluded == 1)
+    return index == excluded[0];
+  return std::binary_search(excluded, excluded + num_excluded, index);
+}
+
+/**
+ * Calculate the distance from the reference point to a point of the training set.
+ *
+ * \param index Permuted index of the point in the training set.
+ * \return Distance between the reference point and the training point.
+ */
+template <typename T, unsigned int D, typename M>
+typename KDSearch<T, D, M>::Distance KDSearch<T, D, M>::distance(unsigned int index) const {
+  if (squared_norms)
+    return query.distance_with_norms(data.get_permuted(index), squared_norms[index]);
+  return query.distance(data.get_permuted(index));
+}
+
+/**
+ * Calculate the distance from the reference point to a point of the training set with an upper bound.
+ * The upper bound is not used when distances are calculated with squared norms, since the dot product cannot be bounded.
+ *
+ * \param index Permuted index of the point in the training set.
+ * \param upper_bound Upper bound for the distance.
+ * \return Distance between the reference point and the training point, or a partial result greater than \a upper_bound.
+ */
+template <typename T, unsigned int D, typename M>
+typename KDSearch<T, D, M>::Distance KDSearch<T, D, M>::distance(unsigned int index, ConstRef_Distance upper_bound) const {
+  if (squared_norms)
+    return query.distance_with_norms(data.get_permuted(index), squared_norms[index]);
+  return query.distance(data.get_permuted(index), upper_bound);
+}
 
 } // namespace kche_tree
@@ -0,0 +1,186 @@
+/***************************************************************************
+ *   Copyright (C) 2011, 2012 by Leandro Graciá Gil                        *
+ *   leandro.gracia.gil@gmail.com                                          *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/**
+ * \file kd-summaries.h
+ * \brief Template for the summaries of the labels of the kd-tree branches used by aggregate queries.
+ * \author Leandro Graciá Gil
+ */
+
+#ifndef _KCHE_TREE_KD_SUMMARIES_H_
+#define _KCHE_TREE_KD_SUMMARIES_H_
+
+// Include fixed size integer types and STL vectors.
+#include <stdint.h>
+#include <vector>
+
+#include "cpp1x.h"
+#include "dataset.h"
+#include "kd-bounds.h"
+
+namespace kche_tree {
+
+/**
+ * \brief Summary of the labels of the train vectors inside a region of a kd-tree.
+ *
+ * Provided by the aggregate queries of kd-trees built with label summaries.
+ */
+struct LabelSummary {
+  unsigned int count; ///< Number of train vectors in the region, including identical ones collapsed in the kd-tree.
+  double sum; ///< Sum of the labels of the train vectors in the region. Zero if the labels are not arithmetic.
+  std::vector<unsigned int> histogram; ///< Number of train vectors in the region with each label class. Empty if no classes were requested.
+
+  /// Create an empty summary.
+  LabelSummary() : count(0), sum(0.0) {}
+};
+
+/**
+ * \brief Access to the values and classes of the labels summarized in kd-trees.
+ *
+ * Labels are summed only if they are arithmetic, and counted by classes only if they are integral.
+ * Unlabeled kd-trees, with \c void labels, only summarize the number of vectors.
+ *
+ * \tparam LabelType Type of the labels associated to the feature vectors.
+ */
+template <typename LabelType, bool is_arithmetic = IsArithmetic<LabelType>::value, bool is_integral = IsIntegral<LabelType>::value>
+struct LabelSummaryTraits {
+  /// Check if the labels of a data set can be summarized with the given number of classes.
+  template <typename DataSet>
+  static bool valid(const DataSet &, unsigned int num_classes) { return num_classes == 0; }
+
+  /// Value of the label of an original vector added to the sums.
+  template <typename DataSet>
+  static double value(const DataSet &, unsigned int) { return 0.0; }
+
+  /// Class of the label of an original vector counted in the histograms.
+  template <typename DataSet>
+  static unsigned int label_class(const DataSet &, unsigned int) { return 0; }
+};
+
+/// Arithmetic non-integral labels are summed, but cannot be counted by classes.
+template <typename LabelType>
+struct LabelSummaryTraits<LabelType, true, false> {
+  template <typename DataSet>
+  static bool valid(const DataSet &, unsigned int num_classes) { return num_classes == 0; }
+
+  template <typename DataSet>
+  static double value(const DataSet &data, unsigned int index) { return static_cast<double>(data.label(index)); }
+
+  template <typename DataSet>
+  static unsigned int label_class(const DataSet &, unsigned int) { return 0; }
+};
+
+/// Integral labels are summed and counted by classes, which must be in the range [0, num_classes).
+template <typename LabelType>
+struct LabelSummaryTraits<LabelType, true, true> {
+  template <typename DataSet>
+  static bool valid(const DataSet &data, unsigned int num_classes);
+
+  template <typename DataSet>
+  static double value(const DataSet &data, unsigned int index) { return static_cast<double>(data.label(index)); }
+
+  template <typename DataSet>
+  static unsigned int label_class(const DataSet &data, unsigned int index) { return static_cast<unsigned int>(data.label(index)); }
+};
+
+/**
+ * \brief Summaries of the labels of the points stored in a kd-tree, allowing aggregate queries to summarize whole branches at once.
+ *
+ * The points of every branch of a kd-tree are contiguous in the permuted data, so the summary of each branch is kept implicitly
+ * as the difference of two prefix sums over the permuted points: number of vectors, sum of their labels and, if requested, their
+ * histogram of label classes. Any branch is then summarized in constant time, or linear in the number of classes for histograms,
+ * with memory linear in the number of points times the number of classes.
+ *
+ * Box queries use the regular box traversal of the kd-tree, summarizing the branches contained in the box. Range queries traverse
+ * the tight bounding boxes of the branches, summarizing the branches entirely within the distance and checking the points of the
+ * leaves crossing it.
+ *
+ * \tparam ElementType Type of the elements in the feature vectors.
+ * \tparam NumDimensions Number of dimensions of the feature vectors.
+ */
+template <typename ElementType, unsigned int NumDimensions>
+class KDSummaries {
+public:
+  /// Type of the elements in the feature vectors.
+  typedef ElementType Element;
+
+  /// Number of dimensions of the feature vectors.
+  static const unsigned int Dimensions = NumDimensions;
+
+  /// Alias of compatible non-labeled data sets.
+  typedef typename kche_tree::DataSet<Element, Dimensions> DataSet;
+
+  /// Alias of the flat hierarchy of the kd-tree.
+  typedef kche_tree::KDBounds<Element, Dimensions> KDBounds;
+
+  // Constructor.
+  KDSummaries();
+
+  // Construction from a kd-tree.
+  template <typename KDNode>
+  void build(const KDNode *root, const DataSet &data, const uint32_t *cumulative_counts, const std::vector<double> &values,
+      const std::vector<uint32_t> &classes, unsigned int num_classes);
+
+  /// Number of label classes counted in the histograms.
+  unsigned int num_classes() const { return num_classes_; }
+
+  /// Label values of the original vectors, grouped by the permuted point storing them.
+  const std::vector<double> &values() const { return values_; }
+
+  /// Label classes of the original vectors, grouped by the permuted point storing them. Empty if no histograms are requested.
+  const std::vector<uint32_t> &classes() const { return classes_; }
+
+  // Aggregate queries.
+  void summarize_range(unsigned int begin, unsigned int end, LabelSummary &summary) const;
+  void summarize_ball(const DataSet &data, const Element *p, double squared_distance, LabelSummary &summary) const;
+
+  /**
+   * \brief Visitor of the box traversal of the kd-tree adding the points found to a summary.
+   */
+  struct BoxVisitor {
+    const KDSummaries &summaries; ///< Summaries of the kd-tree.
+    LabelSummary &summary; ///< Summary receiving the points found.
+
+    /// Summarize the point with the given permuted index.
+    void visit(unsigned int index) { summaries.summarize_range(index, index + 1, summary); }
+
+    /// Summarize the points in a range of permuted indices in constant time.
+    void visit_range(unsigned int begin, unsigned int end) { summaries.summarize_range(begin, end, summary); }
+  };
+
+private:
+  // Recursive range query.
+  void summarize_branch(const DataSet &data, unsigned int branch, const Element *p, double squared_distance, LabelSummary &summary) const;
+
+  KDBounds bounds_; ///< Tight bounding boxes of the branches, used by range queries.
+  unsigned int num_classes_; ///< Number of label classes counted in the histograms. Zero if not requested.
+  std::vector<double> values_; ///< Label values of the original vectors, kept since the labels of collapsed vectors are not stored in the kd-tree data.
+  std::vector<uint32_t> classes_; ///< Label classes of the original vectors. Empty if no histograms are requested.
+  std::vector<uint32_t> counts_; ///< Number of original vectors before each permuted index, followed by the total.
+  std::vector<double> sums_; ///< Sum of the labels of the original vectors before each permuted index, followed by the total.
+  std::vector<uint32_t> histograms_; ///< Number of original vectors of each class before each permuted index, followed by the totals, stored contiguously by index.
+};
+
+} // namespace kche_tree
+
+// Template implementation.
+#include "kd-summaries.tpp"
+
+#endif
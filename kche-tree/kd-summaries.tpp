@@ -0,0 +1,177 @@
+/***************************************************************************
+ *   Copyright (C) 2011, 2012 by Leandro Graciá Gil                        *
+ *   leandro.gracia.gil@gmail.com                                          *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/**
+ * \file kd-summaries.tpp
+ * \brief Template implementation for the summaries of the labels of the kd-tree branches used by aggregate queries.
+ * \author Leandro Graciá Gil
+ */
+
+// Include STL algorithms.
+#include <algorithm>
+
+namespace kche_tree {
+
+/**
+ * Check if the integral labels of a data set are all valid classes.
+ *
+ * \param data Labeled data set.
+ * \param num_classes Number of label classes counted in the histograms. Zero if no histograms are requested.
+ * \return \c true if no classes are requested or all the labels are in the range [0, num_classes), \c false otherwise.
+ */
+template <typename L> template <typename DataSet>
+bool LabelSummaryTraits<L, true, true>::valid(const DataSet &data, unsigned int num_classes) {
+  if (num_classes == 0)
+    return true;
+
+  for (unsigned int i=0; i<data.size(); ++i) {
+    if (data.label(i) < L() || !(static_cast<uint64_t>(data.label(i)) < num_classes))
+      return false;
+  }
+  return true;
+}
+
+/// Create empty summaries.
+template <typename T, unsigned int D>
+KDSummaries<T, D>::KDSummaries()
+    : num_classes_(0) {}
+
+/**
+ * Build the summaries of the points of a kd-tree from the label values and classes of the original vectors they store.
+ *
+ * Labels are grouped by permuted point as in the cumulative counts, so that each group of collapsed vectors contributes the
+ * labels of all its members.
+ *
+ * \tparam KDNode Type of the internal nodes of the kd-tree.
+ * \param root Root node of the kd-tree.
+ * \param data Permuted data stored by the kd-tree.
+ * \param cumulative_counts Number of original vectors before each permuted index, followed by the total. \c NULL if no vectors were collapsed.
+ * \param values Label value of each original vector, grouped by permuted point.
+ * \param classes Label class of each original vector, grouped by permuted point. Unused if \a num_classes is zero.
+ * \param num_classes Number of label classes counted in the histograms. Zero if no histograms are requested.
+ */
+template <typename T, unsigned int D> template <typename KDNode>
+void KDSummaries<T, D>::build(const KDNode *root, const DataSet &data, const uint32_t *cumulative_counts, const std::vector<double> &values,
+    const std::vector<uint32_t> &classes, unsigned int num_classes) {
+
+  bounds_.build(root, data, cumulative_counts);
+  num_classes_ = num_classes;
+  values_ = values;
+  if (num_classes)
+    classes_ = classes;
+  else
+    classes_.clear();
+
+  const unsigned int num_points = data.size();
+  counts_.assign(num_points + 1, 0);
+  sums_.assign(num_points + 1, 0.0);
+  histograms_.assign(num_classes ? (static_cast<size_t>(num_points) + 1) * num_classes : 0, 0);
+
+  for (unsigned int i=0; i<num_points; ++i) {
+    const uint32_t first = cumulative_counts ? cumulative_counts[i] : i;
+    const uint32_t last = cumulative_counts ? cumulative_counts[i + 1] : i + 1;
+    counts_[i + 1] = counts_[i] + (last - first);
+
+    double sum = 0.0;
+    for (uint32_t j=first; j<last; ++j)
+      sum += values[j];
+    sums_[i + 1] = sums_[i] + sum;
+
+    if (num_classes) {
+      const size_t offset = static_cast<size_t>(i) * num_classes;
+      std::copy(&histograms_[offset], &histograms_[offset] + num_classes, &histograms_[offset + num_classes]);
+      for (uint32_t j=first; j<last; ++j)
+        ++histograms_[offset + num_classes + classes[j]];
+    }
+  }
+}
+
+/**
+ * Add the points in a range of permuted indices to a summary. Constant time, or linear in the number of classes if histograms are used.
+ *
+ * \param begin Permuted index of the first point in the range.
+ * \param end Permuted index following the last point in the range.
+ * \param summary Summary where the points are added. Its histogram must have been resized to the number of classes.
+ */
+template <typename T, unsigned int D>
+void KDSummaries<T, D>::summarize_range(unsigned int begin, unsigned int end, LabelSummary &summary) const {
+  summary.count += counts_[end] - counts_[begin];
+  summary.sum += sums_[end] - sums_[begin];
+
+  const uint32_t *first = num_classes_ ? &histograms_[static_cast<size_t>(begin) * num_classes_] : NULL;
+  const uint32_t *last = num_classes_ ? &histograms_[static_cast<size_t>(end) * num_classes_] : NULL;
+  for (unsigned int c=0; c<num_classes_; ++c)
+    summary.histogram[c] += last[c] - first[c];
+}
+
+/**
+ * Add the points within a Euclidean distance of a point to a summary.
+ *
+ * \param data Permuted data stored by the kd-tree.
+ * \param p Point in the stored dimension order.
+ * \param squared_distance Squared Euclidean distance within which points are added, included.
+ * \param summary Summary where the points are added. Its histogram must have been resized to the number of classes.
+ */
+template <typename T, unsigned int D>
+void KDSummaries<T, D>::summarize_ball(const DataSet &data, const Element *p, double squared_distance, LabelSummary &summary) const {
+  if (bounds_.size())
+    summarize_branch(data, 0, p, squared_distance, summary);
+}
+
+/**
+ * Add the points of a branch within a Euclidean distance of a point to a summary. Branches entirely within the
+ * distance are summarized at once, and branches entirely beyond it are skipped.
+ *
+ * \param data Permuted data stored by the kd-tree.
+ * \param branch Index of the branch in the flat hierarchy.
+ * \param p Point in the stored dimension order.
+ * \param squared_distance Squared Euclidean distance within which points are added, included.
+ * \param summary Summary where the points are added.
+ */
+template <typename T, unsigned int D>
+void KDSummaries<T, D>::summarize_branch(const DataSet &data, unsigned int branch, const Element *p, double squared_distance, LabelSummary &summary) const {
+  const typename KDBounds::Branch &node = bounds_[branch];
+  if (node.begin == node.end || KDBounds::min_squared_distance(p, p, bounds_.lower(branch), bounds_.upper(branch)) > squared_distance)
+    return;
+
+  if (!(KDBounds::max_squared_distance(p, p, bounds_.lower(branch), bounds_.upper(branch)) > squared_distance)) {
+    summarize_range(node.begin, node.end, summary);
+    return;
+  }
+
+  if (!bounds_.is_leaf(branch)) {
+    summarize_branch(data, node.left, p, squared_distance, summary);
+    summarize_branch(data, node.right, p, squared_distance, summary);
+    return;
+  }
+
+  for (unsigned int i=node.begin; i<node.end; ++i) {
+    const typename DataSet::Vector &v = data.get_permuted(i);
+    double distance = 0.0;
+    for (unsigned int d=0; d<D; ++d) {
+      const double difference = static_cast<double>(v[d]) - static_cast<double>(p[d]);
+      distance += difference * difference;
+    }
+    if (!(distance > squared_distance))
+      summarize_range(i, i + 1, summary);
+  }
+}
+
+} // namespace kche_tree
@@ -36,11 +36,27 @@
 #include "k-vector.h"
 
 // Other includes from the library.
+#include "brute_force.h"
+#include "build_options.h"
+#include "build_report.h"
 #include "dataset.h"
+#include "dimension_order.h"
+#include "duplicates.h"
+#include "kd-bounds.h"
+#include "kd-dbscan.h"
+#include "kd-emst.h"
+#include "kd-interleaved.h"
+#include "kd-join.h"
+#include "kd-kmeans.h"
 #include "kd-node.h"
+#include "kd-packet.h"
+#include "kd-summaries.h"
 #include "labeled_dataset.h"
 #include "metrics.h"
 #include "neighbor.h"
+#include "outlier_factors.h"
+#include "search_engine.h"
+#include "search_planner.h"
 #include "serializable.h"
 #include "traits.h"
 #include "utils.h"
@@ -118,6 +134,9 @@ public:
   /// Type of the k-neighbour results.
   typedef std::vector<Neighbor> KNeighbors;
 
+  /// Type of the permutation applied to the dimensions of the stored vectors.
+  typedef kche_tree::DimensionOrder<Element, Dimensions> DimensionOrder;
+
   /// Type of the default metric used for search methods.
   typedef EuclideanMetric<Element, Dimensions> DefaultMetric;
 
@@ -125,7 +144,7 @@ public:
   typedef typename RParam<Distance>::Type ConstRef_Distance;
 
   /// Default size for kd-tree leaf node buckets.
-  static const unsigned int DefaultBucketSize = 32;
+  static const unsigned int DefaultBucketSize = BuildOptions::default_bucket_size;
 
   /// Default constructor. Creates an empty and uninitialized kd-tree.
   KDTree();
@@ -134,7 +153,8 @@ public:
   KDTree(const DataSet &train_set, unsigned int bucket_size = DefaultBucketSize);
 
   // Basic kd-tree operations.
-  bool build(const DataSet &train_set, unsigned int bucket_size = DefaultBucketSize); ///< Build a kd-tree from a set of training vectors. Cost: O(n log² n).
+  bool build(const DataSet &train_set, unsigned int bucket_size = DefaultBucketSize, BuildReport *report = NULL); ///< Build a kd-tree from a set of training vectors. Cost: O(n log² n).
+  bool build(const DataSet &train_set, const BuildOptions &options, BuildReport *report = NULL); ///< Build a kd-tree from a set of training vectors with the provided options. Cost: O(n log² n).
 
   #ifdef KCHE_TREE_DISABLE_CPP1X
   template <template <typename, typename> class KContainer, typename M>
@@ -144,6 +164,18 @@ public:
   void knn(const Vector &p, unsigned int K, KNeighbors &output, const M &metric = M(), ConstRef_Distance epsilon = Traits<Distance>::zero(), bool ignore_p_in_tree = false) const; ///< Get the K nearest neighbours of a point. Estimated average cost: O(log K log n).
   #endif
 
+  #ifdef KCHE_TREE_DISABLE_CPP1X
+  template <template <typename, typename> class KContainer, typename M>
+  void knn_excluding(const Vector &p, unsigned int K, KNeighbors &output, unsigned int excluded_index, const M &metric = DefaultMetric(), ConstRef_Distance epsilon = Traits<Distance>::zero()) const; ///< Get the K nearest neighbours of a point excluding a train vector by its index.
+  template <template <typename, typename> class KContainer, typename M>
+  void knn_excluding(const Vector &p, unsigned int K, KNeighbors &output, const std::vector<unsigned int> &excluded_indices, const M &metric = DefaultMetric(), ConstRef_Distance epsilon = Traits<Distance>::zero()) const; ///< Get the K nearest neighbours of a point excluding a set of train vectors by their indices.
+  #else
+  template <template <typename, typename> class KContainer = KVector, typename M = DefaultMetric>
+  void knn_excluding(const Vector &p, unsigned int K, KNeighbors &output, unsigned int excluded_index, const M &metric = M(), ConstRef_Distance epsilon = Traits<Distance>::zero()) const; ///< Get the K nearest neighbours of a point excluding a train vector by its index.
+  template <template <typename, typename> class KContainer = KVector, typename M = DefaultMetric>
+  void knn_excluding(const Vector &p, unsigned int K, KNeighbors &output, const std::vector<unsigned int> &excluded_indices, const M &metric = M(), ConstRef_Distance epsilon = Traits<Distance>::zero()) const; ///< Get the K nearest neighbours of a point excluding a set of train vectors by their indices.
+  #endif
+
   #ifdef KCHE_TREE_DISABLE_CPP1X
   template <typename M>
   void all_in_range(const Vector &p, ConstRef_Distance distance, std::vector<Neighbor> &output, const M &metric = DefaultMetric(), bool ignore_p_in_tree = false) const; ///< Get all neighbours within a distance from a point. Estimated average Cost: O(log m log n) depending on the number of results m.
@@ -152,8 +184,65 @@ public:
   void all_in_range(const Vector &p, ConstRef_Distance distance, std::vector<Neighbor> &output, const M &metric = M(), bool ignore_p_in_tree = false) const; ///< Get all neighbours within a distance from a point. Estimated average Cost: O(log m log n) depending on the number of results m.
   #endif
 
+  #ifdef KCHE_TREE_DISABLE_CPP1X
+  template <template <typename, typename> class KContainer, typename M>
+  void batch_knn(const kche_tree::DataSet<Element, Dimensions> &queries, unsigned int K, std::vector<KNeighbors> &output, const M &metric = DefaultMetric(), ConstRef_Distance epsilon = Traits<Distance>::zero(), bool ignore_p_in_tree = false, SearchEngine::Type engine = SearchEngine::Automatic) const; ///< Get the K nearest neighbours of a batch of points.
+  #else
+  template <template <typename, typename> class KContainer = KVector, typename M = DefaultMetric>
+  void batch_knn(const kche_tree::DataSet<Element, Dimensions> &queries, unsigned int K, std::vector<KNeighbors> &output, const M &metric = M(), ConstRef_Distance epsilon = Traits<Distance>::zero(), bool ignore_p_in_tree = false, SearchEngine::Type engine = SearchEngine::Automatic) const; ///< Get the K nearest neighbours of a batch of points.
+  #endif
+
+  #ifdef KCHE_TREE_DISABLE_CPP1X
+  template <typename M>
+  unsigned int count_in_range(const Vector &p, ConstRef_Distance distance, const M &metric = DefaultMetric(), bool ignore_p_in_tree = false) const; ///< Count the points within a distance from a point, including identical ones collapsed in the tree.
+  #else
+  template <typename M = DefaultMetric>
+  unsigned int count_in_range(const Vector &p, ConstRef_Distance distance, const M &metric = M(), bool ignore_p_in_tree = false) const; ///< Count the points within a distance from a point, including identical ones collapsed in the tree.
+  #endif
+
+  // Axis-aligned box searches. Boxes include their boundaries.
+  void all_in_box(const Vector &lower, const Vector &upper, std::vector<unsigned int> &output) const; ///< Get the indices of all the points inside an axis-aligned box.
+  unsigned int count_in_box(const Vector &lower, const Vector &upper) const; ///< Count the points inside an axis-aligned box.
+  template <typename Visitor>
+  void visit_box(const Vector &lower, const Vector &upper, Visitor &visitor) const; ///< Call a visitor with the index of each point inside an axis-aligned box.
+
+  // Gaussian kernel density estimation with a bounded relative error. Uses Euclidean distances.
+  double kernel_density(const Vector &p, double bandwidth, double relative_error = 0.0) const; ///< Estimate the Gaussian kernel density at a point.
+  void kernel_density(const kche_tree::DataSet<Element, Dimensions> &queries, double bandwidth, std::vector<double> &output, double relative_error = 0.0) const; ///< Estimate the Gaussian kernel density at a batch of points using a dual-tree traversal.
+
+  // Density-based clustering of the train vectors. Uses Euclidean distances.
+  unsigned int dbscan(double distance, unsigned int min_points, std::vector<int> &labels) const; ///< Cluster the train vectors with DBSCAN, labeling them by their original indices.
+
+  // K-means clustering of the train vectors. Uses Euclidean distances.
+  unsigned int kmeans(kche_tree::DataSet<Element, Dimensions> &centers, std::vector<unsigned int> &labels, unsigned int max_iterations = 100, double *inertia = NULL) const; ///< Cluster the train vectors with k-means, filtering the candidate centers of each branch.
+
+  // Euclidean minimum spanning tree and single-linkage clustering of the train vectors.
+  void minimum_spanning_tree(std::vector<kche_tree::SpanningTreeEdge> &edges) const; ///< Build the Euclidean minimum spanning tree of the train vectors with a dual-tree Borůvka algorithm.
+  unsigned int single_linkage(double distance, std::vector<unsigned int> &labels) const; ///< Cluster the train vectors joining the ones within a distance of each other, directly or through others.
+
+  // Dual-tree joins with another kd-tree of the same element type and dimensions. Use Euclidean distances.
+  template <typename OtherLabel>
+  void nearest_within(const KDTree<Element, Dimensions, OtherLabel> &references, double distance, std::vector<int> &nearest, std::vector<double> *distances = NULL) const; ///< Find the nearest vector of another kd-tree within a distance of each train vector.
+  template <typename OtherLabel>
+  double closest_pair(const KDTree<Element, Dimensions, OtherLabel> &other, unsigned int &index, unsigned int &other_index) const; ///< Find the closest pair of train vectors between this kd-tree and another one.
+
+  // Aggregate queries summarizing the labels of the train vectors. Require kd-trees built with label summaries.
+  void summarize_box(const Vector &lower, const Vector &upper, kche_tree::LabelSummary &summary) const; ///< Summarize the train vectors inside an axis-aligned box.
+  void summarize_in_range(const Vector &p, double distance, kche_tree::LabelSummary &summary) const; ///< Summarize the train vectors within a Euclidean distance from a point.
+
+  // Local outlier factors of the train vectors. Use Euclidean distances.
+  void local_outlier_factors(unsigned int K, kche_tree::LocalOutlierFactors &factors) const; ///< Compute the k-distances, densities and local outlier factors of all the train vectors in a batch.
+  double outlier_factor(const Vector &p, const kche_tree::LocalOutlierFactors &factors) const; ///< Score a point against the local outlier factors of the train vectors.
+  void outlier_factor(const kche_tree::DataSet<Element, Dimensions> &queries, const kche_tree::LocalOutlierFactors &factors, std::vector<double> &output) const; ///< Score a batch of points against the local outlier factors of the train vectors.
+
+  // Calibration of the boundary checks in bounded distances.
+  template <typename M>
+  bool calibrate_bound_checks(const kche_tree::DataSet<Element, Dimensions> &queries, unsigned int K, const M &metric, bool ignore_p_in_tree = false) const; ///< Select the cadence of the boundary checks of a metric profile from a sample of queries.
+
   // Access to the data stored within the kd-tree.
   const DataSet& data() const;
+  const DimensionOrder *dimension_order() const;
+  const Duplicates *duplicates() const;
 
   // Stream operators.
   //friend std::istream& operator >> <>(std::istream &in, KDTree &kdtree);
@@ -168,9 +257,74 @@ private:
   void serialize(std::ostream &out) const;
   void swap(KDTree &kdtree);
 
+  /// Type of the non-labeled data sets used for batches of queries.
+  typedef kche_tree::DataSet<Element, Dimensions> QuerySet;
+
+  // Search of the K nearest neighbours of a prepared query, optionally excluding some train vectors by their original indices.
+  template <template <typename, typename> class KContainer, typename M>
+  void search_knn(const Vector &p, unsigned int K, KNeighbors &output, const M &metric, ConstRef_Distance epsilon, bool ignore_p_in_tree,
+      const unsigned int *excluded_indices = NULL, unsigned int num_excluded = 0) const;
+
+  // Search of all the points within a distance from a prepared query, returned with their permuted indices after the range itself.
+  template <typename M>
+  void search_all_in_range(const Vector &p, ConstRef_Distance distance, std::vector<Neighbor> &points_in_range, const M &metric, bool ignore_p_in_tree) const;
+
+  // Expansion of the groups of identical vectors in the results.
+  void expand_duplicates(KNeighbors &output, unsigned int first, unsigned int max_size, const std::vector<unsigned int> *excluded_indices = NULL) const;
+
+  // Preparation of the queries for the layout of the stored data.
+  template <typename M>
+  const Vector &prepare_query(const Vector &p, Vector &prepared) const;
+
+  template <typename M>
+  const QuerySet &prepare_queries(const QuerySet &queries, QuerySet &prepared) const;
+
+  // Search of the points inside an axis-aligned box, reported by their permuted indices.
+  template <typename BoxVisitor>
+  void search_box(const Vector &lower, const Vector &upper, BoxVisitor &visitor) const;
+
+  // Bounding box of the stored points.
+  void calculate_bounding_box();
+
+  // Number of original vectors before each permuted index when identical vectors are collapsed.
+  void calculate_cumulative_counts();
+  const uint32_t *cumulative_counts() const;
+  unsigned int total_weight() const;
+  unsigned int first_occurrence(unsigned int index) const;
+
+  // Check if the dimensions of another kd-tree are stored in the same order, or access its data in the order of this one.
+  template <typename OtherLabel>
+  bool same_dimension_order(const KDTree<Element, Dimensions, OtherLabel> &kdtree) const;
+  template <typename OtherLabel>
+  const QuerySet &data_in_dimension_order(const KDTree<Element, Dimensions, OtherLabel> &kdtree, ScopedPtr<QuerySet> &reordered_data) const;
+
+  // Summaries of the labels of the points for aggregate queries.
+  void calculate_summaries(const DataSet &train_set, unsigned int num_classes);
+  void reset_summary(kche_tree::LabelSummary &summary) const;
+
+  // Squared norms of the points for dot product distances, if available.
+  void calculate_squared_norms();
+  const Distance *squared_norms() const;
+
+  // Nearest neighbours of the points scored with local outlier factors.
+  void search_outlier_neighbors(const Vector &p, unsigned int K, const unsigned int *excluded_index, KNeighbors &buffer, uint32_t *neighbors, double *distances) const;
+  void expand_outlier_values(const std::vector<double> &values, std::vector<double> &output) const;
+  unsigned int num_batch_ranges(unsigned int num_queries) const;
+
+  /// Minimum number of queries processed by each thread in parallel batches if OpenMP is enabled.
+  static const unsigned int min_queries_per_range = 256;
+
+  // Choose the engine for a batch search.
+  template <template <typename, typename> class KContainer, typename M>
+  SearchEngine::Type plan_batch_knn(const kche_tree::DataSet<Element, Dimensions> &queries, unsigned int K, std::vector<KNeighbors> &output,
+      const M &metric, ConstRef_Distance epsilon, bool ignore_p_in_tree, unsigned int &first_query) const;
+
   friend std::istream& operator >> <>(std::istream &in, Serializable<KDTree> &kdtree);
   friend std::ostream& operator << <>(std::ostream &out, const Serializable<KDTree> &kdtree);
 
+  // Allow dual-tree algorithms to access the nodes of kd-trees with other label types.
+  template <typename, unsigned int, typename> friend class KDTree;
+
   /// Type of the internal nodes using in the tree.
   typedef kche_tree::KDNode<Element, Dimensions> KDNode;
 
@@ -180,16 +334,28 @@ private:
   // Kd-tree data.
   ScopedPtr<KDNode> root_; ///< Root node of the tree. Will point to \c NULL in empty trees.
   ScopedPtr<DataSet> data_; ///< Data of the kd-tree. Consists of a permuted version of the training set created while building the tree.
+  ScopedPtr<DimensionOrder> dimension_order_; ///< Order of the dimensions of the stored vectors. \c NULL if the original order is kept.
+  Vector bounding_lower_; ///< Lower corner of the bounding box of the stored points, in their stored dimension order.
+  Vector bounding_upper_; ///< Upper corner of the bounding box of the stored points, in their stored dimension order.
+  ScopedPtr<Duplicates> duplicates_; ///< Original indices of the identical train vectors stored once. \c NULL if not collapsed or no duplicates were found.
+  std::vector<uint32_t> cumulative_counts_; ///< Number of original vectors before each permuted index, followed by the total. Empty if no vectors were collapsed.
+  std::vector<Distance> squared_norms_; ///< Squared norms of the points in the permuted data. Empty if not requested in the build options or not supported by the element type.
+  ScopedPtr<KDSummaries<Element, Dimensions> > summaries_; ///< Summaries of the labels of the points for aggregate queries. \c NULL if not requested in the build options.
 
   // Serialization settings.
   static const uint16_t version[2]; ///< Tuple of major and minor version of the current kd-tree serialization format.
   static const uint16_t signature; ///< Signature value used to check the end of data according to the current format.
+  static const uint8_t squared_norms_flag = 0x01; ///< Serialized flag indicating that the squared norms of the points should be calculated.
+  static const uint8_t dimension_order_flag = 0x02; ///< Serialized flag indicating that the order of the dimensions follows the flags.
+  static const uint8_t duplicates_flag = 0x04; ///< Serialized flag indicating that the groups of identical vectors follow the flags.
+  static const uint8_t label_summaries_flag = 0x08; ///< Serialized flag indicating that the number of label classes and the labels of the summaries follow the flags.
 };
 
 } // namespace kche_tree
 
 // Template implementation.
 #include "kd-tree.tpp"
+#include "kd-tree_batch.tpp"
 #include "kd-tree_io.tpp"
 
 #endif
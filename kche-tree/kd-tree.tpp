@@ -26,7 +26,7 @@
 
 namespace kche_tree {
 
-// Include the out_of_range exception.
+// Include the out_of_range and invalid_argument exceptions.
 #include <stdexcept>
 
 /**
@@ -44,6 +44,26 @@ const typename KDTree<T, D, L>::DataSet& KDTree<T, D, L>::data() const {
   return *data_;
 }
 
+/**
+ * \brief Get the order of the dimensions of the vectors stored in the kd-tree.
+ *
+ * \return Permutation applied to the dimensions of the vectors returned by data(), or \c NULL if they keep their original order.
+ */
+template <typename T, unsigned int D, typename L>
+const typename KDTree<T, D, L>::DimensionOrder *KDTree<T, D, L>::dimension_order() const {
+  return dimension_order_.get();
+}
+
+/**
+ * \brief Get the groups of identical vectors collapsed while building the kd-tree.
+ *
+ * \return Original indices of the vectors represented by each of the ones returned by data(), or \c NULL if no vectors were collapsed.
+ */
+template <typename T, unsigned int D, typename L>
+const Duplicates *KDTree<T, D, L>::duplicates() const {
+  return duplicates_.get();
+}
+
 /**
  * \brief Get the number of elements stored in the tree.
  */
@@ -67,32 +87,221 @@ KDTree<T, D, L>::KDTree(const DataSet &train_set, unsigned int bucket_size) {
  *
  * \param train_set Train set used to build the kd-tree.
  * \param bucket_size Number of elements that should be grouped in leaf nodes.
+ * \param report Optional report filled with the time spent in each of the build phases. No timing is performed if \c NULL.
  * \return \c true if successful, \c false otherwise.
  */
 template <typename T, unsigned int D, typename L>
-bool KDTree<T, D, L>::build(const DataSet &train_set, unsigned int bucket_size) {
+bool KDTree<T, D, L>::build(const DataSet &train_set, unsigned int bucket_size, BuildReport *report) {
+  return build(train_set, BuildOptions(bucket_size), report);
+}
+
+/**
+ * Build a kd-tree from a set of \a n D-dimensional samples.
+ *
+ * \param train_set Train set used to build the kd-tree.
+ * \param options Options controlling the build, including the bucket size.
+ * \param report Optional report filled with the time spent in each of the build phases. No timing is performed if \c NULL.
+ * \return \c true if successful, \c false otherwise. Fails if label histograms are requested and the labels are not integral classes in range.
+ */
+template <typename T, unsigned int D, typename L>
+bool KDTree<T, D, L>::build(const DataSet &train_set, const BuildOptions &options, BuildReport *report) {
 
   // Check params.
   unsigned int num_points = train_set.size();
+  unsigned int bucket_size = options.bucket_size;
   if (num_points == 0 || bucket_size == 0)
     return false;
+  if (options.label_summaries && !LabelSummaryTraits<Label>::valid(train_set, options.label_classes))
+    return false;
+
+  // Reset the report, if any.
+  if (report)
+    report->reset();
+  clock_t t_total = report ? clock() : 0;
+
+  // Sort the dimensions by decreasing variance if requested, building the tree from a reordered copy of the train set.
+  clock_t t_phase = report ? clock() : 0;
+  ScopedPtr<DimensionOrder> dimension_order;
+  ScopedPtr<DataSet> reordered_set;
+  const DataSet *source_set = &train_set;
+  if (options.reorder_dimensions) {
+    dimension_order.reset(new DimensionOrder());
+    dimension_order->sort_by_variance(train_set);
+    if (dimension_order->is_identity()) {
+      dimension_order.reset();
+    } else {
+      unsigned int *identity = new unsigned int[num_points];
+      for (unsigned int i=0; i<num_points; ++i)
+        identity[i] = i;
+      reordered_set.reset(new DataSet(train_set, identity));
+      dimension_order->reorder(*reordered_set);
+      source_set = reordered_set.get();
+    }
+  }
+  if (report)
+    report->dimension_order_time = BuildReport::elapsed(t_phase);
+
+  // Collapse identical vectors if requested, building the tree from a copy of the distinct ones.
+  t_phase = report ? clock() : 0;
+  ScopedPtr<Duplicates> duplicates;
+  ScopedPtr<DataSet> distinct_set;
+  if (options.collapse_duplicates) {
+    duplicates.reset(new Duplicates());
+    std::vector<unsigned int> representatives;
+    if (duplicates->group(*source_set, representatives)) {
+      distinct_set.reset(new DataSet(*source_set, &representatives[0], representatives.size()));
+      source_set = distinct_set.get();
+      num_points = source_set->size();
+    } else {
+      duplicates.reset();
+    }
+  }
+  if (report)
+    report->duplicates_time = BuildReport::elapsed(t_phase);
 
   // Allocate and initialize the permutation array to identity.
+  t_phase = report ? clock() : 0;
   ScopedArray<unsigned int> permutation(new unsigned int[num_points]);
   for (unsigned int i=0; i<num_points; ++i)
     permutation[i] = i;
+  if (report)
+    report->permutation_time = BuildReport::elapsed(t_phase);
 
   // Build the kd-tree recursively (num_elements will contain a recursively-calculated num_points after the call).
+  t_phase = report ? clock() : 0;
   unsigned int num_elements = 0;
-  root_.reset(KDNode::build(train_set, permutation.get(), train_set.size(), NULL, bucket_size, num_elements));
+  {
+    typename KDNode::BuildAllocator allocator(report);
+    root_.reset(KDNode::build(*source_set, permutation.get(), num_points, NULL, bucket_size, num_elements, allocator));
+  }
   KCHE_TREE_DCHECK(num_elements == num_points);
+  if (report)
+    report->recursion_time = BuildReport::elapsed(t_phase);
 
   // Make a local permuted copy of the train data. The permutation vector ownership is transferred to the data set.
-  data_.reset(new DataSet(train_set, permutation.release()));
+  t_phase = report ? clock() : 0;
+  data_.reset(new DataSet(*source_set, permutation.release()));
+  dimension_order_.swap(dimension_order);
+  duplicates_.swap(duplicates);
+  calculate_bounding_box();
+  calculate_cumulative_counts();
+  if (report)
+    report->data_copy_time = BuildReport::elapsed(t_phase);
+
+  // Precalculate the squared norms of the permuted points if requested.
+  t_phase = report ? clock() : 0;
+  squared_norms_.clear();
+  if (options.squared_norms)
+    calculate_squared_norms();
+  if (report)
+    report->squared_norms_time = BuildReport::elapsed(t_phase);
+
+  // Summarize the labels of the permuted points if requested.
+  t_phase = report ? clock() : 0;
+  summaries_.reset();
+  if (options.label_summaries)
+    calculate_summaries(train_set, options.label_classes);
+  if (report) {
+    report->summaries_time = BuildReport::elapsed(t_phase);
+    report->total_time = BuildReport::elapsed(t_total);
+  }
 
   return true;
 }
 
+/**
+ * Prepare a query point for the layout of the stored vectors, reordering its dimensions if required.
+ *
+ * \param p Query point.
+ * \param prepared Vector where the query is reordered if required.
+ * \return Reference to the prepared query. Can be \a p itself if no changes are required.
+ * \exception std::invalid_argument Thrown if the dimensions are reordered and the metric is not invariant to permutations of the dimensions.
+ */
+template <typename T, unsigned int D, typename L> template <typename Metric>
+const typename KDTree<T, D, L>::Vector &KDTree<T, D, L>::prepare_query(const Vector &p, Vector &prepared) const {
+  if (!dimension_order_)
+    return p;
+
+  if (!IsPermutationInvariant<Metric>::value)
+    throw std::invalid_argument("the metric is not invariant to the dimension reordering used to build the kd-tree");
+
+  dimension_order_->reorder(p, prepared);
+  return prepared;
+}
+
+/**
+ * Prepare a batch of queries for the layout of the stored vectors, reordering their dimensions if required.
+ *
+ * \param queries Query points.
+ * \param prepared Data set where the queries are reordered if required.
+ * \return Reference to the prepared queries. Can be \a queries itself if no changes are required.
+ * \exception std::invalid_argument Thrown if the dimensions are reordered and the metric is not invariant to permutations of the dimensions.
+ */
+template <typename T, unsigned int D, typename L> template <typename Metric>
+const typename KDTree<T, D, L>::QuerySet &KDTree<T, D, L>::prepare_queries(const QuerySet &queries, QuerySet &prepared) const {
+  if (!dimension_order_)
+    return queries;
+
+  if (!IsPermutationInvariant<Metric>::value)
+    throw std::invalid_argument("the metric is not invariant to the dimension reordering used to build the kd-tree");
+
+  prepared.reset_to_size(queries.size());
+  for (unsigned int i=0; i<queries.size(); ++i)
+    dimension_order_->reorder(queries[i], prepared[i]);
+  return prepared;
+}
+
+/**
+ * Precalculate the squared norms of the points in the permuted data, so that Euclidean distances can be calculated with dot products.
+ * No norms are calculated if the element type does not support it.
+ */
+template <typename T, unsigned int D, typename L>
+void KDTree<T, D, L>::calculate_squared_norms() {
+  KCHE_TREE_DCHECK(data_);
+  DotProductDistance<Element, Dimensions, DefaultMetric>::squared_norms(*data_, squared_norms_);
+}
+
+/**
+ * Calculate the summaries of the labels of the points in the permuted data used by the aggregate queries.
+ *
+ * Labels are taken from the original train set, so that identical vectors collapsed in the kd-tree contribute their own labels.
+ *
+ * \param train_set Train set used to build the kd-tree.
+ * \param num_classes Number of label classes counted in the histograms. Zero if no histograms are requested.
+ */
+template <typename T, unsigned int D, typename L>
+void KDTree<T, D, L>::calculate_summaries(const DataSet &train_set, unsigned int num_classes) {
+  KCHE_TREE_DCHECK(data_);
+  std::vector<double> values;
+  std::vector<uint32_t> classes;
+  values.reserve(total_weight());
+  classes.reserve(num_classes ? total_weight() : 0);
+  for (unsigned int i=0; i<size(); ++i) {
+    const unsigned int index = data_->get_original_index(i);
+    const uint32_t *indices = duplicates_ ? duplicates_->indices(index) : NULL;
+    const unsigned int count = duplicates_ ? duplicates_->count(index) : 1;
+    for (unsigned int j=0; j<count; ++j) {
+      const unsigned int original = indices ? indices[j] : index;
+      values.push_back(LabelSummaryTraits<Label>::value(train_set, original));
+      if (num_classes)
+        classes.push_back(LabelSummaryTraits<Label>::label_class(train_set, original));
+    }
+  }
+
+  summaries_.reset(new KDSummaries<Element, Dimensions>());
+  summaries_->build(root_.get(), *data_, cumulative_counts(), values, classes, num_classes);
+}
+
+/**
+ * Get the squared norms of the points in the permuted data.
+ *
+ * \return Pointer to the squared norms, or \c NULL if not available.
+ */
+template <typename T, unsigned int D, typename L>
+const typename KDTree<T, D, L>::Distance *KDTree<T, D, L>::squared_norms() const {
+  return squared_norms_.empty() ? NULL : &squared_norms_[0];
+}
+
 /**
  * Find the K nearest neighbors of a given Point and push their indices sorted into a given STL vector.
  * In case that there are not enough points in the tree, all the available ones will be provided.
@@ -103,6 +312,7 @@ bool KDTree<T, D, L>::build(const DataSet &train_set, unsigned int bucket_size)
  * \param metric Metric functor that will be used to calculate the distances between points. Defaults to Euclidean metric if C++1x is enabled.
  * \param epsilon Acceptable distance margin to ignore regions during kd-tree exploration. Defaults to zero (deterministic).
  * \param ignore_p_in_tree Assume that \a p is contained in the tree any number of times and ignore them all.
+ * \exception std::invalid_argument Thrown if the dimensions of the kd-tree are reordered and the metric is not invariant to permutations of the dimensions.
  */
 template <typename T, unsigned int D, typename L> template <template <typename, typename> class KContainer, typename Metric>
 void KDTree<T, D, L>::knn(const Vector &p, unsigned int K, std::vector<Neighbor> &output, const Metric &metric, ConstRef_Distance epsilon, bool ignore_p_in_tree) const {
@@ -111,26 +321,133 @@ void KDTree<T, D, L>::knn(const Vector &p, unsigned int K, std::vector<Neighbor>
   if (!root_ || size() == 0 || K == 0)
     return;
 
+  // Reorder the query as the stored vectors if required.
+  Vector prepared_p;
+  search_knn<KContainer>(prepare_query<Metric>(p, prepared_p), K, output, metric, epsilon, ignore_p_in_tree);
+}
+
+/**
+ * Find the K nearest neighbors of a given point excluding a train vector by its index, and push their indices sorted into a given STL vector.
+ * Unlike ignoring the point by its distance, only the given vector is excluded and its distance is never calculated.
+ * Intended for self-joins and leave-one-out evaluations, where each query is the train vector with the excluded index.
+ *
+ * \param p Point whose \a K neighbors should be retrieved.
+ * \param K Number of nearest neighbors to retrieve.
+ * \param output STL vector where the nearest neighbors will be appended. Sorted result depends on the template parameter S, enabled by default.
+ * \param excluded_index Index of the excluded vector in the train set used to build the kd-tree.
+ * \param metric Metric functor that will be used to calculate the distances between points. Defaults to Euclidean metric if C++1x is enabled.
+ * \param epsilon Acceptable distance margin to ignore regions during kd-tree exploration. Defaults to zero (deterministic).
+ * \exception std::out_of_range Thrown if the index is out of the range of the train set.
+ * \exception std::invalid_argument Thrown if the dimensions of the kd-tree are reordered and the metric is not invariant to permutations of the dimensions.
+ */
+template <typename T, unsigned int D, typename L> template <template <typename, typename> class KContainer, typename Metric>
+void KDTree<T, D, L>::knn_excluding(const Vector &p, unsigned int K, std::vector<Neighbor> &output, unsigned int excluded_index, const Metric &metric, ConstRef_Distance epsilon) const {
+  // Check if there is any data on the tree and K is valid.
+  KCHE_TREE_DCHECK(data_);
+  if (!root_ || size() == 0 || K == 0)
+    return;
+
+  // Reorder the query as the stored vectors if required.
+  Vector prepared_p;
+  search_knn<KContainer>(prepare_query<Metric>(p, prepared_p), K, output, metric, epsilon, false, &excluded_index, 1);
+}
+
+/**
+ * Find the K nearest neighbors of a given point excluding a set of train vectors by their indices, and push their indices sorted into a given STL vector.
+ * Only the given vectors are excluded and their distances are never calculated.
+ *
+ * \param p Point whose \a K neighbors should be retrieved.
+ * \param K Number of nearest neighbors to retrieve.
+ * \param output STL vector where the nearest neighbors will be appended. Sorted result depends on the template parameter S, enabled by default.
+ * \param excluded_indices Indices of the excluded vectors in the train set used to build the kd-tree. Expected to be a small set.
+ * \param metric Metric functor that will be used to calculate the distances between points. Defaults to Euclidean metric if C++1x is enabled.
+ * \param epsilon Acceptable distance margin to ignore regions during kd-tree exploration. Defaults to zero (deterministic).
+ * \exception std::out_of_range Thrown if any of the indices is out of the range of the train set.
+ * \exception std::invalid_argument Thrown if the dimensions of the kd-tree are reordered and the metric is not invariant to permutations of the dimensions.
+ */
+template <typename T, unsigned int D, typename L> template <template <typename, typename> class KContainer, typename Metric>
+void KDTree<T, D, L>::knn_excluding(const Vector &p, unsigned int K, std::vector<Neighbor> &output, const std::vector<unsigned int> &excluded_indices, const Metric &metric, ConstRef_Distance epsilon) const {
+  // Check if there is any data on the tree and K is valid.
+  KCHE_TREE_DCHECK(data_);
+  if (!root_ || size() == 0 || K == 0)
+    return;
+
+  // Reorder the query as the stored vectors if required.
+  Vector prepared_p;
+  search_knn<KContainer>(prepare_query<Metric>(p, prepared_p), K, output, metric, epsilon, false,
+      excluded_indices.empty() ? NULL : &excluded_indices[0], excluded_indices.size());
+}
+
+/**
+ * Find the K nearest neighbors of a query already prepared for the layout of the stored vectors.
+ * Shared by \link kche_tree::KDTree::knn knn\endlink, \link kche_tree::KDTree::knn_excluding knn_excluding\endlink
+ * and the batch searches, which prepare all their queries at once.
+ *
+ * \param p Prepared point whose \a K neighbors should be retrieved.
+ * \param K Number of nearest neighbors to retrieve.
+ * \param output STL vector where the nearest neighbors will be appended.
+ * \param metric Metric functor that will be used to calculate the distances between points.
+ * \param epsilon Acceptable distance margin to ignore regions during kd-tree exploration.
+ * \param ignore_p_in_tree Assume that \a p is contained in the tree any number of times and ignore them all.
+ * \param excluded_indices Original indices of the train vectors excluded from the search, in any order. \c NULL if none.
+ * \param num_excluded Number of excluded train vectors.
+ * \exception std::out_of_range Thrown if any of the excluded indices is out of the range of the train set.
+ */
+template <typename T, unsigned int D, typename L> template <template <typename, typename> class KContainer, typename Metric>
+void KDTree<T, D, L>::search_knn(const Vector &p, unsigned int K, std::vector<Neighbor> &output, const Metric &metric, ConstRef_Distance epsilon, bool ignore_p_in_tree,
+    const unsigned int *excluded_indices, unsigned int num_excluded) const {
+
+  // Map the excluded vectors to their permuted indices, sorted to be checked in the leaves.
+  // Identical vectors stored once are filtered while expanding them instead, searching enough additional distinct vectors to replace them.
+  unsigned int num_original = duplicates_ ? duplicates_->num_indices() : size();
+  unsigned int num_searched = K;
+  unsigned int single_excluded = 0;
+  std::vector<unsigned int> excluded;
+  for (unsigned int i=0; i<num_excluded; ++i) {
+    if (excluded_indices[i] >= num_original)
+      throw std::out_of_range("excluded index out of the range of the train set");
+  }
+
+  if (num_excluded && duplicates_) {
+    excluded.assign(excluded_indices, excluded_indices + num_excluded);
+    std::sort(excluded.begin(), excluded.end());
+    num_searched += num_excluded;
+  } else if (num_excluded == 1) {
+    single_excluded = data_->get_permuted_index(excluded_indices[0]);
+  } else if (num_excluded) {
+    excluded.resize(num_excluded);
+    for (unsigned int i=0; i<num_excluded; ++i)
+      excluded[i] = data_->get_permuted_index(excluded_indices[i]);
+    std::sort(excluded.begin(), excluded.end());
+  }
+
   // Create an object for tree traversal and incremental hyperrectangle intersection calculation.
-  KDSearch<Element, Dimensions, Metric> search_data(p, *data_, metric, K, ignore_p_in_tree);
+  KDSearch<Element, Dimensions, Metric> search_data(p, *data_, metric, num_searched, ignore_p_in_tree);
+  search_data.use_squared_norms(squared_norms());
+  if (num_excluded && !duplicates_)
+    search_data.exclude(num_excluded == 1 ? &single_excluded : &excluded[0], num_excluded);
 
   // Convert epsilon to a squared distance and set it as initial hyperrectangle distance.
   search_data.hyperrect_distance = epsilon;
   search_data.hyperrect_distance *= epsilon;
 
   // Build a special sorted container for the current K nearest neighbor candidates.
-  KContainer<Neighbor, typename Neighbor::DistanceComparer> best_k(K);
+  KContainer<Neighbor, typename Neighbor::DistanceComparer> best_k(num_searched);
 
   // Start an exploration traversal from the root.
   root_->explore(NULL, search_data, best_k);
 
   // Append the nearest neighbors to the output vector in increasing distance correcting index permutations.
+  unsigned int first = output.size();
   while (!best_k.empty()) {
     Neighbor neighbor = best_k.back();
     neighbor.set_index(data_->get_original_index(neighbor.index()));
     output.push_back(neighbor);
     best_k.pop_back();
   }
+
+  // Replace the collapsed vectors by all their identical ones. The K nearest distinct vectors always include the K nearest ones.
+  expand_duplicates(output, first, K, num_excluded ? &excluded : NULL);
 }
 
 /**
@@ -142,6 +459,7 @@ void KDTree<T, D, L>::knn(const Vector &p, unsigned int K, std::vector<Neighbor>
  * \param output STL vector where the neighbors within the specified range will be appended. Elements are not sorted by distance.
  * \param metric Metric functor that will be used to calculate the distances between points. Defaults to Euclidean metric if C++1x is enabled.
  * \param ignore_p_in_tree Assume that \a p is contained in the tree any number of times and ignore them all.
+ * \exception std::invalid_argument Thrown if the dimensions of the kd-tree are reordered and the metric is not invariant to permutations of the dimensions.
  */
 template <typename T, unsigned int D, typename L> template <typename Metric>
 void KDTree<T, D, L>::all_in_range(const Vector &p, ConstRef_Distance distance, std::vector<Neighbor> &output, const Metric &metric, bool ignore_p_in_tree) const {
@@ -151,26 +469,779 @@ void KDTree<T, D, L>::all_in_range(const Vector &p, ConstRef_Distance distance,
   if (!root_ || size() == 0 || !(distance > Traits<Distance>::zero()))
     return;
 
+  // Reorder the query as the stored vectors if required.
+  Vector prepared_p;
+  std::vector<Neighbor> points_in_range;
+  search_all_in_range(prepare_query<Metric>(p, prepared_p), distance, points_in_range, metric, ignore_p_in_tree);
+
+  // Append the nearest neighbors to the output vector correcting index permutations.
+  unsigned int first = output.size();
+  for (unsigned int i=1; i<points_in_range.size(); ++i) {
+    Neighbor neighbor = points_in_range[i];
+    neighbor.set_index(data_->get_original_index(neighbor.index()));
+    output.push_back(neighbor);
+  }
+
+  // Replace the collapsed vectors by all their identical ones.
+  expand_duplicates(output, first, std::numeric_limits<unsigned int>::max());
+}
+
+/**
+ * Count the points within a given distance from a point.
+ * Identical vectors collapsed while building the kd-tree are counted from their multiplicities without being expanded.
+ *
+ * \param p Point whose neighbors should be counted.
+ * \param distance Euclidean distance margin used to count all points within.
+ * \param metric Metric functor that will be used to calculate the distances between points. Defaults to Euclidean metric if C++1x is enabled.
+ * \param ignore_p_in_tree Assume that \a p is contained in the tree any number of times and ignore them all.
+ * \return Number of points in the original train set within the distance from \a p.
+ * \exception std::invalid_argument Thrown if the dimensions of the kd-tree are reordered and the metric is not invariant to permutations of the dimensions.
+ */
+template <typename T, unsigned int D, typename L> template <typename Metric>
+unsigned int KDTree<T, D, L>::count_in_range(const Vector &p, ConstRef_Distance distance, const Metric &metric, bool ignore_p_in_tree) const {
+
+  // Check if there is any data on the tree and the distance is valid.
+  KCHE_TREE_DCHECK(data_);
+  if (!root_ || size() == 0 || !(distance > Traits<Distance>::zero()))
+    return 0;
+
+  // Reorder the query as the stored vectors if required.
+  Vector prepared_p;
+  std::vector<Neighbor> points_in_range;
+  search_all_in_range(prepare_query<Metric>(p, prepared_p), distance, points_in_range, metric, ignore_p_in_tree);
+
+  // Ignore the dummy element with the distance range.
+  unsigned int num_points = points_in_range.size() - 1;
+  if (!duplicates_)
+    return num_points;
+
+  unsigned int count = 0;
+  for (unsigned int i=1; i<points_in_range.size(); ++i)
+    count += duplicates_->count(data_->get_original_index(points_in_range[i].index()));
+  return count;
+}
+
+/**
+ * Find all the points within a given distance from a query already prepared for the layout of the stored vectors.
+ * Shared by \link kche_tree::KDTree::all_in_range all_in_range\endlink and \link kche_tree::KDTree::count_in_range count_in_range\endlink.
+ *
+ * \param p Prepared point whose neighbors should be retrieved.
+ * \param distance Euclidean distance margin used to retrieve all points within.
+ * \param points_in_range STL vector where the neighbors are stored with their permuted indices after a dummy first element holding the squared range.
+ * \param metric Metric functor that will be used to calculate the distances between points.
+ * \param ignore_p_in_tree Assume that \a p is contained in the tree any number of times and ignore them all.
+ */
+template <typename T, unsigned int D, typename L> template <typename Metric>
+void KDTree<T, D, L>::search_all_in_range(const Vector &p, ConstRef_Distance distance, std::vector<Neighbor> &points_in_range, const Metric &metric, bool ignore_p_in_tree) const {
+
   // Create an object for tree traversal and incremental hyperrectangle intersection calculation.
   KDSearch<Element, Dimensions, Metric> search_data(p, *data_, metric, 0, ignore_p_in_tree);
+  search_data.use_squared_norms(squared_norms());
   search_data.farthest_distance = distance;
   search_data.farthest_distance *= distance;
 
-  // Build a STL vector to hold all the points in range.
-  std::vector<Neighbor> points_in_range;
-
   // Store a dummy element in the vector with the distance range (will act as the farthest nearest neighbor during calculations).
   points_in_range.push_back(Neighbor(-1, search_data.farthest_distance));
 
   // Start an exploration traversal from the root.
   root_->explore(NULL, search_data, points_in_range);
+}
 
-  // Append the nearest neighbors to the output vector correcting index permutations.
-  for (unsigned int i=1; i<points_in_range.size(); ++i) {
-    Neighbor neighbor = points_in_range[i];
-    neighbor.set_index(data_->get_original_index(neighbor.index()));
-    output.push_back(neighbor);
+/**
+ * Replace the neighbors referring to groups of identical vectors by all the vectors in the groups, keeping their order.
+ * Does nothing if no vectors were collapsed while building the kd-tree.
+ *
+ * \param output STL vector of neighbors whose indices refer to the distinct vectors returned by data().
+ * \param first Position of the first neighbor in \a output to expand. Previous ones are not modified.
+ * \param max_size Maximum number of neighbors after \a first once expanded. The last ones are discarded.
+ * \param excluded_indices Sorted original indices of the vectors left out of the groups. \c NULL if none.
+ */
+template <typename T, unsigned int D, typename L>
+void KDTree<T, D, L>::expand_duplicates(KNeighbors &output, unsigned int first, unsigned int max_size, const std::vector<unsigned int> *excluded_indices) const {
+  if (!duplicates_ || first == output.size())
+    return;
+
+  KNeighbors collapsed(output.begin() + first, output.end());
+  output.resize(first);
+  for (unsigned int i=0; i<collapsed.size() && output.size() - first < max_size; ++i) {
+    unsigned int group = collapsed[i].index();
+    const uint32_t *indices = duplicates_->indices(group);
+    for (unsigned int j=0; j<duplicates_->count(group) && output.size() - first < max_size; ++j) {
+      if (!excluded_indices || !std::binary_search(excluded_indices->begin(), excluded_indices->end(), indices[j]))
+        output.push_back(Neighbor(indices[j], collapsed[i].squared_distance()));
+    }
   }
 }
 
+/**
+ * Get the indices of all the points inside an axis-aligned box, including its boundaries.
+ * Branches of the kd-tree contained in the box are reported without checking their points.
+ *
+ * \param lower Lower corner of the box.
+ * \param upper Upper corner of the box.
+ * \param output STL vector where the indices of the points inside the box will be appended, in no particular order.
+ */
+template <typename T, unsigned int D, typename L>
+void KDTree<T, D, L>::all_in_box(const Vector &lower, const Vector &upper, std::vector<unsigned int> &output) const {
+  KDBoxIndexCollector collector = { output };
+  visit_box(lower, upper, collector);
+}
+
+/**
+ * Count the points inside an axis-aligned box, including its boundaries.
+ * Branches of the kd-tree contained in the box are counted in constant time.
+ *
+ * \param lower Lower corner of the box.
+ * \param upper Upper corner of the box.
+ * \return Number of points in the original train set inside the box.
+ */
+template <typename T, unsigned int D, typename L>
+unsigned int KDTree<T, D, L>::count_in_box(const Vector &lower, const Vector &upper) const {
+  KDBoxCounter counter = { cumulative_counts(), 0 };
+  search_box(lower, upper, counter);
+  return counter.count;
+}
+
+/**
+ * Call a visitor with the index of each point inside an axis-aligned box, including its boundaries.
+ *
+ * \tparam Visitor Type of the visitor. Called as \c visitor(index) with the index of each point in the original train set.
+ * \param lower Lower corner of the box.
+ * \param upper Upper corner of the box.
+ * \param visitor Visitor receiving the indices of the points inside the box, in no particular order.
+ */
+template <typename T, unsigned int D, typename L> template <typename Visitor>
+void KDTree<T, D, L>::visit_box(const Vector &lower, const Vector &upper, Visitor &visitor) const {
+  KDBoxIndexVisitor<Element, Dimensions, Visitor> index_visitor = { *data_, duplicates_.get(), visitor };
+  search_box(lower, upper, index_visitor);
+}
+
+/**
+ * Summarize the labels of the train vectors inside an axis-aligned box, including its boundaries.
+ * Branches of the kd-tree contained in the box are summarized in constant time, or linear in the number of label classes.
+ *
+ * \param lower Lower corner of the box.
+ * \param upper Upper corner of the box.
+ * \param summary Summary of the train vectors inside the box. Its histogram is resized to the number of label classes.
+ * \exception std::invalid_argument Thrown if the kd-tree was not built with label summaries.
+ */
+template <typename T, unsigned int D, typename L>
+void KDTree<T, D, L>::summarize_box(const Vector &lower, const Vector &upper, LabelSummary &summary) const {
+  reset_summary(summary);
+  typename KDSummaries<Element, Dimensions>::BoxVisitor visitor = { *summaries_, summary };
+  search_box(lower, upper, visitor);
+}
+
+/**
+ * Summarize the labels of the train vectors within a Euclidean distance from a point, including the ones at the distance.
+ * Branches of the kd-tree entirely within the distance are summarized in constant time, or linear in the number of label classes.
+ * Requires elements convertible to \c double.
+ *
+ * \param original_p Center of the range.
+ * \param distance Euclidean distance within which vectors are summarized.
+ * \param summary Summary of the train vectors within the distance. Its histogram is resized to the number of label classes.
+ * \exception std::invalid_argument Thrown if the kd-tree was not built with label summaries or the distance is negative.
+ */
+template <typename T, unsigned int D, typename L>
+void KDTree<T, D, L>::summarize_in_range(const Vector &original_p, double distance, LabelSummary &summary) const {
+  if (distance < 0.0)
+    throw std::invalid_argument("invalid summary distance");
+  reset_summary(summary);
+
+  // Reorder the query as the stored vectors if required. Euclidean distances are not affected by the order.
+  Vector prepared_p;
+  const Vector &p = prepare_query<DefaultMetric>(original_p, prepared_p);
+  summaries_->summarize_ball(*data_, p.data(), distance * distance, summary);
+}
+
+/**
+ * Reset a summary before an aggregate query, checking that the kd-tree was built with label summaries.
+ *
+ * \param summary Summary set to zero, with a histogram entry per label class.
+ * \exception std::invalid_argument Thrown if the kd-tree was not built with label summaries.
+ */
+template <typename T, unsigned int D, typename L>
+void KDTree<T, D, L>::reset_summary(LabelSummary &summary) const {
+  KCHE_TREE_DCHECK(data_);
+  if (!summaries_)
+    throw std::invalid_argument("the kd-tree was not built with label summaries");
+
+  summary.count = 0;
+  summary.sum = 0.0;
+  summary.histogram.assign(summaries_->num_classes(), 0);
+}
+
+/**
+ * Find the points inside an axis-aligned box, reporting them by their permuted indices.
+ * The corners of the box are reordered as the stored vectors if required.
+ *
+ * \param original_lower Lower corner of the box.
+ * \param original_upper Upper corner of the box.
+ * \param visitor Object receiving the permuted indices through its \c visit(index) and \c visit_range(begin, end) methods.
+ */
+template <typename T, unsigned int D, typename L> template <typename BoxVisitor>
+void KDTree<T, D, L>::search_box(const Vector &original_lower, const Vector &original_upper, BoxVisitor &visitor) const {
+
+  // Check if there is any data on the tree.
+  KCHE_TREE_DCHECK(data_);
+  if (!root_ || size() == 0)
+    return;
+
+  // Reorder the box as the stored vectors if required. Boxes are not affected by the metrics.
+  Vector prepared_lower, prepared_upper;
+  if (dimension_order_) {
+    dimension_order_->reorder(original_lower, prepared_lower);
+    dimension_order_->reorder(original_upper, prepared_upper);
+  }
+  const Vector &lower = dimension_order_ ? prepared_lower : original_lower;
+  const Vector &upper = dimension_order_ ? prepared_upper : original_upper;
+
+  // Start from the bounding box of the stored points, skipping the search if the box does not intersect it.
+  KDBoxSearch<Element, Dimensions> search_data(lower, upper, *data_, bounding_lower_, bounding_upper_);
+  if (search_data.intersects())
+    root_->visit_box(search_data, visitor);
+}
+
+/**
+ * Calculate the bounding box of the points in the permuted data, used as the region of the root node in box searches.
+ */
+template <typename T, unsigned int D, typename L>
+void KDTree<T, D, L>::calculate_bounding_box() {
+  KCHE_TREE_DCHECK(data_);
+  if (data_->size() == 0)
+    return;
+
+  bounding_lower_ = bounding_upper_ = data_->get_permuted(0);
+  for (unsigned int i=1; i<data_->size(); ++i) {
+    const Vector &v = data_->get_permuted(i);
+    for (unsigned int d=0; d<Dimensions; ++d) {
+      if (v[d] < bounding_lower_[d])
+        bounding_lower_[d] = v[d];
+      if (v[d] > bounding_upper_[d])
+        bounding_upper_[d] = v[d];
+    }
+  }
+}
+
+/**
+ * Calculate the number of original vectors before each permuted index, so that the points of any range of
+ * permuted indices can be counted in constant time when identical vectors are collapsed.
+ */
+template <typename T, unsigned int D, typename L>
+void KDTree<T, D, L>::calculate_cumulative_counts() {
+  KCHE_TREE_DCHECK(data_);
+  cumulative_counts_.clear();
+  if (!duplicates_)
+    return;
+
+  cumulative_counts_.resize(data_->size() + 1);
+  cumulative_counts_[0] = 0;
+  for (unsigned int i=0; i<data_->size(); ++i)
+    cumulative_counts_[i + 1] = cumulative_counts_[i] + duplicates_->count(data_->get_original_index(i));
+}
+
+/**
+ * Get the number of original vectors before each permuted index, followed by the total.
+ *
+ * \return Pointer to the cumulative counts, or \c NULL if no identical vectors were collapsed.
+ */
+template <typename T, unsigned int D, typename L>
+const uint32_t *KDTree<T, D, L>::cumulative_counts() const {
+  return cumulative_counts_.empty() ? NULL : &cumulative_counts_[0];
+}
+
+/**
+ * Get the number of vectors in the original train set, including identical ones collapsed in the kd-tree.
+ */
+template <typename T, unsigned int D, typename L>
+unsigned int KDTree<T, D, L>::total_weight() const {
+  return duplicates_ ? duplicates_->num_indices() : size();
+}
+
+/**
+ * Get the original index of the first occurrence of a stored vector.
+ *
+ * \param index Original index of the stored vector, which is the index of its group if identical vectors were collapsed.
+ * \return Original index of its first occurrence in the train set.
+ */
+template <typename T, unsigned int D, typename L>
+unsigned int KDTree<T, D, L>::first_occurrence(unsigned int index) const {
+  return duplicates_ ? duplicates_->indices(index)[0] : index;
+}
+
+/**
+ * Check if the dimensions of another kd-tree are stored in the same order as the ones of this kd-tree.
+ *
+ * \param kdtree Kd-tree to compare with.
+ * \return \c true if both kd-trees store their dimensions in the same order, \c false otherwise.
+ */
+template <typename T, unsigned int D, typename L> template <typename OtherLabel>
+bool KDTree<T, D, L>::same_dimension_order(const KDTree<Element, Dimensions, OtherLabel> &kdtree) const {
+  for (unsigned int d=0; d<Dimensions; ++d) {
+    const unsigned int dimension = dimension_order_ ? (*dimension_order_)[d] : d;
+    const unsigned int other_dimension = kdtree.dimension_order_ ? (*kdtree.dimension_order_)[d] : d;
+    if (dimension != other_dimension)
+      return false;
+  }
+  return true;
+}
+
+/**
+ * Get the permuted data of another kd-tree with its dimensions stored in the same order as the ones of this kd-tree.
+ * Vectors keep their permuted indices, so the hierarchy of the other kd-tree still applies to them.
+ *
+ * \param kdtree Kd-tree whose data is accessed.
+ * \param reordered_data Set to a copy of the vectors of \a kdtree in permuted order if the dimensions need to be reordered.
+ * \return Data of \a kdtree if both kd-trees store their dimensions in the same order, \a reordered_data otherwise.
+ */
+template <typename T, unsigned int D, typename L> template <typename OtherLabel>
+const typename KDTree<T, D, L>::QuerySet &KDTree<T, D, L>::data_in_dimension_order(const KDTree<Element, Dimensions, OtherLabel> &kdtree, ScopedPtr<QuerySet> &reordered_data) const {
+  if (same_dimension_order(kdtree))
+    return *kdtree.data_;
+
+  // Restore the original order of the dimensions of the other kd-tree and apply the order of this one.
+  reordered_data.reset(new QuerySet(kdtree.size()));
+  Vector original;
+  for (unsigned int i=0; i<kdtree.size(); ++i) {
+    const Vector &stored = kdtree.data_->get_permuted(i);
+    if (kdtree.dimension_order_)
+      kdtree.dimension_order_->restore(stored, original);
+    else
+      original = stored;
+
+    if (dimension_order_)
+      dimension_order_->reorder(original, (*reordered_data)[i]);
+    else
+      (*reordered_data)[i] = original;
+  }
+  return *reordered_data;
+}
+
+/**
+ * Estimate the Gaussian kernel density at a point, defined as the average of \f$ e^{-\|p - x\|^2 / 2h^2} \f$ over the train set.
+ * Multiply by \f$ (2 \pi h^2)^{-D/2} \f$ to obtain a normalized probability density.
+ *
+ * Branches of the kd-tree whose kernel bounds are tight enough for the requested error are approximated as a whole,
+ * expanding only the ones whose contribution is uncertain. Requires elements convertible to \c double.
+ *
+ * \param p Point where the density is estimated.
+ * \param bandwidth Standard deviation \f$ h \f$ of the Gaussian kernel.
+ * \param relative_error Maximum error of the estimation relative to its exact value. Defaults to zero (exact).
+ * \return Estimated kernel density, or zero if the kd-tree is empty.
+ * \exception std::invalid_argument Thrown if the bandwidth is not positive or the relative error is negative.
+ */
+template <typename T, unsigned int D, typename L>
+double KDTree<T, D, L>::kernel_density(const Vector &original_p, double bandwidth, double relative_error) const {
+  if (!(bandwidth > 0.0) || relative_error < 0.0)
+    throw std::invalid_argument("invalid kernel bandwidth or relative error");
+
+  // Check if there is any data on the tree.
+  KCHE_TREE_DCHECK(data_);
+  if (!root_ || size() == 0)
+    return 0.0;
+
+  // Reorder the query as the stored vectors if required. Euclidean distances are not affected by the order.
+  Vector prepared_p;
+  const Vector &p = prepare_query<DefaultMetric>(original_p, prepared_p);
+
+  // All the points contribute at least the kernel value of the farthest point in the bounding box of the tree.
+  KDKernelSearch<Element, Dimensions> search_data(p, *data_, cumulative_counts(), total_weight(), bandwidth, relative_error, bounding_lower_, bounding_upper_);
+  double min_kernel, max_kernel;
+  search_data.region_bounds(min_kernel, max_kernel);
+  search_data.bounds.lower = total_weight() * min_kernel;
+  root_->kernel_density(search_data, 0, size(), min_kernel, max_kernel);
+
+  return search_data.sum / total_weight();
+}
+
+/**
+ * Estimate the Gaussian kernel density at a batch of points, defined as in the single point version.
+ *
+ * A temporary kd-tree is built from the queries and both trees are traversed at once, so that a branch of
+ * the train set can be approximated for a whole branch of queries with a single check.
+ *
+ * \param queries Points where the density is estimated.
+ * \param bandwidth Standard deviation \f$ h \f$ of the Gaussian kernel.
+ * \param output STL vector where the estimated kernel densities are stored, indexed as the queries.
+ * \param relative_error Maximum error of each estimation relative to its exact value. Defaults to zero (exact).
+ * \exception std::invalid_argument Thrown if the bandwidth is not positive or the relative error is negative.
+ */
+template <typename T, unsigned int D, typename L>
+void KDTree<T, D, L>::kernel_density(const QuerySet &queries, double bandwidth, std::vector<double> &output, double relative_error) const {
+  if (!(bandwidth > 0.0) || relative_error < 0.0)
+    throw std::invalid_argument("invalid kernel bandwidth or relative error");
+
+  // Check if there is any data on the tree.
+  KCHE_TREE_DCHECK(data_);
+  output.assign(queries.size(), 0.0);
+  if (!root_ || size() == 0 || queries.size() == 0)
+    return;
+
+  // Reorder the queries as the stored vectors and build a kd-tree from them.
+  QuerySet prepared;
+  KDTree<Element, Dimensions> query_tree;
+  query_tree.build(prepare_queries<DefaultMetric>(queries, prepared));
+
+  // Calculate the bounding boxes of the branches of both trees.
+  KDBounds<Element, Dimensions> query_bounds, reference_bounds;
+  query_bounds.build(query_tree.root_.get(), *query_tree.data_);
+  reference_bounds.build(root_.get(), *data_, cumulative_counts());
+
+  std::vector<double> sums;
+  KDKernelDualSearch<Element, Dimensions> search(query_bounds, *query_tree.data_, reference_bounds, *data_, cumulative_counts(), bandwidth, relative_error);
+  search.run(sums);
+
+  for (unsigned int i=0; i<sums.size(); ++i)
+    output[query_tree.data_->get_original_index(i)] = sums[i] / total_weight();
+}
+
+/**
+ * Cluster the train vectors with DBSCAN using Euclidean distances.
+ *
+ * Vectors with at least \a min_points vectors within \a distance, themselves included, are core vectors. Core vectors within
+ * the distance of each other belong to the same cluster. Any other vector joins the cluster of its nearest core vector within
+ * the distance, or is labeled as noise if there is none. Identical vectors collapsed while building the kd-tree are counted
+ * from their multiplicities and always share the same label. Requires elements convertible to \c double.
+ *
+ * \param distance Euclidean distance within which vectors are neighbours.
+ * \param min_points Minimum number of neighbours of core vectors, including themselves.
+ * \param labels STL vector where the cluster of each vector is stored, indexed as the train set. Clusters are numbered
+ *   from zero in the order of their first vector in the train set. Noise vectors are labeled -1.
+ * \return Number of clusters found.
+ * \exception std::invalid_argument Thrown if the distance is not positive or the minimum number of points is zero.
+ */
+template <typename T, unsigned int D, typename L>
+unsigned int KDTree<T, D, L>::dbscan(double distance, unsigned int min_points, std::vector<int> &labels) const {
+  if (!(distance > 0.0) || min_points == 0)
+    throw std::invalid_argument("invalid DBSCAN distance or minimum number of points");
+
+  // Check if there is any data on the tree.
+  KCHE_TREE_DCHECK(data_);
+  labels.assign(total_weight(), -1);
+  if (!root_ || size() == 0)
+    return 0;
+
+  // Cluster the stored points, identifying each cluster by the lowest permuted index of its core points.
+  KDBounds<Element, Dimensions> bounds;
+  bounds.build(root_.get(), *data_, cumulative_counts());
+
+  std::vector<int32_t> clusters;
+  KDDensityClustering<Element, Dimensions> clustering(bounds, *data_, cumulative_counts(), distance, min_points);
+  clustering.run(clusters);
+
+  // Label the original vectors, expanding the collapsed identical ones.
+  for (unsigned int i=0; i<clusters.size(); ++i) {
+    if (clusters[i] < 0)
+      continue;
+
+    unsigned int index = data_->get_original_index(i);
+    if (!duplicates_) {
+      labels[index] = clusters[i];
+      continue;
+    }
+
+    const uint32_t *indices = duplicates_->indices(index);
+    for (unsigned int j=0; j<duplicates_->count(index); ++j)
+      labels[indices[j]] = clusters[i];
+  }
+
+  // Number the clusters in the order of their first vector in the train set.
+  std::vector<int> numbers(size(), -1);
+  unsigned int num_clusters = 0;
+  for (unsigned int i=0; i<labels.size(); ++i) {
+    if (labels[i] < 0)
+      continue;
+
+    int &number = numbers[labels[i]];
+    if (number < 0)
+      number = static_cast<int>(num_clusters++);
+    labels[i] = number;
+  }
+
+  return num_clusters;
+}
+
+/**
+ * Cluster the train vectors with k-means using Euclidean distances, running Lloyd's algorithm from a set of initial centers.
+ *
+ * Each iteration uses the filtering algorithm: the candidate centers of each branch of the kd-tree are filtered by its
+ * bounding box, and branches left with a single candidate are assigned to it as a whole. Identical vectors collapsed while
+ * building the kd-tree are weighted by their multiplicities. Centers without any vector assigned keep their position.
+ * Requires elements convertible to and from \c double.
+ *
+ * \param centers Initial centers. Replaced by the final ones, which are calculated in double precision.
+ * \param labels STL vector where the index of the nearest final center of each vector is stored, indexed as the train set.
+ * \param max_iterations Maximum number of iterations. Iterations stop earlier if the centers do not change.
+ * \param inertia Optional sum of the squared distances of the vectors to their nearest final centers. Ignored if \c NULL.
+ * \return Number of iterations run.
+ * \exception std::invalid_argument Thrown if no initial centers are provided.
+ */
+template <typename T, unsigned int D, typename L>
+unsigned int KDTree<T, D, L>::kmeans(QuerySet &centers, std::vector<unsigned int> &labels, unsigned int max_iterations, double *inertia) const {
+  if (centers.size() == 0)
+    throw std::invalid_argument("no initial centers provided for k-means");
+
+  // Check if there is any data on the tree.
+  KCHE_TREE_DCHECK(data_);
+  labels.assign(total_weight(), 0);
+  if (inertia)
+    *inertia = 0.0;
+  if (!root_ || size() == 0)
+    return 0;
+
+  // Copy the centers in the order of the stored dimensions.
+  std::vector<double> coordinates(centers.size() * Dimensions);
+  for (unsigned int c=0; c<centers.size(); ++c) {
+    for (unsigned int d=0; d<Dimensions; ++d)
+      coordinates[c * Dimensions + d] = static_cast<double>(centers[c][dimension_order_ ? (*dimension_order_)[d] : d]);
+  }
+
+  KDBounds<Element, Dimensions> bounds;
+  bounds.build(root_.get(), *data_, cumulative_counts());
+
+  KDKMeans<Element, Dimensions> clustering(bounds, *data_, cumulative_counts());
+  unsigned int iterations = clustering.run(coordinates, max_iterations);
+
+  std::vector<uint32_t> assignments;
+  double sum = clustering.assign(coordinates, assignments);
+  if (inertia)
+    *inertia = sum;
+
+  // Restore the centers to their original dimension order.
+  for (unsigned int c=0; c<centers.size(); ++c) {
+    for (unsigned int d=0; d<Dimensions; ++d)
+      centers[c][dimension_order_ ? (*dimension_order_)[d] : d] = static_cast<Element>(coordinates[c * Dimensions + d]);
+  }
+
+  // Label the original vectors, expanding the collapsed identical ones.
+  for (unsigned int i=0; i<assignments.size(); ++i) {
+    unsigned int index = data_->get_original_index(i);
+    if (!duplicates_) {
+      labels[index] = assignments[i];
+      continue;
+    }
+
+    const uint32_t *indices = duplicates_->indices(index);
+    for (unsigned int j=0; j<duplicates_->count(index); ++j)
+      labels[indices[j]] = assignments[i];
+  }
+
+  return iterations;
+}
+
+/**
+ * Build the Euclidean minimum spanning tree of the train vectors using a dual-tree Borůvka algorithm.
+ *
+ * Identical vectors collapsed while building the kd-tree are joined by zero-length edges to their first occurrence,
+ * which is the one connected to the rest of the tree.
+ *
+ * \param edges STL vector where the edges of the tree are stored, connecting the train vectors by their original indices.
+ *   Edges are sorted by increasing distance, breaking ties by their indices, which is the merge order of a single-linkage clustering.
+ */
+template <typename T, unsigned int D, typename L>
+void KDTree<T, D, L>::minimum_spanning_tree(std::vector<SpanningTreeEdge> &edges) const {
+
+  // Check if there is any data on the tree.
+  KCHE_TREE_DCHECK(data_);
+  edges.clear();
+  if (!root_ || size() == 0)
+    return;
+
+  KDBounds<Element, Dimensions> bounds;
+  bounds.build(root_.get(), *data_, cumulative_counts());
+
+  KDSpanningTree<Element, Dimensions> spanning_tree(bounds, *data_);
+  spanning_tree.run(edges);
+
+  // Translate the edges to original indices, using the first occurrence of collapsed identical vectors.
+  for (unsigned int i=0; i<edges.size(); ++i) {
+    const unsigned int first = first_occurrence(data_->get_original_index(edges[i].first));
+    const unsigned int second = first_occurrence(data_->get_original_index(edges[i].second));
+    edges[i].first = std::min(first, second);
+    edges[i].second = std::max(first, second);
+  }
+
+  if (duplicates_) {
+    for (unsigned int group=0; group<duplicates_->num_groups(); ++group) {
+      const uint32_t *indices = duplicates_->indices(group);
+      for (unsigned int j=1; j<duplicates_->count(group); ++j) {
+        SpanningTreeEdge edge;
+        edge.first = indices[0];
+        edge.second = indices[j];
+        edge.distance = 0.0;
+        edges.push_back(edge);
+      }
+    }
+  }
+
+  std::sort(edges.begin(), edges.end());
+}
+
+/**
+ * Cluster the train vectors with single linkage, joining the ones within a Euclidean distance of each other directly or through other vectors.
+ * Clusters are found by cutting the edges of the minimum spanning tree longer than the distance.
+ *
+ * \param distance Euclidean distance within which vectors are joined.
+ * \param labels STL vector where the cluster of each vector is stored, indexed as the train set. Clusters are numbered in the order of their first vector.
+ * \return Number of clusters found.
+ * \exception std::invalid_argument Thrown if the distance is negative.
+ */
+template <typename T, unsigned int D, typename L>
+unsigned int KDTree<T, D, L>::single_linkage(double distance, std::vector<unsigned int> &labels) const {
+  if (!(distance >= 0.0))
+    throw std::invalid_argument("invalid single-linkage distance");
+
+  std::vector<SpanningTreeEdge> edges;
+  minimum_spanning_tree(edges);
+
+  const unsigned int num_vectors = total_weight();
+  DisjointSets clusters;
+  clusters.reset(num_vectors);
+  for (unsigned int i=0; i<edges.size() && edges[i].distance <= distance; ++i)
+    clusters.merge(edges[i].first, edges[i].second);
+
+  // Number the clusters in the order of their first vector in the train set, which is also their representative.
+  labels.resize(num_vectors);
+  unsigned int num_clusters = 0;
+  for (unsigned int i=0; i<num_vectors; ++i) {
+    unsigned int root = clusters.find(i);
+    labels[i] = root == i ? num_clusters++ : labels[root];
+  }
+
+  return num_clusters;
+}
+
+/**
+ * Find the nearest vector of another kd-tree within a Euclidean distance of each train vector using a dual-tree traversal.
+ * If the dimensions of both kd-trees are stored in different orders, the vectors of \a references are copied in the order of this kd-tree.
+ *
+ * \param references Kd-tree whose train vectors are searched.
+ * \param distance Euclidean distance within which vectors are searched.
+ * \param nearest STL vector where the original index in \a references of the nearest vector to each train vector is stored,
+ *   indexed as the train set. Set to -1 if there is none within the distance. Identical vectors collapsed in \a references
+ *   are reported by their first occurrence.
+ * \param distances Optional STL vector where the Euclidean distance to each nearest vector is stored. Ignored if \c NULL.
+ * \exception std::invalid_argument Thrown if the distance is negative.
+ */
+template <typename T, unsigned int D, typename L> template <typename OtherLabel>
+void KDTree<T, D, L>::nearest_within(const KDTree<Element, Dimensions, OtherLabel> &references, double distance, std::vector<int> &nearest, std::vector<double> *distances) const {
+  if (!(distance >= 0.0))
+    throw std::invalid_argument("invalid join distance");
+
+  // Check if there is any data on the trees.
+  KCHE_TREE_DCHECK(data_);
+  nearest.assign(total_weight(), -1);
+  if (distances)
+    distances->assign(total_weight(), distance);
+  if (!root_ || size() == 0 || !references.root_ || references.size() == 0)
+    return;
+
+  ScopedPtr<QuerySet> reordered_data;
+  const QuerySet &reference_data = data_in_dimension_order(references, reordered_data);
+
+  KDBounds<Element, Dimensions> query_bounds, reference_bounds;
+  query_bounds.build(root_.get(), *data_);
+  reference_bounds.build(references.root_.get(), reference_data);
+
+  std::vector<int32_t> permuted_nearest;
+  std::vector<double> squared_distances;
+  KDJoin<Element, Dimensions> join(query_bounds, *data_, reference_bounds, reference_data);
+  join.nearest(distance, permuted_nearest, squared_distances);
+
+  // Translate the results to original indices, expanding the collapsed identical vectors.
+  for (unsigned int i=0; i<permuted_nearest.size(); ++i) {
+    if (permuted_nearest[i] < 0)
+      continue;
+
+    const int index = static_cast<int>(references.first_occurrence(references.data_->get_original_index(permuted_nearest[i])));
+    const unsigned int query = data_->get_original_index(i);
+    const unsigned int count = duplicates_ ? duplicates_->count(query) : 1;
+    for (unsigned int j=0; j<count; ++j) {
+      const unsigned int original = duplicates_ ? duplicates_->indices(query)[j] : query;
+      nearest[original] = index;
+      if (distances)
+        (*distances)[original] = std::sqrt(squared_distances[i]);
+    }
+  }
+}
+
+/**
+ * Find the closest pair of train vectors between this kd-tree and another one using a dual-tree traversal.
+ * If the dimensions of both kd-trees are stored in different orders, the vectors of \a other are copied in the order of this kd-tree.
+ * Identical vectors collapsed in any of the kd-trees are reported by their first occurrence.
+ *
+ * \param other Kd-tree whose train vectors are paired with the ones of this kd-tree.
+ * \param index Set to the original index of the vector of the pair in this kd-tree.
+ * \param other_index Set to the original index of the vector of the pair in \a other.
+ * \return Euclidean distance between the vectors of the pair.
+ * \exception std::invalid_argument Thrown if any of the kd-trees is empty.
+ */
+template <typename T, unsigned int D, typename L> template <typename OtherLabel>
+double KDTree<T, D, L>::closest_pair(const KDTree<Element, Dimensions, OtherLabel> &other, unsigned int &index, unsigned int &other_index) const {
+  if (!root_ || size() == 0 || !other.root_ || other.size() == 0)
+    throw std::invalid_argument("closest pair requested with an empty kd-tree");
+
+  ScopedPtr<QuerySet> reordered_data;
+  const QuerySet &reference_data = data_in_dimension_order(other, reordered_data);
+
+  KDBounds<Element, Dimensions> query_bounds, reference_bounds;
+  query_bounds.build(root_.get(), *data_);
+  reference_bounds.build(other.root_.get(), reference_data);
+
+  uint32_t query = 0, reference = 0;
+  double squared_distance = 0.0;
+  KDJoin<Element, Dimensions> join(query_bounds, *data_, reference_bounds, reference_data);
+  join.closest_pair(query, reference, squared_distance);
+
+  index = first_occurrence(data_->get_original_index(query));
+  other_index = other.first_occurrence(other.data_->get_original_index(reference));
+  return std::sqrt(squared_distance);
+}
+
+/**
+ * \brief Select the cadence of the boundary checks of a metric from the bounded distances calculated while searching a sample of queries.
+ *
+ * The bound is checked after every dimension while searching the K nearest neighbours of each query, recording where
+ * each bounded distance first exceeds its bound. The profile of the metric is then set to the cadence that minimizes
+ * the estimated cost of those distances with the costs defined in the library \link kche_tree::Settings Settings\endlink
+ * (see \link kche_tree::BoundCheckProfile::select_cadence BoundCheckProfile::select_cadence\endlink).
+ * The recorded statistics are kept in the profile afterwards to show where the early-outs happen.
+ * Requires a metric providing a \link kche_tree::BoundCheckProfile BoundCheckProfile\endlink, such as the Euclidean and Mahalanobis ones.
+ *
+ * \param queries Sample of queries representative of the ones that will be searched.
+ * \param K Number of nearest neighbours searched for each query.
+ * \param metric Metric whose profile is calibrated.
+ * \param ignore_p_in_tree Assume that each query is contained in the tree any number of times and ignore them all.
+ * \return \c true if a cadence was selected, \c false if the metric has no profile or no bounded distances were calculated. The cadence of the profile is not modified in this case.
+ * \exception std::invalid_argument Thrown if the dimensions of the kd-tree are reordered and the metric is not invariant to permutations of the dimensions.
+ */
+template <typename T, unsigned int D, typename L> template <typename Metric>
+bool KDTree<T, D, L>::calibrate_bound_checks(const kche_tree::DataSet<Element, Dimensions> &original_queries, unsigned int K, const Metric &metric, bool ignore_p_in_tree) const {
+
+  BoundCheckProfile *profile = metric.bound_check_profile();
+  if (!profile || !root_ || size() == 0 || K == 0 || original_queries.size() == 0)
+    return false;
+
+  // Record where the bound is first exceeded by checking it as often as possible.
+  const unsigned int prefix = profile->prefix(), interval = profile->interval();
+  const bool instrumented = profile->is_instrumented();
+  profile->set_cadence(0, 1);
+  profile->reset_statistics();
+  profile->set_instrumented(true);
+
+  QuerySet prepared_queries;
+  const QuerySet &queries = prepare_queries<Metric>(original_queries, prepared_queries);
+  for (unsigned int i=0; i<queries.size(); ++i) {
+    KNeighbors neighbours;
+    search_knn<KVector>(queries[i], K, neighbours, metric, Traits<Distance>::zero(), ignore_p_in_tree);
+  }
+
+  profile->set_instrumented(instrumented);
+  if (profile->select_cadence(Dimensions))
+    return true;
+
+  profile->set_cadence(prefix, interval);
+  return false;
+}
+
 } // namespace kche_tree
@@ -0,0 +1,366 @@
+/***************************************************************************
+ *   Copyright (C) 2011, 2012 by Leandro Graciá Gil                        *
+ *   leandro.gracia.gil@gmail.com                                          *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/**
+ * \file kd-tree_batch.tpp
+ * \brief Template implementations for batch searches in kd-trees.
+ * \author Leandro Graciá Gil
+ */
+
+// Include C math functions and C time functions for the calibration of the automatic engine.
+#include <cmath>
+#include <ctime>
+
+// Include OpenMP functions if enabled.
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace kche_tree {
+
+/**
+ * Find the K nearest neighbors of each point in a batch and push their indices sorted into a given STL vector per point.
+ * Results are the same as calling \link kche_tree::KDTree::knn knn\endlink for each of the points, but the engine used
+ * to process the batch can take advantage of having many queries available at the same time.
+ *
+ * \param original_queries Points whose \a K neighbors should be retrieved.
+ * \param K Number of nearest neighbors to retrieve for each point.
+ * \param output STL vector resized to the number of points in the batch. The nearest neighbors of each point will be appended to its entry sorted by increasing distance.
+ * \param metric Metric functor that will be used to calculate the distances between points. Defaults to Euclidean metric if C++1x is enabled.
+ * \param epsilon Acceptable distance margin to ignore regions during kd-tree exploration. Defaults to zero (deterministic). Brute-force searches are always exact.
+ * \param ignore_p_in_tree Assume that each point is contained in the tree any number of times and ignore them all.
+ * \param engine Engine used to process the batch. Defaults to choosing automatically between the kd-tree and brute force.
+ * \exception std::invalid_argument Thrown if the dimensions of the kd-tree are reordered and the metric is not invariant to permutations of the dimensions.
+ */
+template <typename T, unsigned int D, typename L> template <template <typename, typename> class KContainer, typename Metric>
+void KDTree<T, D, L>::batch_knn(const kche_tree::DataSet<Element, Dimensions> &original_queries, unsigned int K, std::vector<KNeighbors> &output,
+    const Metric &metric, ConstRef_Distance epsilon, bool ignore_p_in_tree, SearchEngine::Type engine) const {
+
+  // Check if there is any data on the tree and K is valid.
+  KCHE_TREE_DCHECK(data_);
+  output.resize(original_queries.size());
+  if (!root_ || size() == 0 || K == 0)
+    return;
+
+  // Reorder the queries as the stored vectors if required.
+  kche_tree::DataSet<Element, Dimensions> prepared_queries;
+  const kche_tree::DataSet<Element, Dimensions> &queries = prepare_queries<Metric>(original_queries, prepared_queries);
+
+  // Keep the previous size of the outputs if identical vectors have to be expanded after searching the distinct ones.
+  // Automatic searches always use batch engines, including the one used for calibration.
+  std::vector<unsigned int> previous_sizes;
+  if (duplicates_ && engine != SearchEngine::Sequential) {
+    previous_sizes.resize(queries.size());
+    for (unsigned int i=0; i<queries.size(); ++i)
+      previous_sizes[i] = output[i].size();
+  }
+
+  // Let the planner choose the engine. Any queries used for calibration are already searched.
+  unsigned int first_query = 0;
+  if (engine == SearchEngine::Automatic)
+    engine = plan_batch_knn<KContainer>(queries, K, output, metric, epsilon, ignore_p_in_tree, first_query);
+
+  typedef KContainer<Neighbor, typename Neighbor::DistanceComparer> Container;
+  switch (engine) {
+    case SearchEngine::Sequential:
+      for (unsigned int i=first_query; i<queries.size(); ++i)
+        search_knn<KContainer>(queries[i], K, output[i], metric, epsilon, ignore_p_in_tree);
+      break;
+
+    case SearchEngine::Interleaved: {
+      KDInterleavedSearch<Element, Dimensions, Metric, Container> interleaved_search(root_.get(), *data_, metric, K, epsilon,
+          ignore_p_in_tree, Settings::interleaved_search_width, squared_norms());
+      interleaved_search.run(queries, output, first_query, queries.size());
+      break;
+    }
+
+    case SearchEngine::Packet: {
+      KDPacketSearch<Element, Dimensions, Metric, Container, Settings::packet_search_width> packet_search(root_.get(), *data_, metric, K, epsilon,
+          ignore_p_in_tree, squared_norms());
+      packet_search.run(queries, output, first_query);
+      break;
+    }
+
+    case SearchEngine::BruteForce: {
+      BruteForceSearch<Element, Dimensions, Metric, Container> brute_force_search(*data_, metric, K, ignore_p_in_tree, size(), squared_norms());
+      brute_force_search.run(queries, output, first_query, queries.size());
+      break;
+    }
+
+    case SearchEngine::Automatic:
+      KCHE_TREE_NOT_REACHED();
+  }
+
+  // Replace the collapsed vectors by all their identical ones, including the ones of the calibration queries. Sequential searches already do it.
+  if (!previous_sizes.empty()) {
+    for (unsigned int i=0; i<queries.size(); ++i)
+      expand_duplicates(output[i], previous_sizes[i], K);
+  }
+}
+
+/**
+ * Choose the engine used to search a batch of queries, calibrating the costs of the kd-tree and brute force if required.
+ * Calibration searches the first queries of the batch with the kd-tree engine that would be used for the rest of the batch and keeps their results.
+ * Identical vectors collapsed in the kd-tree are not expanded in these results, as with the rest of the batch engines.
+ *
+ * \param queries Points whose \a K neighbors should be retrieved, already prepared for the layout of the stored vectors.
+ * \param K Number of nearest neighbors to retrieve for each point.
+ * \param output STL vector where the results of the calibration queries are appended.
+ * \param metric Metric functor that will be used to calculate the distances between points.
+ * \param epsilon Acceptable distance margin to ignore regions during kd-tree exploration.
+ * \param ignore_p_in_tree Assume that each point is contained in the tree any number of times and ignore them all.
+ * \param first_query Set to the index of the first query not searched yet.
+ * \return Engine to use for the rest of the batch.
+ */
+template <typename T, unsigned int D, typename L> template <template <typename, typename> class KContainer, typename Metric>
+SearchEngine::Type KDTree<T, D, L>::plan_batch_knn(const kche_tree::DataSet<Element, Dimensions> &queries, unsigned int K, std::vector<KNeighbors> &output,
+    const Metric &metric, ConstRef_Distance epsilon, bool ignore_p_in_tree, unsigned int &first_query) const {
+
+  SearchPlanner planner(size(), Dimensions, K, queries.size(), SearchEngine::Interleaved);
+  if (planner.decided())
+    return planner.engine();
+
+  // Measure the kd-tree engine with the calibration queries, keeping their results.
+  typedef KContainer<Neighbor, typename Neighbor::DistanceComparer> Container;
+  unsigned int num_queries = planner.num_calibration_queries();
+  KDInterleavedSearch<Element, Dimensions, Metric, Container> interleaved_search(root_.get(), *data_, metric, K, epsilon,
+      ignore_p_in_tree, Settings::interleaved_search_width, squared_norms());
+  clock_t start = clock();
+  interleaved_search.run(queries, output, 0, num_queries);
+  double tree_time = (clock() - start) / static_cast<double>(CLOCKS_PER_SEC);
+
+  // Measure brute force with the same queries against a subset of the points, discarding the results.
+  BruteForceSearch<Element, Dimensions, Metric, Container> brute_force_search(*data_, metric, K, ignore_p_in_tree, planner.num_calibration_points(),
+      squared_norms());
+  std::vector<KNeighbors> discarded;
+  start = clock();
+  brute_force_search.run(queries, discarded, 0, num_queries);
+  double brute_force_time = (clock() - start) / static_cast<double>(CLOCKS_PER_SEC);
+
+  planner.calibrate(tree_time, brute_force_time);
+  first_query = num_queries;
+  return planner.engine();
+}
+
+/**
+ * Compute the local outlier factors of all the train vectors using Euclidean distances, as defined in \link kche_tree::LocalOutlierFactors LocalOutlierFactors\endlink.
+ *
+ * The K nearest neighbours of each train vector are searched excluding exactly the vector itself, so identical vectors
+ * in the train set are neighbours at distance zero. Identical vectors collapsed while building the kd-tree are searched
+ * only once. Neighbour searches, densities and factors are calculated in contiguous ranges of the stored vectors, one
+ * per thread if OpenMP is enabled. Requires elements convertible to \c double.
+ *
+ * \param K Number of nearest neighbours defining the neighbourhood of each train vector.
+ * \param factors Local outlier factors where the k-distances, densities and factors of the train vectors are stored, indexed as the train set.
+ * \exception std::invalid_argument Thrown if \a K is zero or not smaller than the number of train vectors.
+ */
+template <typename T, unsigned int D, typename L>
+void KDTree<T, D, L>::local_outlier_factors(unsigned int K, LocalOutlierFactors &factors) const {
+  // Check if there is any data on the tree and K is valid.
+  KCHE_TREE_DCHECK(data_);
+  const unsigned int num_vectors = root_ ? total_weight() : 0;
+  if (K == 0 || (num_vectors && K >= num_vectors))
+    throw std::invalid_argument("invalid number of neighbours for the local outlier factors");
+
+  factors.k_ = K;
+  factors.k_distances_.assign(num_vectors, 0.0);
+  factors.densities_.assign(num_vectors, 0.0);
+  factors.scores_.assign(num_vectors, 0.0);
+  if (num_vectors == 0)
+    return;
+
+  // Search the neighbours of each stored vector excluding its first occurrence in the train set.
+  const unsigned int num_points = size();
+  const int ranges = static_cast<int>(num_batch_ranges(num_points));
+  std::vector<uint32_t> neighbors(static_cast<size_t>(num_points) * K);
+  std::vector<double> distances(neighbors.size());
+  std::vector<double> values(num_points);
+
+  #ifdef _OPENMP
+  #pragma omp parallel for schedule(static)
+  #endif
+  for (int range = 0; range < ranges; ++range) {
+    unsigned int first = static_cast<unsigned int>(static_cast<uint64_t>(num_points) * range / ranges);
+    unsigned int last = static_cast<unsigned int>(static_cast<uint64_t>(num_points) * (range + 1) / ranges);
+    KNeighbors buffer;
+    for (unsigned int i = first; i < last; ++i) {
+      const unsigned int excluded_index = first_occurrence(data_->get_original_index(i));
+      search_outlier_neighbors(data_->get_permuted(i), K, &excluded_index, buffer, &neighbors[static_cast<size_t>(i) * K], &distances[static_cast<size_t>(i) * K]);
+      values[i] = distances[static_cast<size_t>(i) * K + K - 1];
+    }
+  }
+  expand_outlier_values(values, factors.k_distances_);
+
+  // Calculate the densities once all the k-distances are known, and then the factors from the densities.
+  #ifdef _OPENMP
+  #pragma omp parallel for schedule(static)
+  #endif
+  for (int range = 0; range < ranges; ++range) {
+    unsigned int first = static_cast<unsigned int>(static_cast<uint64_t>(num_points) * range / ranges);
+    unsigned int last = static_cast<unsigned int>(static_cast<uint64_t>(num_points) * (range + 1) / ranges);
+    for (unsigned int i = first; i < last; ++i)
+      values[i] = factors.density(&neighbors[static_cast<size_t>(i) * K], &distances[static_cast<size_t>(i) * K]);
+  }
+  expand_outlier_values(values, factors.densities_);
+
+  #ifdef _OPENMP
+  #pragma omp parallel for schedule(static)
+  #endif
+  for (int range = 0; range < ranges; ++range) {
+    unsigned int first = static_cast<unsigned int>(static_cast<uint64_t>(num_points) * range / ranges);
+    unsigned int last = static_cast<unsigned int>(static_cast<uint64_t>(num_points) * (range + 1) / ranges);
+    for (unsigned int i = first; i < last; ++i)
+      values[i] = factors.score(values[i], &neighbors[static_cast<size_t>(i) * K]);
+  }
+  expand_outlier_values(values, factors.scores_);
+}
+
+/**
+ * Calculate the local outlier factor of a point against the k-distances and densities of the train vectors.
+ * The point is not considered part of the train set, so its K nearest train vectors are all its neighbours.
+ *
+ * \param original_p Point to score.
+ * \param factors Local outlier factors previously computed for this kd-tree with \link kche_tree::KDTree::local_outlier_factors local_outlier_factors\endlink.
+ * \return Local outlier factor of the point.
+ * \exception std::invalid_argument Thrown if the factors were not computed for the train vectors of this kd-tree.
+ */
+template <typename T, unsigned int D, typename L>
+double KDTree<T, D, L>::outlier_factor(const Vector &original_p, const LocalOutlierFactors &factors) const {
+  // Check if the factors belong to the data on the tree.
+  KCHE_TREE_DCHECK(data_);
+  if (!root_ || size() == 0 || factors.k() == 0 || factors.size() != total_weight())
+    throw std::invalid_argument("local outlier factors not computed for the train vectors of the kd-tree");
+
+  // Reorder the query as the stored vectors if required. Euclidean distances are not affected by the order.
+  Vector prepared_p;
+  const Vector &p = prepare_query<DefaultMetric>(original_p, prepared_p);
+
+  KNeighbors buffer;
+  std::vector<uint32_t> neighbors(factors.k());
+  std::vector<double> distances(factors.k());
+  search_outlier_neighbors(p, factors.k(), NULL, buffer, &neighbors[0], &distances[0]);
+  return factors.score(factors.density(&neighbors[0], &distances[0]), &neighbors[0]);
+}
+
+/**
+ * Calculate the local outlier factors of a batch of points against the k-distances and densities of the train vectors,
+ * defined as in the single point version. Queries are scored in contiguous ranges, one per thread if OpenMP is enabled.
+ *
+ * \param original_queries Points to score.
+ * \param factors Local outlier factors previously computed for this kd-tree with \link kche_tree::KDTree::local_outlier_factors local_outlier_factors\endlink.
+ * \param output STL vector where the local outlier factors are stored, indexed as the queries.
+ * \exception std::invalid_argument Thrown if the factors were not computed for the train vectors of this kd-tree.
+ */
+template <typename T, unsigned int D, typename L>
+void KDTree<T, D, L>::outlier_factor(const kche_tree::DataSet<Element, Dimensions> &original_queries, const LocalOutlierFactors &factors, std::vector<double> &output) const {
+  // Check if the factors belong to the data on the tree.
+  KCHE_TREE_DCHECK(data_);
+  if (!root_ || size() == 0 || factors.k() == 0 || factors.size() != total_weight())
+    throw std::invalid_argument("local outlier factors not computed for the train vectors of the kd-tree");
+
+  // Reorder the queries as the stored vectors if required.
+  kche_tree::DataSet<Element, Dimensions> prepared_queries;
+  const kche_tree::DataSet<Element, Dimensions> &queries = prepare_queries<DefaultMetric>(original_queries, prepared_queries);
+
+  const unsigned int K = factors.k();
+  const unsigned int num_queries = queries.size();
+  const int ranges = static_cast<int>(num_batch_ranges(num_queries));
+  output.resize(num_queries);
+
+  #ifdef _OPENMP
+  #pragma omp parallel for schedule(static)
+  #endif
+  for (int range = 0; range < ranges; ++range) {
+    unsigned int first = static_cast<unsigned int>(static_cast<uint64_t>(num_queries) * range / ranges);
+    unsigned int last = static_cast<unsigned int>(static_cast<uint64_t>(num_queries) * (range + 1) / ranges);
+    KNeighbors buffer;
+    std::vector<uint32_t> neighbors(K);
+    std::vector<double> distances(K);
+    for (unsigned int i = first; i < last; ++i) {
+      search_outlier_neighbors(queries[i], K, NULL, buffer, &neighbors[0], &distances[0]);
+      output[i] = factors.score(factors.density(&neighbors[0], &distances[0]), &neighbors[0]);
+    }
+  }
+}
+
+/**
+ * Search the K nearest train vectors of a prepared point for its local outlier factor.
+ *
+ * \param p Prepared point whose neighbours are searched.
+ * \param K Number of nearest neighbours to retrieve. Must not exceed the number of train vectors, excluded one aside.
+ * \param excluded_index Original index of a train vector excluded from the search, or \c NULL if none.
+ * \param buffer STL vector used to hold the search results, to avoid reallocating it for each point.
+ * \param neighbors Array where the original indices of the K nearest neighbours are stored.
+ * \param distances Array where the Euclidean distances to the K nearest neighbours are stored.
+ */
+template <typename T, unsigned int D, typename L>
+void KDTree<T, D, L>::search_outlier_neighbors(const Vector &p, unsigned int K, const unsigned int *excluded_index, KNeighbors &buffer,
+    uint32_t *neighbors, double *distances) const {
+
+  buffer.clear();
+  search_knn<KVector>(p, K, buffer, DefaultMetric(), Traits<Distance>::zero(), false, excluded_index, excluded_index ? 1 : 0);
+  KCHE_TREE_DCHECK(buffer.size() == K);
+
+  for (unsigned int j=0; j<K; ++j) {
+    neighbors[j] = buffer[j].index();
+    distances[j] = std::sqrt(static_cast<double>(buffer[j].squared_distance()));
+  }
+}
+
+/**
+ * Store a value calculated for each stored vector in all the original vectors it represents.
+ *
+ * \param values Values of the stored vectors, indexed by their permuted indices.
+ * \param output STL vector where the values are stored, indexed as the train set.
+ */
+template <typename T, unsigned int D, typename L>
+void KDTree<T, D, L>::expand_outlier_values(const std::vector<double> &values, std::vector<double> &output) const {
+  for (unsigned int i=0; i<values.size(); ++i) {
+    unsigned int index = data_->get_original_index(i);
+    if (!duplicates_) {
+      output[index] = values[i];
+      continue;
+    }
+
+    const uint32_t *indices = duplicates_->indices(index);
+    for (unsigned int j=0; j<duplicates_->count(index); ++j)
+      output[indices[j]] = values[i];
+  }
+}
+
+/**
+ * Get the number of contiguous ranges of queries processed in parallel by the batch operations.
+ *
+ * \param num_queries Number of queries in the batch.
+ * \return Number of ranges, one per thread if OpenMP is enabled and there are enough queries.
+ */
+template <typename T, unsigned int D, typename L>
+unsigned int KDTree<T, D, L>::num_batch_ranges(unsigned int num_queries) const {
+  #ifdef _OPENMP
+  const int ranges = std::min(omp_get_max_threads(), static_cast<int>(num_queries / min_queries_per_range));
+  if (ranges > 1)
+    return static_cast<unsigned int>(ranges);
+  #else
+  (void) num_queries;
+  #endif
+  return 1;
+}
+
+} // namespace kche_tree
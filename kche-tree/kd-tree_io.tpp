@@ -33,8 +33,12 @@
 namespace kche_tree {
 
 // KD-Tree serialization settings.
-template <typename T, unsigned int D, typename L> const uint16_t KDTree<T, D, L>::version[2] = { 2, 0 };
+template <typename T, unsigned int D, typename L> const uint16_t KDTree<T, D, L>::version[2] = { 2, 3 };
 template <typename T, unsigned int D, typename L> const uint16_t KDTree<T, D, L>::signature = 0xCAFE;
+template <typename T, unsigned int D, typename L> const uint8_t KDTree<T, D, L>::squared_norms_flag;
+template <typename T, unsigned int D, typename L> const uint8_t KDTree<T, D, L>::dimension_order_flag;
+template <typename T, unsigned int D, typename L> const uint8_t KDTree<T, D, L>::duplicates_flag;
+template <typename T, unsigned int D, typename L> const uint8_t KDTree<T, D, L>::label_summaries_flag;
 
 // KD-Tree content verification
 template <bool enabled> struct VerifyKDTreeContents;
@@ -85,6 +89,41 @@ void KDTree<T, D, L>::serialize(std::ostream &out) const {
   // Write the kd-tree structure recursively. Will throw std::runtime_error on failure.
   root_->serialize(out);
 
+  // Write the build flags required to restore the kd-tree. Squared norms and the prefix sums of the label summaries are recalculated instead of being stored.
+  uint8_t flags = squared_norms_.empty() ? 0 : squared_norms_flag;
+  if (dimension_order_)
+    flags |= dimension_order_flag;
+  if (duplicates_)
+    flags |= duplicates_flag;
+  if (summaries_)
+    flags |= label_summaries_flag;
+  kche_tree::serialize(flags, out);
+
+  // Write the order of the dimensions of the stored vectors, if reordered.
+  if (dimension_order_) {
+    for (unsigned int d=0; d<Dimensions; ++d)
+      kche_tree::serialize(static_cast<uint32_t>((*dimension_order_)[d]), out);
+  }
+
+  // Write the original indices of the identical vectors stored once, if collapsed. Will throw std::runtime_error on failure.
+  if (duplicates_)
+    duplicates_->serialize(out);
+
+  // Write the number of label classes counted by the summaries and the labels of the original vectors, if any.
+  // Labels are stored apart from the kd-tree data because the labels of collapsed vectors are not kept there.
+  if (summaries_) {
+    const std::vector<double> &values = summaries_->values();
+    const std::vector<uint32_t> &classes = summaries_->classes();
+    kche_tree::serialize(static_cast<uint32_t>(summaries_->num_classes()), out);
+    for (unsigned int i=0; i<values.size(); ++i)
+      kche_tree::serialize(values[i], out);
+    for (unsigned int i=0; i<classes.size(); ++i)
+      kche_tree::serialize(classes[i], out);
+  }
+
+  if (!out.good())
+    throw std::runtime_error("error writing kd-tree flags");
+
   // Write a 2-byte signature at the end.
   kche_tree::serialize(signature, out);
   if (!out.good())
@@ -109,8 +148,9 @@ KDTree<T, D, L>::KDTree(std::istream &in, Endianness::Type endianness) {
   if (!in.good())
     throw std::runtime_error("error reading version data");
 
-  // Check supported file versions.
-  if (version[0] != KDTree::version[0] || version[1] != KDTree::version[1]) {
+  // Check supported file versions. Version 2.0 is the same format without build flags, 2.1 cannot collapse identical vectors
+  // and 2.2 cannot summarize the labels.
+  if (version[0] != KDTree::version[0] || version[1] > KDTree::version[1]) {
     std::string error_msg = "unsupported kd-tree version: required ";
     error_msg += KDTree::version[0];
     error_msg += ".";
@@ -132,6 +172,56 @@ KDTree<T, D, L>::KDTree(std::istream &in, Endianness::Type endianness) {
   // Read the tree structure from the stream.
   root_.reset(new KDNode(in, endianness));
 
+  // Read the build flags, if present.
+  uint8_t flags = 0;
+  if (version[1] >= 1) {
+    deserialize(flags, in, endianness);
+    if (!in.good())
+      throw std::runtime_error("error reading kd-tree flags");
+  }
+
+  // Read the order of the dimensions of the stored vectors, if reordered.
+  if (flags & dimension_order_flag) {
+    uint32_t order[Dimensions];
+    for (unsigned int d=0; d<Dimensions; ++d)
+      deserialize(order[d], in, endianness);
+    if (!in.good())
+      throw std::runtime_error("error reading the order of the kd-tree dimensions");
+
+    dimension_order_.reset(new DimensionOrder());
+    if (!dimension_order_->set_order(order))
+      throw std::runtime_error("invalid order of the kd-tree dimensions");
+  }
+
+  // Read the original indices of the identical vectors stored once, if collapsed. Will throw std::runtime_error on failure.
+  if (flags & duplicates_flag) {
+    duplicates_.reset(new Duplicates());
+    duplicates_->deserialize(in, endianness);
+    if (duplicates_->num_groups() != data_->size())
+      throw std::runtime_error("the groups of identical vectors do not match the kd-tree data");
+  }
+
+  // Read the number of label classes counted by the summaries and the labels of the original vectors, if used.
+  uint32_t label_classes = 0;
+  std::vector<double> summary_values;
+  std::vector<uint32_t> summary_classes;
+  if (flags & label_summaries_flag) {
+    const unsigned int num_original = duplicates_ ? duplicates_->num_indices() : data_->size();
+    deserialize(label_classes, in, endianness);
+    summary_values.resize(num_original);
+    summary_classes.resize(label_classes ? num_original : 0);
+    for (unsigned int i=0; i<summary_values.size(); ++i)
+      deserialize(summary_values[i], in, endianness);
+    for (unsigned int i=0; i<summary_classes.size(); ++i)
+      deserialize(summary_classes[i], in, endianness);
+    if (!in.good())
+      throw std::runtime_error("error reading the labels of the summaries");
+    for (unsigned int i=0; i<summary_classes.size(); ++i) {
+      if (summary_classes[i] >= label_classes)
+        throw std::runtime_error("the labels of the summaries do not match the number of label classes");
+    }
+  }
+
   // Read and check the signature value.
   uint16_t signature;
   deserialize(signature, in, endianness);
@@ -140,6 +230,20 @@ KDTree<T, D, L>::KDTree(std::istream &in, Endianness::Type endianness) {
 
   // Verify kd-tree contents if enabled by the settings. Will throw std::runtime_error if not valid.
   VerifyKDTreeContents<Settings::verify_kdtree_after_deserializing>::verify(root_.get(), *data_);
+
+  // Restore the bounding box of the points and the cumulative counts of the collapsed ones.
+  calculate_bounding_box();
+  calculate_cumulative_counts();
+
+  // Restore the squared norms of the points if they were used.
+  if (flags & squared_norms_flag)
+    calculate_squared_norms();
+
+  // Restore the summaries of the labels if they were used.
+  if (flags & label_summaries_flag) {
+    summaries_.reset(new KDSummaries<Element, Dimensions>());
+    summaries_->build(root_.get(), *data_, cumulative_counts(), summary_values, summary_classes, label_classes);
+  }
 }
 
 /**
@@ -153,6 +257,13 @@ template <typename T, unsigned int D, typename L>
 void KDTree<T, D, L>::swap(KDTree &kdtree) {
   kdtree.data_.swap(data_);
   kdtree.root_.swap(root_);
+  kdtree.dimension_order_.swap(dimension_order_);
+  kdtree.duplicates_.swap(duplicates_);
+  std::swap(kdtree.bounding_lower_, bounding_lower_);
+  std::swap(kdtree.bounding_upper_, bounding_upper_);
+  kdtree.cumulative_counts_.swap(cumulative_counts_);
+  kdtree.squared_norms_.swap(squared_norms_);
+  kdtree.summaries_.swap(summaries_);
 }
 
 /**
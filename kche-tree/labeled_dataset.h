@@ -67,6 +67,7 @@ public:
   LabeledDataSet(const Vector *vectors, const Label *labels, unsigned int size);
   LabeledDataSet(SharedArray<Vector> vectors, SharedArray<Label> labels, unsigned int size);
   LabeledDataSet(const LabeledDataSet &dataset, unsigned int *permutation);
+  LabeledDataSet(const LabeledDataSet &dataset, const unsigned int *indices, unsigned int size);
   virtual ~LabeledDataSet();
 
   // Overriden initialization methods.
@@ -96,6 +96,21 @@ LabeledDataSet<T, D, L>::LabeledDataSet(const LabeledDataSet &dataset, unsigned
     : kche_tree::DataSet<T, D>(dataset, permutation),
       labels_(dataset.labels_) {}
 
+/**
+ * \brief Create a copy of a subset of the vectors of another labeled data set, including their labels.
+ *
+ * \param dataset Data set to be copied.
+ * \param indices Array of the indices of the vectors to copy, in the order they are stored in the new set.
+ * \param size Number of vectors to copy.
+ */
+template <typename T, unsigned int D, typename L>
+LabeledDataSet<T, D, L>::LabeledDataSet(const LabeledDataSet &dataset, const unsigned int *indices, unsigned int size)
+    : kche_tree::DataSet<T, D>(dataset, indices, size),
+      labels_(SharedArray<Label>(size ? new Label[size] : NULL)) {
+  for (unsigned int i=0; i<size; ++i)
+    labels_[i] = dataset.label(indices[i]);
+}
+
 /**
  * \brief Default virtual destructor.
  */
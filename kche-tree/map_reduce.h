@@ -30,6 +30,9 @@
 // Include STL binary functions and comparison functors.
 #include <functional>
 
+// Include fixed size integer types.
+#include <stdint.h>
+
 // Include metaprogramming utilities.
 #include "utils.h"
 
@@ -262,6 +265,60 @@ struct BoundedMapReduce<BoundCheckFreq, T, D, Index, D_max, BlockSize, NextCheck
   }
 };
 
+
+/**
+ * \brief Provide a bounded map-reduce operation whose boundary checks are selected at runtime.
+ *
+ * Arrays are processed in unrolled chunks of \a ChunkSize dimensions. After each chunk the boundary is checked
+ * only if the bit of the chunk is set in a mask provided at runtime, so the cadence of the checks can change without
+ * losing the unrolled code. Mask tests always take the same branch for a given mask, so they are well predicted.
+ *
+ * \tparam T Type of the data in the input arrays.
+ * \tparam D Number of dimensions in the input arrays.
+ * \tparam ChunkSize Number of dimensions processed between possible boundary checks. Arrays should have 64 chunks at most.
+ * \tparam BlockSize Number of consecutive dimensions to process in each call to the functor when possible.
+ * \tparam Index Index of the dimension to operate.
+ */
+template <typename T, unsigned int D, unsigned int ChunkSize, unsigned int BlockSize = 1, unsigned int Index = 0>
+struct MaskedBoundedMapReduce {
+  /**
+   * \brief Run the bounded map-reduce operation.
+   *
+   * \param map_reduce Functor used to map the input and reduce the corresponding elements in the input arrays to a single value.
+   * \param accumulator Reference to initial accumulation value and holder of the result when finished.
+   * \param check Functor used for checking the boundaries. Should return \c true when the boundary is crossed.
+   * \param boundary Boundary value used to avoid unnecessary calculations.
+   * \param check_mask Mask with a bit set for each chunk after which the boundary should be checked, starting from the least significant bit.
+   * \param a First input array.
+   * \param b Second input array. Optional.
+   * \param extra Extra arguments provided to the map-reduce function. Optional.
+   * \return Number of dimensions operated: \a D if the boundary was not crossed in any check.
+   */
+  template <typename MapReduceFunctor, typename Accumulator, typename BoundaryCheckFunctor, typename Boundary>
+  static inline unsigned int run(const MapReduceFunctor &map_reduce, Accumulator &accumulator, const BoundaryCheckFunctor &check, const Boundary &boundary,
+                                 uint64_t check_mask, const T *a, const T *b = NULL, const void *extra = NULL) {
+    KCHE_TREE_CHECK_CONCEPT(BoundaryCheckFunctor, BoundaryCheckFunctorConcept<Boundary>);
+    KCHE_TREE_COMPILE_ASSERT(ChunkSize > 0 && (D + ChunkSize - 1) / ChunkSize <= 64, "Expecting 64 chunks at most");
+    static const unsigned int StepSize = Min<ChunkSize, D - Index>::value;
+    MapReduce<T, D, Index, Index + StepSize, BlockSize>::run(map_reduce, accumulator, a, b, extra);
+    if ((check_mask & (static_cast<uint64_t>(1) << (Index / ChunkSize))) && check(accumulator, boundary))
+      return Index + StepSize;
+    return MaskedBoundedMapReduce<T, D, ChunkSize, BlockSize, Index + StepSize>::run(map_reduce, accumulator, check, boundary, check_mask, a, b, extra);
+  }
+};
+
+/// Base case specialization for the masked bounded map-reduce operation: \a Index = \a D. End of arrays case.
+template <typename T, unsigned int D, unsigned int ChunkSize, unsigned int BlockSize>
+struct MaskedBoundedMapReduce<T, D, ChunkSize, BlockSize, D> {
+
+  /// Nothing needs to be done in this base case.
+  template <typename MapReduceFunctor, typename Accumulator, typename BoundaryCheckFunctor, typename Boundary>
+  static inline unsigned int run(const MapReduceFunctor &map_reduce, Accumulator &accumulator, const BoundaryCheckFunctor &check, const Boundary &boundary,
+                                 uint64_t check_mask, const T *a, const T *b = NULL, const void *extra = NULL) {
+    return D;
+  }
+};
+
 } // namespace kche_tree
 
 #endif
@@ -35,6 +35,12 @@
 #ifndef _KCHE_TREE_METRICS_H_
 #define _KCHE_TREE_METRICS_H_
 
+// Include STL vectors.
+#include <vector>
+
+#include "bound_checks.h"
+#include "covariance.h"
+#include "eigen_decomposition.h"
 #include "incremental.h"
 #include "kd-node.h"
 #include "symmetric_matrix.h"
@@ -73,11 +79,21 @@ public:
   /// Use optimized const reference type for distance.
   typedef typename RParam<Distance>::Type ConstRef_Distance;
 
+  // Constructor.
+  EuclideanMetric();
+
+  // Runtime cadence of the boundary checks. The profile is not owned by the metric.
+  void set_bound_check_profile(BoundCheckProfile *profile) { bound_check_profile_ = profile; } ///< Use the cadence of a profile in bounded distances, or the default one if \c NULL.
+  BoundCheckProfile *bound_check_profile() const { return bound_check_profile_; } ///< Profile used by bounded distances, if any.
+
   // Squared distance to a feature vector.
   inline Distance operator () (const Vector &v1, const Vector &v2) const;
 
   // Squared distance to a feature vector with an upper bound.
   inline Distance operator () (const Vector &v1, const Vector &v2, ConstRef_Distance upper_boundary) const;
+
+private:
+  BoundCheckProfile *bound_check_profile_; ///< Optional profile defining the cadence of the boundary checks.
 };
 
 /**
@@ -89,6 +105,9 @@ public:
  * Requires *= (float) plus requirements for symmetric matrix inversion.
  * \note This metric assumes \a T to be commutative under multiplication and distributive over addition.
  *
+ * Distances cost O(D²) with a full inverse covariance matrix. They can be reduced to O(D·r) by approximating the matrix
+ * as a diagonal plus a rank r matrix, or to O(D) by keeping only its diagonal.
+ *
  * \tparam T Type of the elements the metric is applied to. The +=, -=, *= and > operators are required.
  * \tparam D Number of dimensions of the vectors the metric is applied to.
  */
@@ -127,12 +146,31 @@ public:
   // Matrix is assumed to have the properties of the inverse of a covariance matrix
   // (symmetric positive-definite, as inverting will fail for non-invertible positive-semidefinite ones).
   bool set_inverse_covariance(const DataSet &train_set);
+  bool set_inverse_covariance(const CovarianceEstimator<Element, Dimensions> &estimator, CholeskyDecomposition<Distance> *covariance_factor = NULL);
   bool set_inverse_covariance(const Distance *inverse_covariance);
   bool set_diagonal_covariance(const Distance *diagonal);
   void force_diagonal_covariance();
 
+  // Low-rank plus diagonal approximation of the inverse covariance matrix. Only available for floating point distance types.
+  bool force_low_rank_covariance(unsigned int rank, Distance *relative_error = NULL);
+  bool fit_low_rank_covariance(float max_relative_error, unsigned int *rank = NULL);
+
+  // Incremental updates of the inverse covariance matrix when vectors are added to or removed from the estimator used to fit it.
+  bool add_to_inverse_covariance(CovarianceEstimator<Element, Dimensions> &estimator, const Vector &vector);
+  bool remove_from_inverse_covariance(CovarianceEstimator<Element, Dimensions> &estimator, const Vector &vector);
+
   const SymmetricMatrix<Distance> &inverse_covariance() const { return inv_covariance_; } ///< Retrieve the inverse covariance matrix associated to the metric.
   bool has_diagonal_covariance() const { return is_diagonal_; } ///< Check if the inverse covariance matrix is diagonal.
+  bool has_low_rank_covariance() const { return low_rank_ != 0; } ///< Check if the inverse covariance matrix is approximated as a diagonal plus a low-rank matrix.
+  unsigned int low_rank() const { return low_rank_; } ///< Rank of the low-rank part of the inverse covariance matrix, or 0 if not approximated.
+  unsigned int num_positive_low_rank_factors() const { return low_rank_positive_; } ///< Number of low-rank factors added to the distances. The rest are subtracted.
+  const Distance *low_rank_diagonal() const { return &low_rank_diagonal_[0]; } ///< Diagonal part of the low-rank approximation.
+  const Distance *low_rank_factor(unsigned int index) const { return &low_rank_factors_[index * D]; } ///< Factor of the low-rank part. Its outer product with itself is one of the rank-one terms.
+  const Distance *low_rank_axis_factors(unsigned int axis) const { return &low_rank_axis_factors_[axis * low_rank_]; } ///< Elements of all the low-rank factors for a dimension.
+
+  // Runtime cadence of the boundary checks. The profile is not owned by the metric.
+  void set_bound_check_profile(BoundCheckProfile *profile) { bound_check_profile_ = profile; } ///< Use the cadence of a profile in bounded distances, or the default one if \c NULL.
+  BoundCheckProfile *bound_check_profile() const { return bound_check_profile_; } ///< Profile used by bounded distances, if any.
 
   // Squared distance to a feature vector.
   inline Distance operator () (const Vector &v1, const Vector &v2) const;
@@ -141,8 +179,92 @@ public:
   inline Distance operator () (const Vector &v1, const Vector &v2, ConstRef_Distance upper_boundary) const;
 
 private:
+  bool normalized_eigendecomposition(EigenDecomposition<Distance> &decomposition, Distance *scale) const;
+  static void select_low_rank_eigenvalues(const EigenDecomposition<Distance> &decomposition, unsigned int rank, unsigned int &num_largest, Distance &relative_error);
+  void set_low_rank_covariance(const EigenDecomposition<Distance> &decomposition, const Distance *scale, unsigned int rank, unsigned int num_largest);
+
   SymmetricMatrix<Distance> inv_covariance_; ///< Inverse covariance matrix associated with the metric instance.
   bool is_diagonal_; ///< Flag indicating if the inverse covariance matrix is diagonal and hence enabling severe optimizations.
+  unsigned int low_rank_; ///< Rank of the low-rank part of the inverse covariance matrix, or 0 if not approximated.
+  unsigned int low_rank_positive_; ///< Number of low-rank factors added to the distances. The rest are subtracted.
+  std::vector<Distance> low_rank_diagonal_; ///< Diagonal part of the low-rank approximation.
+  std::vector<Distance> low_rank_factors_; ///< Factors of the low-rank part stored by rows.
+  std::vector<Distance> low_rank_axis_factors_; ///< Factors of the low-rank part stored by dimensions, for incremental hyperrectangle updates.
+  BoundCheckProfile *bound_check_profile_; ///< Optional profile defining the cadence of the boundary checks.
+};
+
+/**
+ * \brief Template providing Euclidean metrics in a periodic (toroidal) box.
+ *
+ * Provides squared Euclidean distances between the nearest periodic images of two feature vectors (minimum image convention),
+ * as used in simulations with periodic boundary conditions. A single kd-tree built from the vectors in the box can be searched
+ * with this metric directly, without replicating the points near the boundaries.
+ *
+ * Each dimension has its own box length. All the vectors, including the queries, are assumed to lie within a window
+ * of one box length per dimension, such as [0, L). A box length of zero leaves its dimension non-periodic.
+ *
+ * \tparam T Type of the elements the metric is applied to. The +=, -=, *=, < and > operators are required.
+ * \tparam D Number of dimensions of the vectors the metric is applied to.
+ */
+template <typename T, const unsigned int D>
+class PeriodicEuclideanMetric {
+public:
+  /// Type of the elements to which the metrics are applied.
+  typedef T Element;
+
+  /// Number of dimensions to which the metrics are applied.
+  static unsigned const int Dimensions = D;
+
+  /// Type for incremental hyperrectangle intersection calculations when using this metric.
+  typedef PeriodicEuclideanIncrementalUpdater<T, D> IncrementalUpdater;
+
+  /// Alias for the associated distance type.
+  typedef typename Traits<Element>::Distance Distance;
+
+  /// Alias for the compatible feature vectors.
+  typedef typename kche_tree::Vector<Element, Dimensions> Vector;
+
+  /// Use optimized const reference type for distance.
+  typedef typename RParam<Distance>::Type ConstRef_Distance;
+
+  // Constructors.
+  PeriodicEuclideanMetric();
+  explicit PeriodicEuclideanMetric(ConstRef_Distance box_length);
+  explicit PeriodicEuclideanMetric(const Distance *box_lengths);
+
+  // Box lengths of each dimension. Zero if the dimension is not periodic.
+  bool set_box_lengths(const Distance *box_lengths);
+  const Distance *box_lengths() const { return box_lengths_; } ///< Box length of each dimension, or zero if the dimension is not periodic.
+
+  // Runtime cadence of the boundary checks. The profile is not owned by the metric.
+  void set_bound_check_profile(BoundCheckProfile *profile) { bound_check_profile_ = profile; } ///< Use the cadence of a profile in bounded distances, or the default one if \c NULL.
+  BoundCheckProfile *bound_check_profile() const { return bound_check_profile_; } ///< Profile used by bounded distances, if any.
+
+  // Squared distance to the nearest periodic image of a feature vector.
+  inline Distance operator () (const Vector &v1, const Vector &v2) const;
+
+  // Squared distance to the nearest periodic image of a feature vector with an upper bound.
+  inline Distance operator () (const Vector &v1, const Vector &v2, ConstRef_Distance upper_boundary) const;
+
+private:
+  Distance box_lengths_[D]; ///< Box length of each dimension, or zero if the dimension is not periodic.
+  BoundCheckProfile *bound_check_profile_; ///< Optional profile defining the cadence of the boundary checks.
+};
+
+/**
+ * \brief Check if a metric is invariant to permutations of the dimensions of the feature vectors.
+ *
+ * Required to search kd-trees built with their dimensions reordered. Specialize it for any custom metric with this property.
+ */
+template <typename Metric>
+struct IsPermutationInvariant {
+  enum { value = false };
+};
+
+/// The Euclidean metric is invariant to permutations of the dimensions.
+template <typename T, unsigned int D>
+struct IsPermutationInvariant<EuclideanMetric<T, D> > {
+  enum { value = true };
 };
 
 } // namespace kche_tree
@@ -150,5 +272,6 @@ private:
 // Template implementation files.
 #include "metrics_euclidean.tpp"
 #include "metrics_mahalanobis.tpp"
+#include "metrics_periodic.tpp"
 
 #endif
@@ -74,6 +74,7 @@ struct EuclideanDistanceCalculator {
 
   static inline Distance distance(const Vector &v1, const Vector &v2);
   static inline Distance distance(const Vector &v1, const Vector &v2, ConstRef_Distance upper_bound);
+  static inline Distance distance(const Vector &v1, const Vector &v2, ConstRef_Distance upper_bound, BoundCheckProfile &profile);
 };
 
 /**
@@ -88,8 +89,14 @@ struct EuclideanDistanceCalculatorSSE : EuclideanDistanceCalculator<T, D> {
 
   static inline Distance distance(const Vector &v1, const Vector &v2);
   static inline Distance distance(const Vector &v1, const Vector &v2, ConstRef_Distance upper_bound);
+  static inline Distance distance(const Vector &v1, const Vector &v2, ConstRef_Distance upper_bound, BoundCheckProfile &profile);
 };
 
+/// Create a Euclidean metric object using the default cadence of the boundary checks.
+template <typename T, const unsigned int D>
+EuclideanMetric<T, D>::EuclideanMetric()
+    : bound_check_profile_(NULL) {}
+
 /**
  * \brief Generic squared euclidean distance operator for two D-dimensional feature vectors.
  *
@@ -119,6 +126,8 @@ typename EuclideanMetric<T, D>::Distance EuclideanMetric<T, D>::operator () (con
 
   // Delegate the distance calculation depending on the SSE optimization settings.
   typedef typename TypeBranch<Settings::enable_sse, EuclideanDistanceCalculatorSSE<T, D>, EuclideanDistanceCalculator<T, D> >::Result DistanceCalculator;
+  if (bound_check_profile_)
+    return DistanceCalculator::distance(v1, v2, upper_bound, *bound_check_profile_);
   return DistanceCalculator::distance(v1, v2, upper_bound);
 }
 
@@ -163,6 +172,23 @@ typename EuclideanDistanceCalculator<T, D>::Distance EuclideanDistanceCalculator
   return acc;
 }
 
+/**
+ * \brief Generic squared Euclidean distance calculator with early-out when reaching an upper bound value, checked with the cadence of a profile.
+ *
+ * \param v1 First feature vector.
+ * \param v2 Second feature vector.
+ * \param upper_bound Upper boundary value used for early-out.
+ * \param profile Profile defining the cadence of the boundary checks.
+ * \return Squared Euclidean distance between the two vectors or the partial result if greater than \a upper_bound.
+ */
+template <typename T, const unsigned int D>
+typename EuclideanDistanceCalculator<T, D>::Distance EuclideanDistanceCalculator<T, D>::distance(const Vector &v1, const Vector &v2, ConstRef_Distance upper_bound, BoundCheckProfile &profile) {
+
+  Distance acc = Traits<Distance>::zero();
+  profiled_bounded_map_reduce<D, D, 1, 1>(profile, DifferenceDotFunctor<T>(), acc, GreaterThanBoundaryFunctor<Distance>(), upper_bound, v1.data(), v2.data());
+  return acc;
+}
+
 } // namespace kche_tree
 
 // Include the SSE specializations if enabled.
@@ -123,4 +123,29 @@ typename EuclideanDistanceCalculatorSSE<T, D>::Distance EuclideanDistanceCalcula
   return acc.sum();
 }
 
+/**
+ * \brief SSE-optimized squared Euclidean distance calculator with early-out when reaching an upper bound value, checked with the cadence of a profile.
+ *
+ * \param v1 First feature vector.
+ * \param v2 Second feature vector.
+ * \param upper_bound Upper boundary value used for early-out.
+ * \param profile Profile defining the cadence of the boundary checks.
+ * \return Squared Euclidean distance between the two vectors or the partial result if greater than \a upper_bound.
+ */
+template <typename T, const unsigned int D>
+typename EuclideanDistanceCalculatorSSE<T, D>::Distance EuclideanDistanceCalculatorSSE<T, D>::distance(const Vector &v1, const Vector &v2, ConstRef_Distance upper_bound, BoundCheckProfile &profile) {
+
+  const unsigned int num_blocks = NumSSEBlocks<T, D>::value;
+  const SSERegister<T> *v1_sse = reinterpret_cast<const SSERegister<T> *>(v1.data());
+  const SSERegister<T> *v2_sse = reinterpret_cast<const SSERegister<T> *>(v2.data());
+
+  v1_sse->prefetch();
+  v2_sse->prefetch();
+
+  SSERegister<T> acc = SSERegister<T>::zero();
+  profiled_bounded_map_reduce<D, num_blocks, SSETraits<T>::NumElements, 2>(profile, DifferenceDotFunctorSSE<SSERegister<T> >(), acc, GreaterThanBoundaryFunctorSSE<Distance>(), upper_bound, v1_sse, v2_sse);
+
+  return acc.sum();
+}
+
 } // namespace kche_tree
@@ -34,7 +34,10 @@ namespace kche_tree {
 template <typename T, const unsigned int D>
 MahalanobisMetric<T, D>::MahalanobisMetric()
     : inv_covariance_(D, true),
-      is_diagonal_(true) {
+      is_diagonal_(true),
+      low_rank_(0),
+      low_rank_positive_(0),
+      bound_check_profile_(NULL) {
 }
 
 /**
@@ -45,16 +48,18 @@ MahalanobisMetric<T, D>::MahalanobisMetric()
 template <typename T, const unsigned int D>
 MahalanobisMetric<T, D>::MahalanobisMetric(const DataSet &data_set)
     : inv_covariance_(D, true),
-      is_diagonal_(true) {
+      is_diagonal_(true),
+      low_rank_(0),
+      low_rank_positive_(0),
+      bound_check_profile_(NULL) {
   set_inverse_covariance(data_set);
 }
 
 /**
  * \brief Calculate the inverse covariance matrix of the object from the data of a provided set.
  *
- * To perform this, the covariance matrix of the data in the set will be calculated and stored as a
- * symmetric matrix. Then, this matrix will be inverted using a specialized version of the LDL'
- * decomposition for symmetric matrices. The result is then stored as the inverse covariance matrix.
+ * The covariance matrix of the data in the set is estimated with a \link kche_tree::CovarianceEstimator CovarianceEstimator\endlink
+ * and then inverted as in \link set_inverse_covariance(const CovarianceEstimator<Element, Dimensions>&) set_inverse_covariance\endlink.
  *
  * \note If the resulting covariance matrix for the provided data set is not invertible then the contents
  * of the existing matrix won't be updated.
@@ -66,37 +71,42 @@ MahalanobisMetric<T, D>::MahalanobisMetric(const DataSet &data_set)
  */
 template <typename T, const unsigned int D>
 bool MahalanobisMetric<T, D>::set_inverse_covariance(const DataSet &data_set) {
+  CovarianceEstimator<T, D> estimator;
+  estimator.add(data_set);
+  return set_inverse_covariance(estimator);
+}
 
-  unsigned int N = data_set.size();
-  if (N <= 1)
-    return false;
-
-  // Calculate the mean of each dimension.
-  T mean[D];
-  for (unsigned int i=0; i<D; ++i) {
-    mean[i] = Traits<T>::mean(data_set.column_begin(i), data_set.column_end(i));
-  }
+/**
+ * \brief Calculate the inverse covariance matrix of the object from the statistics of a covariance estimator.
+ *
+ * The covariance matrix estimated will be inverted using its Cholesky decomposition, or a specialized version of the LDL'
+ * decomposition for symmetric matrices if not positive-definite. The result is then stored as the inverse covariance matrix.
+ * Estimators can be updated with new data and used again to refit the metric.
+ *
+ * \note If the estimated covariance matrix is not invertible then the contents of the existing matrix won't be updated.
+ *
+ * \param estimator Estimator of the covariance matrix. Should have at least 2 vectors added.
+ * \param covariance_factor Optional decomposition where the Cholesky factor of the covariance matrix is returned, for example to whiten
+ * vectors. Cleared if the covariance matrix is not positive-definite.
+ * \return \c true if succesfully set, \c false if the estimated covariance matrix is not invertible.
+ */
+template <typename T, const unsigned int D>
+bool MahalanobisMetric<T, D>::set_inverse_covariance(const CovarianceEstimator<Element, Dimensions> &estimator, CholeskyDecomposition<Distance> *covariance_factor) {
 
-  // Calculate the covariance matrix.
-  SymmetricMatrix<Distance> new_inv_covariance(inv_covariance_.size());
-  float inv_N1 = 1.0f / (N - 1);
-  for (unsigned int j=0; j<D; ++j) {
-    for (unsigned int i=0; i<=j; ++i) {
+  SymmetricMatrix<Distance> new_inv_covariance;
+  if (!estimator.covariance(new_inv_covariance))
+    return false;
 
-      Distance acc = Traits<Distance>::zero();
-      for (unsigned int k=0; k<N; ++k) {
-        Distance temp = Traits<T>::distance(data_set[k][i], mean[i]);
-        Distance temp2 = Traits<T>::distance(data_set[k][j], mean[j]);
-        temp *= temp2;
-        acc += temp;
-      }
-      acc *= inv_N1;
-      new_inv_covariance(j, i) = acc;
+  // Invert the covariance matrix to get the inverse covariance matrix, keeping its Cholesky factor if requested.
+  if (covariance_factor) {
+    if (covariance_factor->decompose(new_inv_covariance))
+      covariance_factor->invert(new_inv_covariance);
+    else {
+      covariance_factor->clear();
+      if (!new_inv_covariance.invert_ldl())
+        return false;
     }
-  }
-
-  // Invert it to get the inverse covariance matrix.
-  if (!new_inv_covariance.invert())
+  } else if (!new_inv_covariance.invert())
     return false;
 
   // The matrix was invertible, copy the results.
@@ -105,6 +115,7 @@ bool MahalanobisMetric<T, D>::set_inverse_covariance(const DataSet &data_set) {
   // Assume that the resulting matrix is not a diagonal one.
   // The method force_diagonal_covariance should be used if the result is expected to be diagonal.
   is_diagonal_ = false;
+  low_rank_ = 0;
 
   return true;
 }
@@ -140,6 +151,7 @@ bool MahalanobisMetric<T, D>::set_inverse_covariance(const Distance *inverse_cov
 
   // Assume that the provided matrix is not a diagonal one.
   is_diagonal_ = false;
+  low_rank_ = 0;
   return true;
 }
 
@@ -170,6 +182,7 @@ bool MahalanobisMetric<T, D>::set_diagonal_covariance(const Distance *diagonal)
   }
 
   is_diagonal_ = true;
+  low_rank_ = 0;
   return true;
 }
 
@@ -188,6 +201,314 @@ void MahalanobisMetric<T, D>::force_diagonal_covariance() {
   }
 
   is_diagonal_ = true;
+  low_rank_ = 0;
+}
+
+/**
+ * \brief Approximate the current inverse covariance matrix as a diagonal matrix plus a matrix of the given rank.
+ *
+ * The inverse covariance matrix S is first normalized by its diagonal as N = Δ^-1 S Δ^-1, with Δ = diag(S)^(1/2), and decomposed
+ * into its eigenvalues μ and unit eigenvectors v. The \a rank eigenvalues farthest from the rest, taken from both ends of the spectrum,
+ * are kept exactly while all the remaining ones are replaced by a single value c. This results in the approximation
+ * c Δ² + Σ (μ_k - c) (Δ v_k) (Δ v_k)', a positive diagonal plus a matrix of rank \a rank, with which distances are calculated
+ * in O(D·rank) operations.
+ *
+ * Since N and its approximation share their eigenvectors, all the squared distances of the approximation are within a factor
+ * (1 ± ε) of the exact ones, where ε = (μ_max - μ_min) / (μ_max + μ_min) over the replaced eigenvalues when using the optimal c.
+ *
+ * The inverse covariance matrix is replaced by its approximation. Setting a new inverse covariance matrix or
+ * updating it incrementally discards the approximation.
+ * \note A rank of 0 results in a diagonal matrix proportional to the diagonal of S.
+ *
+ * \param rank Rank of the approximation. Must be lower than the number of dimensions.
+ * \param relative_error Optional output for the maximum relative error ε of the squared distances.
+ * \return \c true if successful, \c false if the eigendecomposition is not available for the distance type or the matrix is not positive definite.
+ */
+template <typename T, const unsigned int D>
+bool MahalanobisMetric<T, D>::force_low_rank_covariance(unsigned int rank, Distance *relative_error) {
+
+  KCHE_TREE_DCHECK(rank < D);
+  EigenDecomposition<Distance> decomposition;
+  Distance scale[D];
+  if (!normalized_eigendecomposition(decomposition, scale))
+    return false;
+
+  unsigned int num_largest;
+  Distance error;
+  select_low_rank_eigenvalues(decomposition, rank, num_largest, error);
+  if (relative_error)
+    *relative_error = error;
+
+  set_low_rank_covariance(decomposition, scale, rank, num_largest);
+  return true;
+}
+
+/**
+ * \brief Approximate the current inverse covariance matrix as a diagonal matrix plus a low-rank matrix, choosing the smallest rank that meets an error target.
+ *
+ * The approximation is the same as in \link force_low_rank_covariance force_low_rank_covariance\endlink, whose relative error
+ * is known for every rank once the eigendecomposition is available. If the rank required is high enough for the full matrix
+ * to be faster, the current matrix is kept unmodified.
+ *
+ * \param max_relative_error Maximum relative error allowed for the squared distances.
+ * \param rank Optional output for the rank of the approximation, 0 if diagonal or \a D if the full matrix is kept.
+ * \return \c true if successful, \c false if the eigendecomposition is not available for the distance type or the matrix is not positive definite.
+ */
+template <typename T, const unsigned int D>
+bool MahalanobisMetric<T, D>::fit_low_rank_covariance(float max_relative_error, unsigned int *rank) {
+
+  EigenDecomposition<Distance> decomposition;
+  Distance scale[D];
+  if (!normalized_eigendecomposition(decomposition, scale))
+    return false;
+
+  Distance max_error = Traits<Distance>::one();
+  max_error *= max_relative_error;
+
+  // A rank r approximation costs D·(r + 1) operations per distance while the full matrix costs D·(D + 1) / 2.
+  const unsigned int max_rank = (D - 1) / 2;
+  for (unsigned int selected_rank = 0; selected_rank <= max_rank; ++selected_rank) {
+    unsigned int num_largest;
+    Distance error;
+    select_low_rank_eigenvalues(decomposition, selected_rank, num_largest, error);
+    if (!(error > max_error)) {
+      if (rank)
+        *rank = selected_rank;
+      set_low_rank_covariance(decomposition, scale, selected_rank, num_largest);
+      return true;
+    }
+  }
+
+  if (rank)
+    *rank = D;
+  return true;
+}
+
+/**
+ * \brief Calculate the eigendecomposition of the inverse covariance matrix normalized by its diagonal.
+ *
+ * \param decomposition Eigendecomposition of Δ^-1 S Δ^-1, where S is the inverse covariance matrix and Δ = diag(S)^(1/2).
+ * \param scale Array of \a D values where the diagonal of Δ is returned.
+ * \return \c true if successful, \c false if the eigendecomposition is not available for the distance type or the matrix is not positive definite.
+ */
+template <typename T, const unsigned int D>
+bool MahalanobisMetric<T, D>::normalized_eigendecomposition(EigenDecomposition<Distance> &decomposition, Distance *scale) const {
+
+  Distance inverse_scale[D];
+  for (unsigned int i=0; i<D; ++i) {
+    if (!CholeskySquareRoot<Distance>::positive_root(inv_covariance_(i, i), scale[i]))
+      return false;
+    inverse_scale[i] = scale[i];
+    Traits<Distance>::invert(inverse_scale[i]);
+  }
+
+  SymmetricMatrix<Distance> normalized(D, false);
+  for (unsigned int j=0; j<D; ++j) {
+    for (unsigned int i=0; i<=j; ++i) {
+      Distance value = inv_covariance_(j, i);
+      value *= inverse_scale[i];
+      value *= inverse_scale[j];
+      normalized(j, i) = value;
+    }
+  }
+
+  // Positive-definite matrices have positive eigenvalues.
+  return decomposition.decompose(normalized) && decomposition.eigenvalue(D - 1) > Traits<Distance>::zero();
+}
+
+/**
+ * \brief Select the eigenvalues kept exactly by a low-rank approximation of a given rank, minimizing its relative error.
+ *
+ * The eigenvalues replaced always form a contiguous range in decreasing order, so only the number of largest eigenvalues kept needs to be chosen.
+ *
+ * \param decomposition Eigendecomposition of the normalized inverse covariance matrix.
+ * \param rank Rank of the approximation.
+ * \param num_largest Returns the number of largest eigenvalues kept. The rest up to \a rank are the smallest eigenvalues.
+ * \param relative_error Returns the maximum relative error of the squared distances.
+ */
+template <typename T, const unsigned int D>
+void MahalanobisMetric<T, D>::select_low_rank_eigenvalues(const EigenDecomposition<Distance> &decomposition, unsigned int rank, unsigned int &num_largest, Distance &relative_error) {
+
+  for (unsigned int first=0; first<=rank; ++first) {
+    const Distance &largest = decomposition.eigenvalue(first);
+    const Distance &smallest = decomposition.eigenvalue(D - 1 - (rank - first));
+
+    // Equivalent to: Distance error = (largest - smallest) / (largest + smallest);
+    Distance error = largest;
+    error -= smallest;
+    Distance sum = largest;
+    sum += smallest;
+    error /= sum;
+
+    if (first == 0 || relative_error > error) {
+      relative_error = error;
+      num_largest = first;
+    }
+  }
+}
+
+/**
+ * \brief Set the low-rank plus diagonal approximation of the inverse covariance matrix.
+ *
+ * \param decomposition Eigendecomposition of the normalized inverse covariance matrix.
+ * \param scale Diagonal of the normalization, as returned by \link normalized_eigendecomposition normalized_eigendecomposition\endlink.
+ * \param rank Rank of the approximation.
+ * \param num_largest Number of largest eigenvalues kept. The rest up to \a rank are the smallest eigenvalues.
+ */
+template <typename T, const unsigned int D>
+void MahalanobisMetric<T, D>::set_low_rank_covariance(const EigenDecomposition<Distance> &decomposition, const Distance *scale, unsigned int rank, unsigned int num_largest) {
+
+  // Value replacing the eigenvalues not kept. Equivalent to: Distance c = 2 * largest * smallest / (largest + smallest);
+  const Distance &largest = decomposition.eigenvalue(num_largest);
+  const Distance &smallest = decomposition.eigenvalue(D - 1 - (rank - num_largest));
+  Distance c = largest;
+  c *= smallest;
+  c += c;
+  Distance sum = largest;
+  sum += smallest;
+  c /= sum;
+
+  low_rank_diagonal_.resize(D);
+  for (unsigned int i=0; i<D; ++i) {
+    low_rank_diagonal_[i] = inv_covariance_(i, i);
+    low_rank_diagonal_[i] *= c;
+  }
+
+  // A rank 0 approximation is just a diagonal matrix.
+  if (rank == 0) {
+    for (unsigned int j=0; j<D; ++j) {
+      for (unsigned int i=0; i<j; ++i)
+        inv_covariance_(j, i) = Traits<Distance>::zero();
+      inv_covariance_(j, j) = low_rank_diagonal_[j];
+    }
+
+    is_diagonal_ = true;
+    low_rank_ = 0;
+    return;
+  }
+
+  // Calculate the factors Δ v_k sqrt(|μ_k - c|). The ones for the largest eigenvalues are added to the distances and
+  // stored first, the ones for the smallest eigenvalues are subtracted and stored after them.
+  std::vector<Distance> factors(rank * D);
+  for (unsigned int k=0; k<rank; ++k) {
+    const unsigned int index = k < num_largest ? k : D - rank + k;
+    Distance weight = decomposition.eigenvalue(index);
+    if (k < num_largest)
+      weight -= c;
+    else {
+      Traits<Distance>::negate(weight);
+      weight += c;
+    }
+
+    Distance root = Traits<Distance>::zero();
+    CholeskySquareRoot<Distance>::positive_root(weight, root);
+
+    const Distance *eigenvector = decomposition.eigenvector(index);
+    for (unsigned int i=0; i<D; ++i) {
+      factors[k * D + i] = eigenvector[i];
+      factors[k * D + i] *= scale[i];
+      factors[k * D + i] *= root;
+    }
+  }
+
+  low_rank_factors_.swap(factors);
+  low_rank_axis_factors_.resize(D * rank);
+  for (unsigned int i=0; i<D; ++i)
+    for (unsigned int k=0; k<rank; ++k)
+      low_rank_axis_factors_[i * rank + k] = low_rank_factors_[k * D + i];
+
+  // Replace the inverse covariance matrix by its approximation.
+  Distance minus_one = Traits<Distance>::one();
+  Traits<Distance>::negate(minus_one);
+  inv_covariance_.reset_to_size(D, true);
+  for (unsigned int i=0; i<D; ++i)
+    inv_covariance_(i, i) = low_rank_diagonal_[i];
+  for (unsigned int k=0; k<rank; ++k)
+    inv_covariance_.rank_one_update(&low_rank_factors_[k * D], k < num_largest ? Traits<Distance>::one() : minus_one);
+
+  is_diagonal_ = false;
+  low_rank_ = rank;
+  low_rank_positive_ = num_largest;
+}
+
+/**
+ * \brief Update the inverse covariance matrix after adding a feature vector to the estimator used to fit the metric.
+ *
+ * Adding a vector to n existing ones changes the covariance matrix C to (n - 1) / n * C + 1 / (n + 1) * d * d',
+ * where d is the difference between the vector and the previous mean. The inverse of this matrix is calculated from
+ * the current one with the Sherman-Morrison formula in O(D²) operations, avoiding to estimate and invert the matrix again.
+ *
+ * \warning The current inverse covariance matrix must have been calculated from the provided estimator, either
+ * by \link set_inverse_covariance(const CovarianceEstimator<Element, Dimensions>&, CholeskyDecomposition<Distance>*) set_inverse_covariance\endlink
+ * or by previous incremental updates. Errors accumulate with each update, so refitting from the estimator from time to time is recommended.
+ * \note If the estimator has less than 2 vectors the inverse covariance matrix is fitted again after adding the vector.
+ *
+ * \param estimator Estimator used to fit the metric. The vector is added to it.
+ * \param vector Feature vector to add.
+ * \return \c true if succesfully updated, \c false if the updated covariance matrix is not invertible. The vector is added to the estimator in any case.
+ */
+template <typename T, const unsigned int D>
+bool MahalanobisMetric<T, D>::add_to_inverse_covariance(CovarianceEstimator<Element, Dimensions> &estimator, const Vector &vector) {
+
+  const uint64_t count = estimator.size();
+  if (count < 2) {
+    estimator.add(vector);
+    return set_inverse_covariance(estimator);
+  }
+
+  Distance deviation[D];
+  estimator.deviation(vector, deviation);
+  estimator.add(vector);
+
+  // Apply the rank-one update to the inverse of the scaled covariance matrix: inv(a * C + w * d * d') = inv(C + w / a * d * d') / a.
+  const double scale = static_cast<double>(count - 1) / count;
+  const double weight = 1.0 / (count + 1);
+  if (!inv_covariance_.inverse_rank_one_update(deviation, static_cast<float>(weight / scale)))
+    return false;
+
+  inv_covariance_.scale(static_cast<float>(1.0 / scale));
+  is_diagonal_ = false;
+  low_rank_ = 0;
+  return true;
+}
+
+/**
+ * \brief Update the inverse covariance matrix after removing a feature vector from the estimator used to fit the metric.
+ *
+ * Removing a vector from n existing ones changes the covariance matrix C to (n - 1) / (n - 2) * C - n / ((n - 1) * (n - 2)) * d * d',
+ * where d is the difference between the vector and the current mean. The inverse of this matrix is calculated from
+ * the current one with the Sherman-Morrison formula in O(D²) operations, avoiding to estimate and invert the matrix again.
+ *
+ * \warning The current inverse covariance matrix must have been calculated from the provided estimator, either
+ * by \link set_inverse_covariance(const CovarianceEstimator<Element, Dimensions>&, CholeskyDecomposition<Distance>*) set_inverse_covariance\endlink
+ * or by previous incremental updates. Errors accumulate with each update, so refitting from the estimator from time to time is recommended.
+ * \note Neither the estimator nor the metric are modified if the update fails.
+ *
+ * \param estimator Estimator used to fit the metric. The vector is removed from it and should have been added before.
+ * \param vector Feature vector to remove.
+ * \return \c true if succesfully updated, \c false if less than 2 vectors would remain or the updated covariance matrix would not be positive definite.
+ */
+template <typename T, const unsigned int D>
+bool MahalanobisMetric<T, D>::remove_from_inverse_covariance(CovarianceEstimator<Element, Dimensions> &estimator, const Vector &vector) {
+
+  const uint64_t count = estimator.size();
+  if (count < 3)
+    return false;
+
+  Distance deviation[D];
+  estimator.deviation(vector, deviation);
+
+  // Apply the rank-one update to the inverse of the scaled covariance matrix: inv(a * C + w * d * d') = inv(C + w / a * d * d') / a.
+  const double scale = static_cast<double>(count - 1) / (count - 2);
+  const double weight = -static_cast<double>(count) / ((count - 1) * (count - 2));
+  if (!inv_covariance_.inverse_rank_one_update(deviation, static_cast<float>(weight / scale)))
+    return false;
+
+  inv_covariance_.scale(static_cast<float>(1.0 / scale));
+  estimator.remove(vector);
+  is_diagonal_ = false;
+  low_rank_ = 0;
+  return true;
 }
 
 /// Map-reduce functor to calculate the difference between 2 values.
@@ -386,6 +707,9 @@ struct MahalanobisDistanceCalculator {
 
   static inline Distance distance(const Vector &v1, const Vector &v2, const Metric &metric);
   static inline Distance distance(const Vector &v1, const Vector &v2, const Metric &metric, ConstRef_Distance upper_bound);
+
+  static inline Distance low_rank_distance(const Vector &v1, const Vector &v2, const Metric &metric);
+  static inline Distance low_rank_distance(const Vector &v1, const Vector &v2, const Metric &metric, ConstRef_Distance upper_bound);
 };
 
 /**
@@ -446,6 +770,10 @@ typename MahalanobisMetric<T, D>::Distance MahalanobisMetric<T, D>::operator ()
 template <typename T, const unsigned int D>
 typename MahalanobisDistanceCalculator<T, D>::Distance MahalanobisDistanceCalculator<T, D>::distance(const Vector &v1, const Vector &v2, const Metric &metric) {
 
+  // Use the low-rank approximation if available.
+  if (metric.has_low_rank_covariance())
+    return low_rank_distance(v1, v2, metric);
+
   // Initialize the distance accumulator.
   Distance acc = Traits<Distance>::zero();
 
@@ -481,6 +809,10 @@ typename MahalanobisDistanceCalculator<T, D>::Distance MahalanobisDistanceCalcul
 template <typename T, const unsigned int D>
 typename MahalanobisDistanceCalculator<T, D>::Distance MahalanobisDistanceCalculator<T, D>::distance(const Vector &v1, const Vector &v2, const Metric &metric, ConstRef_Distance upper_bound) {
 
+  // Use the low-rank approximation if available.
+  if (metric.has_low_rank_covariance())
+    return low_rank_distance(v1, v2, metric, upper_bound);
+
   // Constant calculated empirically.
   const unsigned int D_acc = (unsigned int) (0.4f * D);
 
@@ -490,6 +822,10 @@ typename MahalanobisDistanceCalculator<T, D>::Distance MahalanobisDistanceCalcul
   // Don't precalculate the cache if the covariance matrix is diagonal.
   if (metric.has_diagonal_covariance()) {
     // Check the details below to see why this operation is mathematically safe.
+    if (BoundCheckProfile *profile = metric.bound_check_profile()) {
+      profiled_bounded_map_reduce<D, D, 1, 1>(*profile, MahalanobisDiagonalFunctor<T>(), acc, GreaterThanBoundaryFunctor<Distance>(), upper_bound, v1.data(), v2.data(), metric.inverse_covariance().diagonal());
+      return acc;
+    }
     MapReduce<T, D, 0, D_acc>::run(MahalanobisDiagonalFunctor<T>(), acc, v1.data(), v2.data(), metric.inverse_covariance().diagonal());
     BoundedMapReduce<3, T, D, D_acc, D>::run(MahalanobisDiagonalFunctor<T>(), acc, GreaterThanBoundaryFunctor<Distance>(), upper_bound, v1.data(), v2.data(), metric.inverse_covariance().diagonal());
     return acc;
@@ -511,12 +847,100 @@ typename MahalanobisDistanceCalculator<T, D>::Distance MahalanobisDistanceCalcul
   // since it's the inverse of another positive-definite matrix and therefore, as a positive-definite Hermian matrix, all the elements
   // in its main diagonal will always be positive. This allows BoundedMapReduce to be safely used, as the distance function becomes
   // monotonically increasing: a sum of squared differences and positive diagonal values.
+  if (BoundCheckProfile *profile = metric.bound_check_profile()) {
+    profiled_bounded_map_reduce<D, D, 1, 1>(*profile, SquaredFirstDotFunctor<Distance>(), acc, GreaterThanBoundaryFunctor<Distance>(), upper_bound, cache.data(), metric.inverse_covariance().diagonal());
+    return acc;
+  }
   MapReduce<Distance, D, 0, D_acc>::run(SquaredFirstDotFunctor<Distance>(), acc, cache.data(), metric.inverse_covariance().diagonal());
   BoundedMapReduce<3, Distance, D, D_acc, D>::run(SquaredFirstDotFunctor<Distance>(), acc, GreaterThanBoundaryFunctor<Distance>(), upper_bound, cache.data(), metric.inverse_covariance().diagonal());
 
   return acc;
 }
 
+/**
+ * \brief Squared Mahalanobis distance calculator using a low-rank plus diagonal approximation of the inverse covariance matrix.
+ *
+ * \param v1 First feature vector.
+ * \param v2 Second feature vector.
+ * \param metric Mahalanobis metric object being used. Must have a low-rank covariance.
+ * \return Squared Mahalanobis distance between the two vectors.
+ */
+template <typename T, const unsigned int D>
+typename MahalanobisDistanceCalculator<T, D>::Distance MahalanobisDistanceCalculator<T, D>::low_rank_distance(const Vector &v1, const Vector &v2, const Metric &metric) {
+
+  // Map the difference into a separate vector. No reduction operation is performed.
+  typename MahalanobisMetric<T, D>::CacheVector cache;
+  Distance *cache_data = cache.mutable_data();
+  MapReduce<T, D>::run(DifferenceFunctor<T>(), cache_data, v1.data(), v2.data());
+
+  // Subtract the squared projections on the negative low-rank factors.
+  Distance acc = Traits<Distance>::zero();
+  for (unsigned int k=metric.num_positive_low_rank_factors(); k<metric.low_rank(); ++k) {
+    Distance projection = CholeskyKernels<Distance>::dot(metric.low_rank_factor(k), cache.data(), D);
+    projection *= projection;
+    acc -= projection;
+  }
+
+  // Operate over the diagonal part.
+  MapReduce<Distance, D>::run(SquaredFirstDotFunctor<Distance>(), acc, cache.data(), metric.low_rank_diagonal());
+
+  // Add the squared projections on the positive low-rank factors.
+  for (unsigned int k=0; k<metric.num_positive_low_rank_factors(); ++k) {
+    Distance projection = CholeskyKernels<Distance>::dot(metric.low_rank_factor(k), cache.data(), D);
+    projection *= projection;
+    acc += projection;
+  }
+
+  return acc;
+}
+
+/**
+ * \brief Squared Mahalanobis distance calculator using a low-rank plus diagonal approximation of the inverse covariance matrix,
+ * with early-out when reaching an upper bound value.
+ *
+ * The squared projections on the negative factors are subtracted first. All the remaining terms are non-negative, so the diagonal part
+ * is then accumulated with the usual bounded map-reduce and the squared projections on the positive factors are added afterwards
+ * in decreasing order of their eigenvalues, checking the bound before each one.
+ *
+ * \param v1 First feature vector.
+ * \param v2 Second feature vector.
+ * \param metric Mahalanobis metric object being used. Must have a low-rank covariance.
+ * \param upper_bound Upper boundary value used for early-out.
+ * \return Squared Mahalanobis distance between the two vectors or the partial result if greater than \a upper_bound.
+ */
+template <typename T, const unsigned int D>
+typename MahalanobisDistanceCalculator<T, D>::Distance MahalanobisDistanceCalculator<T, D>::low_rank_distance(const Vector &v1, const Vector &v2, const Metric &metric, ConstRef_Distance upper_bound) {
+
+  // Constant calculated empirically.
+  const unsigned int D_acc = (unsigned int) (0.4f * D);
+
+  // Map the difference into a separate vector. No reduction operation is performed.
+  typename MahalanobisMetric<T, D>::CacheVector cache;
+  Distance *cache_data = cache.mutable_data();
+  MapReduce<T, D>::run(DifferenceFunctor<T>(), cache_data, v1.data(), v2.data());
+
+  // Subtract the squared projections on the negative low-rank factors. Everything added after them is non-negative.
+  Distance acc = Traits<Distance>::zero();
+  for (unsigned int k=metric.num_positive_low_rank_factors(); k<metric.low_rank(); ++k) {
+    Distance projection = CholeskyKernels<Distance>::dot(metric.low_rank_factor(k), cache.data(), D);
+    projection *= projection;
+    acc -= projection;
+  }
+
+  // Operate over the diagonal part.
+  MapReduce<Distance, D, 0, D_acc>::run(SquaredFirstDotFunctor<Distance>(), acc, cache.data(), metric.low_rank_diagonal());
+  BoundedMapReduce<3, Distance, D, D_acc, D>::run(SquaredFirstDotFunctor<Distance>(), acc, GreaterThanBoundaryFunctor<Distance>(), upper_bound, cache.data(), metric.low_rank_diagonal());
+
+  // Add the squared projections on the positive low-rank factors.
+  for (unsigned int k=0; k<metric.num_positive_low_rank_factors() && !(acc > upper_bound); ++k) {
+    Distance projection = CholeskyKernels<Distance>::dot(metric.low_rank_factor(k), cache.data(), D);
+    projection *= projection;
+    acc += projection;
+  }
+
+  return acc;
+}
+
 } // namespace kche_tree
 
 // Include the SSE specializations if enabled.
@@ -276,6 +276,10 @@ struct MahalanobisColumnFunctorSSE : public SSEFunctor<T> {
 template <typename T, const unsigned int D>
 typename MahalanobisDistanceCalculatorSSE<T, D>::Distance MahalanobisDistanceCalculatorSSE<T, D>::distance(const Vector &v1, const Vector &v2, const Metric &metric) {
 
+  // Use the low-rank approximation if available.
+  if (metric.has_low_rank_covariance())
+    return MahalanobisDistanceCalculator<T, D>::low_rank_distance(v1, v2, metric);
+
   // Access the input data as SSE registers. The required alignment should be automatically provided.
   const unsigned int num_blocks = NumSSEBlocks<T, D>::value;
   const SSERegister<T> *v1_sse = reinterpret_cast<const SSERegister<T> *>(v1.data());
@@ -324,6 +328,10 @@ typename MahalanobisDistanceCalculatorSSE<T, D>::Distance MahalanobisDistanceCal
 template <typename T, const unsigned int D>
 typename MahalanobisDistanceCalculatorSSE<T, D>::Distance MahalanobisDistanceCalculatorSSE<T, D>::distance(const Vector &v1, const Vector &v2, const Metric &metric, ConstRef_Distance upper_bound) {
 
+  // Use the low-rank approximation if available.
+  if (metric.has_low_rank_covariance())
+    return MahalanobisDistanceCalculator<T, D>::low_rank_distance(v1, v2, metric, upper_bound);
+
   // Constant calculated empirically.
   const unsigned int D_acc = (unsigned int) (0.4f * D);
 
@@ -345,6 +353,10 @@ typename MahalanobisDistanceCalculatorSSE<T, D>::Distance MahalanobisDistanceCal
   if (metric.has_diagonal_covariance()) {
     // Check the details below to see why this operation is mathematically safe.
     diagonal_sse->prefetch();
+    if (BoundCheckProfile *profile = metric.bound_check_profile()) {
+      profiled_bounded_map_reduce<D, num_blocks, SSETraits<T>::NumElements, 2>(*profile, MahalanobisDiagonalFunctorSSE<SSERegister<T> >(), acc, GreaterThanBoundaryFunctorSSE<Distance>(), upper_bound, v1_sse, v2_sse, diagonal_sse);
+      return acc.sum();
+    }
     MapReduce<SSERegister<T>, num_blocks, 0, num_blocks_acc>::run(MahalanobisDiagonalFunctorSSE<SSERegister<T> >(), acc, v1_sse, v2_sse, diagonal_sse);
     BoundedMapReduce<3, SSERegister<T>, num_blocks, num_blocks_acc, num_blocks>::run(MahalanobisDiagonalFunctorSSE<SSERegister<T> >(), acc, GreaterThanBoundaryFunctorSSE<Distance>(), upper_bound, v1_sse, v2_sse, diagonal_sse);
     return acc.sum();
@@ -367,6 +379,10 @@ typename MahalanobisDistanceCalculatorSSE<T, D>::Distance MahalanobisDistanceCal
   // since it's the inverse of another positive-definite matrix and therefore, as a positive-definite Hermian matrix, all the elements
   // in its main diagonal will always be positive. This allows BoundedMapReduce to be safely used, as the distance function becames
   // monotonically increasing: a sum of squared differences and positive diagonal values.
+  if (BoundCheckProfile *profile = metric.bound_check_profile()) {
+    profiled_bounded_map_reduce<D, num_blocks, SSETraits<T>::NumElements, 2>(*profile, SquaredFirstDotFunctorSSE<SSERegister<T> >(), acc, GreaterThanBoundaryFunctorSSE<Distance>(), upper_bound, cache_sse, diagonal_sse);
+    return acc.sum();
+  }
   MapReduce<SSERegister<T>, num_blocks, 0, num_blocks_acc>::run(SquaredFirstDotFunctorSSE<SSERegister<T> >(), acc, cache_sse, diagonal_sse);
   BoundedMapReduce<3, SSERegister<T>, num_blocks, num_blocks_acc, num_blocks>::run(SquaredFirstDotFunctorSSE<SSERegister<T> >(), acc, GreaterThanBoundaryFunctorSSE<Distance>(), upper_bound, cache_sse, diagonal_sse);
 
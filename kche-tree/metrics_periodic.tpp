@@ -0,0 +1,166 @@
+/***************************************************************************
+ *   Copyright (C) 2011, 2012 by Leandro Graciá Gil                        *
+ *   leandro.gracia.gil@gmail.com                                          *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/**
+ * \file metrics_periodic.tpp
+ * \brief Template implementations for the periodic Euclidean metric.
+ * \author Leandro Graciá Gil
+ */
+
+// Include the map-reduce metaprograming templates and traits.
+#include "map_reduce.h"
+#include "traits.h"
+#include "utils.h"
+
+namespace kche_tree {
+
+/**
+ * \brief Map-reduce functor to calculate the dot product of the difference between 2 values in a periodic box.
+ *
+ * The box length of each dimension is provided in the extra data. Only the absolute difference or its complement
+ * to the box length are used, so no modulo operation is required as long as both values lie within a box length.
+ * Makes use of the <, -= and *= operators for the \a T type and the += operator for the accumulator type.
+ */
+template <typename T>
+struct PeriodicDifferenceDotFunctor : public MapReduceFunctorConcept<T> {
+
+  /// Auxiliary type for optimized const references.
+  typedef typename RParam<T>::Type ConstRef_T;
+
+  /// Calculate the dot product of the difference of 2 values to the nearest periodic image.
+  /// With a zero box length the complement is the negated difference, which has the same square.
+  template <typename Distance>
+  inline Distance &op(Distance &acc, ConstRef_T a, ConstRef_T b, const Distance &box_length) const {
+    Distance temp = a < b ? Traits<T>::distance(b, a) : Traits<T>::distance(a, b);
+    Distance wrapped = box_length;
+    wrapped -= temp;
+    if (wrapped < temp)
+      temp = wrapped;
+    temp *= temp;
+    return acc += temp;
+  }
+
+  /// Loop-based version of the operation.
+  template <unsigned int D, typename Distance>
+  inline Distance& operator () (unsigned int index, unsigned int block_size, Distance &acc, const T *a, const T *b, const void *extra) const {
+    KCHE_TREE_DCHECK(block_size == 1);
+    return op(acc, a[index], b[index], static_cast<const Distance *>(extra)[index]);
+  }
+
+  /// 'Unrolled' compile-time version of the operation.
+  template <unsigned int Index, unsigned int BlockSize, unsigned int D, typename Distance>
+  inline Distance& operator () (Distance &acc, const T *a, const T *b, const void *extra) const {
+    KCHE_TREE_COMPILE_ASSERT(BlockSize == 1, "Expecting BlockSize == 1");
+    return op(acc, a[Index], b[Index], static_cast<const Distance *>(extra)[Index]);
+  }
+};
+
+/// Create a periodic Euclidean metric object with no periodic dimensions.
+template <typename T, const unsigned int D>
+PeriodicEuclideanMetric<T, D>::PeriodicEuclideanMetric()
+    : bound_check_profile_(NULL) {
+  for (unsigned int d=0; d<D; ++d)
+    box_lengths_[d] = Traits<Distance>::zero();
+}
+
+/**
+ * \brief Create a periodic Euclidean metric object with the same box length in all the dimensions.
+ *
+ * \param box_length Box length of all the dimensions. Negative values are replaced by zero, leaving the dimensions non-periodic.
+ */
+template <typename T, const unsigned int D>
+PeriodicEuclideanMetric<T, D>::PeriodicEuclideanMetric(ConstRef_Distance box_length)
+    : bound_check_profile_(NULL) {
+  for (unsigned int d=0; d<D; ++d)
+    box_lengths_[d] = box_length < Traits<Distance>::zero() ? Traits<Distance>::zero() : box_length;
+}
+
+/**
+ * \brief Create a periodic Euclidean metric object with a box length per dimension.
+ *
+ * \param box_lengths Box length of each dimension. The dimensions are left non-periodic if any of the lengths is negative.
+ */
+template <typename T, const unsigned int D>
+PeriodicEuclideanMetric<T, D>::PeriodicEuclideanMetric(const Distance *box_lengths)
+    : bound_check_profile_(NULL) {
+  for (unsigned int d=0; d<D; ++d)
+    box_lengths_[d] = Traits<Distance>::zero();
+  set_box_lengths(box_lengths);
+}
+
+/**
+ * \brief Set the box length of each dimension.
+ *
+ * \param box_lengths Box length of each dimension, or zero to leave a dimension non-periodic.
+ * \return \c true if successful, \c false if any of the lengths is negative. The previous lengths are kept in this case.
+ */
+template <typename T, const unsigned int D>
+bool PeriodicEuclideanMetric<T, D>::set_box_lengths(const Distance *box_lengths) {
+  for (unsigned int d=0; d<D; ++d) {
+    if (box_lengths[d] < Traits<Distance>::zero())
+      return false;
+  }
+
+  for (unsigned int d=0; d<D; ++d)
+    box_lengths_[d] = box_lengths[d];
+  return true;
+}
+
+/**
+ * \brief Squared Euclidean distance between the nearest periodic images of two D-dimensional feature vectors.
+ *
+ * \param v1 First feature vector.
+ * \param v2 Second feature vector.
+ * \return Squared periodic Euclidean distance between the two vectors.
+ */
+template <typename T, const unsigned int D>
+typename PeriodicEuclideanMetric<T, D>::Distance PeriodicEuclideanMetric<T, D>::operator () (const Vector &v1, const Vector &v2) const {
+  Distance acc = Traits<Distance>::zero();
+  MapReduce<T, D>::run(PeriodicDifferenceDotFunctor<T>(), acc, v1.data(), v2.data(), box_lengths_);
+  return acc;
+}
+
+/**
+ * \brief Squared Euclidean distance between the nearest periodic images of two D-dimensional feature vectors.
+ * Special version with early-out in case an upper bound value is reached.
+ *
+ * \param v1 First feature vector.
+ * \param v2 Second feature vector.
+ * \param upper_bound Upper bound for the distance. Will return immediatly if reached.
+ * \return Squared periodic Euclidean distance between the two vectors or a partial result greater than \a upper_bound.
+ */
+template <typename T, const unsigned int D>
+typename PeriodicEuclideanMetric<T, D>::Distance PeriodicEuclideanMetric<T, D>::operator () (const Vector &v1, const Vector &v2, ConstRef_Distance upper_bound) const {
+
+  Distance acc = Traits<Distance>::zero();
+  if (bound_check_profile_) {
+    profiled_bounded_map_reduce<D, D, 1, 1>(*bound_check_profile_, PeriodicDifferenceDotFunctor<T>(), acc, GreaterThanBoundaryFunctor<Distance>(), upper_bound,
+        v1.data(), v2.data(), box_lengths_);
+    return acc;
+  }
+
+  // Accumulate the first dimensions without any kind of check, as in the Euclidean metric.
+  const unsigned int D_acc = (unsigned int) (0.4f * D);
+  MapReduce<T, D, 0, D_acc>::run(PeriodicDifferenceDotFunctor<T>(), acc, v1.data(), v2.data(), box_lengths_);
+  BoundedMapReduce<4, T, D, D_acc>::run(PeriodicDifferenceDotFunctor<T>(), acc, GreaterThanBoundaryFunctor<Distance>(), upper_bound, v1.data(), v2.data(), box_lengths_);
+  return acc;
+}
+
+} // namespace kche_tree
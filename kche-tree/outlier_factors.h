@@ -0,0 +1,91 @@
+/***************************************************************************
+ *   Copyright (C) 2011, 2012 by Leandro Graciá Gil                        *
+ *   leandro.gracia.gil@gmail.com                                          *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/**
+ * \file outlier_factors.h
+ * \brief Local outlier factors of the vectors of a kd-tree and their neighbourhood distances.
+ * \author Leandro Graciá Gil
+ */
+
+#ifndef _KCHE_TREE_OUTLIER_FACTORS_H_
+#define _KCHE_TREE_OUTLIER_FACTORS_H_
+
+// Include fixed size integer types and STL vectors.
+#include <stdint.h>
+#include <vector>
+
+namespace kche_tree {
+
+/**
+ * \brief Local outlier factors (LOF) of the train vectors of a kd-tree using Euclidean distances.
+ *
+ * The k-distance of a vector is the distance to its K-th nearest neighbour, itself excluded. The reachability distance
+ * from a point to a neighbour is the maximum between their distance and the k-distance of the neighbour, and the local
+ * reachability density of a point is the inverse of the mean reachability distance to its K nearest neighbours. The local
+ * outlier factor of a point is the mean density of its neighbours relative to its own: values close to 1 correspond to
+ * points as dense as their neighbourhood, and values much larger than 1 to outliers.
+ *
+ * Points whose K nearest neighbours are all identical to them have an infinite density. The ratio between two infinite
+ * densities is considered to be 1, and the ratio of a finite density to an infinite one is zero.
+ *
+ * Computed by \link kche_tree::KDTree::local_outlier_factors KDTree::local_outlier_factors\endlink, which keeps the
+ * k-distances and densities of the train vectors so that new points can be scored against them with
+ * \link kche_tree::KDTree::outlier_factor KDTree::outlier_factor\endlink.
+ */
+class LocalOutlierFactors {
+public:
+  // Constructor.
+  LocalOutlierFactors();
+
+  /// Number of neighbours used to calculate the factors. Zero if not computed yet.
+  unsigned int k() const { return k_; }
+
+  /// Number of train vectors with a factor.
+  unsigned int size() const { return static_cast<unsigned int>(scores_.size()); }
+
+  /// Distances to the K-th nearest neighbour of each train vector, indexed as the train set.
+  const std::vector<double> &k_distances() const { return k_distances_; }
+
+  /// Local reachability densities of the train vectors, indexed as the train set.
+  const std::vector<double> &densities() const { return densities_; }
+
+  /// Local outlier factors of the train vectors, indexed as the train set.
+  const std::vector<double> &scores() const { return scores_; }
+
+private:
+  // Kd-trees compute the factors and score new points with them.
+  template <typename, unsigned int, typename> friend class KDTree;
+
+  // Calculation of the factors from the nearest neighbours of the points.
+  double density(const uint32_t *neighbors, const double *distances) const;
+  double score(double density, const uint32_t *neighbors) const;
+
+  unsigned int k_; ///< Number of neighbours used to calculate the factors.
+  std::vector<double> k_distances_; ///< Distance to the K-th nearest neighbour of each train vector, itself excluded.
+  std::vector<double> densities_; ///< Local reachability density of each train vector.
+  std::vector<double> scores_; ///< Local outlier factor of each train vector.
+};
+
+} // namespace kche_tree
+
+// Template implementation.
+#include "outlier_factors.tpp"
+
+#endif
@@ -0,0 +1,73 @@
+/***************************************************************************
+ *   Copyright (C) 2011, 2012 by Leandro Graciá Gil                        *
+ *   leandro.gracia.gil@gmail.com                                          *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/**
+ * \file outlier_factors.tpp
+ * \brief Implementation of the local outlier factors of the vectors of a kd-tree.
+ * \author Leandro Graciá Gil
+ */
+
+// Include STL algorithms and numeric limits.
+#include <algorithm>
+#include <limits>
+
+namespace kche_tree {
+
+/// Create an empty set of factors, not computed yet.
+inline LocalOutlierFactors::LocalOutlierFactors()
+    : k_(0) {}
+
+/**
+ * \brief Calculate the local reachability density of a point from its K nearest train vectors.
+ *
+ * \param neighbors Indices of the K nearest train vectors of the point.
+ * \param distances Euclidean distances from the point to its K nearest train vectors.
+ * \return Inverse of the mean reachability distance from the point to its neighbours. Infinite if all the distances are zero.
+ */
+inline double LocalOutlierFactors::density(const uint32_t *neighbors, const double *distances) const {
+  double sum = 0.0;
+  for (unsigned int i=0; i<k_; ++i)
+    sum += std::max(k_distances_[neighbors[i]], distances[i]);
+
+  return sum > 0.0 ? k_ / sum : std::numeric_limits<double>::infinity();
+}
+
+/**
+ * \brief Calculate the local outlier factor of a point from its density and its K nearest train vectors.
+ *
+ * \param density Local reachability density of the point.
+ * \param neighbors Indices of the K nearest train vectors of the point.
+ * \return Mean ratio between the densities of the neighbours and the density of the point.
+ */
+inline double LocalOutlierFactors::score(double density, const uint32_t *neighbors) const {
+  const double infinity = std::numeric_limits<double>::infinity();
+  double sum = 0.0;
+  for (unsigned int i=0; i<k_; ++i) {
+    const double neighbor_density = densities_[neighbors[i]];
+    if (density == infinity)
+      sum += neighbor_density == infinity ? 1.0 : 0.0;
+    else
+      sum += neighbor_density / density;
+  }
+
+  return sum / k_;
+}
+
+} // namespace kche_tree
@@ -0,0 +1,90 @@
+/***************************************************************************
+ *   Copyright (C) 2011, 2012 by Leandro Graciá Gil                        *
+ *   leandro.gracia.gil@gmail.com                                          *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/**
+ * \file prepared_query.h
+ * \brief Template definitions for the per-query state precalculated by metrics.
+ * \author Leandro Graciá Gil
+ */
+
+#ifndef _KCHE_TREE_PREPARED_QUERY_H_
+#define _KCHE_TREE_PREPARED_QUERY_H_
+
+#include "dot_products.h"
+#include "traits.h"
+#include "utils.h"
+#include "vector.h"
+
+namespace kche_tree {
+
+/**
+ * \brief Query of a search prepared for the distance calculations of a metric.
+ *
+ * Searches create one object for each query and calculate all the distances from the query through it, so any work
+ * depending only on the query and the metric is done once per query instead of once per distance. Incremental updaters
+ * can also access it through the search data. This generic version keeps the squared norm of the query when distances
+ * are expanded in terms of dot products, and forwards any other distance to the metric.
+ *
+ * This is an optional part of the metric concept: specialize it for any metric with work that can be precalculated
+ * from the query, such as a transformed or padded copy of it. Specializations must provide the same public interface.
+ *
+ * \tparam Metric Metric used to calculate the distances.
+ */
+template <typename Metric>
+class PreparedQuery {
+public:
+  /// Type of the elements to which the metric is applied.
+  typedef typename Metric::Element Element;
+
+  /// Number of dimensions to which the metric is applied.
+  static const unsigned int Dimensions = Metric::Dimensions;
+
+  /// Distance type associated with the elements.
+  typedef typename Traits<Element>::Distance Distance;
+
+  /// Use optimized const reference type for distance.
+  typedef typename RParam<Distance>::Type ConstRef_Distance;
+
+  /// Alias for the compatible feature vectors.
+  typedef typename kche_tree::Vector<Element, Dimensions> Vector;
+
+  // Constructor.
+  PreparedQuery(const Vector &p, const Metric &metric);
+
+  const Vector &vector() const { return p_; } ///< Query vector as provided.
+  ConstRef_Distance squared_norm() const { return squared_norm_; } ///< Squared norm of the query. Only valid if distances can be expanded in dot products.
+
+  // Distances from the query to a feature vector.
+  inline Distance distance(const Vector &v) const;
+  inline Distance distance(const Vector &v, ConstRef_Distance upper_bound) const;
+  inline Distance distance_with_norms(const Vector &v, ConstRef_Distance v_squared_norm) const;
+
+private:
+  const Vector &p_; ///< Query vector.
+  const Metric &metric_; ///< Metric used to calculate the distances.
+  Distance squared_norm_; ///< Squared norm of the query, if distances can be expanded in dot products.
+};
+
+} // namespace kche_tree
+
+// Template implementation.
+#include "prepared_query.tpp"
+
+#endif
@@ -0,0 +1,85 @@
+/***************************************************************************
+ *   Copyright (C) 2011, 2012 by Leandro Graciá Gil                        *
+ *   leandro.gracia.gil@gmail.com                                          *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/**
+ * \file prepared_query.tpp
+ * \brief Template implementation of the per-query state precalculated by metrics.
+ * \author Leandro Graciá Gil
+ */
+
+namespace kche_tree {
+
+// Static data.
+template <typename M>
+const unsigned int PreparedQuery<M>::Dimensions;
+
+/**
+ * \brief Prepare a query for the distance calculations of a metric.
+ *
+ * \param p Query vector. Must outlive the prepared query.
+ * \param metric Metric used to calculate the distances. Must outlive the prepared query.
+ */
+template <typename M>
+PreparedQuery<M>::PreparedQuery(const Vector &p, const M &metric)
+  : p_(p),
+    metric_(metric),
+    squared_norm_(Traits<Distance>::zero()) {
+
+  if (DotProductDistance<Element, Dimensions, M>::enabled)
+    squared_norm_ = DotProductDistance<Element, Dimensions, M>::squared_norm(p);
+}
+
+/**
+ * \brief Calculate the distance from the query to a feature vector.
+ *
+ * \param v Feature vector.
+ * \return Distance between the query and \a v.
+ */
+template <typename M>
+typename PreparedQuery<M>::Distance PreparedQuery<M>::distance(const Vector &v) const {
+  return metric_(p_, v);
+}
+
+/**
+ * \brief Calculate the distance from the query to a feature vector with an upper bound.
+ *
+ * \param v Feature vector.
+ * \param upper_bound Upper bound for the distance.
+ * \return Distance between the query and \a v, or a partial result greater than \a upper_bound.
+ */
+template <typename M>
+typename PreparedQuery<M>::Distance PreparedQuery<M>::distance(const Vector &v, ConstRef_Distance upper_bound) const {
+  return metric_(p_, v, upper_bound);
+}
+
+/**
+ * \brief Calculate the distance from the query to a feature vector expanded in terms of their squared norms and dot product.
+ * Distances are calculated by the metric if it does not support it.
+ *
+ * \param v Feature vector.
+ * \param v_squared_norm Squared norm of \a v.
+ * \return Distance between the query and \a v.
+ */
+template <typename M>
+typename PreparedQuery<M>::Distance PreparedQuery<M>::distance_with_norms(const Vector &v, ConstRef_Distance v_squared_norm) const {
+  return DotProductDistance<Element, Dimensions, M>::distance(metric_, p_, squared_norm_, v, v_squared_norm);
+}
+
+} // namespace kche_tree
@@ -0,0 +1,47 @@
+/***************************************************************************
+ *   Copyright (C) 2011, 2012 by Leandro Graciá Gil                        *
+ *   leandro.gracia.gil@gmail.com                                          *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/**
+ * \file search_engine.h
+ * \brief Selection of the engine used to process batches of queries.
+ * \author Leandro Graciá Gil
+ */
+
+#ifndef _KCHE_TREE_SEARCH_ENGINE_H_
+#define _KCHE_TREE_SEARCH_ENGINE_H_
+
+namespace kche_tree {
+
+/// Engines available to process the queries of a batch search.
+struct SearchEngine {
+
+  /// Enumeration type for the search engines.
+  enum Type {
+    Sequential = 0, ///< Search each query independently, one after another. Same as calling the single-query methods in a loop.
+    Interleaved,    ///< Advance several queries at once, switching between them while the memory of their next nodes is prefetched.
+    Packet,         ///< Traverse the tree with packets of nearby queries, sharing the node and bucket loads among them.
+    BruteForce,     ///< Compare every query with every point using a blocked exhaustive search. Does not use the tree.
+    Automatic       ///< Choose between the interleaved engine and brute force using the sizes of the problem and calibration measurements.
+  };
+};
+
+} // namespace kche_tree
+
+#endif
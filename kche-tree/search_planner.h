@@ -0,0 +1,128 @@
+/***************************************************************************
+ *   Copyright (C) 2011, 2012 by Leandro Graciá Gil                        *
+ *   leandro.gracia.gil@gmail.com                                          *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/**
+ * \file search_planner.h
+ * \brief Selection between kd-tree and brute-force search for batches of queries.
+ * \author Leandro Graciá Gil
+ */
+
+#ifndef _KCHE_TREE_SEARCH_PLANNER_H_
+#define _KCHE_TREE_SEARCH_PLANNER_H_
+
+// Include STL min and max.
+#include <algorithm>
+
+#include "search_engine.h"
+
+namespace kche_tree {
+
+/**
+ * \brief Choose between the kd-tree and a brute-force search to process a batch of queries.
+ *
+ * With few points, very high dimensions or a large K a kd-tree cannot discard enough regions of the space and
+ * a blocked brute-force search is faster. Trivial cases are decided from the sizes of the problem. Otherwise
+ * the planner requires calibration data: the time to search a sample of the batch with the kd-tree and the time
+ * to search the same sample by brute force against a subset of the points. The costs of the rest of the batch
+ * are extrapolated from them.
+ */
+class SearchPlanner {
+public:
+  static const unsigned int min_tree_points = 64; ///< Number of points below which brute force is always used.
+  static const unsigned int calibration_queries = 16; ///< Maximum number of queries used to calibrate the search costs.
+  static const unsigned int calibration_work = 1 << 20; ///< Maximum number of elements compared per query when calibrating brute force.
+
+  /**
+   * \brief Prepare the plan of a batch search.
+   *
+   * \param num_points Number of points in the kd-tree.
+   * \param num_dimensions Number of dimensions of the feature vectors.
+   * \param K Number of neighbours to retrieve for each query.
+   * \param num_queries Number of queries in the batch.
+   * \param tree_engine Engine used if the kd-tree is chosen.
+   */
+  SearchPlanner(unsigned int num_points, unsigned int num_dimensions, unsigned int K, unsigned int num_queries, SearchEngine::Type tree_engine)
+    : num_points_(num_points),
+      num_dimensions_(num_dimensions),
+      num_queries_(num_queries),
+      engine_(tree_engine),
+      decided_(true),
+      tree_time_(0.0),
+      brute_force_time_(0.0) {
+
+    // The kd-tree would need to visit every point anyway.
+    if (num_points <= K || num_points <= min_tree_points)
+      engine_ = SearchEngine::BruteForce;
+
+    // Calibrate only if the batch has enough queries to amortize it. Otherwise use the kd-tree.
+    else if (num_queries > 2 * calibration_queries)
+      decided_ = false;
+  }
+
+  /// Check if the engine was decided without calibration.
+  bool decided() const { return decided_; }
+
+  /// Number of queries from the start of the batch used to calibrate the search costs.
+  unsigned int num_calibration_queries() const { return num_queries_ < calibration_queries ? num_queries_ : calibration_queries; }
+
+  /// Number of points from the start of the data set used to calibrate the brute-force search.
+  unsigned int num_calibration_points() const { return std::min(num_points_, std::max(calibration_work / num_dimensions_, 1U)); }
+
+  /**
+   * \brief Provide the measured calibration times and choose the engine.
+   *
+   * \param tree_time Time spent searching the calibration queries with the kd-tree.
+   * \param brute_force_time Time spent searching the calibration queries by brute force against the calibration points.
+   */
+  void calibrate(double tree_time, double brute_force_time) {
+    tree_time_ = tree_time;
+    brute_force_time_ = brute_force_time;
+    if (estimated_brute_force_time() < estimated_tree_time())
+      engine_ = SearchEngine::BruteForce;
+    decided_ = true;
+  }
+
+  /// Engine chosen to search the batch.
+  SearchEngine::Type engine() const { return engine_; }
+
+  /// Estimated time to search the rest of the batch with the kd-tree.
+  double estimated_tree_time() const { return tree_time_ * remaining_queries() / num_calibration_queries(); }
+
+  /// Estimated time to search the rest of the batch by brute force.
+  double estimated_brute_force_time() const {
+    return brute_force_time_ * remaining_queries() / num_calibration_queries() * num_points_ / num_calibration_points();
+  }
+
+private:
+  /// Number of queries of the batch not used for calibration.
+  unsigned int remaining_queries() const { return num_queries_ - num_calibration_queries(); }
+
+  unsigned int num_points_; ///< Number of points in the kd-tree.
+  unsigned int num_dimensions_; ///< Number of dimensions of the feature vectors.
+  unsigned int num_queries_; ///< Number of queries in the batch.
+  SearchEngine::Type engine_; ///< Engine chosen to search the batch.
+  bool decided_; ///< Indicates if the engine has been decided.
+  double tree_time_; ///< Time spent searching the calibration queries with the kd-tree.
+  double brute_force_time_; ///< Time spent searching the calibration queries by brute force.
+};
+
+} // namespace kche_tree
+
+#endif
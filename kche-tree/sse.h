@@ -108,6 +108,11 @@ struct SSETraits<float> {
   static inline Register mult(const Register &a, const Register &b) {
     return _mm_mul_ps(a, b);
   }
+
+  /// Return a register loaded from a possibly unaligned address.
+  static inline Register load_unaligned(const float *address) {
+    return _mm_loadu_ps(address);
+  }
 };
 
 /**
@@ -66,6 +66,11 @@ struct SSETraits<double> {
   static inline Register mult(const Register &a, const Register &b) {
     return _mm_mul_pd(a, b);
   }
+
+  /// Return a register loaded from a possibly unaligned address.
+  static inline Register load_unaligned(const double *address) {
+    return _mm_loadu_pd(address);
+  }
 };
 
 } // namespace kche_tree
@@ -32,6 +32,9 @@
 
 namespace kche_tree {
 
+// Forward declarations.
+template <typename U> class CholeskyDecomposition;
+
 /**
  * \brief Symmetric matrix container of the specified size. Stores (n² + n) / 2 elements.
  *
@@ -52,7 +55,7 @@ namespace kche_tree {
  *
  * diagonal: (0,0), (1,1), (2,2), (3,3), (4,4)
  *
- * \tparam U Data type of the elements in the matrix. Requires the -=, *=, /=, *= float scaling operators and the zero, one, negate and invert traits.
+ * \tparam U Data type of the elements in the matrix. Requires the +=, -=, *=, /=, *= float scaling and > operators and the zero, one, negate and invert traits.
  * \note The type \a U corresponds to the Distance type for the elements in the kd-tree, not to the elements themselves.
  */
 template <typename U>
@@ -81,6 +84,11 @@ public:
 
   // Matrix operations.
   bool invert();
+  bool invert_ldl();
+  void scale(float factor);
+  void multiply(const U *vector, U *result) const;
+  void rank_one_update(const U *vector, const U &weight);
+  bool inverse_rank_one_update(const U *vector, float weight);
 
 private:
   /// Internal method to access the matrix contents.
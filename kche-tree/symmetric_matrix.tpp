@@ -24,7 +24,11 @@
  * \author Leandro Graciá Gil
  */
 
-// Include traits.
+// Include STL vectors.
+#include <vector>
+
+// Include the Cholesky decomposition and traits.
+#include "cholesky.h"
 #include "traits.h"
 
 namespace kche_tree {
@@ -140,6 +144,28 @@ const U &SymmetricMatrix<U>::operator () (unsigned int row, unsigned int column)
     return column_[column][row];
 }
 
+/**
+ * \brief Invert the matrix.
+ *
+ * Positive definite matrices, such as covariance matrices, are inverted using their
+ * \link kche_tree::CholeskyDecomposition Cholesky decomposition\endlink if available for the element type.
+ * Any other matrices are inverted with \link invert_ldl invert_ldl\endlink.
+ * \note Matrix contents won't be updated if the matrix is not invertible.
+ *
+ * \return \c true if successfully inverted, \c false if not invertible.
+ */
+template <typename U>
+bool SymmetricMatrix<U>::invert() {
+
+  CholeskyDecomposition<U> cholesky;
+  if (size_ != 0 && cholesky.decompose(*this)) {
+    cholesky.invert(*this);
+    return true;
+  }
+
+  return invert_ldl();
+}
+
 /**
  * \brief Invert the matrix using LDL' decomposition optimized for symmetric matrices.
  *
@@ -149,7 +175,7 @@ const U &SymmetricMatrix<U>::operator () (unsigned int row, unsigned int column)
  * \return \c true if successfully inverted, \c false if not invertible.
  */
 template <typename U>
-bool SymmetricMatrix<U>::invert() {
+bool SymmetricMatrix<U>::invert_ldl() {
 
   // Check empty matrices.
   if (size_ == 0)
@@ -228,4 +254,122 @@ bool SymmetricMatrix<U>::invert() {
   return true;
 }
 
+/**
+ * \brief Multiply all the elements of the matrix by a scalar factor.
+ *
+ * \param factor Factor to multiply the matrix by.
+ */
+template <typename U>
+void SymmetricMatrix<U>::scale(float factor) {
+  for (unsigned int j=0; j<size_; ++j) {
+    U *column = column_[j].get();
+    for (unsigned int i=0; i<j; ++i)
+      column[i] *= factor;
+    diagonal_[j] *= factor;
+  }
+}
+
+/**
+ * \brief Multiply the matrix by a vector.
+ *
+ * \param vector Array of \link size size()\endlink values to multiply.
+ * \param result Array of \link size size()\endlink values where the product is returned. Must not overlap with \a vector.
+ */
+template <typename U>
+void SymmetricMatrix<U>::multiply(const U *vector, U *result) const {
+
+  for (unsigned int j=0; j<size_; ++j) {
+    result[j] = diagonal_[j];
+    result[j] *= vector[j];
+  }
+
+  // Each stored column contributes to its own row and, by symmetry, to the rows above the diagonal.
+  for (unsigned int j=1; j<size_; ++j) {
+    const U *column = column_[j].get();
+    const U vj = vector[j];
+    U acc = Traits<U>::zero();
+    for (unsigned int i=0; i<j; ++i) {
+      U temp = column[i];
+      temp *= vector[i];
+      acc += temp;
+
+      temp = column[i];
+      temp *= vj;
+      result[i] += temp;
+    }
+    result[j] += acc;
+  }
+}
+
+/**
+ * \brief Add to the matrix a scaled outer product of a vector with itself, that is M + weight * v * v'.
+ *
+ * \param vector Array of \link size size()\endlink values defining the outer product.
+ * \param weight Factor applied to the outer product.
+ */
+template <typename U>
+void SymmetricMatrix<U>::rank_one_update(const U *vector, const U &weight) {
+  for (unsigned int j=0; j<size_; ++j) {
+    U weighted = vector[j];
+    weighted *= weight;
+
+    U *column = column_[j].get();
+    for (unsigned int i=0; i<j; ++i) {
+      U temp = vector[i];
+      temp *= weighted;
+      column[i] += temp;
+    }
+
+    weighted *= vector[j];
+    diagonal_[j] += weighted;
+  }
+}
+
+/**
+ * \brief Update the matrix as the inverse of a rank-one modification of its own inverse.
+ *
+ * If the matrix is the inverse of a matrix A, replaces it with the inverse of A + weight * v * v' using
+ * the Sherman-Morrison formula. This requires O(n²) operations instead of the O(n³) required to invert the matrix again.
+ * The update is rejected if the result would not be positive definite assuming that the current matrix is.
+ * \note Errors accumulate with each update. Inverting the updated matrix again from time to time is recommended.
+ * \note Matrix contents won't be updated if the update is rejected.
+ *
+ * \param vector Array of \link size size()\endlink values defining the rank-one modification.
+ * \param weight Factor applied to the outer product of the vector. Negative values remove the outer product.
+ * \return \c true if successfully updated, \c false if the result would not be positive definite.
+ */
+template <typename U>
+bool SymmetricMatrix<U>::inverse_rank_one_update(const U *vector, float weight) {
+
+  if (size_ == 0)
+    return true;
+
+  // Calculate inv(A) * v and the quadratic form v' * inv(A) * v.
+  std::vector<U> product(size_);
+  multiply(vector, &product[0]);
+
+  U quadratic_form = Traits<U>::zero();
+  for (unsigned int i=0; i<size_; ++i) {
+    U temp = vector[i];
+    temp *= product[i];
+    quadratic_form += temp;
+  }
+
+  // Check that the denominator 1 + weight * v' * inv(A) * v keeps the result positive definite.
+  U denominator = quadratic_form;
+  denominator *= weight;
+  denominator += Traits<U>::one();
+  if (!(denominator > Traits<U>::zero()))
+    return false;
+
+  // Apply inv(A) - weight / (1 + weight * v' * inv(A) * v) * (inv(A) * v) * (inv(A) * v)'.
+  U coefficient = denominator;
+  Traits<U>::invert(coefficient);
+  coefficient *= weight;
+  Traits<U>::negate(coefficient);
+  rank_one_update(&product[0], coefficient);
+
+  return true;
+}
+
 } // namespace kche_tree
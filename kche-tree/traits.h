@@ -127,7 +127,7 @@ struct NumericTraits<T, false> {
   /// Returns the distance between two given elements. Should be redefined for custom types.
   static Distance distance(typename RParam<T>::Type a, typename RParam<T>::Type b);
 
-  /// Return the mean value from an array of elements. Needs to be defined for custom types that use set_inverse_covariance(DataSet) method of the Mahalanobis metric object.
+  /// Return the mean value from an array of elements. Not required by the library, as covariance estimations only use distances between elements.
   template <typename BidirectionalElementIterator>
   static T mean(const BidirectionalElementIterator &begin, const BidirectionalElementIterator &end);
 };
@@ -153,6 +153,18 @@ unsigned int next_multiple_of_pot(unsigned int m, unsigned int n) {
   return (n + (m - 1)) & ~(m - 1);
 }
 
+/// Size in bytes assumed for the cache lines when prefetching ranges of memory.
+static const unsigned int cache_line_size = 64;
+
+/// Hint the processor to load the cache line containing an address. Does nothing if not supported by the compiler.
+inline void prefetch(const void *address) {
+#if defined(__GNUC__)
+  __builtin_prefetch(address);
+#else
+  (void) address;
+#endif
+}
+
 } // namespace kche_tree
 
 #endif
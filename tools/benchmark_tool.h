@@ -69,6 +69,12 @@ public:
 private:
   // Command-line option validation.
   bool validate_options() const;
+
+  // Result reporting.
+  void print_build_report(const kche_tree::BuildReport &report) const;
+
+  // Additional benchmarks.
+  void benchmark_inversion(unsigned int size) const;
 };
 
 // Template implementation.
@@ -25,6 +25,8 @@
  */
 
 // C Standard Library and C++ STL includes.
+#include <algorithm>
+#include <cmath>
 #include <ctime>
 #include <iostream>
 #include <iomanip>
@@ -67,6 +69,11 @@ bool BenchmarkTool<T, D, L>::validate_options() const {
     return false;
   }
 
+  if (this->options_->benchmark_inversion_given && this->options_->benchmark_inversion_arg <= 0) {
+    std::cerr << "Invalid matrix size for the inversion benchmark." << std::endl;
+    return false;
+  }
+
   return true;
 }
 
@@ -86,21 +93,54 @@ bool BenchmarkTool<T, D, L>::run(const Metric &metric) {
   if (!this->is_ready())
     return false;
 
+  // Search with a copy of the metric using a calibrated boundary check profile if requested.
+  if (this->options_->calibrate_bound_checks_flag && !metric.bound_check_profile()) {
+    kche_tree::BoundCheckProfile profile;
+    Metric calibrated_metric(metric);
+    calibrated_metric.set_bound_check_profile(&profile);
+    return run(calibrated_metric);
+  }
+
+  // Benchmark the inversion of symmetric matrices if requested.
+  if (this->options_->benchmark_inversion_given)
+    benchmark_inversion(this->options_->benchmark_inversion_arg);
+
   // Use the kche_tree namespace locally for simplicity.
   using namespace kche_tree;
 
   // Type aliases.
   typedef kche_tree::KDTree<T, D, L> KDTree;
 
-  // Build the kd-tree.
+  // Build the kd-tree, timing each of its phases if requested.
+  BuildReport build_report;
   clock_t t1_build = clock();
   KDTree kdtree;
-  kdtree.build(this->train_set_, this->options_->bucket_size_arg);
+  kdtree.build(this->train_set_, this->build_options(metric), this->options_->build_report_flag ? &build_report : NULL);
   clock_t t2_build = clock();
 
-  // Process each test case.
+  // Calibrate the boundary checks of the metric. Not included in the build or test times.
+  if (metric.bound_check_profile())
+    this->calibrate_bound_checks(kdtree, metric);
+
+  // Keep the results only if they are going to be evaluated against the ground truth.
+  std::vector<typename KDTree::KNeighbors> results(this->has_ground_truth() ? this->test_set_.size() : 0);
+
+  // Process the whole test set at once if a batch engine was requested.
   clock_t t1_test = clock();
-  for (unsigned int i=0; i < this->test_set_.size(); ++i) {
+  SearchEngine::Type engine;
+  if (this->options_->batch_engine_given && this->parse_search_engine(this->options_->batch_engine_arg, engine)) {
+    std::vector<typename KDTree::KNeighbors> batch_results;
+    if (this->options_->use_k_heap_flag)
+      kdtree.template batch_knn<KHeap>(this->test_set_, this->options_->knn_arg, batch_results, metric, this->options_->epsilon_arg, this->options_->ignore_existing_flag, engine);
+    else
+      kdtree.template batch_knn<KVector>(this->test_set_, this->options_->knn_arg, batch_results, metric, this->options_->epsilon_arg, this->options_->ignore_existing_flag, engine);
+
+    if (!results.empty())
+      results.swap(batch_results);
+  }
+
+  // Process each test case.
+  for (unsigned int i=0; i < this->test_set_.size() && !this->options_->batch_engine_given; ++i) {
 
     // Get the K nearest neighbours.
     std::vector<typename KDTree::Neighbor> knn;
@@ -108,6 +148,9 @@ bool BenchmarkTool<T, D, L>::run(const Metric &metric) {
       kdtree.template knn<KHeap>(this->test_set_[i], this->options_->knn_arg, knn, metric, this->options_->epsilon_arg, this->options_->ignore_existing_flag);
     else
       kdtree.template knn<KVector>(this->test_set_[i], this->options_->knn_arg, knn, metric, this->options_->epsilon_arg, this->options_->ignore_existing_flag);
+
+    if (!results.empty())
+      results[i].swap(knn);
   }
   clock_t t2_test = clock();
 
@@ -124,9 +167,117 @@ bool BenchmarkTool<T, D, L>::run(const Metric &metric) {
       << " neighbours, epsilon " << std::setprecision(2) << this->options_->epsilon_arg
       << ", training set size " << this->train_set_.size() << ", test set size " << this->test_set_.size() << std::endl;
   std::cout << "Build time: " << std::setprecision(3) << time_build << " sec (" << std::setprecision(2) << build_percent << "%)" << std::endl;
+  if (this->options_->build_report_flag)
+    print_build_report(build_report);
   std::cout << "Test  time: " << std::setprecision(3) << time_test  << " sec (" << std::setprecision(2) << test_percent  << "%) -- average per test: "
       << std::setprecision(4) << test_average << " sec" << std::endl;
   std::cout << "Total time: " << std::setprecision(3) << (time_build + time_test) << " sec" << std::endl;
 
+  // Report the recall with respect to the ground truth.
+  if (!results.empty()) {
+    double recall = 0.0;
+    for (unsigned int i=0; i < this->test_set_.size(); ++i)
+      recall += this->recall(i, results[i], this->options_->knn_arg);
+    std::cout << "Recall@" << this->options_->knn_arg << ": " << std::setprecision(4) << recall / this->test_set_.size() << std::endl;
+  }
+
   return true;
 }
+
+/**
+ * \brief Print the per-phase breakdown of the kd-tree build time.
+ *
+ * \param report Build report filled while building the kd-tree.
+ */
+template <typename T, unsigned int D, typename L>
+void BenchmarkTool<T, D, L>::print_build_report(const BuildReport &report) const {
+
+  double total = report.total_time > 0.0 ? report.total_time : 1.0;
+  std::cout << "  Dimension order:  " << std::setprecision(3) << report.dimension_order_time << " sec ("
+      << std::setprecision(2) << 100.0 * report.dimension_order_time / total << "%)" << std::endl;
+  std::cout << "  Duplicates:       " << std::setprecision(3) << report.duplicates_time << " sec ("
+      << std::setprecision(2) << 100.0 * report.duplicates_time / total << "%)" << std::endl;
+  std::cout << "  Permutation init: " << std::setprecision(3) << report.permutation_time << " sec ("
+      << std::setprecision(2) << 100.0 * report.permutation_time / total << "%)" << std::endl;
+  std::cout << "  Split and sort:   " << std::setprecision(3) << report.split_time << " sec ("
+      << std::setprecision(2) << 100.0 * report.split_time / total << "%)" << std::endl;
+  std::cout << "  Node allocation:  " << std::setprecision(3) << report.allocation_time << " sec ("
+      << std::setprecision(2) << 100.0 * report.allocation_time / total << "%) -- "
+      << report.num_branches << " branches, " << report.num_leaves << " leaves" << std::endl;
+  std::cout << "  Other recursion:  " << std::setprecision(3) << report.other_recursion_time() << " sec ("
+      << std::setprecision(2) << 100.0 * report.other_recursion_time() / total << "%)" << std::endl;
+  std::cout << "  Permuted copy:    " << std::setprecision(3) << report.data_copy_time << " sec ("
+      << std::setprecision(2) << 100.0 * report.data_copy_time / total << "%)" << std::endl;
+  std::cout << "  Squared norms:    " << std::setprecision(3) << report.squared_norms_time << " sec ("
+      << std::setprecision(2) << 100.0 * report.squared_norms_time / total << "%)" << std::endl;
+  std::cout << "  Label summaries:  " << std::setprecision(3) << report.summaries_time << " sec ("
+      << std::setprecision(2) << 100.0 * report.summaries_time / total << "%)" << std::endl;
+}
+
+/**
+ * \brief Measure the time to invert a symmetric positive-definite matrix with the Cholesky and LDL' decompositions.
+ *
+ * Uses the Kac-Murdock-Szegő matrix with elements 0.5^|i - j|, which is positive-definite and well conditioned for any size.
+ * The accuracy of each inverse is reported as the largest error of A * inv(A) with respect to the identity in a sample of rows.
+ *
+ * \param size Size of the matrix to invert.
+ */
+template <typename T, unsigned int D, typename L>
+void BenchmarkTool<T, D, L>::benchmark_inversion(unsigned int size) const {
+
+  using namespace kche_tree;
+  typedef typename Traits<T>::Distance Distance;
+
+  std::vector<Distance> powers(size, Traits<Distance>::one());
+  for (unsigned int i=1; i<size; ++i) {
+    powers[i] = powers[i - 1];
+    powers[i] *= 0.5f;
+  }
+
+  SymmetricMatrix<Distance> matrix(size, false);
+  for (unsigned int j=0; j<size; ++j) {
+    for (unsigned int i=0; i<=j; ++i)
+      matrix(j, i) = powers[j - i];
+  }
+
+  SymmetricMatrix<Distance> cholesky_inverse(matrix), ldl_inverse(matrix);
+  clock_t t1 = clock();
+  bool cholesky_ok = cholesky_inverse.invert();
+  clock_t t2 = clock();
+  bool ldl_ok = ldl_inverse.invert_ldl();
+  clock_t t3 = clock();
+
+  // Check the results in a sample of rows.
+  double cholesky_error = 0.0, ldl_error = 0.0;
+  const unsigned int row_step = std::max(1u, size / 16);
+  for (unsigned int row=0; row<size; row += row_step) {
+    for (unsigned int column=0; column<size; ++column) {
+      double cholesky_value = 0.0, ldl_value = 0.0;
+      for (unsigned int k=0; k<size; ++k) {
+        cholesky_value += static_cast<double>(matrix(row, k)) * static_cast<double>(cholesky_inverse(k, column));
+        ldl_value += static_cast<double>(matrix(row, k)) * static_cast<double>(ldl_inverse(k, column));
+      }
+
+      double expected = row == column ? 1.0 : 0.0;
+      cholesky_error = std::max(cholesky_error, std::fabs(cholesky_value - expected));
+      ldl_error = std::max(ldl_error, std::fabs(ldl_value - expected));
+    }
+  }
+
+  double cholesky_time = (t2 - t1) / static_cast<double>(CLOCKS_PER_SEC);
+  double ldl_time = (t3 - t2) / static_cast<double>(CLOCKS_PER_SEC);
+  std::cout << std::fixed << "Inversion of a " << size << "x" << size << " matrix:" << std::endl;
+  std::cout << "  Cholesky: " << std::setprecision(3) << cholesky_time << " sec";
+  if (cholesky_ok)
+    std::cout << ", max error " << std::scientific << std::setprecision(2) << cholesky_error << std::fixed;
+  else
+    std::cout << ", failed";
+  std::cout << std::endl;
+
+  std::cout << "  LDL':     " << std::setprecision(3) << ldl_time << " sec";
+  if (ldl_ok)
+    std::cout << ", max error " << std::scientific << std::setprecision(2) << ldl_error << std::fixed;
+  else
+    std::cout << ", failed";
+  std::cout << std::endl;
+}
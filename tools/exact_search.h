@@ -0,0 +1,118 @@
+/***************************************************************************
+ *   Copyright (C) 2011, 2012 by Leandro Graciá Gil                        *
+ *   leandro.gracia.gil@gmail.com                                          *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/**
+ * \file exact_search.h
+ * \brief Exhaustive search of the nearest neighbours used as reference by the verification tools.
+ * \author Leandro Graciá Gil
+ */
+
+#ifndef _EXACT_SEARCH_H_
+#define _EXACT_SEARCH_H_
+
+// C Standard Library and C++ STL includes.
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Include the kche-tree library.
+#include "kche-tree/kche-tree.h"
+
+/**
+ * \brief Exhaustive all-to-all search of the K nearest neighbours and the number of neighbours within a range.
+ *
+ * Test vectors are processed in tiles against blocks of the train set small enough to stay in cache,
+ * keeping only the best candidates of each test vector by partial sorting. Tiles are processed in
+ * parallel if OpenMP is enabled.
+ *
+ * Results can be cached in a directory, keyed by a hash of the data sets, the search settings, and the type and parameters of the metric,
+ * so that they can be reused across runs with the same settings.
+ *
+ * \tparam ElementType Type of the elements in the data sets.
+ * \tparam NumDimensions Number of dimensions of the feature vectors.
+ * \tparam LabelType Type of the labels in the data sets.
+ */
+template <typename ElementType, unsigned int NumDimensions, typename LabelType>
+class ExactSearch {
+public:
+  /// Type of the elements in the data sets.
+  typedef ElementType Element;
+
+  /// Number of dimensions of the feature vectors.
+  static unsigned const int Dimensions = NumDimensions;
+
+  /// Corresponding kd-tree type.
+  typedef kche_tree::KDTree<Element, Dimensions, LabelType> KDTree;
+
+  /// Corresponding data set type.
+  typedef typename KDTree::DataSet DataSet;
+
+  /// Type of the distances between feature vectors.
+  typedef typename KDTree::Distance Distance;
+
+  /// Type of the neighbour results.
+  typedef typename KDTree::Neighbor Neighbor;
+
+  // Constructor.
+  ExactSearch(const DataSet &train_set, const DataSet &test_set, unsigned int K, const Distance &squared_range, bool ignore_existing);
+
+  // Search the results, loading or saving them in the cache directory if provided.
+  template <typename Metric>
+  void run(const Metric &metric, const char *cache_directory = NULL);
+
+  // Access to the results.
+  unsigned int num_neighbours(unsigned int test_index) const { return num_neighbours_[test_index]; } ///< Number of nearest neighbours found for a test vector.
+  const Neighbor &neighbour(unsigned int test_index, unsigned int k) const { return neighbours_[test_index * K_ + k]; } ///< Get the k-th nearest neighbour of a test vector.
+  unsigned int num_in_range(unsigned int test_index) const { return num_in_range_[test_index]; } ///< Number of train vectors within the range of a test vector.
+  unsigned int num_precision_warnings() const { return num_precision_warnings_; } ///< Number of vector pairs whose distance was inconsistent with their equality.
+  bool loaded_from_cache() const { return loaded_from_cache_; } ///< Check if the results were loaded from the cache.
+
+private:
+  // Search and caching.
+  template <typename Metric>
+  void search(const Metric &metric);
+
+  template <typename Metric>
+  uint64_t hash(const Metric &metric) const;
+
+  bool load(const std::string &filename, uint64_t key);
+  bool save(const std::string &filename, uint64_t key) const;
+
+  static const unsigned int tile_size = 8; ///< Number of test vectors processed together.
+  static const unsigned int block_size = 256; ///< Number of train vectors processed at a time by each tile.
+  static const uint32_t cache_version = 1; ///< Version of the cache file format.
+
+  const DataSet &train_set_; ///< Train set where neighbours are searched.
+  const DataSet &test_set_; ///< Test set whose neighbours are searched.
+  unsigned int K_; ///< Number of nearest neighbours to search.
+  Distance squared_range_; ///< Squared distance used to count the neighbours within a range.
+  bool ignore_existing_; ///< Ignore train vectors at zero distance from the test vector.
+
+  std::vector<Neighbor> neighbours_; ///< K nearest neighbours of each test vector sorted by distance.
+  std::vector<unsigned int> num_neighbours_; ///< Number of valid nearest neighbours of each test vector.
+  std::vector<unsigned int> num_in_range_; ///< Number of train vectors within range of each test vector.
+  unsigned int num_precision_warnings_; ///< Number of vector pairs with inconsistent distances.
+  bool loaded_from_cache_; ///< Flag indicating if the results were loaded from the cache.
+};
+
+// Template implementation.
+#include "exact_search.tpp"
+
+#endif
@@ -0,0 +1,381 @@
+/***************************************************************************
+ *   Copyright (C) 2011, 2012 by Leandro Graciá Gil                        *
+ *   leandro.gracia.gil@gmail.com                                          *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/**
+ * \file exact_search.tpp
+ * \brief Implementation of the exhaustive search of the nearest neighbours used as reference by the verification tools.
+ * \author Leandro Graciá Gil
+ */
+
+// C Standard Library and C++ STL includes.
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <typeinfo>
+
+// Static data.
+template <typename T, unsigned int D, typename L>
+const unsigned int ExactSearch<T, D, L>::tile_size;
+
+template <typename T, unsigned int D, typename L>
+const unsigned int ExactSearch<T, D, L>::block_size;
+
+template <typename T, unsigned int D, typename L>
+const uint32_t ExactSearch<T, D, L>::cache_version;
+
+/**
+ * \brief Accumulate a block of bytes into a 64-bit FNV-1a hash.
+ *
+ * \param data Bytes to hash.
+ * \param size Number of bytes.
+ * \param hash Current value of the hash.
+ * \return Updated value of the hash.
+ */
+inline uint64_t fnv1a_hash(const void *data, size_t size, uint64_t hash = 14695981039346656037ULL) {
+  const uint8_t *bytes = static_cast<const uint8_t *>(data);
+  for (size_t i=0; i<size; ++i) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+/**
+ * \brief Accumulate the parameters of a metric into a hash.
+ *
+ * Metrics without any parameters are completely defined by their type. Overloaded for the metrics with parameters.
+ *
+ * \param metric Metric whose parameters are hashed.
+ * \param hash Current value of the hash.
+ * \return Updated value of the hash.
+ */
+template <typename Metric>
+uint64_t metric_hash(const Metric &, uint64_t hash) {
+  return hash;
+}
+
+/**
+ * \brief Accumulate the box lengths of a periodic Euclidean metric into a hash.
+ *
+ * \param metric Metric whose parameters are hashed.
+ * \param hash Current value of the hash.
+ * \return Updated value of the hash.
+ */
+template <typename T, unsigned int D>
+uint64_t metric_hash(const kche_tree::PeriodicEuclideanMetric<T, D> &metric, uint64_t hash) {
+  typedef typename kche_tree::PeriodicEuclideanMetric<T, D>::Distance Distance;
+  return fnv1a_hash(metric.box_lengths(), D * sizeof(Distance), hash);
+}
+
+/**
+ * \brief Accumulate the inverse covariance matrix of a Mahalanobis metric into a hash, including any diagonal or low-rank approximation.
+ *
+ * \param metric Metric whose parameters are hashed.
+ * \param hash Current value of the hash.
+ * \return Updated value of the hash.
+ */
+template <typename T, unsigned int D>
+uint64_t metric_hash(const kche_tree::MahalanobisMetric<T, D> &metric, uint64_t hash) {
+  typedef typename kche_tree::MahalanobisMetric<T, D>::Distance Distance;
+
+  const kche_tree::SymmetricMatrix<Distance> &inverse_covariance = metric.inverse_covariance();
+  for (unsigned int i=0; i<inverse_covariance.size(); ++i) {
+    for (unsigned int j=i; j<inverse_covariance.size(); ++j)
+      hash = fnv1a_hash(&inverse_covariance(i, j), sizeof(Distance), hash);
+  }
+
+  uint32_t approximation[3] = { metric.has_diagonal_covariance(), metric.low_rank(), metric.num_positive_low_rank_factors() };
+  hash = fnv1a_hash(approximation, sizeof(approximation), hash);
+  if (metric.has_low_rank_covariance()) {
+    hash = fnv1a_hash(metric.low_rank_diagonal(), D * sizeof(Distance), hash);
+    for (unsigned int i=0; i<metric.low_rank(); ++i)
+      hash = fnv1a_hash(metric.low_rank_factor(i), D * sizeof(Distance), hash);
+  }
+  return hash;
+}
+
+/**
+ * \brief Prepare an exhaustive search between a train and a test set.
+ *
+ * \param train_set Train set where neighbours are searched.
+ * \param test_set Test set whose neighbours are searched.
+ * \param K Number of nearest neighbours to search. Set to 0 to skip.
+ * \param squared_range Squared distance used to count the neighbours within a range.
+ * \param ignore_existing Ignore train vectors at zero distance from the test vector, as knn and all_in_range do when requested.
+ */
+template <typename T, unsigned int D, typename L>
+ExactSearch<T, D, L>::ExactSearch(const DataSet &train_set, const DataSet &test_set, unsigned int K, const Distance &squared_range, bool ignore_existing)
+    : train_set_(train_set),
+      test_set_(test_set),
+      K_(std::min(K, train_set.size())),
+      squared_range_(squared_range),
+      ignore_existing_(ignore_existing),
+      num_precision_warnings_(0),
+      loaded_from_cache_(false) {}
+
+/**
+ * \brief Get the exhaustive search results, reusing any cached results if available.
+ *
+ * \param metric Metric used to calculate the distances.
+ * \param cache_directory Directory where results are cached. No caching is performed if \c NULL.
+ */
+template <typename T, unsigned int D, typename L> template <typename Metric>
+void ExactSearch<T, D, L>::run(const Metric &metric, const char *cache_directory) {
+
+  // Try to load the results from the cache.
+  std::string filename;
+  uint64_t key = 0;
+  if (cache_directory) {
+    key = hash(metric);
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.exact", static_cast<unsigned long long>(key));
+    filename = std::string(cache_directory) + "/" + name;
+
+    loaded_from_cache_ = load(filename, key);
+    if (loaded_from_cache_)
+      return;
+  }
+
+  // Calculate the results and cache them.
+  search(metric);
+  if (cache_directory && !save(filename, key))
+    std::cerr << "Warning: could not write the exhaustive search cache file '" << filename << "'." << std::endl;
+}
+
+/**
+ * \brief Calculate the exhaustive search results.
+ *
+ * Each tile of test vectors is compared against blocks of the train set, so that the train vectors
+ * are reused from cache by all the test vectors in the tile. The best candidates of each test vector
+ * are kept in a buffer pruned by partial sorting, avoiding to sort the whole train set.
+ *
+ * \param metric Metric used to calculate the distances.
+ */
+template <typename T, unsigned int D, typename L> template <typename Metric>
+void ExactSearch<T, D, L>::search(const Metric &metric) {
+
+  using namespace kche_tree;
+
+  const unsigned int num_tests = test_set_.size();
+  const unsigned int num_train = train_set_.size();
+  const Distance zero = Traits<Distance>::zero();
+
+  neighbours_.assign(num_tests * K_, Neighbor());
+  num_neighbours_.assign(num_tests, 0);
+  num_in_range_.assign(num_tests, 0);
+  std::vector<unsigned int> precision_warnings(num_tests, 0);
+
+  const int num_tiles = (num_tests + tile_size - 1) / tile_size;
+
+  #ifdef _OPENMP
+  #pragma omp parallel for schedule(dynamic)
+  #endif
+  for (int tile = 0; tile < num_tiles; ++tile) {
+
+    const unsigned int first = tile * tile_size;
+    const unsigned int last = std::min(first + tile_size, num_tests);
+    typename Neighbor::DistanceComparer comparer;
+
+    // Candidate buffers for each test vector of the tile.
+    std::vector<Neighbor> candidates[tile_size];
+    for (unsigned int i=first; i<last; ++i)
+      candidates[i - first].reserve(K_ + 2 * block_size);
+
+    for (unsigned int block = 0; block < num_train; block += block_size) {
+      const unsigned int block_end = std::min(block + block_size, num_train);
+
+      for (unsigned int i=first; i<last; ++i) {
+        std::vector<Neighbor> &best = candidates[i - first];
+        for (unsigned int n=block; n<block_end; ++n) {
+          Distance distance = metric(train_set_[n], test_set_[i]);
+
+          // Check numerical consistency of the distance.
+          bool is_zero = distance == zero;
+          if (is_zero ? test_set_[i] != train_set_[n] : test_set_[i] == train_set_[n])
+            ++precision_warnings[i];
+
+          // Exclude the point as knn and all_in_range will do.
+          if (ignore_existing_ && is_zero)
+            continue;
+
+          if (!(distance > squared_range_))
+            ++num_in_range_[i];
+
+          if (K_)
+            best.push_back(Neighbor(n, distance));
+        }
+
+        // Keep only the K best candidates when the buffer is full.
+        if (best.size() >= K_ + block_size) {
+          std::nth_element(best.begin(), best.begin() + K_, best.end(), comparer);
+          best.resize(K_);
+        }
+      }
+    }
+
+    // Sort the final K nearest neighbours of each test vector.
+    for (unsigned int i=first; i<last; ++i) {
+      std::vector<Neighbor> &best = candidates[i - first];
+      unsigned int num_best = std::min(K_, static_cast<unsigned int>(best.size()));
+      std::partial_sort(best.begin(), best.begin() + num_best, best.end(), comparer);
+      std::copy(best.begin(), best.begin() + num_best, neighbours_.begin() + i * K_);
+      num_neighbours_[i] = num_best;
+    }
+  }
+
+  num_precision_warnings_ = 0;
+  for (unsigned int i=0; i<num_tests; ++i)
+    num_precision_warnings_ += precision_warnings[i];
+}
+
+/**
+ * \brief Calculate the key identifying the results in the cache.
+ *
+ * Covers the contents of both data sets, the search settings, and the type and parameters of the metric.
+ *
+ * \param metric Metric used to calculate the distances.
+ * \return Hash of the data and settings.
+ */
+template <typename T, unsigned int D, typename L> template <typename Metric>
+uint64_t ExactSearch<T, D, L>::hash(const Metric &metric) const {
+
+  uint32_t settings[6] = { cache_version, D, sizeof(T), train_set_.size(), test_set_.size(), K_ };
+  uint64_t key = fnv1a_hash(settings, sizeof(settings));
+  key = fnv1a_hash(&squared_range_, sizeof(squared_range_), key);
+  key = fnv1a_hash(&ignore_existing_, sizeof(ignore_existing_), key);
+
+  const char *element_type = typeid(T).name();
+  const char *metric_type = typeid(metric).name();
+  key = fnv1a_hash(element_type, strlen(element_type), key);
+  key = fnv1a_hash(metric_type, strlen(metric_type), key);
+  key = metric_hash(metric, key);
+
+  for (unsigned int i=0; i<train_set_.size(); ++i)
+    key = fnv1a_hash(train_set_[i].data(), D * sizeof(T), key);
+  for (unsigned int i=0; i<test_set_.size(); ++i)
+    key = fnv1a_hash(test_set_[i].data(), D * sizeof(T), key);
+
+  return key;
+}
+
+/**
+ * \brief Load cached results from a file.
+ *
+ * \param filename Name of the cache file.
+ * \param key Expected key of the results.
+ * \return \c true if the file exists and matches the current data and settings, \c false otherwise.
+ */
+template <typename T, unsigned int D, typename L>
+bool ExactSearch<T, D, L>::load(const std::string &filename, uint64_t key) {
+
+  using namespace kche_tree;
+  std::ifstream in(filename.c_str(), std::ios::in | std::ios::binary);
+  if (!in.good())
+    return false;
+
+  const unsigned int num_tests = test_set_.size();
+  try {
+    // Check the header. Cache files are only meant to be read by the host that wrote them.
+    uint32_t version, num_tests_read, K;
+    uint64_t key_read;
+    deserialize(version, in);
+    deserialize(key_read, in);
+    deserialize(num_tests_read, in);
+    deserialize(K, in);
+    if (!in.good() || version != cache_version || key_read != key || num_tests_read != num_tests || K != K_)
+      return false;
+
+    // Read the results.
+    std::vector<unsigned int> num_neighbours(num_tests), num_in_range(num_tests);
+    std::vector<Neighbor> neighbours(num_tests * K_);
+    for (unsigned int i=0; i<num_tests; ++i) {
+      uint32_t value;
+      deserialize(value, in);
+      num_neighbours[i] = value;
+      deserialize(value, in);
+      num_in_range[i] = value;
+      if (num_neighbours[i] > K_)
+        return false;
+
+      for (unsigned int k=0; k<num_neighbours[i]; ++k) {
+        uint32_t index;
+        Distance distance;
+        deserialize(index, in);
+        deserialize(distance, in);
+        neighbours[i * K_ + k] = Neighbor(index, distance);
+      }
+    }
+
+    uint32_t num_precision_warnings;
+    deserialize(num_precision_warnings, in);
+    if (!in.good())
+      return false;
+
+    neighbours_.swap(neighbours);
+    num_neighbours_.swap(num_neighbours);
+    num_in_range_.swap(num_in_range);
+    num_precision_warnings_ = num_precision_warnings;
+
+  } catch (std::runtime_error &) {
+    return false;
+  }
+
+  return true;
+}
+
+/**
+ * \brief Save the results to a cache file.
+ *
+ * \param filename Name of the cache file.
+ * \param key Key of the results.
+ * \return \c true if successful, \c false otherwise.
+ */
+template <typename T, unsigned int D, typename L>
+bool ExactSearch<T, D, L>::save(const std::string &filename, uint64_t key) const {
+
+  using namespace kche_tree;
+  std::ofstream out(filename.c_str(), std::ios::out | std::ios::binary);
+  if (!out.good())
+    return false;
+
+  try {
+    const unsigned int num_tests = test_set_.size();
+    serialize(cache_version, out);
+    serialize(key, out);
+    serialize(static_cast<uint32_t>(num_tests), out);
+    serialize(static_cast<uint32_t>(K_), out);
+
+    for (unsigned int i=0; i<num_tests; ++i) {
+      serialize(static_cast<uint32_t>(num_neighbours_[i]), out);
+      serialize(static_cast<uint32_t>(num_in_range_[i]), out);
+      for (unsigned int k=0; k<num_neighbours_[i]; ++k) {
+        serialize(static_cast<uint32_t>(neighbours_[i * K_ + k].index()), out);
+        serialize(neighbours_[i * K_ + k].squared_distance(), out);
+      }
+    }
+    serialize(static_cast<uint32_t>(num_precision_warnings_), out);
+
+  } catch (std::runtime_error &) {
+    return false;
+  }
+
+  return out.good();
+}
@@ -30,6 +30,9 @@
 // Include the kche-tree library.
 #include "kche-tree/kche-tree.h"
 
+// Readers for the .fvecs, .bvecs and .ivecs formats.
+#include "vecs_file.h"
+
 /**
  * \brief Provide tool initialization and execution for specific tool types.
  *
@@ -59,6 +62,9 @@ public:
   /// Corresponding data set type.
   typedef typename KDTree::DataSet DataSet;
 
+  /// Corresponding k-neighbours result type.
+  typedef typename KDTree::KNeighbors KNeighbors;
+
   // Constructor and destructor.
   template <typename RandomEngineType>
   ToolBase(int argc, char *argv[], RandomEngineType &random_engine);
@@ -66,9 +72,10 @@ public:
 
   // Tool properties.
   bool is_ready() const { return is_ready_; } ///< Check if the tool is ready to be run. May not be the case if the options or the data sets failed.
-  const CommandLineOptions &options() const { return options_; } ///< Return the current set of options provided by the command line arguments.
+  const CommandLineOptions &options() const { return *options_; } ///< Return the current set of options provided by the command line arguments.
   const DataSet &train_set() const { return train_set_; } ///< Return the train set used by the tool.
   const DataSet &test_set() const { return test_set_; } ///< Return the test set used by the tool.
+  bool has_ground_truth() const { return ground_truth_.is_open(); } ///< Check if a ground truth file for the test set was provided.
 
 protected:
   // Initialization, parsing and validation.
@@ -84,11 +91,28 @@ protected:
   template <typename RandomEngineType>
   bool prepare_test_set(RandomEngineType &engine);
 
+  bool prepare_ground_truth();
+
+  // Evaluation against the provided ground truth.
+  double recall(unsigned int test_index, const KNeighbors &knn, unsigned int K) const;
+
+  // Batch search engine selection.
+  static bool parse_search_engine(const char *name, kche_tree::SearchEngine::Type &engine);
+
+  // Kd-tree build options.
+  template <typename Metric>
+  kche_tree::BuildOptions build_options(const Metric &metric) const;
+
+  // Calibration of the boundary checks of the bounded distances.
+  template <typename Metric>
+  bool calibrate_bound_checks(const KDTree &kdtree, const Metric &metric) const;
+
   ScopedPtr<CommandLineOptions> options_; ///< Gengetopt structure containing the parsed command line arguments.
   bool is_ready_; ///< Flag indicating if the tool is ready to be run.
 
   DataSet train_set_; ///< Train set used by the tool.
   DataSet test_set_; ///< Test set used by the tool.
+  VecsFile<int32_t> ground_truth_; ///< Indices of the exact nearest neighbours of each test vector, if provided.
 };
 
 // Template implementation.
@@ -25,7 +25,9 @@
  */
 
 // C Standard Library and C++ STL includes.
+#include <algorithm>
 #include <ctime>
+#include <iomanip>
 #include <iostream>
 #include <fstream>
 
@@ -125,11 +127,22 @@ bool ToolBase<T, D, L, O>::validate_options() const {
     return false;
   }
 
+  if (options_->train_duplicates_arg < 0.0f || options_->train_duplicates_arg > 100.0f) {
+    std::cerr << "Invalid train-duplicates value. Should be between 0 and 100 (%)." << std::endl;
+    return false;
+  }
+
   if (options_->test_from_train_arg < 0.0f || options_->test_from_train_arg > 100.0f) {
     std::cerr << "Invalid test-from-train value. Should be between 0 and 100 (%)." << std::endl;
     return false;
   }
 
+  kche_tree::SearchEngine::Type engine;
+  if (options_->batch_engine_given && !parse_search_engine(options_->batch_engine_arg, engine)) {
+    std::cerr << "Invalid batch engine '" << options_->batch_engine_arg << "'. Should be sequential, interleaved, packet, brute-force or automatic." << std::endl;
+    return false;
+  }
+
   return true;
 }
 
@@ -157,6 +170,10 @@ bool ToolBase<T, D, L, O>::initialize_data(RandomEngine &random_engine) {
   if (!prepare_test_set(random_engine))
     return false;
 
+  // Map the ground truth of the test set if provided.
+  if (!prepare_ground_truth())
+    return false;
+
   return true;
 }
 
@@ -181,6 +198,10 @@ bool ToolBase<T, D, L, O>::prepare_train_set(RandomEngine &random_engine) {
     }
     input >> train_set_;
 
+  } else if (options_->train_vecs_given) {
+    if (!load_vecs(options_->train_vecs_arg, train_set_))
+      return false;
+
   } else if (options_->train_random_given) {
     // Create a random value generator.
     typedef typename kche_tree::Traits<T>::UniformDistribution ValueDistribution;
@@ -191,6 +212,23 @@ bool ToolBase<T, D, L, O>::prepare_train_set(RandomEngine &random_engine) {
     train_set_.reset_to_size(options_->train_random_arg);
     train_set_.set_random_values(value_generator);
 
+    // Replace some of the entries by copies of previous ones if requested.
+    float p = options_->train_duplicates_arg;
+    if (p > 0.0f) {
+      typedef typename kche_tree::Traits<float>::UniformDistribution ProbabilityDistribution;
+      ProbabilityDistribution probability_distribution(0.0f, 100.0f);
+      RandomGenerator<RandomEngine, ProbabilityDistribution> probability_generator(random_engine, probability_distribution);
+
+      for (unsigned int i=1; i<train_set_.size(); ++i) {
+        if (probability_generator() < p) {
+          typedef typename kche_tree::Traits<unsigned int>::UniformDistribution IndexDistribution;
+          IndexDistribution index_distribution(0, i - 1);
+          RandomGenerator<RandomEngine, IndexDistribution> index_generator(random_engine, index_distribution);
+          kche_tree::Traits<T>::copy_array(&train_set_[i][0], &train_set_[index_generator()][0], D);
+        }
+      }
+    }
+
     if (options_->train_save_random_given) {
       ofstream output(options_->train_save_random_arg, ios::out | ios::binary);
       if (!output.good()) {
@@ -229,6 +267,10 @@ bool ToolBase<T, D, L, O>::prepare_test_set(RandomEngine &random_engine) {
     }
     input >> test_set_;
 
+  } else if (options_->test_vecs_given) {
+    if (!load_vecs(options_->test_vecs_arg, test_set_))
+      return false;
+
   } else if (options_->test_random_given) {
     // Create random generators for elements, probabilities and indices.
     typedef typename kche_tree::Traits<T>::UniformDistribution ValueDistribution;
@@ -273,3 +315,164 @@ bool ToolBase<T, D, L, O>::prepare_test_set(RandomEngine &random_engine) {
 
   return true;
 }
+
+/**
+ * \brief Map the ground truth file of the test set if provided by the options.
+ *
+ * The ground truth must provide at least as many neighbours per test vector as requested by the knn option.
+ *
+ * \return \c true if successful or not required, \c false otherwise.
+ */
+template <typename T, unsigned int D, typename L, typename O>
+bool ToolBase<T, D, L, O>::prepare_ground_truth() {
+
+  using namespace std;
+  if (!options_->ground_truth_given)
+    return true;
+
+  if (!ground_truth_.open(options_->ground_truth_arg)) {
+    cerr << "Error loading ground truth file '" << options_->ground_truth_arg << "': " << ground_truth_.error() << "." << endl;
+    return false;
+  }
+
+  if (ground_truth_.size() != test_set_.size()) {
+    cerr << "Ground truth has " << ground_truth_.size() << " entries, but the test set has " << test_set_.size() << " vectors." << endl;
+    return false;
+  }
+
+  if (ground_truth_.dimensions() < static_cast<unsigned int>(options_->knn_arg)) {
+    cerr << "Ground truth only provides " << ground_truth_.dimensions() << " neighbours per test vector, but " << options_->knn_arg << " were requested." << endl;
+    return false;
+  }
+
+  return true;
+}
+
+/**
+ * \brief Calculate the recall of a k-nearest neighbours result with respect to the ground truth.
+ *
+ * \param test_index Index of the test vector whose neighbours were searched.
+ * \param knn K nearest neighbours found for the test vector.
+ * \param K Number of neighbours requested.
+ * \return Fraction of the \a K exact nearest neighbours present in \a knn.
+ */
+template <typename T, unsigned int D, typename L, typename O>
+double ToolBase<T, D, L, O>::recall(unsigned int test_index, const KNeighbors &knn, unsigned int K) const {
+
+  KCHE_TREE_DCHECK(has_ground_truth() && K <= ground_truth_.dimensions());
+  if (K == 0)
+    return 1.0;
+
+  const int32_t *exact = ground_truth_[test_index];
+  unsigned int found = 0;
+  for (unsigned int k=0; k<knn.size() && k<K; ++k) {
+    for (unsigned int j=0; j<K; ++j) {
+      int32_t index = exact[j];
+      if (kche_tree::Endianness::is_big_endian())
+        kche_tree::EndiannessTraits<int32_t>::swap_endianness(index);
+      if (static_cast<unsigned int>(index) == knn[k].index()) {
+        ++found;
+        break;
+      }
+    }
+  }
+
+  return found / static_cast<double>(K);
+}
+
+/**
+ * \brief Get the batch search engine corresponding to a name provided in the command line.
+ *
+ * \param name Name of the engine.
+ * \param engine Engine corresponding to the name, if valid.
+ * \return \c true if the name is valid, \c false otherwise.
+ */
+template <typename T, unsigned int D, typename L, typename O>
+bool ToolBase<T, D, L, O>::parse_search_engine(const char *name, kche_tree::SearchEngine::Type &engine) {
+
+  std::string engine_name(name);
+  if (engine_name == "sequential")
+    engine = kche_tree::SearchEngine::Sequential;
+  else if (engine_name == "interleaved")
+    engine = kche_tree::SearchEngine::Interleaved;
+  else if (engine_name == "packet")
+    engine = kche_tree::SearchEngine::Packet;
+  else if (engine_name == "brute-force")
+    engine = kche_tree::SearchEngine::BruteForce;
+  else if (engine_name == "automatic")
+    engine = kche_tree::SearchEngine::Automatic;
+  else
+    return false;
+
+  return true;
+}
+
+/**
+ * \brief Get the kd-tree build options provided in the command line.
+ *
+ * Dimension reordering is disabled with a warning if the metric does not support it.
+ *
+ * \param metric Metric that will be used to search the kd-tree.
+ * \return Options used to build the kd-tree.
+ */
+template <typename T, unsigned int D, typename L, typename O> template <typename Metric>
+kche_tree::BuildOptions ToolBase<T, D, L, O>::build_options(const Metric &metric) const {
+
+  kche_tree::BuildOptions build_options(options_->bucket_size_arg);
+  build_options.squared_norms = options_->squared_norms_flag;
+  build_options.reorder_dimensions = options_->reorder_dimensions_flag;
+  build_options.collapse_duplicates = options_->collapse_duplicates_flag;
+
+  if (build_options.reorder_dimensions && !kche_tree::IsPermutationInvariant<Metric>::value) {
+    std::cerr << "Warning: the metric does not support reordering the dimensions. Keeping the original order." << std::endl;
+    build_options.reorder_dimensions = false;
+  }
+
+  return build_options;
+}
+
+/**
+ * \brief Calibrate the cadence of the boundary checks of a metric with the test set and report where the early-outs happen.
+ *
+ * \param kdtree Kd-tree that will be searched.
+ * \param metric Metric with a boundary check profile attached.
+ * \return \c true if the cadence was calibrated, \c false otherwise.
+ */
+template <typename T, unsigned int D, typename L, typename O> template <typename Metric>
+bool ToolBase<T, D, L, O>::calibrate_bound_checks(const KDTree &kdtree, const Metric &metric) const {
+
+  clock_t t1 = clock();
+  bool calibrated = kdtree.calibrate_bound_checks(test_set_, options_->knn_arg, metric, options_->ignore_existing_flag);
+  clock_t t2 = clock();
+
+  if (!calibrated) {
+    std::cerr << "Warning: no bounded distances were calculated. Keeping the default cadence of the boundary checks." << std::endl;
+    metric.bound_check_profile()->reset_statistics();
+    return false;
+  }
+
+  // Show the selected cadence and a histogram of the positions of the early-outs.
+  const kche_tree::BoundCheckProfile &profile = *metric.bound_check_profile();
+  const uint64_t num_calls = profile.num_calls();
+  std::cout << std::fixed;
+  std::cout << "Bound checks calibrated in " << std::setprecision(3) << (t2 - t1) / static_cast<double>(CLOCKS_PER_SEC) << " sec: ";
+  if (profile.prefix() < D)
+    std::cout << "prefix " << profile.prefix() << ", interval " << profile.interval() << " dimensions" << std::endl;
+  else
+    std::cout << "disabled" << std::endl;
+  std::cout << "  Early-outs: " << std::setprecision(2) << 100.0 * profile.num_early_outs() / num_calls << "% of " << num_calls
+      << " bounded distances, " << profile.average_dimensions() << " dimensions accumulated on average" << std::endl;
+
+  const unsigned int num_bins = std::min(8u, D);
+  const std::vector<uint64_t> &early_outs = profile.early_outs();
+  for (unsigned int bin = 0; bin < num_bins; ++bin) {
+    unsigned int first = bin * D / num_bins + 1, last = (bin + 1) * D / num_bins;
+    uint64_t count = 0;
+    for (unsigned int position = first; position <= last && position < early_outs.size(); ++position)
+      count += early_outs[position];
+    std::cout << "  Leaving after " << std::setw(4) << first << "-" << std::setw(4) << last << " dimensions: "
+        << std::setw(6) << std::setprecision(2) << 100.0 * count / num_calls << "%" << std::endl;
+  }
+
+  return true;
+}
@@ -0,0 +1,39 @@
+/***************************************************************************
+ *   Copyright (C) 2011 by Leandro Graciá Gil                              *
+ *   leandro.gracia.gil@gmail.com                                          *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+// Common include for tools.
+#include "tool_common.h"
+
+int main(int argc, char *argv[]) {
+
+  // Create and initialize the tool.
+  DefaultRandomEngine random_engine;
+  ToolType tool(argc, argv, random_engine);
+  if (!tool.is_ready())
+    return 1;
+
+  // Run the tool.
+  MahalanobisMetric<ElementType, Dimensions> metric(tool.train_set());
+  if (!metric.force_low_rank_covariance(Dimensions / 4)) {
+    std::cerr << "Low-rank approximation of the inverse covariance matrix not available." << std::endl;
+    return 1;
+  }
+  return !tool.run(metric);
+}
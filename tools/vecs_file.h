@@ -0,0 +1,95 @@
+/***************************************************************************
+ *   Copyright (C) 2011, 2012 by Leandro Graciá Gil                        *
+ *   leandro.gracia.gil@gmail.com                                          *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/**
+ * \file vecs_file.h
+ * \brief Memory-mapped readers for the .fvecs, .bvecs and .ivecs vector file formats.
+ * \author Leandro Graciá Gil
+ *
+ * These are the formats used by the usual approximate nearest neighbour benchmark sets (SIFT, GIST, etc).
+ * Each file is a sequence of records made of a little-endian 32-bit integer with the number of
+ * components of the vector followed by the components themselves: 32-bit floats for .fvecs,
+ * unsigned bytes for .bvecs and 32-bit integers for .ivecs. Ground truth files are .ivecs files
+ * with the indices of the nearest neighbours of each test vector in increasing order of distance.
+ */
+
+#ifndef _VECS_FILE_H_
+#define _VECS_FILE_H_
+
+// C Standard Library and C++ STL includes.
+#include <stdint.h>
+#include <string>
+
+// Include the kche-tree library.
+#include "kche-tree/kche-tree.h"
+
+/**
+ * \brief Read-only memory mapping of a file in any of the vecs formats.
+ *
+ * The file is mapped in memory instead of being read, so vectors are only paged in when accessed.
+ * All the vectors of the file are required to have the same number of components.
+ *
+ * \tparam ComponentType Type of the components of the vectors in the file: \c float, \c uint8_t or \c int32_t.
+ */
+template <typename ComponentType>
+class VecsFile : public kche_tree::NonCopyable {
+public:
+  /// Type of the vector components in the file.
+  typedef ComponentType Component;
+
+  // Constructor and destructor.
+  VecsFile();
+  ~VecsFile();
+
+  // File mapping.
+  bool open(const char *filename);
+  void close();
+
+  // File properties.
+  bool is_open() const { return data_ != NULL; } ///< Check if the file is currently mapped.
+  unsigned int size() const { return size_; } ///< Number of vectors in the file.
+  unsigned int dimensions() const { return dimensions_; } ///< Number of components of each vector.
+  const std::string &error() const { return error_; } ///< Description of the last error found when opening a file.
+
+  // Access to the vectors in the file.
+  const Component *operator [] (unsigned int index) const;
+
+private:
+  const uint8_t *data_; ///< Memory mapped contents of the file.
+  size_t length_; ///< Length in bytes of the mapped file.
+  size_t record_size_; ///< Size in bytes of each vector record including its header.
+  unsigned int size_; ///< Number of vectors in the file.
+  unsigned int dimensions_; ///< Number of components of each vector.
+  std::string error_; ///< Description of the last error.
+};
+
+// Loading of data sets from vecs files.
+template <typename T, unsigned int D, typename ComponentType>
+bool copy_vecs(const VecsFile<ComponentType> &file, kche_tree::DataSet<T, D> &dataset);
+
+template <typename T, unsigned int D>
+bool load_vecs(const char *filename, kche_tree::DataSet<T, D> &dataset);
+
+inline bool is_vecs_filename(const char *filename);
+
+// Template implementation.
+#include "vecs_file.tpp"
+
+#endif
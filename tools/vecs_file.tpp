@@ -0,0 +1,256 @@
+/***************************************************************************
+ *   Copyright (C) 2011, 2012 by Leandro Graciá Gil                        *
+ *   leandro.gracia.gil@gmail.com                                          *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/**
+ * \file vecs_file.tpp
+ * \brief Implementation of the memory-mapped readers for the .fvecs, .bvecs and .ivecs vector file formats.
+ * \author Leandro Graciá Gil
+ */
+
+// C Standard Library and C++ STL includes.
+#include <cstring>
+#include <iostream>
+
+// POSIX memory mapping.
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/// Create an object with no mapped file.
+template <typename C>
+VecsFile<C>::VecsFile()
+    : data_(NULL),
+      length_(0),
+      record_size_(0),
+      size_(0),
+      dimensions_(0) {}
+
+/// Unmap any file currently open.
+template <typename C>
+VecsFile<C>::~VecsFile() {
+  close();
+}
+
+/**
+ * \brief Map a vecs file in memory and validate its structure.
+ *
+ * \param filename Name of the file to map.
+ * \return \c true if successful, \c false otherwise. A description of the problem is available in error() on failure.
+ */
+template <typename C>
+bool VecsFile<C>::open(const char *filename) {
+
+  close();
+  error_.clear();
+
+  int fd = ::open(filename, O_RDONLY);
+  if (fd < 0) {
+    error_ = "error opening file for reading";
+    return false;
+  }
+
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0 || file_stat.st_size < static_cast<off_t>(sizeof(int32_t))) {
+    ::close(fd);
+    error_ = "empty or unreadable file";
+    return false;
+  }
+
+  // The mapping keeps its own reference to the file, so the descriptor can be closed right away.
+  length_ = file_stat.st_size;
+  void *mapping = mmap(NULL, length_, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (mapping == MAP_FAILED) {
+    length_ = 0;
+    error_ = "error mapping file in memory";
+    return false;
+  }
+  data_ = static_cast<const uint8_t *>(mapping);
+
+  // Vectors are consumed sequentially when converted to data sets.
+  madvise(mapping, length_, MADV_SEQUENTIAL);
+
+  // Read the number of components from the first record header.
+  int32_t dimensions;
+  std::memcpy(&dimensions, data_, sizeof(dimensions));
+  if (kche_tree::Endianness::is_big_endian())
+    kche_tree::EndiannessTraits<int32_t>::swap_endianness(dimensions);
+
+  if (dimensions <= 0) {
+    close();
+    error_ = "invalid number of vector components";
+    return false;
+  }
+
+  dimensions_ = dimensions;
+  record_size_ = sizeof(int32_t) + dimensions_ * sizeof(Component);
+  if (length_ % record_size_ != 0) {
+    close();
+    error_ = "file size is not a multiple of the vector record size (wrong format or truncated file?)";
+    return false;
+  }
+  size_ = length_ / record_size_;
+
+  // Check that all the records have the same number of components.
+  for (unsigned int i=1; i<size_; ++i) {
+    int32_t record_dimensions;
+    std::memcpy(&record_dimensions, data_ + i * record_size_, sizeof(record_dimensions));
+    if (kche_tree::Endianness::is_big_endian())
+      kche_tree::EndiannessTraits<int32_t>::swap_endianness(record_dimensions);
+
+    if (record_dimensions != dimensions) {
+      close();
+      error_ = "vectors with different number of components found";
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/// Unmap the current file, if any.
+template <typename C>
+void VecsFile<C>::close() {
+  if (data_)
+    munmap(const_cast<uint8_t *>(data_), length_);
+
+  data_ = NULL;
+  length_ = 0;
+  record_size_ = 0;
+  size_ = 0;
+  dimensions_ = 0;
+}
+
+/**
+ * \brief Access the components of a vector in the file.
+ *
+ * \note Components are stored in little-endian byte order in the file.
+ * \param index Index of the vector to access.
+ * \return Pointer to the first component of the vector.
+ */
+template <typename C>
+const C *VecsFile<C>::operator [] (unsigned int index) const {
+  KCHE_TREE_DCHECK(data_ && index < size_);
+  return reinterpret_cast<const C *>(data_ + index * record_size_ + sizeof(int32_t));
+}
+
+/**
+ * \brief Functor providing the components of a vector one by one.
+ *
+ * Allows reusing the random generation traits to construct elements of any type, including custom ones,
+ * from the plain values read from the vecs files.
+ */
+template <typename Component, typename Value>
+class VecsComponentFeeder {
+public:
+  /// Create a feeder for the components of a vector.
+  VecsComponentFeeder(const Component *components) : components_(components), index_(0) {}
+
+  /// Provide the next component of the vector.
+  Value operator () () {
+    Component component = components_[index_++];
+    if (kche_tree::Endianness::is_big_endian())
+      kche_tree::EndiannessTraits<Component>::swap_endianness(component);
+    return static_cast<Value>(component);
+  }
+
+private:
+  const Component *components_; ///< Components of the vector.
+  unsigned int index_; ///< Index of the next component to provide.
+};
+
+/**
+ * \brief Copy the contents of a mapped vecs file into a data set.
+ *
+ * \param file Mapped vecs file.
+ * \param dataset Data set where to copy the vectors. Its previous contents are discarded.
+ * \return \c true if successful, \c false otherwise.
+ */
+template <typename T, unsigned int D, typename Component>
+bool copy_vecs(const VecsFile<Component> &file, kche_tree::DataSet<T, D> &dataset) {
+
+  if (file.dimensions() != D) {
+    std::cerr << "Vecs file has " << file.dimensions() << " dimensions, but the tool was built for " << D << "." << std::endl;
+    return false;
+  }
+
+  typedef typename kche_tree::Traits<T>::RandomDistributionElement Value;
+  dataset.reset_to_size(file.size());
+  for (unsigned int i=0; i<file.size(); ++i) {
+    VecsComponentFeeder<Component, Value> feeder(file[i]);
+    for (unsigned int d=0; d<D; ++d)
+      dataset[i][d] = kche_tree::Traits<T>::random(feeder);
+  }
+
+  return true;
+}
+
+/**
+ * \brief Check if a file name has any of the supported vecs extensions.
+ *
+ * \param filename Name of the file.
+ * \return \c true if the name ends in .fvecs, .bvecs or .ivecs, \c false otherwise.
+ */
+inline bool is_vecs_filename(const char *filename) {
+  std::string name(filename);
+  if (name.size() < 6)
+    return false;
+
+  std::string extension = name.substr(name.size() - 6);
+  return extension == ".fvecs" || extension == ".bvecs" || extension == ".ivecs";
+}
+
+/**
+ * \brief Load a data set from a .fvecs, .bvecs or .ivecs file. The format is chosen by the extension of the file.
+ *
+ * \param filename Name of the file to load.
+ * \param dataset Data set where to load the vectors. Its previous contents are discarded.
+ * \return \c true if successful, \c false otherwise.
+ */
+template <typename T, unsigned int D>
+bool load_vecs(const char *filename, kche_tree::DataSet<T, D> &dataset) {
+
+  std::string name(filename);
+  std::string extension = is_vecs_filename(filename) ? name.substr(name.size() - 6) : std::string();
+
+  // Map the file according to its extension.
+  bool ok = false;
+  std::string error;
+  if (extension == ".fvecs") {
+    VecsFile<float> file;
+    ok = file.open(filename) && copy_vecs(file, dataset);
+    error = file.error();
+  } else if (extension == ".bvecs") {
+    VecsFile<uint8_t> file;
+    ok = file.open(filename) && copy_vecs(file, dataset);
+    error = file.error();
+  } else if (extension == ".ivecs") {
+    VecsFile<int32_t> file;
+    ok = file.open(filename) && copy_vecs(file, dataset);
+    error = file.error();
+  } else {
+    error = "unknown extension, expecting .fvecs, .bvecs or .ivecs";
+  }
+
+  if (!ok && !error.empty())
+    std::cerr << "Error loading vecs file '" << filename << "': " << error << "." << std::endl;
+  return ok;
+}
@@ -27,12 +27,155 @@
 #ifndef _VERIFICATION_TOOL_H_
 #define _VERIFICATION_TOOL_H_
 
+// Include STL string streams.
+#include <sstream>
+
 // Include argument parsing results from gengetopt.
 #include "verification_tool_args.h"
 
 // Tool base class.
 #include "tool_base.h"
 
+// Exhaustive search used as reference.
+#include "exact_search.h"
+
+/**
+ * \brief Verification of the Gaussian kernel density estimations against an exhaustive sum.
+ */
+struct KernelDensityVerification {
+  /// Name of the verified functionality, used when skipped.
+  static const char *name() { return "kernel density estimations"; }
+
+  template <typename KDTreeType, typename DataSet>
+  static bool verify(const KDTreeType &kdtree, const DataSet &train_set, const DataSet &test_set, double bandwidth, double relative_error);
+};
+
+/**
+ * \brief Verification of the DBSCAN clusters of the train set against an exhaustive clustering.
+ */
+struct DBSCANVerification {
+  /// Name of the verified functionality, used when skipped.
+  static const char *name() { return "DBSCAN clustering"; }
+
+  template <typename KDTreeType, typename DataSet>
+  static bool verify(const KDTreeType &kdtree, const DataSet &train_set, double distance, unsigned int min_points);
+};
+
+/**
+ * \brief Verification of the dual-tree joins between the train set and the test set against an exhaustive search.
+ */
+struct JoinVerification {
+  /// Name of the verified functionality, used when skipped.
+  static const char *name() { return "kd-tree joins"; }
+
+  template <typename KDTreeType, typename DataSet, typename TestSet>
+  static bool verify(const KDTreeType &kdtree, const DataSet &train_set, const TestSet &test_set, const kche_tree::BuildOptions &build_options, double distance, double tolerance);
+};
+
+/**
+ * \brief Verification of the Euclidean minimum spanning tree of the train set against an exhaustive Prim's algorithm.
+ */
+struct SpanningTreeVerification {
+  /// Name of the verified functionality, used when skipped.
+  static const char *name() { return "minimum spanning trees"; }
+
+  template <typename KDTreeType, typename DataSet>
+  static bool verify(const KDTreeType &kdtree, const DataSet &train_set, double tolerance);
+};
+
+/**
+ * \brief Verification of the k-means clustering of the train set against exhaustive assignments.
+ */
+struct KMeansVerification {
+  /// Name of the verified functionality, used when skipped.
+  static const char *name() { return "k-means clustering"; }
+
+  template <typename KDTreeType, typename DataSet>
+  static bool verify(const KDTreeType &kdtree, const DataSet &train_set, unsigned int num_clusters, unsigned int max_iterations, double tolerance);
+};
+
+/**
+ * \brief Verification of the local outlier factors of the train set and the test set against an exhaustive search.
+ */
+struct OutlierFactorVerification {
+  /// Name of the verified functionality, used when skipped.
+  static const char *name() { return "local outlier factors"; }
+
+  template <typename KDTreeType, typename DataSet, typename TestSet>
+  static bool verify(const KDTreeType &kdtree, const DataSet &train_set, const TestSet &test_set, unsigned int K, double tolerance);
+};
+
+/**
+ * \brief Verification of the label summaries of a labeled copy of the train set against an exhaustive search.
+ */
+struct LabelSummaryVerification {
+  /// Name of the verified functionality, used when skipped.
+  static const char *name() { return "label summaries"; }
+
+  template <typename DataSet, typename TestSet>
+  static bool verify(const DataSet &train_set, const TestSet &test_set, const kche_tree::BuildOptions &build_options, unsigned int num_classes, double distance);
+};
+
+/**
+ * \brief Verification of the rank-one updates of the inverse covariance matrix of the Mahalanobis metric against a refit.
+ *
+ * Other metrics have no inverse covariance matrix, so their verification is skipped.
+ */
+struct RankOneUpdateVerification {
+  /// Name of the verified functionality, used when skipped.
+  static const char *name() { return "rank-one inverse covariance updates"; }
+
+  template <typename MetricType, typename DataSet, typename TestSet>
+  static bool verify(const MetricType &metric, const DataSet &train_set, const TestSet &test_set, double tolerance);
+
+  template <typename T, unsigned int D, typename DataSet, typename TestSet>
+  static bool verify(const kche_tree::MahalanobisMetric<T, D> &metric, const DataSet &train_set, const TestSet &test_set, double tolerance);
+};
+
+/**
+ * \brief Dispatch of the verifications only available for arithmetic element types.
+ *
+ * Selects the verification itself for arithmetic element types, and a verification that only warns
+ * about being skipped otherwise, so the verification code is never instantiated for unsupported types.
+ *
+ * \tparam ElementType Type of the elements in the data sets.
+ * \tparam VerificationType Verification to run. Must provide a static \c name() and static \c verify methods.
+ */
+template <typename ElementType, typename VerificationType, bool is_arithmetic = kche_tree::IsArithmetic<ElementType>::value>
+struct ArithmeticOnly {
+  /// Verification to run.
+  typedef VerificationType Type;
+};
+
+/// Verification skipped for non-arithmetic element types. Accepts any verification arguments.
+template <typename VerificationType>
+struct SkippedVerification {
+  template <typename A, typename B, typename C>
+  static bool verify(const A &, const B &, const C &) { return skip(); }
+
+  template <typename A, typename B, typename C, typename D>
+  static bool verify(const A &, const B &, const C &, const D &) { return skip(); }
+
+  template <typename A, typename B, typename C, typename D, typename E>
+  static bool verify(const A &, const B &, const C &, const D &, const E &) { return skip(); }
+
+  template <typename A, typename B, typename C, typename D, typename E, typename F>
+  static bool verify(const A &, const B &, const C &, const D &, const E &, const F &) { return skip(); }
+
+private:
+  static bool skip() {
+    std::cerr << "Warning: skipping the verification of " << VerificationType::name() << ", which needs arithmetic element types." << std::endl;
+    return true;
+  }
+};
+
+/// Verifications are skipped for non-arithmetic element types.
+template <typename ElementType, typename VerificationType>
+struct ArithmeticOnly<ElementType, VerificationType, false> {
+  /// Verification to run.
+  typedef SkippedVerification<VerificationType> Type;
+};
+
 /**
  * \brief Provide result verification functionality for any given type and metric.
  *
@@ -73,6 +216,17 @@ public:
 private:
   // Command-line option validation.
   bool validate_options() const;
+
+  // Verification of the searches excluding train vectors by their indices.
+  template <typename KDTreeType, typename MetricType>
+  bool verify_leave_one_out(const KDTreeType &kdtree, const MetricType &metric) const;
+
+  // Rounding error of the distances expanded with squared norms.
+  template <typename MetricType>
+  typename kche_tree::Traits<Element>::Distance expansion_error(const typename DataSet::Vector &v1, const typename DataSet::Vector &v2) const;
+  template <typename MetricType>
+  void expanded_range_counts(const MetricType &metric, const typename DataSet::Vector &p, const typename kche_tree::Traits<Element>::Distance &squared_range,
+      unsigned int &min_count, unsigned int &max_count) const;
 };
 
 // Template implementation.
@@ -93,6 +93,14 @@ bool VerificationTool<T, D, L>::run(const Metric &metric) {
   if (!this->is_ready())
     return false;
 
+  // Search with a copy of the metric using a calibrated boundary check profile if requested.
+  if (this->options_->calibrate_bound_checks_flag && !metric.bound_check_profile()) {
+    kche_tree::BoundCheckProfile profile;
+    Metric calibrated_metric(metric);
+    calibrated_metric.set_bound_check_profile(&profile);
+    return run(calibrated_metric);
+  }
+
   // Use the kche_tree namespace locally for simplicity.
   using namespace kche_tree;
 
@@ -104,7 +112,11 @@ bool VerificationTool<T, D, L>::run(const Metric &metric) {
 
   // Build the kd-tree.
   KDTree kdtree;
-  kdtree.build(this->train_set_, this->options_->bucket_size_arg);
+  kdtree.build(this->train_set_, this->build_options(metric));
+
+  // Calibrate the boundary checks of the metric.
+  if (metric.bound_check_profile())
+    this->calibrate_bound_checks(kdtree, metric);
 
   // Test the kd-tree I/O.
   if (this->options_->kdtree_io_flag) {
@@ -120,45 +132,61 @@ bool VerificationTool<T, D, L>::run(const Metric &metric) {
     in_file.close();
   }
 
-  // Test the subscript operator.
+  // Test the subscript operator, restoring the original order of the dimensions if reordered.
+  // Each stored vector is compared with all the identical ones it represents if they were collapsed.
   if (this->options_->subscript_flag) {
-    for (unsigned int i=0; i<this->train_set_.size(); ++i) {
-      if (this->train_set_[i] != kdtree.data()[i]) {
-        std::cerr << "Non-matching subscript operator value for index " << i << "." << std::endl;
-        ok = false;
+    typename KDTree::Vector original;
+    const Duplicates *duplicates = kdtree.duplicates();
+    for (unsigned int i=0; i<kdtree.size(); ++i) {
+      if (kdtree.dimension_order())
+        kdtree.dimension_order()->restore(kdtree.data()[i], original);
+      else
+        original = kdtree.data()[i];
+
+      unsigned int count = duplicates ? duplicates->count(i) : 1;
+      for (unsigned int j=0; j<count; ++j) {
+        unsigned int index = duplicates ? duplicates->indices(i)[j] : i;
+        if (this->train_set_[index] != original) {
+          std::cerr << "Non-matching subscript operator value for index " << index << "." << std::endl;
+          ok = false;
+        }
       }
     }
   }
 
-  // Allocate memory for the exhaustive calculation of nearest neighbours.
+  // Calculate the exhaustive search results, or reuse them from the cache if available.
   typedef typename KDTree::Distance Distance;
   typedef typename KDTree::Neighbor Neighbor;
-  ScopedArray<Neighbor> nearest(new Neighbor[this->train_set_.size()]);
-  KCHE_TREE_DCHECK(nearest);
-
-  // Process each test case.
-  for (unsigned int i=0; i<this->test_set_.size(); ++i) {
+  Distance exact_range = this->options_->all_in_range_arg;
+  exact_range *= exact_range;
+  ExactSearch<T, D, L> exact(this->train_set_, this->test_set_, this->options_->knn_arg, exact_range, this->options_->ignore_existing_flag);
+  if (this->options_->knn_arg > 0 || this->options_->all_in_range_arg > 0.0f)
+    exact.run(metric, this->options_->exact_cache_given ? this->options_->exact_cache_arg : NULL);
 
-    // Create a vector of point-distance tuples to current test point.
-    if (this->options_->knn_arg > 0 || this->options_->all_in_range_arg > 0.0f) {
-      for (unsigned int n=0; n<this->train_set_.size(); ++n) {
-        Distance distance = metric(this->train_set_[n], this->test_set_[i]);
+  // Check numerical consistency of the distances.
+  if (exact.num_precision_warnings())
+    std::cerr << "Warning: possible numerical precision problem. Distance from a point to itself not strictly zero in "
+        << exact.num_precision_warnings() << " cases." << std::endl;
 
-        // Check numerical consistency of the distance.
-        if ((distance == Traits<Distance>::zero() && this->test_set_[i] != this->train_set_[n]) || (!(distance == Traits<Distance>::zero()) && this->test_set_[i] == this->train_set_[n]))
-          std::cerr << "Warning: possible numerical precision problem. Distance from a point to itself not strictly zero." << std::endl;
+  // Search the whole test set at once if a batch engine was requested. Results are then checked as the ones of knn.
+  std::vector<typename KDTree::KNeighbors> batch_results;
+  SearchEngine::Type engine;
+  if (this->options_->knn_arg > 0 && this->options_->batch_engine_given && this->parse_search_engine(this->options_->batch_engine_arg, engine)) {
+    if (this->options_->use_k_heap_flag)
+      kdtree.template batch_knn<KHeap>(this->test_set_, this->options_->knn_arg, batch_results, metric, Distance(this->options_->epsilon_arg), this->options_->ignore_existing_flag, engine);
+    else
+      kdtree.template batch_knn<KVector>(this->test_set_, this->options_->knn_arg, batch_results, metric, Distance(this->options_->epsilon_arg), this->options_->ignore_existing_flag, engine);
+  }
 
-        // Exclude the point from the nearest neighbours as knn will do.
-        if (this->options_->ignore_existing_flag && distance == Traits<Distance>::zero())
-          distance = Traits<Distance>::max();
+  // Accumulated recall of the knn results with respect to the ground truth, if provided.
+  double recall = 0.0;
 
-        nearest[n] = Neighbor(n, distance);
-      }
-    }
+  // Largest difference between the returned distances and the ones calculated by the metric, and largest bound of the rounding error of the squared norm expansions.
+  Distance max_distance_error = Traits<Distance>::zero();
+  Distance max_expansion_error = Traits<Distance>::zero();
 
-    // Sort the training set vectors by its distance to the test point.
-    typename Neighbor::DistanceComparer comparer;
-    std::sort(nearest.get(), nearest.get() + this->train_set_.size(), comparer);
+  // Process each test case.
+  for (unsigned int i=0; i<this->test_set_.size(); ++i) {
 
     // Test the knn functionality.
     if (this->options_->knn_arg > 0) {
@@ -166,30 +194,37 @@ bool VerificationTool<T, D, L>::run(const Metric &metric) {
       // Get the K nearest neighbours.
       unsigned int K = this->options_->knn_arg;
       std::vector<Neighbor> knn;
-      if (this->options_->use_k_heap_flag)
+      if (!batch_results.empty())
+        knn.swap(batch_results[i]);
+      else if (this->options_->use_k_heap_flag)
         kdtree.template knn<KHeap>(this->test_set_[i], K, knn, metric, Distance(this->options_->epsilon_arg), this->options_->ignore_existing_flag);
       else
         kdtree.template knn<KVector>(this->test_set_[i], K, knn, metric, Distance(this->options_->epsilon_arg), this->options_->ignore_existing_flag);
 
       // Check the k nearest neighbours returned.
-      unsigned int num_elems = std::min(static_cast<unsigned int>(knn.size()), K);
+      unsigned int num_elems = std::min(static_cast<unsigned int>(knn.size()), exact.num_neighbours(i));
       for (unsigned int k=0; k<num_elems; ++k) {
 
         // Check if the points in the tree were correctly ignored if requested.
-        if (this->options_->ignore_existing_flag && this->test_set_[i] == this->train_set_[knn[k].index()] &&
-            !(nearest[knn[k].index()].squared_distance() == Traits<Distance>::max())) {
-          std::cerr << "Nearest neighbour " << k << " failed (in the tree but not ignored): index " << nearest[k].index()
-              << "(" << nearest[k].squared_distance() << "), expected index " << knn[k].index() << " (" << knn[k].squared_distance()
+        const Neighbor &nearest = exact.neighbour(i, k);
+        if (this->options_->ignore_existing_flag && this->test_set_[i] == this->train_set_[knn[k].index()]) {
+          std::cerr << "Nearest neighbour " << k << " failed (in the tree but not ignored): index " << nearest.index()
+              << "(" << nearest.squared_distance() << "), expected index " << knn[k].index() << " (" << knn[k].squared_distance()
               << ") in test case " << i << std::endl;
           ok = false;
         }
 
-        // Check if distances match with expected ones.
+        // Check if distances match with expected ones, allowing for the rounding error of the squared norm expansion if used.
+        Distance expansion_tolerance = expansion_error<Metric>(this->train_set_[knn[k].index()], this->test_set_[i]);
+        if (expansion_tolerance > max_expansion_error)
+          max_expansion_error = expansion_tolerance;
+        expansion_tolerance += Distance(this->options_->tolerance_arg);
+
         Distance difference = knn[k].squared_distance();
-        difference -= nearest[k].squared_distance();
+        difference -= nearest.squared_distance();
         Traits<Distance>::abs(difference);
-        if (difference > Distance(this->options_->tolerance_arg)) {
-          std::cerr << "Nearest neighbour " << k << " failed: index " << nearest[k].index() << " (" <<nearest[k].squared_distance()
+        if (difference > expansion_tolerance) {
+          std::cerr << "Nearest neighbour " << k << " failed: index " << nearest.index() << " (" << nearest.squared_distance()
               << "), expected index " << knn[k].index() << " (" << knn[k].squared_distance() << ") in test case " << i << std::endl;
           ok = false;
         }
@@ -198,14 +233,27 @@ bool VerificationTool<T, D, L>::run(const Metric &metric) {
         // Since the knn method uses incremental calculations, depending on the type used the result
         // values can be slightly different. This can be more accute with higher dimension values.
         Distance dist1 = metric(this->train_set_[knn[k].index()], this->test_set_[i]);
-        Distance dist2 = nearest[k].squared_distance();
+        Distance dist2 = nearest.squared_distance();
+
+        // Keep track of the error of the returned distance.
+        Distance error = dist1;
+        error -= knn[k].squared_distance();
+        if (error < Traits<Distance>::zero()) {
+          error = knn[k].squared_distance();
+          error -= dist1;
+        }
+        if (error > max_distance_error)
+          max_distance_error = error;
 
         difference = dist1;
         difference -= dist2;
         Traits<Distance>::abs(difference);
 
+        // Neighbours at almost the same distance can be swapped within the rounding error of the squared norm expansion, if used.
         Distance sqr_tolerance(this->options_->tolerance_arg);
         sqr_tolerance *= sqr_tolerance;
+        sqr_tolerance += expansion_error<Metric>(this->train_set_[knn[k].index()], this->test_set_[i]);
+        sqr_tolerance += expansion_error<Metric>(this->train_set_[nearest.index()], this->test_set_[i]);
 
         if (difference > sqr_tolerance) {
           std::cerr << "Nearest neighbour " << k << " failed: returned distance doesn't match (" << dist1
@@ -215,10 +263,14 @@ bool VerificationTool<T, D, L>::run(const Metric &metric) {
       }
 
       // Check vector size.
-      if (knn.size() != num_elems) {
-        std::cerr << "Wrong nearest neighbour vector size (" << knn.size() << ", expected " << num_elems << ") in test case " << i << std::endl;
+      if (knn.size() != exact.num_neighbours(i)) {
+        std::cerr << "Wrong nearest neighbour vector size (" << knn.size() << ", expected " << exact.num_neighbours(i) << ") in test case " << i << std::endl;
         ok = false;
       }
+
+      // Evaluate the results against the ground truth.
+      if (this->has_ground_truth())
+        recall += this->recall(i, knn, K);
     }
 
     // Test the all-in-range functionality.
@@ -243,8 +295,7 @@ bool VerificationTool<T, D, L>::run(const Metric &metric) {
       for (unsigned int k=0; k<points_in_range.size(); ++k) {
 
         // Check if the points in the tree were correctly ignored if requested.
-        if (this->options_->ignore_existing_flag && this->test_set_[i] == this->train_set_[points_in_range[k].index()] &&
-            !(nearest[points_in_range[k].index()].squared_distance() == Traits<Distance>::max())) {
+        if (this->options_->ignore_existing_flag && this->test_set_[i] == this->train_set_[points_in_range[k].index()]) {
           std::cerr << "In-range point: index " << points_in_range[k].index() << " ("
               << points_in_range[i].squared_distance() << ") in tree but not ignored in test case " << i << std::endl;
           ok = false;
@@ -265,31 +316,132 @@ bool VerificationTool<T, D, L>::run(const Metric &metric) {
         difference -= dist2;
         Traits<Distance>::abs(difference);
 
-        if (difference > sqr_tolerance) {
+        Distance expansion_tolerance = expansion_error<Metric>(this->train_set_[points_in_range[k].index()], this->test_set_[i]);
+        expansion_tolerance += sqr_tolerance;
+        if (difference > expansion_tolerance) {
           std::cerr << "In-range point failed: returned squared distance doesnt't match (" << dist1 <<
               " != " << dist2 << ") in test case " << i << std::endl;
           ok = false;
         }
       }
 
-      // Count number of points in range.
-      unsigned int in_range = 0;
-      for (unsigned int n=0; n<this->train_set_.size(); ++n) {
-        if (!(nearest[n].squared_distance() > squared_search_range)) {
-          KCHE_TREE_DCHECK(!(this->options_->ignore_existing_flag && nearest[n].squared_distance() == Traits<Distance>::zero()));
-          ++in_range;
-        }
-      }
+      // Get the number of points in range from the exhaustive search.
+      unsigned int in_range = exact.num_in_range(i);
+
+      // Points close enough to the limit of the range can be included or not within the rounding error of the squared norm expansion, if used.
+      unsigned int min_in_range = in_range, max_in_range = in_range;
+      if (in_range != points_in_range.size() && this->options_->squared_norms_flag)
+        expanded_range_counts(metric, this->test_set_[i], squared_search_range, min_in_range, max_in_range);
 
       // Check number of points in range.
-      if (in_range != points_in_range.size()) {
+      if (points_in_range.size() < min_in_range || points_in_range.size() > max_in_range) {
         std::cerr << "Wrong number of neighbours within range " << this->options_->all_in_range_arg << " (found " <<
             points_in_range.size() << ", expected " << in_range << ") in test case " << i << std::endl;
         ok = false;
       }
+
+      // Check the number of points in range counted without retrieving them.
+      unsigned int count = kdtree.count_in_range(this->test_set_[i], search_range, metric, this->options_->ignore_existing_flag);
+      if (count != points_in_range.size()) {
+        std::cerr << "Wrong count of neighbours within range " << this->options_->all_in_range_arg << " (counted " <<
+            count << ", retrieved " << points_in_range.size() << ") in test case " << i << std::endl;
+        ok = false;
+      }
+    }
+  }
+
+  // Test the axis-aligned box searches against an exhaustive search.
+  if (this->options_->all_in_box_flag) {
+    for (unsigned int i=0; i<this->test_set_.size(); ++i) {
+
+      // Build the box spanned by the test vector and a train vector. Only requires comparisons between elements.
+      const typename KDTree::Vector &corner = this->train_set_[i % this->train_set_.size()];
+      typename KDTree::Vector lower = this->test_set_[i], upper = this->test_set_[i];
+      for (unsigned int d=0; d<D; ++d) {
+        if (corner[d] < lower[d])
+          lower[d] = corner[d];
+        if (corner[d] > upper[d])
+          upper[d] = corner[d];
+      }
+
+      std::vector<unsigned int> in_box, expected;
+      kdtree.all_in_box(lower, upper, in_box);
+      for (unsigned int j=0; j<this->train_set_.size(); ++j) {
+        bool inside = true;
+        for (unsigned int d=0; d<D && inside; ++d)
+          inside = !(this->train_set_[j][d] < lower[d]) && !(this->train_set_[j][d] > upper[d]);
+        if (inside)
+          expected.push_back(j);
+      }
+
+      std::sort(in_box.begin(), in_box.end());
+      if (in_box != expected) {
+        std::cerr << "Wrong points inside the box (found " << in_box.size()
+            << ", expected " << expected.size() << ") in test case " << i << std::endl;
+        ok = false;
+      }
+
+      unsigned int count = kdtree.count_in_box(lower, upper);
+      if (count != expected.size()) {
+        std::cerr << "Wrong count of points inside the box (counted " << count
+            << ", expected " << expected.size() << ") in test case " << i << std::endl;
+        ok = false;
+      }
     }
   }
 
+  // Test the searches excluding train vectors by their indices.
+  if (this->options_->leave_one_out_flag && this->options_->knn_arg > 0 && !verify_leave_one_out(kdtree, metric))
+    ok = false;
+
+  // Test the kernel density estimations.
+  if (this->options_->kernel_density_arg > 0.0f &&
+      !ArithmeticOnly<T, KernelDensityVerification>::Type::verify(kdtree, this->train_set_, this->test_set_, this->options_->kernel_density_arg, this->options_->kernel_error_arg))
+    ok = false;
+
+  // Test the DBSCAN clustering of the train set.
+  if (this->options_->dbscan_arg > 0.0f &&
+      !ArithmeticOnly<T, DBSCANVerification>::Type::verify(kdtree, this->train_set_, this->options_->dbscan_arg, this->options_->dbscan_min_points_arg))
+    ok = false;
+
+  // Test the joins between the train set and the test set.
+  if (this->options_->join_arg > 0.0f &&
+      !ArithmeticOnly<T, JoinVerification>::Type::verify(kdtree, this->train_set_, this->test_set_, this->build_options(metric), this->options_->join_arg, this->options_->tolerance_arg))
+    ok = false;
+
+  // Test the minimum spanning tree of the train set.
+  if (this->options_->spanning_tree_flag && !ArithmeticOnly<T, SpanningTreeVerification>::Type::verify(kdtree, this->train_set_, this->options_->tolerance_arg))
+    ok = false;
+
+  // Test the k-means clustering of the train set.
+  if (this->options_->kmeans_arg > 0 &&
+      !ArithmeticOnly<T, KMeansVerification>::Type::verify(kdtree, this->train_set_, this->options_->kmeans_arg, this->options_->kmeans_iterations_arg, this->options_->tolerance_arg))
+    ok = false;
+
+  // Test the local outlier factors of the train set and the test set.
+  if (this->options_->outlier_factors_arg > 0 &&
+      !ArithmeticOnly<T, OutlierFactorVerification>::Type::verify(kdtree, this->train_set_, this->test_set_, this->options_->outlier_factors_arg, this->options_->tolerance_arg))
+    ok = false;
+
+  // Test the label summaries of a labeled copy of the train set.
+  if (this->options_->label_summaries_arg > 0 &&
+      !ArithmeticOnly<T, LabelSummaryVerification>::Type::verify(this->train_set_, this->test_set_, this->build_options(metric), this->options_->label_summaries_arg, this->options_->all_in_range_arg))
+    ok = false;
+
+  // Test the rank-one updates of the inverse covariance matrix of the metric.
+  if (this->options_->rank_one_updates_flag &&
+      !ArithmeticOnly<T, RankOneUpdateVerification>::Type::verify(metric, this->train_set_, this->test_set_, this->options_->tolerance_arg))
+    ok = false;
+
+  // Report the numerical error of the distances calculated with squared norms.
+  if (this->options_->squared_norms_flag && this->options_->knn_arg > 0)
+    std::cout << "Largest knn distance error using squared norms: " << max_distance_error << " (tolerance " << this->options_->tolerance_arg
+        << " plus an expansion error bound of up to " << max_expansion_error << ")" << std::endl;
+
+  // Report the recall with respect to the ground truth.
+  if (this->has_ground_truth() && this->options_->knn_arg > 0 && this->test_set_.size() > 0)
+    std::cout << "Recall@" << this->options_->knn_arg << " against the ground truth: " << recall / this->test_set_.size() << std::endl;
+
   // Report results.
   if (ok)
     std::cout << "All tests OK!" << std::endl;
@@ -299,3 +451,998 @@ bool VerificationTool<T, D, L>::run(const Metric &metric) {
   return ok;
 }
 
+/**
+ * \brief Verify the K nearest neighbours of some train vectors searched excluding each one by its index.
+ *
+ * Train vectors evenly spaced in the train set are used as queries, as many as vectors in the test set.
+ * Results are compared with an exhaustive search that skips the excluded index only, so identical vectors must still be found.
+ *
+ * \param kdtree Kd-tree built from the train set.
+ * \param metric Metric used to search the kd-tree.
+ * \return \c true if all the results are correct, \c false otherwise.
+ */
+template <typename T, unsigned int D, typename L> template <typename KDTreeType, typename MetricType>
+bool VerificationTool<T, D, L>::verify_leave_one_out(const KDTreeType &kdtree, const MetricType &metric) const {
+
+  typedef typename KDTreeType::Distance Distance;
+  typedef typename KDTreeType::Neighbor Neighbor;
+
+  bool ok = true;
+  unsigned int K = this->options_->knn_arg;
+  unsigned int num_queries = std::min(this->train_set_.size(), this->test_set_.size());
+  Distance tolerance(this->options_->tolerance_arg);
+
+  for (unsigned int q=0; q<num_queries; ++q) {
+    unsigned int index = static_cast<unsigned int>(static_cast<uint64_t>(q) * this->train_set_.size() / num_queries);
+    const typename KDTreeType::Vector &query = this->train_set_[index];
+
+    // Search the nearest neighbours excluding the query itself.
+    std::vector<Neighbor> knn;
+    if (this->options_->use_k_heap_flag)
+      kdtree.template knn_excluding<kche_tree::KHeap>(query, K, knn, index, metric);
+    else
+      kdtree.template knn_excluding<kche_tree::KVector>(query, K, knn, index, metric);
+
+    // Calculate the expected distances exhaustively.
+    std::vector<Distance> distances;
+    distances.reserve(this->train_set_.size());
+    for (unsigned int i=0; i<this->train_set_.size(); ++i) {
+      if (i != index)
+        distances.push_back(metric(this->train_set_[i], query));
+    }
+    unsigned int expected_size = std::min(K, static_cast<unsigned int>(distances.size()));
+    std::partial_sort(distances.begin(), distances.begin() + expected_size, distances.end());
+
+    if (knn.size() != expected_size) {
+      std::cerr << "Wrong leave-one-out nearest neighbour vector size (" << knn.size() << ", expected " << expected_size << ") for train index " << index << std::endl;
+      ok = false;
+      continue;
+    }
+
+    for (unsigned int k=0; k<expected_size; ++k) {
+      if (knn[k].index() == index) {
+        std::cerr << "Leave-one-out nearest neighbour " << k << " failed: excluded train index " << index << " returned" << std::endl;
+        ok = false;
+      }
+
+      // Allow for the rounding error of the squared norm expansion if used.
+      Distance expansion_tolerance = expansion_error<MetricType>(this->train_set_[knn[k].index()], query);
+      expansion_tolerance += tolerance;
+
+      Distance difference = knn[k].squared_distance();
+      difference -= distances[k];
+      kche_tree::Traits<Distance>::abs(difference);
+      if (difference > expansion_tolerance) {
+        std::cerr << "Leave-one-out nearest neighbour " << k << " failed: index " << knn[k].index() << " (" << knn[k].squared_distance()
+            << "), expected distance " << distances[k] << " for train index " << index << std::endl;
+        ok = false;
+      }
+    }
+  }
+
+  return ok;
+}
+
+/**
+ * \brief Get the bound of the rounding error of the distance between two vectors expanded in terms of squared norms and dot products.
+ *
+ * Kd-trees built with squared norms calculate the Euclidean distances of floating point types as ||a||² + ||b||² - 2 a·b,
+ * whose rounding error is proportional to the squared norms instead of to the distance. Returned distances are checked
+ * against the metric with this bound added to the tolerance.
+ *
+ * \param v1 First feature vector.
+ * \param v2 Second feature vector.
+ * \return Bound of the rounding error of the expanded distance. Zero if squared norms are not used.
+ */
+template <typename T, unsigned int D, typename L> template <typename MetricType>
+typename kche_tree::Traits<T>::Distance VerificationTool<T, D, L>::expansion_error(const typename DataSet::Vector &v1, const typename DataSet::Vector &v2) const {
+  typedef kche_tree::DotProductDistance<T, D, MetricType> Expansion;
+  typename kche_tree::Traits<T>::Distance error = kche_tree::Traits<typename kche_tree::Traits<T>::Distance>::zero();
+  if (!this->options_->squared_norms_flag || !Expansion::enabled)
+    return error;
+
+  error = Expansion::squared_norm(v1);
+  error += Expansion::squared_norm(v2);
+  error *= Expansion::relative_error();
+  return error;
+}
+
+/**
+ * \brief Count the train vectors certainly within a range of a test vector, and the ones possibly within it when distances are expanded with squared norms.
+ *
+ * \param metric Metric used to calculate the distances.
+ * \param p Test vector.
+ * \param squared_range Squared distance of the range.
+ * \param min_count Returns the number of train vectors within the range minus the rounding error of their expanded distance.
+ * \param max_count Returns the number of train vectors within the range plus the rounding error of their expanded distance.
+ */
+template <typename T, unsigned int D, typename L> template <typename MetricType>
+void VerificationTool<T, D, L>::expanded_range_counts(const MetricType &metric, const typename DataSet::Vector &p,
+    const typename kche_tree::Traits<T>::Distance &squared_range, unsigned int &min_count, unsigned int &max_count) const {
+
+  typedef typename kche_tree::Traits<T>::Distance Distance;
+  min_count = max_count = 0;
+  for (unsigned int j=0; j<this->train_set_.size(); ++j) {
+    Distance distance = metric(this->train_set_[j], p);
+    if (this->options_->ignore_existing_flag && distance == kche_tree::Traits<Distance>::zero())
+      continue;
+
+    Distance error = expansion_error<MetricType>(this->train_set_[j], p);
+    Distance lower = squared_range, upper = squared_range;
+    lower -= error;
+    upper += error;
+    if (!(distance > lower))
+      ++min_count;
+    if (!(distance > upper))
+      ++max_count;
+  }
+}
+
+/**
+ * \brief Verify the Gaussian kernel densities estimated at the test vectors, both individually and in batch.
+ *
+ * Estimations must be within the requested relative error of an exhaustive sum, with some margin for rounding errors.
+ *
+ * \param kdtree Kd-tree built from the train set.
+ * \param train_set Train set used to build the kd-tree.
+ * \param test_set Test set where the densities are estimated.
+ * \param bandwidth Standard deviation of the Gaussian kernel.
+ * \param relative_error Maximum relative error of the estimations.
+ * \return \c true if all the estimations are correct, \c false otherwise.
+ */
+template <typename KDTreeType, typename DataSet>
+bool KernelDensityVerification::verify(const KDTreeType &kdtree, const DataSet &train_set, const DataSet &test_set, double bandwidth, double relative_error) {
+
+  bool ok = true;
+  const double factor = -0.5 / (bandwidth * bandwidth);
+  const double tolerance = relative_error + 1e-6;
+
+  std::vector<double> batch;
+  kdtree.kernel_density(test_set, bandwidth, batch, relative_error);
+
+  for (unsigned int i=0; i<test_set.size(); ++i) {
+
+    // Calculate the exact density by an exhaustive sum.
+    double exact = 0.0;
+    for (unsigned int j=0; j<train_set.size(); ++j) {
+      double squared_distance = 0.0;
+      for (unsigned int d=0; d<KDTreeType::Dimensions; ++d) {
+        double difference = static_cast<double>(test_set[i][d]) - static_cast<double>(train_set[j][d]);
+        squared_distance += difference * difference;
+      }
+      exact += std::exp(factor * squared_distance);
+    }
+    exact /= train_set.size();
+
+    double single = kdtree.kernel_density(test_set[i], bandwidth, relative_error);
+    if (std::fabs(single - exact) > tolerance * exact) {
+      std::cerr << "Wrong kernel density (" << single << ", expected " << exact << ") in test case " << i << std::endl;
+      ok = false;
+    }
+
+    if (std::fabs(batch[i] - exact) > tolerance * exact) {
+      std::cerr << "Wrong batch kernel density (" << batch[i] << ", expected " << exact << ") in test case " << i << std::endl;
+      ok = false;
+    }
+  }
+
+  return ok;
+}
+
+/**
+ * \brief Verify the DBSCAN clusters of the train set against an exhaustive clustering.
+ *
+ * Core vectors must be partitioned in the same clusters, up to their numbering. Other vectors must join the cluster of
+ * a core vector within the distance, or be noise if there is none. Clusters must be numbered by their first vector.
+ *
+ * \param kdtree Kd-tree built from the train set.
+ * \param train_set Train set used to build the kd-tree.
+ * \param distance Distance within which vectors are neighbours.
+ * \param min_points Minimum number of neighbours of core vectors, including themselves.
+ * \return \c true if the clusters are correct, \c false otherwise.
+ */
+template <typename KDTreeType, typename DataSet>
+bool DBSCANVerification::verify(const KDTreeType &kdtree, const DataSet &train_set, double distance, unsigned int min_points) {
+
+  const unsigned int size = train_set.size();
+  const double squared_range = distance * distance;
+
+  std::vector<int> labels;
+  unsigned int num_clusters = kdtree.dbscan(distance, min_points, labels);
+  if (labels.size() != size) {
+    std::cerr << "Wrong DBSCAN label vector size (" << labels.size() << ", expected " << size << ")" << std::endl;
+    return false;
+  }
+
+  // Find the core vectors exhaustively.
+  struct Neighbors {
+    static bool within(const DataSet &set, unsigned int i, unsigned int j, double squared_range) {
+      double squared_distance = 0.0;
+      for (unsigned int d=0; d<KDTreeType::Dimensions; ++d) {
+        double difference = static_cast<double>(set[i][d]) - static_cast<double>(set[j][d]);
+        squared_distance += difference * difference;
+      }
+      return squared_distance <= squared_range;
+    }
+  };
+
+  std::vector<char> core(size, 0);
+  for (unsigned int i=0; i<size; ++i) {
+    unsigned int count = 0;
+    for (unsigned int j=0; j<size && count < min_points; ++j)
+      count += Neighbors::within(train_set, i, j, squared_range);
+    core[i] = count >= min_points;
+  }
+
+  // Cluster the core vectors by expanding each one not visited yet.
+  std::vector<int> expected(size, -1);
+  int num_expected = 0;
+  for (unsigned int i=0; i<size; ++i) {
+    if (!core[i] || expected[i] >= 0)
+      continue;
+
+    std::vector<unsigned int> pending(1, i);
+    expected[i] = num_expected;
+    while (!pending.empty()) {
+      unsigned int current = pending.back();
+      pending.pop_back();
+      for (unsigned int j=0; j<size; ++j) {
+        if (core[j] && expected[j] < 0 && Neighbors::within(train_set, current, j, squared_range)) {
+          expected[j] = num_expected;
+          pending.push_back(j);
+        }
+      }
+    }
+    ++num_expected;
+  }
+
+  std::cout << "DBSCAN clusters found: " << num_clusters << " (" << std::count(labels.begin(), labels.end(), -1) << " noise vectors)" << std::endl;
+
+  bool ok = true;
+  if (num_clusters != static_cast<unsigned int>(num_expected)) {
+    std::cerr << "Wrong number of DBSCAN clusters (" << num_clusters << ", expected " << num_expected << ")" << std::endl;
+    ok = false;
+  }
+
+  // Clusters must be numbered by their first vector, and map one to one to the expected ones.
+  std::vector<int> mapping(num_expected, -1), reverse_mapping(std::max<unsigned int>(num_clusters, num_expected), -1);
+  int next_label = 0;
+  for (unsigned int i=0; i<size; ++i) {
+    if (labels[i] == next_label)
+      ++next_label;
+    else if (labels[i] > next_label || labels[i] < -1) {
+      std::cerr << "DBSCAN cluster " << labels[i] << " numbered out of order at train index " << i << std::endl;
+      return false;
+    }
+
+    if (!core[i])
+      continue;
+
+    if (mapping[expected[i]] < 0 && labels[i] >= 0 && reverse_mapping[labels[i]] < 0) {
+      mapping[expected[i]] = labels[i];
+      reverse_mapping[labels[i]] = expected[i];
+    }
+    if (labels[i] != mapping[expected[i]]) {
+      std::cerr << "Wrong DBSCAN cluster of core vector " << i << " (" << labels[i] << ")" << std::endl;
+      ok = false;
+    }
+  }
+
+  // Other vectors must be in the cluster of a core vector within the distance, if any.
+  for (unsigned int i=0; i<size; ++i) {
+    if (core[i])
+      continue;
+
+    bool found = false, has_core = false;
+    for (unsigned int j=0; j<size && !found; ++j) {
+      if (core[j] && Neighbors::within(train_set, i, j, squared_range)) {
+        has_core = true;
+        found = labels[i] >= 0 && labels[i] == mapping[expected[j]];
+      }
+    }
+    if (!found && (has_core || labels[i] != -1)) {
+      std::cerr << "Wrong DBSCAN cluster of non-core vector " << i << " (" << labels[i] << ")" << std::endl;
+      ok = false;
+    }
+  }
+
+  return ok;
+}
+
+/**
+ * \brief Verify the dual-tree joins between the train set and a kd-tree built from the test set against an exhaustive search.
+ *
+ * Nearest vectors must be at the exhaustive nearest distance, or not found if it is beyond the join distance. The
+ * closest pair of both sets must be at the exhaustive closest distance. Both kd-trees may store their dimensions in
+ * different orders if built with reordered dimensions.
+ *
+ * \param kdtree Kd-tree built from the train set.
+ * \param train_set Train set used to build the kd-tree.
+ * \param test_set Test set used to build the joined kd-tree.
+ * \param build_options Options used to build the kd-tree of the train set, also used for the test set.
+ * \param distance Euclidean distance within which nearest vectors are searched.
+ * \param tolerance Tolerance of the distances.
+ * \return \c true if the joins are correct, \c false otherwise.
+ */
+template <typename KDTreeType, typename DataSet, typename TestSet>
+bool JoinVerification::verify(const KDTreeType &kdtree, const DataSet &train_set, const TestSet &test_set, const kche_tree::BuildOptions &build_options, double distance, double tolerance) {
+
+  const unsigned int D = KDTreeType::Dimensions;
+  if (train_set.size() == 0 || test_set.size() == 0)
+    return true;
+
+  kche_tree::KDTree<typename KDTreeType::Element, KDTreeType::Dimensions> test_tree;
+  test_tree.build(test_set, build_options);
+
+  struct Distances {
+    static double between(const typename DataSet::Vector &v1, const typename TestSet::Vector &v2) {
+      double distance = 0.0;
+      for (unsigned int d=0; d<D; ++d) {
+        double difference = static_cast<double>(v1[d]) - static_cast<double>(v2[d]);
+        distance += difference * difference;
+      }
+      return std::sqrt(distance);
+    }
+  };
+
+  std::vector<int> nearest;
+  std::vector<double> distances;
+  try {
+    kdtree.nearest_within(test_tree, distance, nearest, &distances);
+  } catch (const std::invalid_argument &) {
+    std::cerr << "Unexpected rejection of the join between the train set and the test set" << std::endl;
+    return false;
+  }
+
+  if (nearest.size() != train_set.size()) {
+    std::cerr << "Wrong join result vector size (" << nearest.size() << ", expected " << train_set.size() << ")" << std::endl;
+    return false;
+  }
+
+  // Check the nearest test vector of each train vector and find the closest pair exhaustively.
+  bool ok = true;
+  unsigned int num_found = 0;
+  double closest = std::numeric_limits<double>::infinity();
+  for (unsigned int i=0; i<train_set.size(); ++i) {
+    double expected = std::numeric_limits<double>::infinity();
+    for (unsigned int j=0; j<test_set.size(); ++j)
+      expected = std::min(expected, Distances::between(train_set[i], test_set[j]));
+    closest = std::min(closest, expected);
+
+    if (expected > distance) {
+      if (nearest[i] >= 0) {
+        std::cerr << "Join found test vector " << nearest[i] << " for train vector " << i << " beyond the distance (nearest at " << expected << ")" << std::endl;
+        ok = false;
+      }
+      continue;
+    }
+
+    if (nearest[i] < 0 || static_cast<unsigned int>(nearest[i]) >= test_set.size()) {
+      std::cerr << "Join missed the nearest test vector of train vector " << i << " at distance " << expected << std::endl;
+      ok = false;
+      continue;
+    }
+
+    ++num_found;
+    double found = Distances::between(train_set[i], test_set[nearest[i]]);
+    if (std::fabs(found - expected) > tolerance || std::fabs(distances[i] - expected) > tolerance) {
+      std::cerr << "Wrong nearest test vector " << nearest[i] << " of train vector " << i << " (distance " << found << ", reported " << distances[i] << ", expected " << expected << ")" << std::endl;
+      ok = false;
+    }
+  }
+  std::cout << "Train vectors joined with a test vector: " << num_found << std::endl;
+
+  unsigned int index = 0, other_index = 0;
+  double pair_distance = kdtree.closest_pair(test_tree, index, other_index);
+  double found = Distances::between(train_set[index], test_set[other_index]);
+  if (std::fabs(pair_distance - closest) > tolerance || std::fabs(found - closest) > tolerance) {
+    std::cerr << "Wrong closest pair (" << index << ", " << other_index << ") at distance " << found << ", reported " << pair_distance << ", expected " << closest << std::endl;
+    ok = false;
+  }
+
+  return ok;
+}
+
+/**
+ * \brief Verify the Euclidean minimum spanning tree of the train set against an exhaustive Prim's algorithm.
+ *
+ * The edges must span the train set in increasing order of distance and add up to the length of the exhaustive
+ * tree. Since the connected components of the edges up to any distance are the same for all minimum spanning trees,
+ * the single-linkage clusters at the median edge length must also match the ones of the exhaustive tree exactly.
+ *
+ * \param kdtree Kd-tree built from the train set.
+ * \param train_set Train set used to build the kd-tree.
+ * \param tolerance Tolerance of the total length of the tree.
+ * \return \c true if the spanning tree is correct, \c false otherwise.
+ */
+template <typename KDTreeType, typename DataSet>
+bool SpanningTreeVerification::verify(const KDTreeType &kdtree, const DataSet &train_set, double tolerance) {
+
+  const unsigned int D = KDTreeType::Dimensions;
+  const unsigned int size = train_set.size();
+
+  std::vector<kche_tree::SpanningTreeEdge> edges;
+  kdtree.minimum_spanning_tree(edges);
+
+  if (edges.size() + 1 != size && size > 0) {
+    std::cerr << "Wrong number of spanning tree edges (" << edges.size() << ", expected " << size - 1 << ")" << std::endl;
+    return false;
+  }
+
+  // Check that the edges are sorted and connect all the train vectors.
+  bool ok = true;
+  double length = 0.0;
+  kche_tree::DisjointSets components;
+  components.reset(size);
+  for (unsigned int i=0; i<edges.size(); ++i) {
+    if (edges[i].first >= edges[i].second || edges[i].second >= size || !components.merge(edges[i].first, edges[i].second)) {
+      std::cerr << "Wrong spanning tree edge " << i << " (" << edges[i].first << ", " << edges[i].second << ")" << std::endl;
+      return false;
+    }
+
+    if (i > 0 && edges[i].distance < edges[i - 1].distance) {
+      std::cerr << "Spanning tree edge " << i << " is not sorted by distance" << std::endl;
+      ok = false;
+    }
+    length += edges[i].distance;
+  }
+
+  // Build the exhaustive tree with Prim's algorithm.
+  std::vector<double> distances(size, std::numeric_limits<double>::infinity());
+  std::vector<unsigned int> parents(size, 0);
+  std::vector<char> added(size, 0);
+  std::vector<std::pair<double, std::pair<unsigned int, unsigned int> > > expected_edges;
+  double expected_length = 0.0;
+  unsigned int current = 0;
+  for (unsigned int n=1; n<size; ++n) {
+    added[current] = 1;
+    unsigned int next = size;
+    for (unsigned int i=0; i<size; ++i) {
+      if (added[i])
+        continue;
+
+      double distance = 0.0;
+      for (unsigned int d=0; d<D; ++d) {
+        double difference = static_cast<double>(train_set[current][d]) - static_cast<double>(train_set[i][d]);
+        distance += difference * difference;
+      }
+      if (distance < distances[i]) {
+        distances[i] = distance;
+        parents[i] = current;
+      }
+      if (next == size || distances[i] < distances[next])
+        next = i;
+    }
+
+    expected_edges.push_back(std::make_pair(std::sqrt(distances[next]), std::make_pair(parents[next], next)));
+    expected_length += std::sqrt(distances[next]);
+    current = next;
+  }
+
+  std::cout << "Minimum spanning tree length: " << length << std::endl;
+  if (std::fabs(length - expected_length) > tolerance * (1.0 + expected_length)) {
+    std::cerr << "Wrong minimum spanning tree length (" << length << ", expected " << expected_length << ")" << std::endl;
+    ok = false;
+  }
+
+  if (edges.empty())
+    return ok;
+
+  // Compare the single-linkage clusters at the median edge length.
+  double distance = edges[edges.size() / 2].distance;
+  std::vector<unsigned int> labels;
+  unsigned int num_clusters = kdtree.single_linkage(distance, labels);
+
+  std::sort(expected_edges.begin(), expected_edges.end());
+  components.reset(size);
+  for (unsigned int i=0; i<expected_edges.size() && expected_edges[i].first <= distance; ++i)
+    components.merge(expected_edges[i].second.first, expected_edges[i].second.second);
+
+  unsigned int expected_clusters = 0;
+  for (unsigned int i=0; i<size; ++i) {
+    unsigned int root = components.find(i);
+    unsigned int expected = root == i ? expected_clusters++ : labels[root];
+    if (labels[i] != expected) {
+      std::cerr << "Wrong single-linkage cluster of train vector " << i << " (" << labels[i] << ", expected " << expected << ")" << std::endl;
+      return false;
+    }
+  }
+
+  if (num_clusters != expected_clusters) {
+    std::cerr << "Wrong number of single-linkage clusters (" << num_clusters << ", expected " << expected_clusters << ")" << std::endl;
+    ok = false;
+  }
+
+  return ok;
+}
+
+/**
+ * \brief Verify the k-means clustering of the train set against exhaustive assignments.
+ *
+ * A single iteration must move the initial centers to the means of their exhaustively assigned vectors. After the
+ * full run, each vector must be labeled with its nearest final center, the reported inertia must match the labels
+ * and, if the centers converged, each one must be the mean of its vectors.
+ *
+ * \param kdtree Kd-tree built from the train set.
+ * \param train_set Train set used to build the kd-tree.
+ * \param num_clusters Number of clusters, initialized with evenly spaced train vectors.
+ * \param max_iterations Maximum number of iterations.
+ * \param tolerance Tolerance of the coordinates of the centers.
+ * \return \c true if the clustering is correct, \c false otherwise.
+ */
+template <typename KDTreeType, typename DataSet>
+bool KMeansVerification::verify(const KDTreeType &kdtree, const DataSet &train_set, unsigned int num_clusters, unsigned int max_iterations, double tolerance) {
+
+  typedef kche_tree::DataSet<typename KDTreeType::Element, KDTreeType::Dimensions> CenterSet;
+  const unsigned int D = KDTreeType::Dimensions;
+  const unsigned int size = train_set.size();
+  num_clusters = std::min(num_clusters, size);
+
+  struct Distances {
+    static double squared(const typename CenterSet::Vector &center, const typename DataSet::Vector &vector) {
+      double distance = 0.0;
+      for (unsigned int d=0; d<D; ++d) {
+        double difference = static_cast<double>(center[d]) - static_cast<double>(vector[d]);
+        distance += difference * difference;
+      }
+      return distance;
+    }
+
+    static unsigned int nearest(const CenterSet &centers, const typename DataSet::Vector &vector, double &distance) {
+      unsigned int nearest = 0;
+      distance = squared(centers[0], vector);
+      for (unsigned int c=1; c<centers.size(); ++c) {
+        double candidate = squared(centers[c], vector);
+        if (candidate < distance) {
+          distance = candidate;
+          nearest = c;
+        }
+      }
+      return nearest;
+    }
+  };
+
+  CenterSet initial(num_clusters), centers(num_clusters);
+  for (unsigned int c=0; c<num_clusters; ++c)
+    initial[c] = centers[c] = train_set[static_cast<unsigned int>(static_cast<uint64_t>(c) * size / num_clusters)];
+
+  // Check a single iteration against the means of the exhaustive assignments.
+  bool ok = true;
+  std::vector<unsigned int> labels;
+  kdtree.kmeans(centers, labels, 1);
+
+  std::vector<double> sums(num_clusters * D, 0.0), counts(num_clusters, 0.0);
+  for (unsigned int i=0; i<size; ++i) {
+    double distance;
+    unsigned int nearest = Distances::nearest(initial, train_set[i], distance);
+    for (unsigned int d=0; d<D; ++d)
+      sums[nearest * D + d] += static_cast<double>(train_set[i][d]);
+    counts[nearest] += 1.0;
+  }
+
+  for (unsigned int c=0; c<num_clusters; ++c) {
+    for (unsigned int d=0; d<D; ++d) {
+      double expected = counts[c] > 0.0 ? sums[c * D + d] / counts[c] : static_cast<double>(initial[c][d]);
+      if (std::fabs(static_cast<double>(centers[c][d]) - expected) > tolerance) {
+        std::cerr << "Wrong k-means center " << c << " after one iteration (" << centers[c][d] << ", expected " << expected << ") in dimension " << d << std::endl;
+        ok = false;
+        break;
+      }
+    }
+  }
+
+  // Run the full clustering and check its labels and inertia.
+  for (unsigned int c=0; c<num_clusters; ++c)
+    centers[c] = initial[c];
+  double inertia = 0.0;
+  unsigned int iterations = kdtree.kmeans(centers, labels, max_iterations, &inertia);
+  std::cout << "K-means iterations run: " << iterations << " (inertia " << inertia << ")" << std::endl;
+
+  if (labels.size() != size) {
+    std::cerr << "Wrong k-means label vector size (" << labels.size() << ", expected " << size << ")" << std::endl;
+    return false;
+  }
+
+  double expected_inertia = 0.0;
+  sums.assign(num_clusters * D, 0.0);
+  counts.assign(num_clusters, 0.0);
+  for (unsigned int i=0; i<size; ++i) {
+    double distance;
+    Distances::nearest(centers, train_set[i], distance);
+    double labeled_distance = Distances::squared(centers[labels[i]], train_set[i]);
+    if (labels[i] >= num_clusters || labeled_distance > distance * (1.0 + 1e-4) + tolerance) {
+      std::cerr << "Wrong k-means label " << labels[i] << " of train vector " << i << " (squared distance " << labeled_distance << ", nearest " << distance << ")" << std::endl;
+      ok = false;
+    }
+
+    expected_inertia += labeled_distance;
+    for (unsigned int d=0; d<D; ++d)
+      sums[labels[i] * D + d] += static_cast<double>(train_set[i][d]);
+    counts[labels[i]] += 1.0;
+  }
+
+  if (std::fabs(inertia - expected_inertia) > 1e-4 * expected_inertia + tolerance) {
+    std::cerr << "Wrong k-means inertia (" << inertia << ", expected " << expected_inertia << ")" << std::endl;
+    ok = false;
+  }
+
+  // Converged centers must be the means of their vectors.
+  for (unsigned int c=0; c<num_clusters && iterations < max_iterations; ++c) {
+    for (unsigned int d=0; d<D && counts[c] > 0.0; ++d) {
+      double expected = sums[c * D + d] / counts[c];
+      if (std::fabs(static_cast<double>(centers[c][d]) - expected) > tolerance) {
+        std::cerr << "Converged k-means center " << c << " is not the mean of its vectors (" << centers[c][d] << ", expected " << expected << ") in dimension " << d << std::endl;
+        ok = false;
+        break;
+      }
+    }
+  }
+
+  return ok;
+}
+
+/**
+ * \brief Verify the local outlier factors of the train set and the test set against an exhaustive search.
+ *
+ * The K nearest neighbours of each train vector exclude only the vector itself. Test vectors are scored against
+ * the k-distances and densities of the train set, both individually and in batch. Distances are compared with
+ * the absolute tolerance and densities and factors relative to their expected values.
+ *
+ * \param kdtree Kd-tree built from the train set.
+ * \param train_set Train set used to build the kd-tree.
+ * \param test_set Test set scored against the train set.
+ * \param K Number of nearest neighbours defining the neighbourhood of each vector.
+ * \param tolerance Tolerance of the distances, also used as relative tolerance of the densities and factors.
+ * \return \c true if the factors are correct, \c false otherwise.
+ */
+template <typename KDTreeType, typename DataSet, typename TestSet>
+bool OutlierFactorVerification::verify(const KDTreeType &kdtree, const DataSet &train_set, const TestSet &test_set, unsigned int K, double tolerance) {
+
+  const unsigned int D = KDTreeType::Dimensions;
+  const unsigned int num_vectors = train_set.size();
+  if (K >= num_vectors) {
+    std::cerr << "Warning: not enough train vectors for " << K << " neighbours. Skipping the local outlier factor verification." << std::endl;
+    return true;
+  }
+
+  struct Exhaustive {
+    static double distance(const typename DataSet::Vector &v1, const typename KDTreeType::Vector &v2) {
+      double distance = 0.0;
+      for (unsigned int d=0; d<D; ++d) {
+        double difference = static_cast<double>(v1[d]) - static_cast<double>(v2[d]);
+        distance += difference * difference;
+      }
+      return std::sqrt(distance);
+    }
+
+    // Nearest K train vectors of a point, optionally excluding one of them. Candidates are sorted in a reused scratch vector so that only K entries are kept.
+    static void neighbors(const DataSet &train_set, const typename KDTreeType::Vector &p, unsigned int K, int excluded,
+        std::vector<std::pair<double, unsigned int> > &scratch, std::vector<std::pair<double, unsigned int> > &output) {
+      scratch.clear();
+      for (unsigned int j=0; j<train_set.size(); ++j) {
+        if (static_cast<int>(j) != excluded)
+          scratch.push_back(std::make_pair(distance(train_set[j], p), j));
+      }
+      std::partial_sort(scratch.begin(), scratch.begin() + K, scratch.end());
+      std::vector<std::pair<double, unsigned int> >(scratch.begin(), scratch.begin() + K).swap(output);
+    }
+
+    // Inverse of the mean reachability distance to the neighbours of a point.
+    static double density(const std::vector<std::pair<double, unsigned int> > &neighbors, const std::vector<double> &k_distances) {
+      double sum = 0.0;
+      for (unsigned int j=0; j<neighbors.size(); ++j)
+        sum += std::max(neighbors[j].first, k_distances[neighbors[j].second]);
+      return sum > 0.0 ? neighbors.size() / sum : std::numeric_limits<double>::infinity();
+    }
+
+    // Mean ratio between the densities of the neighbours of a point and its own.
+    static double score(double density, const std::vector<std::pair<double, unsigned int> > &neighbors, const std::vector<double> &densities) {
+      const double infinity = std::numeric_limits<double>::infinity();
+      double sum = 0.0;
+      for (unsigned int j=0; j<neighbors.size(); ++j) {
+        if (density == infinity)
+          sum += densities[neighbors[j].second] == infinity ? 1.0 : 0.0;
+        else
+          sum += densities[neighbors[j].second] / density;
+      }
+      return sum / neighbors.size();
+    }
+
+    static bool differ(double value, double expected, double tolerance) {
+      if (value == expected)
+        return false;
+      return !(std::fabs(value - expected) <= tolerance * std::fabs(expected));
+    }
+  };
+
+  kche_tree::LocalOutlierFactors factors;
+  kdtree.local_outlier_factors(K, factors);
+  if (factors.k() != K || factors.size() != num_vectors) {
+    std::cerr << "Wrong local outlier factors size (" << factors.size() << " with K = " << factors.k() << ", expected " << num_vectors << " with K = " << K << ")" << std::endl;
+    return false;
+  }
+
+  // Compute the exhaustive neighbours of the train vectors and their k-distances.
+  std::vector<std::vector<std::pair<double, unsigned int> > > neighbors(num_vectors);
+  std::vector<std::pair<double, unsigned int> > scratch;
+  std::vector<double> k_distances(num_vectors), densities(num_vectors);
+  for (unsigned int i=0; i<num_vectors; ++i) {
+    Exhaustive::neighbors(train_set, train_set[i], K, i, scratch, neighbors[i]);
+    k_distances[i] = neighbors[i].back().first;
+  }
+
+  for (unsigned int i=0; i<num_vectors; ++i)
+    densities[i] = Exhaustive::density(neighbors[i], k_distances);
+
+  bool ok = true;
+  unsigned int num_outliers = 0;
+  for (unsigned int i=0; i<num_vectors; ++i) {
+    double expected_score = Exhaustive::score(densities[i], neighbors[i], densities);
+    if (std::fabs(factors.k_distances()[i] - k_distances[i]) > tolerance ||
+        Exhaustive::differ(factors.densities()[i], densities[i], tolerance) ||
+        Exhaustive::differ(factors.scores()[i], expected_score, tolerance)) {
+      std::cerr << "Wrong local outlier factor of train vector " << i << " (k-distance " << factors.k_distances()[i] << ", density " << factors.densities()[i] << ", factor " << factors.scores()[i]
+          << ", expected " << k_distances[i] << ", " << densities[i] << ", " << expected_score << ")" << std::endl;
+      ok = false;
+    }
+    if (expected_score > 1.5)
+      ++num_outliers;
+  }
+  std::cout << "Train vectors with a local outlier factor above 1.5: " << num_outliers << std::endl;
+
+  // Score the test vectors against the train set, individually and in batch.
+  std::vector<double> batch_scores;
+  kdtree.outlier_factor(test_set, factors, batch_scores);
+  if (batch_scores.size() != test_set.size()) {
+    std::cerr << "Wrong batch local outlier factor vector size (" << batch_scores.size() << ", expected " << test_set.size() << ")" << std::endl;
+    return false;
+  }
+
+  std::vector<std::pair<double, unsigned int> > test_neighbors;
+  for (unsigned int i=0; i<test_set.size(); ++i) {
+    Exhaustive::neighbors(train_set, test_set[i], K, -1, scratch, test_neighbors);
+    double expected = Exhaustive::score(Exhaustive::density(test_neighbors, k_distances), test_neighbors, densities);
+    double score = kdtree.outlier_factor(test_set[i], factors);
+    if (Exhaustive::differ(score, expected, tolerance) || Exhaustive::differ(batch_scores[i], expected, tolerance)) {
+      std::cerr << "Wrong local outlier factor of test vector " << i << " (" << score << ", batch " << batch_scores[i] << ", expected " << expected << ")" << std::endl;
+      ok = false;
+    }
+  }
+
+  return ok;
+}
+
+/**
+ * \brief Verify the label summaries of a labeled copy of the train set against an exhaustive search.
+ *
+ * Train vectors are labeled cyclically with the classes, and a kd-tree is built from them with label summaries
+ * and the same build options, going through a serialization round trip. Collapsed identical vectors are expected
+ * to be summarized with the label of the first vector of each group.
+ *
+ * \param train_set Train set labeled for the summaries.
+ * \param test_set Test set providing the boxes and the centers of the ranges.
+ * \param build_options Options used to build the kd-tree of the train set, also used for the labeled kd-tree.
+ * \param num_classes Number of label classes.
+ * \param distance Euclidean distance of the range summaries. Ranges are skipped if not positive.
+ * \return \c true if the summaries are correct, \c false otherwise.
+ */
+template <typename DataSet, typename TestSet>
+bool LabelSummaryVerification::verify(const DataSet &train_set, const TestSet &test_set, const kche_tree::BuildOptions &build_options, unsigned int num_classes, double distance) {
+
+  const unsigned int D = DataSet::Dimensions;
+  typedef kche_tree::LabeledDataSet<typename DataSet::Element, D, unsigned int> LabeledSet;
+  typedef kche_tree::KDTree<typename DataSet::Element, D, unsigned int> LabeledKDTree;
+
+  LabeledSet labeled_set(train_set.size());
+  for (unsigned int i=0; i<train_set.size(); ++i) {
+    labeled_set[i] = train_set[i];
+    labeled_set.label(i) = i % num_classes;
+  }
+
+  kche_tree::BuildOptions options = build_options;
+  options.label_summaries = true;
+  options.label_classes = num_classes;
+  LabeledKDTree built_tree, kdtree;
+  if (!built_tree.build(labeled_set, options)) {
+    std::cerr << "Failed to build the kd-tree with label summaries" << std::endl;
+    return false;
+  }
+
+  // The summaries are restored from the labels serialized with the kd-tree, including the ones of collapsed vectors.
+  std::stringstream stream;
+  stream << built_tree;
+  stream >> kdtree;
+
+  struct Expected {
+    static void add(kche_tree::LabelSummary &summary, unsigned int label) {
+      ++summary.count;
+      summary.sum += label;
+      ++summary.histogram[label];
+    }
+
+    static bool differ(const kche_tree::LabelSummary &summary, const kche_tree::LabelSummary &expected) {
+      return summary.count != expected.count || summary.histogram != expected.histogram ||
+          std::fabs(summary.sum - expected.sum) > 1e-9 * std::max(1.0, expected.sum);
+    }
+  };
+
+  bool ok = true;
+  double mean_count = 0.0;
+  for (unsigned int i=0; i<test_set.size(); ++i) {
+
+    // Summarize the box spanned by the test vector and a train vector.
+    const typename DataSet::Vector &corner = train_set[i % train_set.size()];
+    typename DataSet::Vector lower = test_set[i], upper = test_set[i];
+    for (unsigned int d=0; d<D; ++d) {
+      if (corner[d] < lower[d])
+        lower[d] = corner[d];
+      if (corner[d] > upper[d])
+        upper[d] = corner[d];
+    }
+
+    kche_tree::LabelSummary summary, expected;
+    expected.histogram.assign(num_classes, 0);
+    kdtree.summarize_box(lower, upper, summary);
+    for (unsigned int j=0; j<train_set.size(); ++j) {
+      bool inside = true;
+      for (unsigned int d=0; d<D && inside; ++d)
+        inside = !(train_set[j][d] < lower[d]) && !(train_set[j][d] > upper[d]);
+      if (inside)
+        Expected::add(expected, labeled_set.label(j));
+    }
+
+    if (Expected::differ(summary, expected)) {
+      std::cerr << "Wrong label summary inside the box (count " << summary.count << ", sum " << summary.sum
+          << ", expected " << expected.count << ", " << expected.sum << ") in test case " << i << std::endl;
+      ok = false;
+    }
+
+    // Summarize the range around the test vector.
+    if (!(distance > 0.0))
+      continue;
+
+    expected.count = 0;
+    expected.sum = 0.0;
+    expected.histogram.assign(num_classes, 0);
+    kdtree.summarize_in_range(test_set[i], distance, summary);
+    for (unsigned int j=0; j<train_set.size(); ++j) {
+      double squared_distance = 0.0;
+      for (unsigned int d=0; d<D; ++d) {
+        double difference = static_cast<double>(train_set[j][d]) - static_cast<double>(test_set[i][d]);
+        squared_distance += difference * difference;
+      }
+      if (!(squared_distance > distance * distance))
+        Expected::add(expected, labeled_set.label(j));
+    }
+    mean_count += expected.count;
+
+    if (Expected::differ(summary, expected)) {
+      std::cerr << "Wrong label summary in range (count " << summary.count << ", sum " << summary.sum
+          << ", expected " << expected.count << ", " << expected.sum << ") in test case " << i << std::endl;
+      ok = false;
+    }
+  }
+
+  if (distance > 0.0 && test_set.size() > 0)
+    std::cout << "Mean number of train vectors summarized in range: " << mean_count / test_set.size() << std::endl;
+
+  return ok;
+}
+
+/**
+ * \brief Skip the verification of the rank-one updates for metrics without an inverse covariance matrix.
+ *
+ * \return Always \c true.
+ */
+template <typename MetricType, typename DataSet, typename TestSet>
+bool RankOneUpdateVerification::verify(const MetricType &, const DataSet &, const TestSet &, double) {
+  std::cerr << "Warning: rank-one updates are only available for the Mahalanobis metric. Skipping their verification." << std::endl;
+  return true;
+}
+
+/**
+ * \brief Verify the rank-one updates of the inverse covariance matrix of the Mahalanobis metric.
+ *
+ * A metric is fitted to the train set, the test set is added and the first half of the train set is removed one vector
+ * at a time. The updated inverse covariance matrix must match a metric fitted to an estimator of the remaining vectors
+ * within the tolerance, relative to its largest entry. Removing a vector too far from the others to keep the covariance
+ * matrix positive definite must then be rejected without modifying the metric or the estimator.
+ *
+ * \param train_set Train set used to fit the metric.
+ * \param test_set Test set added to the metric.
+ * \param tolerance Maximum relative error of the updated inverse covariance matrix.
+ * \return \c true if the updates are correct, \c false otherwise.
+ */
+template <typename T, unsigned int D, typename DataSet, typename TestSet>
+bool RankOneUpdateVerification::verify(const kche_tree::MahalanobisMetric<T, D> &, const DataSet &train_set, const TestSet &test_set, double tolerance) {
+
+  typedef kche_tree::MahalanobisMetric<T, D> Metric;
+  typedef typename Metric::Distance Distance;
+  typedef kche_tree::CovarianceEstimator<T, D> Estimator;
+  typedef kche_tree::SymmetricMatrix<Distance> Matrix;
+
+  Estimator estimator;
+  estimator.add(train_set);
+  Metric updated;
+  if (!updated.set_inverse_covariance(estimator)) {
+    std::cerr << "Failed to fit the inverse covariance matrix to the train set" << std::endl;
+    return false;
+  }
+
+  // Add the test set and remove the first half of the train set.
+  bool ok = true;
+  const unsigned int num_removed = train_set.size() / 2;
+  for (unsigned int i=0; i<test_set.size() && ok; ++i) {
+    if (!updated.add_to_inverse_covariance(estimator, test_set[i])) {
+      std::cerr << "Rank-one update failed adding test vector " << i << std::endl;
+      ok = false;
+    }
+  }
+  for (unsigned int i=0; i<num_removed && ok; ++i) {
+    if (!updated.remove_from_inverse_covariance(estimator, train_set[i])) {
+      std::cerr << "Rank-one update failed removing train vector " << i << std::endl;
+      ok = false;
+    }
+  }
+  if (!ok)
+    return false;
+
+  // Refit the metric to an estimator of the remaining vectors.
+  Estimator remaining;
+  for (unsigned int i=num_removed; i<train_set.size(); ++i)
+    remaining.add(train_set[i]);
+  for (unsigned int i=0; i<test_set.size(); ++i)
+    remaining.add(test_set[i]);
+  Metric refitted;
+  if (!refitted.set_inverse_covariance(remaining)) {
+    std::cerr << "Failed to refit the inverse covariance matrix" << std::endl;
+    return false;
+  }
+
+  const Matrix &inverse = updated.inverse_covariance(), &expected = refitted.inverse_covariance();
+  double max_error = 0.0, max_value = 0.0;
+  for (unsigned int j=0; j<D; ++j) {
+    for (unsigned int i=0; i<=j; ++i) {
+      max_error = std::max(max_error, std::fabs(static_cast<double>(inverse(i, j)) - static_cast<double>(expected(i, j))));
+      max_value = std::max(max_value, std::fabs(static_cast<double>(expected(i, j))));
+    }
+  }
+
+  const double relative_error = max_value > 0.0 ? max_error / max_value : max_error;
+  std::cout << "Largest relative error of the inverse covariance matrix after " << test_set.size() << " additions and "
+      << num_removed << " removals: " << relative_error << " (tolerance " << tolerance << ")" << std::endl;
+  if (relative_error > tolerance) {
+    std::cerr << "Inverse covariance matrix updates differ from a refit" << std::endl;
+    ok = false;
+  }
+
+  // Build a vector whose squared Mahalanobis distance to the mean is 4 times the number of vectors by moving the mean along the first dimension.
+  // The covariance matrix would not be positive definite after removing it.
+  const typename DataSet::Vector &reference = train_set[num_removed];
+  Distance deviation[D];
+  estimator.deviation(reference, deviation);
+
+  typename DataSet::Vector outlier = reference;
+  for (unsigned int d=0; d<D; ++d)
+    outlier[d] = static_cast<T>(static_cast<double>(reference[d]) - static_cast<double>(deviation[d]));
+  outlier[0] = static_cast<T>(static_cast<double>(outlier[0]) + std::sqrt(4.0 * estimator.size() / static_cast<double>(inverse(0, 0))));
+
+  const Matrix previous = inverse;
+  const uint64_t previous_size = estimator.size();
+  if (updated.remove_from_inverse_covariance(estimator, outlier)) {
+    std::cerr << "Removal losing positive definiteness was not rejected" << std::endl;
+    return false;
+  }
+
+  bool unchanged = estimator.size() == previous_size;
+  for (unsigned int j=0; j<D && unchanged; ++j) {
+    for (unsigned int i=0; i<=j && unchanged; ++i)
+      unchanged = inverse(i, j) == previous(i, j);
+  }
+  if (!unchanged) {
+    std::cerr << "Rejected removal modified the metric or the estimator" << std::endl;
+    ok = false;
+  }
+
+  return ok;
+}